@@ -0,0 +1,88 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Result of one benchmark case, serialised as one entry of the JSON report.
+struct BenchResult {
+    string name;                // Benchmark identifier, stable across versions
+    uint64_t iterations = 0;    // Operations measured
+    double seconds = 0;         // Wall time for all iterations
+    double itemsPerOp = 1;      // Items (values, samples, blocks) processed per operation
+    map<string, double> extra;  // Additional named measurements
+};
+
+// Keeps the compiler from discarding a computed value.
+template <typename T>
+inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Runs fn() in growing batches until at least minSeconds have elapsed.
+template <typename Fn>
+BenchResult runBench(const string& name, double itemsPerOp, Fn&& fn, double minSeconds = 0.5) {
+    BenchResult result;
+    result.name = name;
+    result.itemsPerOp = itemsPerOp;
+
+    uint64_t batch = 1;
+    while (true) {
+        auto start = chrono::steady_clock::now();
+        for (uint64_t i = 0; i < batch; i++) {
+            fn();
+        }
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        result.iterations += batch;
+        result.seconds += elapsed.count();
+        if (result.seconds >= minSeconds) {
+            break;
+        }
+        batch *= 2;
+    }
+    return result;
+}
+
+// Collects results and renders them as a JSON document.
+class BenchReport {
+public:
+    explicit BenchReport(const string& version) : version(version) {}
+
+    void add(const BenchResult& result) { results.push_back(result); }
+
+    string toJson() const {
+        ostringstream out;
+        out.precision(12);
+        out << "{\n  \"version\": \"" << version << "\",\n"
+            << "  \"timestamp\": " << chrono::duration_cast<chrono::seconds>(
+                   chrono::system_clock::now().time_since_epoch()).count() << ",\n"
+            << "  \"benchmarks\": [";
+        for (size_t i = 0; i < results.size(); i++) {
+            const BenchResult& r = results[i];
+            double nsPerOp = r.iterations ? r.seconds * 1e9 / r.iterations : 0;
+            double itemsPerSecond = r.seconds > 0 ? r.iterations * r.itemsPerOp / r.seconds : 0;
+            out << (i ? "," : "") << "\n    {\"name\": \"" << r.name << "\""
+                << ", \"iterations\": " << r.iterations
+                << ", \"seconds\": " << r.seconds
+                << ", \"ns_per_op\": " << nsPerOp
+                << ", \"items_per_second\": " << itemsPerSecond;
+            for (const auto& [key, value] : r.extra) {
+                out << ", \"" << key << "\": " << value;
+            }
+            out << "}";
+        }
+        out << "\n  ]\n}\n";
+        return out.str();
+    }
+
+private:
+    string version;
+    vector<BenchResult> results;
+};
+
+#endif // BENCH_H
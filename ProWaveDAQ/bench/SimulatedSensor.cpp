@@ -0,0 +1,182 @@
+#include "SimulatedSensor.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+// Sensor FIFO capacity in values (XYZ interleaved)
+static const int FIFO_CAPACITY = 4095;
+
+// Standard Modbus RTU CRC-16 (polynomial 0xA001, initial 0xFFFF).
+static uint16_t modbusCRC(const uint8_t* data, size_t len) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+SimulatedSensor::SimulatedSensor(int slaveID)
+    : slaveID(slaveID), masterFd(-1), running(false), sampleRate(7812),
+      fifoValues(0), sampleIndex(0), served(0) {}
+
+SimulatedSensor::~SimulatedSensor() {
+    stop();
+}
+
+bool SimulatedSensor::start() {
+    masterFd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (masterFd < 0 || grantpt(masterFd) != 0 || unlockpt(masterFd) != 0) {
+        return false;
+    }
+    portPath = ptsname(masterFd);
+
+    // **Raw mode on the master side so frames pass through untouched**
+    termios tty;
+    tcgetattr(masterFd, &tty);
+    cfmakeraw(&tty);
+    tcsetattr(masterFd, TCSANOW, &tty);
+
+    lastFill = chrono::steady_clock::now();
+    running = true;
+    responderThread = thread(&SimulatedSensor::responderLoop, this);
+    return true;
+}
+
+void SimulatedSensor::stop() {
+    if (running) {
+        running = false;
+        if (responderThread.joinable()) {
+            responderThread.join();
+        }
+    }
+    if (masterFd >= 0) {
+        close(masterFd);
+        masterFd = -1;
+    }
+}
+
+string SimulatedSensor::getPortPath() const {
+    return portPath;
+}
+
+uint64_t SimulatedSensor::getSamplesServed() const {
+    return served;
+}
+
+// Requests handled here are all fixed 8-byte frames: id, fc, addr(2), value/qty(2), crc(2).
+void SimulatedSensor::responderLoop() {
+    uint8_t frame[8];
+    size_t have = 0;
+
+    while (running) {
+        pollfd pfd = {masterFd, POLLIN, 0};
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        ssize_t n = read(masterFd, frame + have, sizeof(frame) - have);
+        if (n <= 0) {
+            continue;
+        }
+        have += n;
+        if (have < sizeof(frame)) {
+            continue;
+        }
+        have = 0;
+
+        uint16_t crc = modbusCRC(frame, 6);
+        if (frame[6] != (crc & 0xFF) || frame[7] != (crc >> 8) || frame[0] != slaveID) {
+            tcflush(masterFd, TCIFLUSH); // Resynchronise on a bad frame
+            continue;
+        }
+        handleRequest(frame);
+    }
+}
+
+// Accumulates samples in the simulated FIFO according to elapsed time.
+void SimulatedSensor::fillFifo() {
+    auto now = chrono::steady_clock::now();
+    chrono::duration<double> elapsed = now - lastFill;
+    lastFill = now;
+    fifoValues = min<double>(FIFO_CAPACITY, fifoValues + elapsed.count() * sampleRate * 3);
+}
+
+void SimulatedSensor::handleRequest(const uint8_t* frame) {
+    uint8_t function = frame[1];
+    int addr = (frame[2] << 8) | frame[3];
+    int value = (frame[4] << 8) | frame[5];
+    uint8_t response[3 + 2 * 125 + 2];
+
+    if (function == 0x06) {
+        if (addr == 0x01) {
+            sampleRate = value;
+        }
+        memcpy(response, frame, 6); // Echo the request
+        sendResponse(response, 6);
+        return;
+    }
+
+    if (function != 0x04 || value < 1 || value > 125) {
+        response[0] = frame[0];
+        response[1] = function | 0x80;
+        response[2] = 0x01; // Illegal function
+        sendResponse(response, 3);
+        return;
+    }
+
+    response[0] = frame[0];
+    response[1] = function;
+    response[2] = value * 2;
+    uint8_t* regs = response + 3;
+
+    if (addr == 0x80) {
+        for (int i = 0; i < value; i++) {
+            regs[2 * i] = 0x12;
+            regs[2 * i + 1] = 0x30 + i;
+        }
+    } else {
+        // **Register 0x02: FIFO length left after this read, then interleaved XYZ values**
+        fillFifo();
+        int available = static_cast<int>(fifoValues) / 3 * 3;
+        int take = min(value - 1, available) / 3 * 3;
+        int remaining = available - take;
+
+        regs[0] = remaining >> 8;
+        regs[1] = remaining & 0xFF;
+        for (int i = 0; i < value - 1; i++) {
+            int16_t v = 0;
+            if (i < take) {
+                uint64_t s = sampleIndex + i / 3;
+                v = static_cast<int16_t>(4096.0 * sin(0.05 * s + (i % 3)));
+            }
+            regs[2 + 2 * i] = static_cast<uint16_t>(v) >> 8;
+            regs[3 + 2 * i] = static_cast<uint16_t>(v) & 0xFF;
+        }
+        sampleIndex += take / 3;
+        served += take / 3;
+        fifoValues -= take;
+    }
+    sendResponse(response, 3 + value * 2);
+}
+
+void SimulatedSensor::sendResponse(uint8_t* frame, size_t len) {
+    uint16_t crc = modbusCRC(frame, len);
+    frame[len] = crc & 0xFF;
+    frame[len + 1] = crc >> 8;
+
+    size_t sent = 0;
+    while (sent < len + 2) {
+        ssize_t w = write(masterFd, frame + sent, len + 2 - sent);
+        if (w <= 0) {
+            return;
+        }
+        sent += w;
+    }
+}
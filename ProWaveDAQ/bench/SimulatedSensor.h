@@ -0,0 +1,51 @@
+#ifndef SIMULATED_SENSOR_H
+#define SIMULATED_SENSOR_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+// SimulatedSensor emulates the vibration sensor's Modbus RTU slave on a pseudo
+// terminal, so ProWaveDAQ can be driven end-to-end without hardware.
+//
+// Supported requests: read input registers (0x04) at 0x02 (FIFO length + XYZ data)
+// and 0x80 (chip ID), and write single register (0x06) at 0x01 (sample rate).
+class SimulatedSensor {
+public:
+    explicit SimulatedSensor(int slaveID = 1);
+    ~SimulatedSensor();
+
+    // Opens the pty and starts answering requests. Returns false on failure.
+    bool start();
+
+    // Stops the responder thread and closes the pty.
+    void stop();
+
+    // Path of the pty slave to use as serialPort.
+    string getPortPath() const;
+
+    // Number of 3-axis samples handed out so far.
+    uint64_t getSamplesServed() const;
+
+private:
+    int slaveID;                 // Modbus slave ID answered by the simulator
+    int masterFd;                // pty master side
+    string portPath;             // pty slave path
+    atomic<bool> running;        // Responder thread flag
+    thread responderThread;      // Thread answering Modbus requests
+    atomic<int> sampleRate;      // Current sample rate (register 0x01)
+    double fifoValues;           // Values currently queued in the simulated FIFO
+    uint64_t sampleIndex;        // Next sample to generate
+    atomic<uint64_t> served;     // Samples handed out
+    chrono::steady_clock::time_point lastFill;
+
+    void responderLoop();
+    void handleRequest(const uint8_t* frame);
+    void sendResponse(uint8_t* frame, size_t len);
+    void fillFifo();
+};
+
+#endif // SIMULATED_SENSOR_H
@@ -0,0 +1,1118 @@
+#include "Bench.h"
+#include "SimulatedSensor.h"
+#include "ProWaveDAQ.h"
+#include "CSVWriter.h"
+#include "AsyncFileWriter.h"
+#include "MappedFileWriter.h"
+#include "RecordingJournal.h"
+#include "SegmentCodec.h"
+#include "Metrics.h"
+#include "SegmentSplitter.h"
+#include "HdrHistogram.h"
+#include "BlockKernels.h"
+#include "SimdKernels.h"
+#include "AsyncAcquisition.h"
+#include "BlockFanout.h"
+#include "StreamMerger.h"
+#include "QueryEngine.h"
+#include "AnomalyDetector.h"
+#include "EnvelopeAnalyzer.h"
+#include "VelocityMonitor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <unistd.h>
+
+#ifndef BENCH_VERSION
+#define BENCH_VERSION "unknown"
+#endif
+
+using namespace std;
+
+// Register payload of one full FIFO read: length word + 41 XYZ samples.
+static const int BLOCK_VALUES = 41 * 3;
+
+static vector<uint16_t> randomRegisters(size_t count) {
+    mt19937 rng(12345);
+    uniform_int_distribution<int> dist(-32768, 32767);
+    vector<uint16_t> regs(count);
+    for (auto& r : regs) {
+        r = static_cast<uint16_t>(dist(rng));
+    }
+    return regs;
+}
+
+static vector<double> randomBlock(size_t count) {
+    vector<uint16_t> regs = randomRegisters(count);
+    vector<double> block(count);
+    for (size_t i = 0; i < count; i++) {
+        block[i] = static_cast<int16_t>(regs[i]) / 8192.0;
+    }
+    return block;
+}
+
+// **int16 -> double conversion exactly as done in readLoop()**
+static void benchConversion(BenchReport& report) {
+    vector<uint16_t> vib_data = randomRegisters(BLOCK_VALUES + 1);
+    vector<double> latestData;
+
+    report.add(runBench("convert_int16_to_double", BLOCK_VALUES, [&]() {
+        latestData.clear();
+        for (int i = 1; i <= BLOCK_VALUES; i++) {
+            latestData.push_back(static_cast<double>(static_cast<int16_t>(vib_data[i])) / 8192.0);
+        }
+        doNotOptimize(latestData.data());
+    }));
+}
+
+// **CSVWriter::addDataBlock() throughput (includes the per-call block copy)**
+static void benchCSVWriter(BenchReport& report) {
+    CSVWriter writer(3, "output/bench_csv", "bench");
+    vector<double> block = randomBlock(BLOCK_VALUES);
+    MetricCounter& bytes = Metrics::instance().counter("prowavedaq_writer_bytes_total", "");
+    uint64_t bytesBefore = bytes.value();
+
+    BenchResult result = runBench("csvwriter_add_data_block", BLOCK_VALUES, [&]() {
+        vector<double> copy = block;
+        writer.addDataBlock(move(copy));
+    });
+    result.extra["bytes_per_second"] = (bytes.value() - bytesBefore) / result.seconds;
+    report.add(result);
+    fs::remove_all("output/bench_csv");
+}
+
+// **SegmentSplitter (main.cpp rotation/splitting) with realistic and tiny segments**
+static void benchSplitter(BenchReport& report) {
+    vector<double> block = randomBlock(BLOCK_VALUES);
+    const int sizes[] = {60 * 7812 * 3, 1000};
+
+    for (int targetSize : sizes) {
+        uint64_t rotations = 0;
+        SegmentSplitter splitter(targetSize,
+            [](const DataBlock& chunk) { doNotOptimize(chunk.samples.data()); },
+            [&]() { rotations++; });
+
+        BenchResult result = runBench("segment_split_target_" + to_string(targetSize), BLOCK_VALUES, [&]() {
+            DataBlock copy;
+            copy.samples = block;
+            splitter.push(move(copy));
+        });
+        result.extra["rotations"] = rotations;
+        report.add(result);
+    }
+}
+
+// CSV rows as CSVWriter formatted them with ostringstream (reference output).
+static string formatRowsStream(const vector<double>& block, int channels) {
+    ostringstream rows;
+    for (size_t i = 0; i < block.size(); i += channels) {
+        for (int j = 0; j < channels; ++j) {
+            rows << block[i + j];
+            if (j < channels - 1) {
+                rows << ",";
+            }
+        }
+        rows << "\n";
+    }
+    return rows.str();
+}
+
+// **Block kernels: previous per-value loops vs generic vs 3-channel specialisation**
+static void benchBlockKernels(BenchReport& report) {
+    vector<uint16_t> regs = randomRegisters(BLOCK_VALUES);
+    vector<double> block = randomBlock(BLOCK_VALUES);
+    const int frames = BLOCK_VALUES / 3;
+    const BlockKernels variants[] = {BlockKernels::generic(3), BlockKernels::select(3)};
+
+    // **The kernels must reproduce the previous CSV text exactly**
+    for (const BlockKernels& k : variants) {
+        string text;
+        k.formatRows(block.data(), frames, 3, text);
+        if (text != formatRowsStream(block, 3)) {
+            cerr << "Error: formatRows output differs from ostringstream" << endl;
+            exit(1);
+        }
+    }
+
+    vector<double> values(BLOCK_VALUES);
+    vector<double> x(frames), y(frames), z(frames);
+    double* axes[] = {x.data(), y.data(), z.data()};
+
+    report.add(runBench("format_rows_ostringstream", BLOCK_VALUES, [&]() {
+        string text = formatRowsStream(block, 3);
+        doNotOptimize(text.data());
+    }));
+    report.add(runBench("stats_per_value_loop", BLOCK_VALUES, [&]() {
+        kernels::ChannelStats stats[3];
+        for (size_t i = 0; i < block.size(); i++) {
+            kernels::ChannelStats& s = stats[i % 3];
+            s.min = min(s.min, block[i]);
+            s.max = max(s.max, block[i]);
+            s.sum += block[i];
+            s.sumSquares += block[i] * block[i];
+            s.count++;
+        }
+        doNotOptimize(stats);
+    }));
+
+    for (const BlockKernels& k : variants) {
+        string suffix = k.specialised ? "_3ch" : "_generic";
+        report.add(runBench("kernel_convert" + suffix, BLOCK_VALUES, [&]() {
+            k.convert(regs.data(), BLOCK_VALUES, 3, values.data());
+            doNotOptimize(values.data());
+        }));
+        report.add(runBench("kernel_deinterleave" + suffix, BLOCK_VALUES, [&]() {
+            k.deinterleave(regs.data(), frames, 3, axes);
+            doNotOptimize(x.data());
+        }));
+        report.add(runBench("kernel_format_rows" + suffix, BLOCK_VALUES, [&]() {
+            string text;
+            k.formatRows(block.data(), frames, 3, text);
+            doNotOptimize(text.data());
+        }));
+        report.add(runBench("kernel_stats" + suffix, BLOCK_VALUES, [&]() {
+            kernels::ChannelStats stats[3];
+            k.accumulateStats(block.data(), frames, 3, stats);
+            doNotOptimize(stats);
+        }));
+    }
+}
+
+// Compares one SIMD variant against the scalar reference, bit for bit.
+template <typename Out>
+static bool matchesScalar(const SimdKernels& k, void (*fn)(const uint16_t*, size_t, Out*, Out*, Out*),
+                          void (*ref)(const uint16_t*, size_t, Out*, Out*, Out*),
+                          const uint16_t* regs, size_t frames) {
+    // One guard element past the end catches overruns of the vector stores
+    vector<Out> got(3 * (frames + 1), Out(-1)), want(3 * (frames + 1), Out(-1));
+    fn(regs, frames, got.data(), got.data() + frames + 1, got.data() + 2 * (frames + 1));
+    ref(regs, frames, want.data(), want.data() + frames + 1, want.data() + 2 * (frames + 1));
+    if (memcmp(got.data(), want.data(), got.size() * sizeof(Out)) != 0) {
+        cerr << "Error: " << k.name << " deinterleave (" << sizeof(Out) * 8 << "-bit) differs from scalar for "
+             << frames << " frames" << endl;
+        return false;
+    }
+    return true;
+}
+
+// **Exhaustive check of the SIMD kernels: every int16 value on every axis,
+// every frame count up to 64 (vector tails) and every element misalignment**
+static bool verifySimdKernels() {
+    const SimdKernels& ref = SimdKernels::scalar();
+    vector<uint16_t> all(65536 * 3);
+    for (size_t i = 0; i < 65536; i++) {
+        for (int c = 0; c < 3; c++) {
+            all[i * 3 + c] = static_cast<uint16_t>(i + c * 21845); // Each axis sees all values
+        }
+    }
+
+    bool ok = true;
+    for (const SimdKernels* k : SimdKernels::available()) {
+        // Interleaved conversion: every length up to 64 (vector tails), then the whole
+        // table less the offset (every int16 value), at every misalignment
+        for (size_t offset = 0; offset < 8; offset++) {
+            vector<size_t> lengths;
+            for (size_t values = 0; values <= 64; values++) {
+                lengths.push_back(values);
+            }
+            lengths.push_back(all.size() - offset);
+            for (size_t values : lengths) {
+                vector<double> got(values + 1, -1), want(values + 1, -1);
+                k->convertd(all.data() + offset, values, got.data());
+                ref.convertd(all.data() + offset, values, want.data());
+                if (memcmp(got.data(), want.data(), got.size() * sizeof(double)) != 0) {
+                    cerr << "Error: " << k->name << " convert differs from scalar for " << values << " values" << endl;
+                    ok = false;
+                }
+            }
+        }
+        ok &= matchesScalar(*k, k->deinterleave3f, ref.deinterleave3f, all.data(), 65536);
+        ok &= matchesScalar(*k, k->deinterleave3d, ref.deinterleave3d, all.data(), 65536);
+        for (size_t offset = 0; offset < 8; offset++) {
+            for (size_t frames = 0; frames <= 64; frames++) {
+                ok &= matchesScalar(*k, k->deinterleave3f, ref.deinterleave3f, all.data() + offset, frames);
+                ok &= matchesScalar(*k, k->deinterleave3d, ref.deinterleave3d, all.data() + offset, frames);
+            }
+        }
+    }
+    return ok;
+}
+
+// **SIMD deinterleave + int16 -> float/double per instruction set**
+static void benchSimdKernels(BenchReport& report) {
+    if (!verifySimdKernels()) {
+        exit(1);
+    }
+
+    vector<uint16_t> regs = randomRegisters(BLOCK_VALUES);
+    const size_t frames = BLOCK_VALUES / 3;
+    vector<float> xf(frames), yf(frames), zf(frames);
+    vector<double> xd(frames), yd(frames), zd(frames);
+
+    for (const SimdKernels* k : SimdKernels::available()) {
+        BenchResult f = runBench(string("simd_deinterleave_float_") + k->name, BLOCK_VALUES, [&]() {
+            k->deinterleave3f(regs.data(), frames, xf.data(), yf.data(), zf.data());
+            doNotOptimize(xf.data());
+        });
+        BenchResult d = runBench(string("simd_deinterleave_double_") + k->name, BLOCK_VALUES, [&]() {
+            k->deinterleave3d(regs.data(), frames, xd.data(), yd.data(), zd.data());
+            doNotOptimize(xd.data());
+        });
+        vector<double> converted(BLOCK_VALUES);
+        BenchResult c = runBench(string("simd_convert_double_") + k->name, BLOCK_VALUES, [&]() {
+            k->convertd(regs.data(), BLOCK_VALUES, converted.data());
+            doNotOptimize(converted.data());
+        });
+        f.extra["selected"] = d.extra["selected"] = c.extra["selected"] = k == &SimdKernels::best();
+        report.add(f);
+        report.add(d);
+        report.add(c);
+    }
+}
+
+// **HdrHistogram::record() overhead per sample**
+static void benchHdrRecord(BenchReport& report) {
+    HdrHistogram histogram;
+    uint64_t value = 1;
+
+    BenchResult result = runBench("hdr_histogram_record", 1, [&]() {
+        value = value * 6364136223846793005ULL + 1442695040888963407ULL;
+        histogram.record(value >> 40);
+    });
+    HdrSnapshot snap = histogram.snapshot();
+    result.extra["p99"] = snap.p99;
+    report.add(result);
+}
+
+// **End-to-end: simulated sensor -> ProWaveDAQ -> splitter -> CSVWriter**
+static void benchEndToEnd(BenchReport& report, double seconds) {
+    SimulatedSensor sensor;
+    if (!sensor.start()) {
+        cerr << "Skipping end-to-end benchmark: unable to open a pty" << endl;
+        return;
+    }
+
+    const int sampleRate = 7812;
+    const string iniPath = "bench_ProWaveDAQ.ini";
+    {
+        ofstream ini(iniPath);
+        ini << "[ProWaveDAQ]\nserialPort = " << sensor.getPortPath()
+            << "\nbaudRate = 3000000\nsampleRate = " << sampleRate << "\nslaveID = 1\n";
+    }
+
+    ProWaveDAQ daq;
+    daq.initDevices(iniPath.c_str());
+    daq.startReading();
+
+    CSVWriter writer(3, "output/bench_e2e", "e2e");
+    uint64_t valuesWritten = 0;
+    SegmentSplitter splitter(5 * sampleRate * 3,
+        [&](const DataBlock& chunk) {
+            valuesWritten += chunk.samples.size();
+            writer.addDataBlock(chunk);
+        },
+        [&]() { writer.updateFilename(); });
+
+    // **Main-loop polling as in main.cpp**
+    int prevCounter = 0;
+    auto start = chrono::steady_clock::now();
+    chrono::duration<double> elapsed(0);
+    while (elapsed.count() < seconds) {
+        if (daq.getCounter() > prevCounter) {
+            splitter.push(daq.getDataBlock());
+            prevCounter += 1;
+        } else {
+            this_thread::yield();
+        }
+        elapsed = chrono::steady_clock::now() - start;
+    }
+
+    BenchResult e2e;
+    e2e.name = "end_to_end_samples";
+    e2e.iterations = valuesWritten / 3;
+    e2e.seconds = elapsed.count();
+    e2e.extra["target_samples_per_second"] = sampleRate;
+    e2e.extra["sensor_samples_served"] = sensor.getSamplesServed();
+    report.add(e2e);
+
+    // **getData() copy cost while the reader thread is live**
+    report.add(runBench("get_data_copy", 1, [&]() {
+        vector<double> data = daq.getData();
+        doNotOptimize(data.data());
+    }));
+
+    daq.stopReading();
+    sensor.stop();
+    fs::remove_all("output/bench_e2e");
+    fs::remove(iniPath);
+}
+
+// Counts samples of one device and checks that blocks arrive without gaps.
+static Task<void> consumeBlocks(AsyncDevice& device, uint64_t& samples, uint64_t& gaps) {
+    uint64_t expected = 0;
+    while (BlockResult r = co_await device.nextBlock(chrono::seconds(1))) {
+        if (r.block->firstSample != expected) {
+            gaps++;
+        }
+        expected = r.block->firstSample + r.block->samples.size() / 3;
+        samples += r.block->samples.size() / 3;
+    }
+}
+
+// **Async end-to-end: two simulated sensors, pumps and consumers on one executor thread**
+static void benchAsyncEndToEnd(BenchReport& report, double seconds) {
+    const int DEVICES = 2;
+    const int sampleRate = 7812;
+    SimulatedSensor sensors[DEVICES];
+    ProWaveDAQ daqs[DEVICES];
+    for (int i = 0; i < DEVICES; i++) {
+        if (!sensors[i].start()) {
+            cerr << "Skipping async end-to-end benchmark: unable to open a pty" << endl;
+            return;
+        }
+        string iniPath = "bench_async_" + to_string(i) + ".ini";
+        {
+            ofstream ini(iniPath);
+            ini << "[ProWaveDAQ]\nserialPort = " << sensors[i].getPortPath()
+                << "\nbaudRate = 3000000\nsampleRate = " << sampleRate << "\nslaveID = 1\n";
+        }
+        daqs[i].initDevices(iniPath.c_str());
+        fs::remove(iniPath);
+    }
+
+    Executor executor;
+    CancellationSource cancel;
+    vector<unique_ptr<AsyncDevice>> devices;
+    uint64_t samples[DEVICES] = {};
+    uint64_t gaps[DEVICES] = {};
+    for (int i = 0; i < DEVICES; i++) {
+        devices.push_back(make_unique<AsyncDevice>(executor, daqs[i]));
+        executor.spawn(devices[i]->pump(cancel.token()));
+        executor.spawn(consumeBlocks(*devices[i], samples[i], gaps[i]));
+    }
+    executor.postAt(Executor::Clock::now() + chrono::duration_cast<Executor::Clock::duration>(
+        chrono::duration<double>(seconds)), [&]() { cancel.cancel(); });
+
+    auto start = chrono::steady_clock::now();
+    executor.run();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    BenchResult result;
+    result.name = "async_end_to_end_samples";
+    result.iterations = 0;
+    result.seconds = elapsed.count();
+    result.extra["devices"] = DEVICES;
+    result.extra["executor_threads"] = 1;
+    result.extra["target_samples_per_second"] = sampleRate * DEVICES;
+    double served = 0;
+    double gapCount = 0;
+    for (int i = 0; i < DEVICES; i++) {
+        result.iterations += samples[i];
+        served += sensors[i].getSamplesServed();
+        gapCount += gaps[i];
+    }
+    result.extra["sensor_samples_served"] = served;
+    result.extra["gaps"] = gapCount;
+    report.add(result);
+
+    devices.clear();
+    for (int i = 0; i < DEVICES; i++) {
+        daqs[i].stopReading();
+        sensors[i].stop();
+    }
+}
+
+// **Spill: a consumer stalled for seconds behind a 64 KB budget, then drained**
+static void benchSpill(BenchReport& report, double seconds) {
+    SimulatedSensor sensor;
+    if (!sensor.start()) {
+        cerr << "Skipping spill benchmark: unable to open a pty" << endl;
+        return;
+    }
+    const string iniPath = "bench_spill.ini";
+    {
+        ofstream ini(iniPath);
+        ini << "[ProWaveDAQ]\nserialPort = " << sensor.getPortPath()
+            << "\nbaudRate = 3000000\nsampleRate = 7812\nslaveID = 1\n";
+    }
+    ProWaveDAQ daq;
+    daq.initDevices(iniPath.c_str());
+    fs::remove(iniPath);
+
+    BlockFanout fanout(daq);
+    SubscriberOptions options;
+    options.name = "bench_spill";
+    options.policy = OverflowPolicy::Spill;
+    options.memoryBytes = 64 << 10;
+    options.spillDirectory = ".";
+    shared_ptr<Subscription> subscription = fanout.subscribe(options);
+    string consumer = Metrics::label("consumer", options.name);
+    MetricGauge& queueBytes = Metrics::instance().gauge("prowavedaq_fanout_queue_bytes", "", consumer);
+    MetricGauge& backlog = Metrics::instance().gauge("prowavedaq_fanout_spill_backlog_bytes", "", consumer);
+    MetricCounter& spilled = Metrics::instance().counter("prowavedaq_fanout_spilled_blocks_total", "", consumer);
+    fanout.start();
+    daq.startReading();
+
+    // **Stalled: nothing is popped, RAM must stay at the budget**
+    double peakQueueBytes = 0;
+    auto stallEnd = chrono::steady_clock::now() + chrono::duration<double>(seconds);
+    while (chrono::steady_clock::now() < stallEnd) {
+        peakQueueBytes = max(peakQueueBytes, queueBytes.value());
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    double peakBacklog = backlog.value();
+    daq.stopReading();
+    fanout.stop();
+
+    // **Drain: every block once, in order**
+    uint64_t blocks = 0, gaps = 0, expected = 0;
+    SharedBlock block;
+    auto start = chrono::steady_clock::now();
+    while (subscription->pop(block, chrono::milliseconds(100))) {
+        if (blocks > 0 && block->firstSample != expected) {
+            gaps++;
+        }
+        expected = block->firstSample + block->samples.size() / 3;
+        peakQueueBytes = max(peakQueueBytes, queueBytes.value());
+        blocks++;
+    }
+    double drainSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    BenchResult result;
+    result.name = "spill_drain";
+    result.iterations = blocks;
+    result.seconds = drainSeconds;
+    result.extra["stall_seconds"] = seconds;
+    result.extra["spilled_blocks"] = spilled.value();
+    result.extra["peak_spill_backlog_bytes"] = peakBacklog;
+    result.extra["peak_queue_bytes"] = peakQueueBytes;
+    result.extra["memory_budget_bytes"] = options.memoryBytes;
+    result.extra["gaps"] = gaps;
+    result.extra["samples_delivered"] = expected;
+    report.add(result);
+    sensor.stop();
+}
+
+// **Per-call latency of appending CSV-sized chunks with a sync every 64 chunks**
+static void benchFileWriter(BenchReport& report) {
+    const size_t CHUNK = 2600, CHUNKS = 40000, SYNC_EVERY = 64;
+    string chunk(CHUNK, '7');
+
+    auto addResult = [&](const string& name, double seconds, HdrHistogram& append, HdrHistogram& sync) {
+        BenchResult result;
+        result.name = name;
+        result.iterations = CHUNKS;
+        result.seconds = seconds;
+        result.itemsPerOp = CHUNK;
+        HdrSnapshot a = append.snapshot(), s = sync.snapshot();
+        result.extra["append_p50_ns"] = a.p50;
+        result.extra["append_p99_ns"] = a.p99;
+        result.extra["append_p999_ns"] = a.p999;
+        result.extra["append_max_ns"] = a.max;
+        result.extra["sync_p50_ns"] = s.p50;
+        result.extra["sync_p99_ns"] = s.p99;
+        result.extra["sync_max_ns"] = s.max;
+        report.add(result);
+    };
+
+    // Baseline: write() and fsync() on the calling thread, as CSVWriter did before
+    {
+        HdrHistogram append, sync;
+        int fd = open("bench_blocking.bin", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < CHUNKS; i++) {
+            auto t = chrono::steady_clock::now();
+            if (write(fd, chunk.data(), CHUNK) != static_cast<ssize_t>(CHUNK)) {
+                break;
+            }
+            if ((i + 1) % SYNC_EVERY == 0) {
+                auto s = chrono::steady_clock::now();
+                fsync(fd);
+                sync.recordSince(s);
+            }
+            append.recordSince(t);
+        }
+        close(fd);
+        addResult("file_writer_blocking", chrono::duration<double>(chrono::steady_clock::now() - start).count(),
+                  append, sync);
+        fs::remove("bench_blocking.bin");
+    }
+
+    for (WriterBackend backend : {WriterBackend::IoUring, WriterBackend::Threads}) {
+        for (bool direct : {false, true}) {
+            WriterOptions options;
+            options.backend = backend;
+            options.direct = direct;
+            unique_ptr<AsyncFileWriter> writer = AsyncFileWriter::create(options);
+            if (backend == WriterBackend::IoUring && string(writer->backendName()) != "io_uring") {
+                continue;   // Fell back; measured as "threads" below
+            }
+            writer->open("bench_async.bin");
+            if (direct && !writer->isDirect()) {
+                continue;   // Filesystem without O_DIRECT
+            }
+            string name = string("file_writer_") + writer->backendName() + (direct ? "_direct" : "");
+
+            HdrHistogram append, sync;
+            auto start = chrono::steady_clock::now();
+            for (size_t i = 0; i < CHUNKS; i++) {
+                auto t = chrono::steady_clock::now();
+                writer->append(chunk.data(), CHUNK);
+                if ((i + 1) % SYNC_EVERY == 0) {
+                    writer->sync([&sync, t](bool) { sync.recordSince(t); });
+                }
+                append.recordSince(t);
+            }
+            writer->close();
+            addResult(name, chrono::duration<double>(chrono::steady_clock::now() - start).count(), append, sync);
+            fs::remove("bench_async.bin");
+        }
+    }
+}
+
+// Extents a file occupies on disk (fragmentation), or -1 where FIEMAP is unsupported.
+static long fileExtents(const string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    fiemap map = {};
+    map.fm_length = FIEMAP_MAX_OFFSET;
+    map.fm_flags = FIEMAP_FLAG_SYNC;
+    long extents = fd >= 0 && ioctl(fd, FS_IOC_FIEMAP, &map) == 0 ? map.fm_mapped_extents : -1;
+    if (fd >= 0) {
+        close(fd);
+    }
+    return extents;
+}
+
+// **Segmented recording: appended (async writer) against preallocated, mapped files**
+static void benchSegmentFiles(BenchReport& report) {
+    const size_t CHUNK = 2600, CHUNKS = 4000, SEGMENTS = 8;
+    string chunk(CHUNK, '7');
+    fs::create_directories("segments");
+
+    for (bool useMapped : {false, true}) {
+        unique_ptr<AsyncFileWriter> appender;
+        unique_ptr<MappedFileWriter> mapper;
+        if (useMapped) {
+            mapper.reset(new MappedFileWriter("segments"));
+            mapper->setCapacity(CHUNK * CHUNKS);
+        } else {
+            appender = AsyncFileWriter::create();
+        }
+
+        HdrHistogram append, opened, closed;
+        double extents = 0;
+        double seconds = 0;
+        for (size_t segment = 0; segment < SEGMENTS; segment++) {
+            string path = "segments/" + to_string(segment) + ".csv";
+            usleep(50000);   // A real segment lasts SaveUnit seconds: the next file is prepared by now
+            auto t = chrono::steady_clock::now();
+            if (mapper) {
+                mapper->open(path);
+            } else {
+                appender->open(path);
+            }
+            opened.recordSince(t);
+            auto start = chrono::steady_clock::now();
+            for (size_t i = 0; i < CHUNKS; i++) {
+                auto a = chrono::steady_clock::now();
+                if (mapper) {
+                    mapper->append(chunk.data(), CHUNK);
+                } else {
+                    appender->append(chunk.data(), CHUNK);
+                }
+                append.recordSince(a);
+            }
+            t = chrono::steady_clock::now();
+            seconds += chrono::duration<double>(t - start).count();
+            if (mapper) {
+                mapper->close();
+            } else {
+                appender->close();
+            }
+            closed.recordSince(t);
+        }
+
+        BenchResult result;
+        result.name = useMapped ? "segment_files_mapped" : string("segment_files_") + appender->backendName();
+        result.iterations = SEGMENTS * CHUNKS;
+        result.seconds = seconds;
+        result.itemsPerOp = CHUNK;
+        for (size_t segment = 0; segment < SEGMENTS; segment++) {
+            extents += fileExtents("segments/" + to_string(segment) + ".csv");
+        }
+        HdrSnapshot a = append.snapshot(), o = opened.snapshot(), c = closed.snapshot();
+        result.extra["append_p50_ns"] = a.p50;
+        result.extra["append_p99_ns"] = a.p99;
+        result.extra["append_max_ns"] = a.max;
+        result.extra["open_p50_ns"] = o.p50;
+        result.extra["open_max_ns"] = o.max;
+        result.extra["close_p50_ns"] = c.p50;
+        result.extra["close_max_ns"] = c.max;
+        result.extra["extents_per_segment"] = extents / SEGMENTS;
+        report.add(result);
+        fs::remove_all("segments");
+        fs::create_directories("segments");
+    }
+    fs::remove_all("segments");
+}
+
+// **Startup recovery over an archive whose every session ended in a crash, vs reading it all**
+static void benchRecovery(BenchReport& report) {
+    const int SESSIONS = 50, SEGMENTS = 10;
+    const size_t SEGMENT_BYTES = 200 * 1024, COMMIT_BYTES = 64 * 1024;
+    string row = "0.123047,-0.0366211,0.999878\n";
+    string segment;
+    while (segment.size() + row.size() <= SEGMENT_BYTES) {
+        segment += row;
+    }
+    string torn = segment.substr(0, segment.size() / 2) + "0.12" + string(4096, '\0');
+    for (int s = 0; s < SESSIONS; s++) {
+        string folder = "archive/2026010100" + to_string(1000 + s) + "_run";
+        fs::create_directories(folder);
+        RecordingJournal journal(folder);
+        for (int k = 0; k < SEGMENTS; k++) {
+            string name = "202601010" + to_string(10000 + k) + "_run.csv";
+            bool last = k == SEGMENTS - 1;
+            ofstream(folder + "/" + name, ios::binary) << (last ? torn : segment);
+            for (size_t bytes = COMMIT_BYTES; bytes < (last ? torn.size() - 4096 : segment.size()); bytes += COMMIT_BYTES) {
+                journal.committed(name, bytes / row.size() * row.size());
+            }
+            if (!last) {
+                journal.closed(name, segment.size());
+            }
+        }
+    }
+
+    // **What recovery avoids: every byte of the archive read back**
+    auto start = chrono::steady_clock::now();
+    uint64_t scanned = 0;
+    vector<char> buffer(1 << 20);
+    for (const auto& entry : fs::recursive_directory_iterator("archive")) {
+        ifstream in(entry.path(), ios::binary);
+        while (in.read(buffer.data(), buffer.size()) || in.gcount() > 0) {
+            scanned += in.gcount();
+        }
+    }
+    double scanSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout.setstate(ios::failbit);   // One "Recovered ..." line per session
+    RecoveryReport first = RecordingJournal::recover("archive");
+    RecoveryReport again = RecordingJournal::recover("archive");
+    cout.clear();
+
+    BenchResult result;
+    result.name = "recovery";
+    result.iterations = SESSIONS;
+    result.seconds = first.milliseconds / 1e3;
+    result.itemsPerOp = SEGMENTS;
+    result.extra["repaired"] = first.repaired;
+    result.extra["bytes_trimmed"] = first.bytesTrimmed;
+    result.extra["clean_restart_ms"] = again.milliseconds;
+    result.extra["full_scan_ms"] = scanSeconds * 1e3;
+    result.extra["archive_mb"] = scanned / 1e6;
+    report.add(result);
+    fs::remove_all("archive");
+}
+
+// **Correctness a case measures must hold, or the run fails (as verifySimdKernels does)**
+static void require(const BenchResult& result, const string& key, bool ok) {
+    if (!ok) {
+        cerr << "Error: " << result.name << " " << key << " = " << result.extra.at(key) << " is out of tolerance" << endl;
+        exit(1);
+    }
+}
+
+static void requireWithin(const BenchResult& result, const string& key, double limit) {
+    require(result, key, fabs(result.extra.at(key)) <= limit);   // NaN fails too
+}
+
+// Synthetic sensor streams for the analysis cases: 7812 Hz in 41-frame blocks, as read.
+static const int STREAM_RATE = 7812, STREAM_FRAMES = 41;
+static const double FAULT_HZ = 87.3;
+
+// Outer-race fault: a 2.6 kHz resonance rung at FAULT_HZ.
+static double faultBurst(double t, double amplitude) {
+    return amplitude * exp(-fmod(t, 1 / FAULT_HZ) * 400) * sin(2 * M_PI * 2600 * t);
+}
+
+// seconds of XYZ blocks; frame(t, xyz) fills the frame at time t.
+template <typename Frame>
+static vector<DataBlock> synthesizeStream(double seconds, Frame frame) {
+    vector<DataBlock> blocks(static_cast<size_t>(seconds * STREAM_RATE / STREAM_FRAMES));
+    uint64_t k = 0;
+    for (DataBlock& block : blocks) {
+        block.firstSample = k;
+        block.samples.resize(STREAM_FRAMES * 3);
+        for (int f = 0; f < STREAM_FRAMES; f++, k++) {
+            frame(static_cast<double>(k) / STREAM_RATE, &block.samples[3 * f]);
+        }
+    }
+    return blocks;
+}
+
+// Times push over every block: cost per frame and how many sensors one core keeps up with.
+template <typename Push>
+static BenchResult benchStream(const string& name, const vector<DataBlock>& blocks, Push push) {
+    auto start = chrono::steady_clock::now();
+    for (const DataBlock& block : blocks) {
+        push(block);
+    }
+    BenchResult result;
+    result.name = name;
+    result.iterations = blocks.size();
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    result.itemsPerOp = STREAM_FRAMES;
+    double frames = static_cast<double>(blocks.size()) * STREAM_FRAMES;
+    result.extra["ns_per_frame"] = result.seconds * 1e9 / frames;
+    result.extra["sensors_per_core"] = frames / STREAM_RATE / result.seconds;
+    return result;
+}
+
+// **Compaction of a one-minute segment: 50 Hz + harmonics with sensor noise**
+static void benchSegmentCodec(BenchReport& report) {
+    const size_t FRAMES = 7812 * 60;
+    mt19937 rng(7);
+    normal_distribution<double> noise(0, 12);
+    vector<double> values(FRAMES * 3);
+    for (size_t f = 0; f < FRAMES; f++) {
+        double t = f / 7812.0;
+        for (int c = 0; c < 3; c++) {
+            double g = 0.4 * sin(2 * M_PI * 50 * t + c) + 0.1 * sin(2 * M_PI * 150 * t);
+            values[f * 3 + c] = static_cast<int16_t>(nearbyint(g * 8192 + noise(rng))) / 8192.0;   // As converted from registers
+        }
+    }
+    string csv;
+    BlockKernels::select(3).formatRows(values.data(), FRAMES, 3, csv);
+
+    string packed, restored;
+    auto start = chrono::steady_clock::now();
+    bool encoded = SegmentCodec::encode(csv, packed);
+    double encodeSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    start = chrono::steady_clock::now();
+    bool decoded = SegmentCodec::decodeCsv(packed, restored);
+    double decodeSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    BenchResult result;
+    result.name = "segment_codec";
+    result.iterations = 1;
+    result.seconds = encodeSeconds;
+    result.itemsPerOp = FRAMES;
+    result.extra["csv_mb"] = csv.size() / 1e6;
+    result.extra["ratio"] = encoded ? static_cast<double>(csv.size()) / packed.size() : 0;
+    result.extra["bytes_per_value"] = encoded ? static_cast<double>(packed.size()) / values.size() : 0;
+    result.extra["encode_mb_per_s"] = csv.size() / 1e6 / encodeSeconds;
+    result.extra["decode_mb_per_s"] = csv.size() / 1e6 / decodeSeconds;
+    result.extra["exact"] = decoded && restored == csv;
+    report.add(result);
+    require(result, "exact", result.extra["exact"] == 1);
+}
+
+// **Outer-race fault: 2.6 kHz resonance rung at 87.3 Hz, under a 29 Hz shaft tone and noise**
+static void benchEnvelope(BenchReport& report) {
+    mt19937 rng(3);
+    normal_distribution<double> noise(0, 0.02);
+    vector<DataBlock> blocks = synthesizeStream(60, [&](double t, double* xyz) {
+        double burst = faultBurst(t, 0.3);
+        xyz[0] = burst + 0.5 * sin(2 * M_PI * 29.1 * t) + noise(rng);
+        xyz[1] = 0.5 * burst + noise(rng);
+        xyz[2] = noise(rng);
+    });
+
+    float peakHz = 0;
+    double resolutionHz = 0;
+    int spectra = 0;
+    EnvelopeAnalyzer analyzer(STREAM_RATE, EnvelopeOptions(), [&](const EnvelopeSpectrum& spectrum) {
+        peakHz = spectrum.peakHz[0];
+        resolutionHz = spectrum.resolutionHz;
+        spectra++;
+    });
+    BenchResult result = benchStream("envelope", blocks, [&](const DataBlock& block) { analyzer.push(block); });
+
+    HdrSnapshot fft = Metrics::instance().latency("prowavedaq_envelope_spectrum_seconds", "").snapshot();
+    result.extra["spectrum_p50_ns"] = fft.p50;
+    result.extra["spectra"] = spectra;
+    result.extra["peak_hz"] = peakHz;
+    result.extra["peak_error_hz"] = fabs(peakHz - FAULT_HZ);
+    report.add(result);
+    requireWithin(result, "peak_error_hz", resolutionHz);   // The fault's own spectrum line
+}
+
+// **rms of Z per 10 s window over 8 bearing_* sessions (half compacted to .pwc) among 12, 1 thread vs all**
+static void benchQuery(BenchReport& report) {
+    const int RATE = 7812, SESSIONS = 12, SEGMENTS = 6, SEGMENT_SECONDS = 10;
+    const double AMPLITUDE = 0.3;
+    mt19937 rng(11);
+    normal_distribution<double> noise(0, 0.01);
+    BlockKernels kernels = BlockKernels::select(3);
+    uint64_t bytes = 0;
+    for (int s = 0; s < SESSIONS; s++) {
+        char folder[64];
+        snprintf(folder, sizeof(folder), "query/20260101%02d0000_%s_%d", s, s % 3 == 2 ? "motor" : "bearing", s);
+        fs::create_directories(folder);
+        for (int k = 0; k < SEGMENTS; k++) {
+            vector<double> values(RATE * SEGMENT_SECONDS * 3);
+            for (size_t f = 0; f < values.size() / 3; f++) {
+                double t = static_cast<double>(f) / RATE;
+                double v[3] = {noise(rng), noise(rng), 1 + AMPLITUDE * sin(2 * M_PI * 50 * t) + noise(rng)};
+                for (int c = 0; c < 3; c++) {
+                    values[3 * f + c] = static_cast<int16_t>(lround(v[c] * 8192)) / 8192.0;   // As registers are
+                }
+            }
+            string csv, packed;
+            kernels.formatRows(values.data(), values.size() / 3, 3, csv);
+            char name[64];
+            snprintf(name, sizeof(name), "/20260101%02d00%02d_x.csv", s, k * SEGMENT_SECONDS);
+            string path = string(folder) + name;
+            if (s % 2 == 1 && SegmentCodec::encode(csv, packed)) {
+                path.replace(path.size() - 4, 4, SegmentCodec::EXTENSION);
+                ofstream(path, ios::binary) << packed;
+            } else {
+                ofstream(path, ios::binary) << csv;
+            }
+            bytes += fs::file_size(path);
+        }
+    }
+
+    QuerySpec spec;
+    spec.root = "query";
+    spec.labelPattern = "bearing_*";
+    spec.channel = 2;
+    spec.sampleRate = RATE;
+    double seconds[2] = {}, worstError = 0;
+    size_t windows = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        spec.threads = pass == 0 ? 1 : 0;
+        QueryEngine engine(spec);
+        vector<QueryRow> rows = engine.run();
+        seconds[pass] = engine.stats().seconds;
+        windows = rows.size();
+        for (const QueryRow& row : rows) {
+            worstError = max(worstError, fabs(row.values[0] - AMPLITUDE / sqrt(2.0)));
+        }
+    }
+
+    BenchResult result;
+    result.name = "query";
+    result.iterations = windows;
+    result.seconds = seconds[1];
+    result.itemsPerOp = static_cast<double>(RATE) * SEGMENT_SECONDS;
+    result.extra["archive_mb"] = bytes / 1e6;
+    result.extra["single_thread_seconds"] = seconds[0];
+    result.extra["speedup"] = seconds[0] / seconds[1];
+    result.extra["threads"] = thread::hardware_concurrency();
+    result.extra["rms_max_error"] = worstError;
+    report.add(result);
+    requireWithin(result, "rms_max_error", 0.002);   // 13-bit registers and noise on a 0.21 g rms
+}
+
+// **Velocity rms of a 60 s 50 Hz + 400 Hz vibration on a 1 g offset, against the analytic value**
+static void benchVelocity(BenchReport& report) {
+    vector<DataBlock> blocks = synthesizeStream(60, [](double t, double* xyz) {
+        double a = 0.5 * sin(2 * M_PI * 50 * t) + 0.5 * sin(2 * M_PI * 400 * t);
+        xyz[0] = a;
+        xyz[1] = 0.5 * a;
+        xyz[2] = 1 + 0.1 * a;
+    });
+    // mm/s rms of 0.5 g at 50 Hz and at 400 Hz
+    const double expected = hypot(0.5 * 9806.65 / (2 * M_PI * 50), 0.5 * 9806.65 / (2 * M_PI * 400)) / sqrt(2.0);
+
+    VelocityOptions options;
+    options.windowsSeconds = {1};
+    options.displacement = true;
+    double measured = 0;
+    int readings = 0;
+    VelocityMonitor monitor(STREAM_RATE, options, [&](const VelocityReading& reading) {
+        measured = reading.velocityRms[0];
+        readings++;
+    });
+    BenchResult result = benchStream("velocity", blocks, [&](const DataBlock& block) { monitor.push(block); });
+
+    result.extra["readings"] = readings;
+    result.extra["velocity_rms_mm_s"] = measured;
+    result.extra["velocity_error_pct"] = 100 * (measured - expected) / expected;
+    report.add(result);
+    requireWithin(result, "velocity_error_pct", 2);
+}
+
+// **Baseline from 2 min of normal data, 10 min more normal, then 10 s of bearing-fault bursts**
+static void benchAnomaly(BenchReport& report) {
+    const double TRAINING = 120, NORMAL = 600, FAULT = 10;
+    mt19937 rng(5);
+    normal_distribution<double> noise(0, 0.02);
+    vector<DataBlock> blocks = synthesizeStream(TRAINING + NORMAL + FAULT, [&](double t, double* xyz) {
+        double burst = t >= TRAINING + NORMAL ? faultBurst(t, 0.1) : 0;
+        xyz[0] = burst + 0.5 * sin(2 * M_PI * 29.1 * t) + noise(rng);
+        xyz[1] = 0.2 * sin(2 * M_PI * 58.2 * t) + noise(rng);
+        xyz[2] = 1 + noise(rng);
+    });
+
+    AnomalyOptions options;
+    options.trainingSeconds = TRAINING;
+    int falseEvents = 0;
+    double detectedAfter = -1;
+    AnomalyDetector detector(STREAM_RATE, options, [&](const AnomalyEvent& event) {
+        double t = static_cast<double>(event.sample) / STREAM_RATE;
+        if (!event.active) {
+            return;
+        }
+        if (t < TRAINING + NORMAL) {
+            falseEvents++;
+        } else if (detectedAfter < 0) {
+            detectedAfter = t - (TRAINING + NORMAL);
+        }
+    });
+    BenchResult result = benchStream("anomaly", blocks, [&](const DataBlock& block) { detector.push(block); });
+
+    HdrSnapshot window = Metrics::instance().latency("prowavedaq_anomaly_window_seconds", "").snapshot();
+    result.extra["window_p50_ns"] = window.p50;
+    result.extra["false_events"] = falseEvents;
+    result.extra["detection_seconds"] = detectedAfter;
+    report.add(result);
+    requireWithin(result, "false_events", 0);
+    require(result, "detection_seconds", detectedAfter >= 0);   // Found within the FAULT seconds
+}
+
+// **Two synthetic sensors 3.7 ms apart with +80 ppm drift, merged onto one timeline**
+static void benchStreamMerge(BenchReport& report) {
+    const double rate = 7812, driftPpm = 80, offset = 0.0037, seconds = 60;
+    const double period[2] = {1 / rate, 1 / (rate * (1 + driftPpm * 1e-6))};
+    const double start[2] = {0, offset};
+    auto signal = [](double t) { return sin(2 * M_PI * 37 * t) + 0.5 * sin(2 * M_PI * 113 * t + 1); };
+
+    // Blocks of 41 samples, read 0.3 ms + exponential jitter after the last sample
+    mt19937 rng(7);
+    exponential_distribution<double> jitter(1 / 0.0004);
+    auto origin = chrono::steady_clock::now();
+    vector<pair<size_t, DataBlock>> blocks;
+    for (size_t d = 0; d < 2; d++) {
+        for (uint64_t first = 0; start[d] + (first + 41) * period[d] < seconds; first += 41) {
+            DataBlock block;
+            block.firstSample = first;
+            for (uint64_t k = first; k < first + 41; k++) {
+                block.samples.insert(block.samples.end(), {signal(start[d] + k * period[d]), 0.0, 0.0});
+            }
+            double readAt = start[d] + (first + 41) * period[d] + 0.0003 + jitter(rng);
+            block.acquiredAt = origin + chrono::duration_cast<chrono::steady_clock::duration>(
+                chrono::duration<double>(readAt));
+            blocks.emplace_back(d, move(block));
+        }
+    }
+    stable_sort(blocks.begin(), blocks.end(),
+        [](const auto& x, const auto& y) { return x.second.acquiredAt < y.second.acquiredAt; });
+
+    // Compare the two inputs' X channels once the clock fits have settled
+    double sumSq = 0;
+    uint64_t compared = 0, emitted = 0;
+    StreamMerger merger({{"a", static_cast<int>(rate)}, {"b", static_cast<int>(rate)}},
+        [&](const MergedBlock& merged) {
+            for (size_t i = 0; i < merged.frames(); i++) {
+                emitted++;
+                double t = chrono::duration<double>(merged.firstTime - origin).count() + i / merged.rate;
+                double a = merged.values[i * 6], b = merged.values[i * 6 + 3];
+                if (t > 5 && !isnan(a) && !isnan(b)) {
+                    sumSq += (a - b) * (a - b);
+                    compared++;
+                }
+            }
+        });
+
+    auto begin = chrono::steady_clock::now();
+    for (const auto& [input, block] : blocks) {
+        merger.push(input, block);
+    }
+    BenchResult result;
+    result.name = "stream_merge_2_inputs";
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    result.iterations = emitted;
+
+    // Unaligned: sample k of one sensor against sample k of the other
+    double rawSq = 0;
+    uint64_t rawCount = 0;
+    for (uint64_t k = static_cast<uint64_t>(5 * rate); k < static_cast<uint64_t>((seconds - 1) * rate); k++) {
+        double diff = signal(start[0] + k * period[0]) - signal(start[1] + k * period[1]);
+        rawSq += diff * diff;
+        rawCount++;
+    }
+
+    MergeClock clock = merger.clock(1);
+    result.extra["aligned_rms_error"] = compared ? sqrt(sumSq / compared) : NAN;
+    result.extra["unaligned_rms_error"] = sqrt(rawSq / rawCount);
+    result.extra["offset_error_us"] = (clock.offsetSeconds - offset) * 1e6;
+    result.extra["drift_error_ppm"] = clock.driftPpm - driftPpm;
+    result.extra["compared_frames"] = compared;
+    report.add(result);
+    requireWithin(result, "aligned_rms_error", 0.01);   // Unaligned is ~0.46
+}
+
+static void usage(const char* prog) {
+    cerr << "Usage: " << prog << " [--out FILE (default bench_results.json)] [--filter NAME] [--e2e-seconds N]" << endl;
+}
+
+int main(int argc, char** argv) {
+    string outPath = "bench_results.json";
+    string filter;
+    double e2eSeconds = 5.0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (!strcmp(argv[i], "--e2e-seconds") && i + 1 < argc) {
+            e2eSeconds = atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // **Work in a scratch directory so CSVWriter's output/ does not touch the tree**
+    char scratch[] = "/tmp/prowavedaq_bench_XXXXXX";
+    string origin = fs::current_path();
+    outPath = fs::absolute(outPath);
+    if (!mkdtemp(scratch) || chdir(scratch) != 0) {
+        cerr << "Error: Unable to create scratch directory" << endl;
+        return 1;
+    }
+
+    BenchReport report(BENCH_VERSION);
+    auto enabled = [&](const string& name) { return filter.empty() || name.find(filter) != string::npos; };
+
+    if (enabled("convert")) benchConversion(report);
+    if (enabled("csvwriter")) benchCSVWriter(report);
+    if (enabled("file_writer")) benchFileWriter(report);
+    if (enabled("segment_files")) benchSegmentFiles(report);
+    if (enabled("recovery")) benchRecovery(report);
+    if (enabled("segment_codec")) benchSegmentCodec(report);
+    if (enabled("segment")) benchSplitter(report);
+    if (enabled("kernel") || enabled("format_rows") || enabled("stats")) benchBlockKernels(report);
+    if (enabled("simd")) benchSimdKernels(report);
+    if (enabled("hdr")) benchHdrRecord(report);
+    if (enabled("end_to_end") || enabled("get_data")) benchEndToEnd(report, e2eSeconds);
+    if (enabled("async")) benchAsyncEndToEnd(report, e2eSeconds);
+    if (enabled("merge")) benchStreamMerge(report);
+    if (enabled("envelope")) benchEnvelope(report);
+    if (enabled("anomaly")) benchAnomaly(report);
+    if (enabled("velocity")) benchVelocity(report);
+    if (enabled("query")) benchQuery(report);
+    if (enabled("spill")) benchSpill(report, e2eSeconds);
+
+    if (chdir(origin.c_str()) == 0) {
+        fs::remove_all(scratch);
+    }
+
+    // **Results go to a file: the library logs progress on stdout**
+    ofstream(outPath) << report.toJson();
+    cout << "Benchmark results written to " << outPath << endl;
+    return 0;
+}
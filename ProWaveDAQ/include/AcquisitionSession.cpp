@@ -0,0 +1,297 @@
+#include "AcquisitionSession.h"
+
+#include <sstream>
+#include <unistd.h>
+
+// Current local time as YYYYMMDDHHMMSS (session folder prefix).
+static string folderTimestamp() {
+    auto now = chrono::system_clock::now();
+    time_t now_time = chrono::system_clock::to_time_t(now);
+    struct tm localTime;
+    localtime_r(&now_time, &localTime);
+
+    char buffer[20];
+    strftime(buffer, sizeof(buffer), "%Y%m%d%H%M%S", &localTime);
+    return string(buffer);
+}
+
+AcquisitionSession::AcquisitionSession(ProWaveDAQ& daq, BlockFanout& fanout, const SessionConfig& config)
+    : daq(daq), fanout(fanout), config(config), running(false), hasPending(false), nextTicket(1),
+      samplesRecorded(0), segments(0), lastSample(0), sampleRate(daq.getSampleRate()), recordingTicket(0),
+      queueDepth(Metrics::instance().gauge("prowavedaq_writer_queue_depth",
+          "Acquired blocks not yet handed to the CSV writer")),
+      droppedBlocks(Metrics::instance().counter("prowavedaq_consumer_dropped_blocks_total",
+          "Blocks missing from the sequence the recorder consumed")) {}
+
+AcquisitionSession::~AcquisitionSession() {
+    stop();
+}
+
+void AcquisitionSession::start() {
+    if (running) {
+        return;
+    }
+    SubscriberOptions options;
+    options.name = "recorder";
+    options.policy = config.spill ? OverflowPolicy::Spill : OverflowPolicy::Block;
+    options.memoryBytes = config.spillMemoryBytes;
+    options.spillDirectory = config.spillDirectory;
+    subscription = fanout.subscribe(options);
+
+    running = true;
+    consumerThread = thread(&AcquisitionSession::consumeLoop, this);
+}
+
+void AcquisitionSession::stop() {
+    if (running) {
+        // **Closed first: the consumer drains what is queued or spilled, then exits**
+        fanout.unsubscribe(subscription);
+        if (consumerThread.joinable()) {
+            consumerThread.join();
+        }
+        running = false;
+        subscription.reset();
+    }
+    closeRecording();
+}
+
+void AcquisitionSession::enqueue(const Request& request) {
+    lock_guard<mutex> lock(requestMutex);
+    pending.push_back(request);
+    hasPending = true;
+}
+
+uint64_t AcquisitionSession::startRecording(const string& newLabel, const string& outputRoot) {
+    Request request;
+    request.kind = Request::Record;
+    request.label = newLabel;
+    request.outputRoot = outputRoot;
+    request.ticket = nextTicket++;
+    enqueue(request);
+    return request.ticket;
+}
+
+void AcquisitionSession::changeOutputRoot(const string& outputRoot) {
+    startRecording("", outputRoot);
+}
+
+void AcquisitionSession::stopRecording(uint64_t ticket) {
+    Request request;
+    request.kind = Request::Stop;
+    request.ticket = ticket;
+    enqueue(request);
+}
+
+void AcquisitionSession::newSegment() {
+    Request request;
+    request.kind = Request::Segment;
+    enqueue(request);
+}
+
+void AcquisitionSession::applyConfig(const SessionConfig& newConfig) {
+    Request request;
+    request.kind = Request::Config;
+    request.config = newConfig;
+    enqueue(request);
+}
+
+string AcquisitionSession::status() {
+    lock_guard<mutex> lock(statusMutex);
+    ostringstream out;
+    if (label.empty()) {
+        out << "idle";
+    } else {
+        out << "recording label=" << label << " folder=" << folder;
+    }
+    out << " samples=" << samplesRecorded << " segments=" << segments
+        << " sample_index=" << lastSample << " save_unit=" << config.saveUnitSeconds << "s"
+        << " sample_rate=" << sampleRate;
+    return out.str();
+}
+
+string AcquisitionSession::recordingFolder() {
+    lock_guard<mutex> lock(statusMutex);
+    return folder;
+}
+
+// **Consumer loop: runs between ProWaveDAQ's reader and the CSV files**
+void AcquisitionSession::consumeLoop() {
+    if (Tracer::isEnabled()) {
+        Tracer::instance().setThreadName("recorder");
+    }
+    uint64_t prevSequence = 0;
+    SharedBlock block;
+
+    while (true) {
+        // **Switches happen here, between two blocks, i.e. on a sample boundary**
+        if (hasPending) {
+            applyPending();
+        }
+
+        queueDepth.set(subscription->size());
+        if (!subscription->pop(block, chrono::milliseconds(10))) {
+            if (subscription->isClosed()) {
+                break;
+            }
+            continue;
+        }
+        if (prevSequence != 0 && block->sequence > prevSequence + 1) {
+            droppedBlocks.inc(block->sequence - prevSequence - 1);
+        }
+        prevSequence = block->sequence;
+
+        // **A live sample-rate change resizes segments from the next one on**
+        int currentRate = daq.getSampleRate();
+        if (currentRate != sampleRate) {
+            {
+                lock_guard<mutex> lock(statusMutex);
+                sampleRate = currentRate;
+            }
+            if (splitter) {
+                splitter->setTargetSize(segmentSize());
+            }
+        }
+
+        size_t samples = block->samples.size() / 3;
+        uint64_t nextSample = block->firstSample + samples;
+        if (splitter) {
+            splitter->push(*block);
+        }
+        block.reset();
+
+        lock_guard<mutex> lock(statusMutex);
+        lastSample = nextSample;
+        if (writer) {
+            samplesRecorded += samples;
+        }
+    }
+}
+
+void AcquisitionSession::applyPending() {
+    deque<Request> requests;
+    {
+        lock_guard<mutex> lock(requestMutex);
+        requests.swap(pending);
+        hasPending = false;
+    }
+    for (const Request& request : requests) {
+        applyRequest(request);
+    }
+}
+
+void AcquisitionSession::applyRequest(const Request& request) {
+    switch (request.kind) {
+    case Request::Record: {
+        // **An empty label keeps the current one (output folder change)**
+        string newLabel = request.label;
+        if (newLabel.empty()) {
+            lock_guard<mutex> lock(statusMutex);
+            newLabel = label;
+        }
+        if (newLabel.empty()) {
+            config.outputRoot = request.outputRoot;
+            break;
+        }
+        closeRecording();
+        openRecording(newLabel, request.outputRoot);
+        if (!request.label.empty()) {
+            recordingTicket = request.ticket;   // A new output root keeps the recording's ticket
+        }
+        break;
+    }
+    case Request::Stop:
+        if (request.ticket == 0 || request.ticket == recordingTicket) {
+            closeRecording();
+        }
+        break;
+    case Request::Segment:
+        if (writer) {
+            writer->updateFilename();
+            openSplitter();
+            lock_guard<mutex> lock(statusMutex);
+            segments++;
+            cout << "New segment started at sample " << lastSample << endl;
+        }
+        break;
+    case Request::Config: {
+        // **All output settings change together, between two blocks**
+        const SessionConfig& next = request.config;
+        {
+            lock_guard<mutex> lock(statusMutex);
+            config.saveUnitSeconds = next.saveUnitSeconds;
+            config.syncIntervalMs = next.syncIntervalMs;
+            config.durability = next.durability;
+            config.writer = next.writer;
+        }
+        if (splitter) {
+            splitter->setTargetSize(segmentSize());
+        }
+        if (writer) {
+            writer->setSyncInterval(next.syncIntervalMs);
+            writer->setDurability(next.durability);
+            writer->setSegmentSize(segmentSize());
+        }
+        if (next.outputRoot != config.outputRoot) {
+            Request relocate;
+            relocate.kind = Request::Record;
+            relocate.outputRoot = next.outputRoot;
+            applyRequest(relocate);
+        }
+        lock_guard<mutex> lock(statusMutex);
+        cout << "Output settings applied at sample " << lastSample << ": SaveUnit "
+             << config.saveUnitSeconds << " s (from next segment), sync " << config.syncIntervalMs
+             << " ms (" << durabilityName(config.durability) << "), directory " << config.outputRoot << endl;
+        break;
+    }
+    case Request::None:
+        break;
+    }
+}
+
+int AcquisitionSession::segmentSize() const {
+    return config.saveUnitSeconds * sampleRate * 3;
+}
+
+void AcquisitionSession::openRecording(const string& newLabel, const string& outputRoot) {
+    if (!outputRoot.empty()) {
+        config.outputRoot = outputRoot;
+    }
+    string newFolder = config.outputRoot + "/" + folderTimestamp() + "_" + newLabel;
+    fs::create_directories(newFolder);
+
+    writer.reset(new CSVWriter(3, newFolder, newLabel, config.syncIntervalMs, config.writer));
+    writer->setDurability(config.durability);
+    openSplitter();
+
+    lock_guard<mutex> lock(statusMutex);
+    label = newLabel;
+    folder = newFolder;
+    samplesRecorded = 0;
+    segments = 1;
+    cout << "Recording '" << label << "' into " << folder << " from sample " << lastSample << endl;
+}
+
+// A fresh splitter starts counting the SaveUnit from the next block.
+void AcquisitionSession::openSplitter() {
+    writer->setSegmentSize(segmentSize());
+    splitter.reset(new SegmentSplitter(segmentSize(),
+        [this](const DataBlock& chunk) { writer->addDataBlock(chunk); },
+        [this]() {
+            writer->updateFilename();
+            lock_guard<mutex> lock(statusMutex);
+            segments++;
+            cout << "CSV Saved & Filename Updated" << endl;
+        }));
+}
+
+void AcquisitionSession::closeRecording() {
+    splitter.reset();
+    writer.reset(); // Syncs and closes the last file
+
+    lock_guard<mutex> lock(statusMutex);
+    if (!label.empty()) {
+        cout << "Recording '" << label << "' closed after " << samplesRecorded << " samples" << endl;
+    }
+    label.clear();
+    folder.clear();
+}
@@ -0,0 +1,122 @@
+#ifndef ACQUISITION_SESSION_H
+#define ACQUISITION_SESSION_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "ProWaveDAQ.h"
+#include "BlockFanout.h"
+#include "CSVWriter.h"
+#include "SegmentSplitter.h"
+
+using namespace std;
+
+// Recording settings taken from Master.ini.
+struct SessionConfig {
+    string outputRoot = "output/ProWaveDAQ"; // Parent of the per-label session folders
+    int saveUnitSeconds = 60;                 // Seconds of data per CSV file
+    int syncIntervalMs = 1000;                // CSVWriter fsync interval
+    Durability durability = Durability::Periodic; // How syncIntervalMs is applied
+    WriterOptions writer;                     // CSVWriter I/O backend (from the next recording)
+    bool spill = true;                        // Overflow beyond spillMemoryBytes to disk instead of waiting
+    size_t spillMemoryBytes = 64 << 20;       // RAM budget of the recorder's queue (at start())
+    string spillDirectory = "/var/tmp";       // Scratch file location (at start())
+};
+
+// AcquisitionSession records a running ProWaveDAQ stream, as one subscriber of
+// its BlockFanout, for as long as the program lives. The device stays connected; starting a new label, changing the
+// output folder or forcing a new segment only swaps the CSVWriter between two
+// blocks, so no samples are lost across the switch.
+class AcquisitionSession {
+public:
+    // Subscribes to fanout with OverflowPolicy::Spill (or Block when spill is
+    // off): a stalled disk never stalls the other consumers and RAM stays
+    // within spillMemoryBytes; recording is lossless while the scratch
+    // directory has room.
+    AcquisitionSession(ProWaveDAQ& daq, BlockFanout& fanout, const SessionConfig& config);
+    ~AcquisitionSession();
+
+    // Starts the consumer thread. Data is discarded until a label is set.
+    void start();
+
+    // Writes out everything queued or spilled, stops the consumer thread and
+    // closes the current recording.
+    void stop();
+
+    // Records into a new folder <outputRoot>/<timestamp>_<label> from the next block.
+    // An empty outputRoot keeps the current one. Returns a ticket for stopRecording().
+    uint64_t startRecording(const string& label, const string& outputRoot = "");
+
+    // Moves the recording to a new output root, keeping the current label.
+    void changeOutputRoot(const string& outputRoot);
+
+    // Closes the current recording; acquisition keeps running. With a ticket,
+    // only if the current recording is still the one that startRecording() began.
+    void stopRecording(uint64_t ticket = 0);
+
+    // Closes the current file and starts a new segment in the same folder.
+    void newSegment();
+
+    // Applies reloaded settings between two blocks: SaveUnit from the next segment,
+    // sync interval immediately, and a changed output root by reopening the recording.
+    void applyConfig(const SessionConfig& newConfig);
+
+    // One-line summary of the session state.
+    string status();
+
+    // Folder being recorded into ("" when not recording).
+    string recordingFolder();
+
+private:
+    // Change requested by a control thread, applied by the consumer between blocks.
+    struct Request {
+        enum Kind { None, Record, Stop, Segment, Config } kind = None;
+        string label;
+        string outputRoot;
+        SessionConfig config;
+        uint64_t ticket = 0;
+    };
+
+    ProWaveDAQ& daq;
+    BlockFanout& fanout;
+    shared_ptr<Subscription> subscription;
+    SessionConfig config;
+    atomic<bool> running;
+    thread consumerThread;
+
+    mutex requestMutex;          // Guards pending
+    deque<Request> pending;      // Applied in order by the consumer
+    atomic<bool> hasPending;
+    atomic<uint64_t> nextTicket;
+
+    mutex statusMutex;           // Guards the fields below
+    string label;                // Current label ("" = not recording)
+    string folder;               // Current session folder
+    uint64_t samplesRecorded;    // Samples written under the current label
+    uint64_t segments;           // Files started under the current label
+    uint64_t lastSample;         // Sample index of the last block consumed
+    int sampleRate;              // Rate the current segment size is based on
+
+    // Owned by the consumer thread
+    uint64_t recordingTicket;    // Ticket of the Record request behind the current recording
+    unique_ptr<CSVWriter> writer;
+    unique_ptr<SegmentSplitter> splitter;
+
+    MetricGauge& queueDepth;     // Blocks queued for the recorder
+    MetricCounter& droppedBlocks;// Gaps in the block sequence seen by the recorder
+
+    void consumeLoop();
+    void applyPending();
+    void applyRequest(const Request& request);
+    void enqueue(const Request& request);
+    int segmentSize() const;
+    void openRecording(const string& newLabel, const string& outputRoot);
+    void closeRecording();
+    void openSplitter();
+};
+
+#endif // ACQUISITION_SESSION_H
@@ -0,0 +1,484 @@
+#include "AnomalyDetector.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+// Floor under band and rms energies before the log (g²)
+static const double ENERGY_FLOOR = 1e-12;
+
+// Covariance regularisation: 1 % shrinkage of every variance plus an
+// absolute floor, so a feature that hardly moved during training (0.01 in
+// log units = 1 %) cannot dominate the score on its own
+static const double SHRINKAGE = 0.01;
+static const double MIN_VARIANCE = 1e-4;
+
+static const int SCALAR_FEATURES = 3;   // log rms, crest factor, kurtosis per axis
+
+static const char* AXIS_NAMES[3] = {"x", "y", "z"};
+
+// Wall-clock time of a block acquired at acquiredAt.
+static chrono::system_clock::time_point wallClock(chrono::steady_clock::time_point acquiredAt) {
+    return chrono::system_clock::now() -
+           chrono::duration_cast<chrono::system_clock::duration>(chrono::steady_clock::now() - acquiredAt);
+}
+
+string AnomalyDetector::check(const AnomalyOptions& options, int sampleRate) {
+    if (sampleRate <= 0) {
+        return "sample rate must be positive";
+    }
+    if (options.bandEdgesHz.size() < 2) {
+        return "bandEdgesHz needs at least two edges";
+    }
+    for (size_t i = 0; i < options.bandEdgesHz.size(); i++) {
+        if (options.bandEdgesHz[i] <= 0 || (i > 0 && options.bandEdgesHz[i] <= options.bandEdgesHz[i - 1])) {
+            return "bandEdgesHz must be positive and increasing";
+        }
+    }
+    if (options.bandEdgesHz.back() >= sampleRate / 2.0) {
+        return "the last band edge must be below sampleRate / 2";
+    }
+    if (options.windowSeconds * sampleRate < 64) {
+        return "windowSeconds must span at least 64 samples";
+    }
+    size_t dimension = 3 * (SCALAR_FEATURES + options.bandEdgesHz.size() - 1);
+    if (options.trainingSeconds < 2 * dimension * options.windowSeconds) {
+        ostringstream out;
+        out << "trainingSeconds must cover at least " << 2 * dimension << " windows ("
+            << 2 * dimension * options.windowSeconds << " s)";
+        return out.str();
+    }
+    if (options.threshold <= 0 || options.clearRatio <= 0 || options.clearRatio > 1) {
+        return "threshold must be positive and 0 < clearRatio <= 1";
+    }
+    if (options.confirmWindows < 1) {
+        return "confirmWindows must be >= 1";
+    }
+    return "";
+}
+
+AnomalyDetector::AnomalyDetector(int sampleRate, const AnomalyOptions& options, Sink sink)
+    : sampleRate(sampleRate), options(options), sink(move(sink)), bands(options.bandEdgesHz.size() - 1),
+      dimension(3 * (SCALAR_FEATURES + bands)), highPass(bands), lowPass(bands), bandEnergy(bands),
+      windowFrames(1), frames(0), settling(true), features(dimension), retrainRequested(false), trained(false),
+      trainingWindows(0), seen(0), mean(dimension), comoment(dimension * dimension), deviation(dimension),
+      factor(dimension * dimension), scratch(dimension), above(0), below(0), inEvent(false), eventStart(0), scoredSample(0),
+      lastScore(0), events(0),
+      windowLatency(Metrics::instance().latency("prowavedaq_anomaly_window_seconds",
+          "Features and score of one anomaly window")),
+      scoreGauge(Metrics::instance().gauge("prowavedaq_anomaly_score",
+          "Normalised Mahalanobis distance of the last window from the baseline")),
+      activeGauge(Metrics::instance().gauge("prowavedaq_anomaly_active",
+          "1 while an anomaly event is open")),
+      eventCount(Metrics::instance().counter("prowavedaq_anomaly_events_total",
+          "Anomaly events started")) {
+    for (int axis = 0; axis < 3; axis++) {
+        string prefix = AXIS_NAMES[axis];
+        featureNames.push_back(prefix + "_rms");
+        featureNames.push_back(prefix + "_crest");
+        featureNames.push_back(prefix + "_kurtosis");
+        for (size_t b = 0; b < bands; b++) {
+            ostringstream name;
+            name << prefix << "_band_" << options.bandEdgesHz[b] << "_" << options.bandEdgesHz[b + 1];
+            featureNames.push_back(name.str());
+        }
+    }
+    lastFeature.reserve(32);
+    event.feature.reserve(32);
+    design();
+    startTraining();
+    if (!options.baselinePath.empty() && loadBaseline()) {
+        lock_guard<mutex> lock(statusMutex);
+        trained = true;
+    }
+}
+
+void AnomalyDetector::setSampleRate(int newSampleRate) {
+    endEvent();   // At the old rate, so its duration is right
+    sampleRate = newSampleRate;
+    design();
+    startTraining();
+}
+
+// **Band-pass bank for the current rate; the current window is discarded**
+void AnomalyDetector::design() {
+    for (size_t b = 0; b < bands; b++) {
+        highPass[b] = Biquad::highPass(options.bandEdgesHz[b], sampleRate, M_SQRT1_2);
+        lowPass[b] = Biquad::lowPass(options.bandEdgesHz[b + 1], sampleRate, M_SQRT1_2);
+    }
+    windowFrames = max<size_t>(1, static_cast<size_t>(lround(options.windowSeconds * sampleRate)));
+    for (int axis = 0; axis < 3; axis++) {
+        shift[axis] = 0;
+    }
+    settling = true;   // The filters and the moment shift settle during the first window
+    resetWindow();
+}
+
+void AnomalyDetector::resetWindow() {
+    frames = 0;
+    fill(bandEnergy.begin(), bandEnergy.end(), FrameLanes{});
+    for (int axis = 0; axis < 3; axis++) {
+        sum[axis] = sum2[axis] = sum3[axis] = sum4[axis] = 0;
+        high[axis] = -INFINITY;
+        low[axis] = INFINITY;
+    }
+}
+
+void AnomalyDetector::startTraining() {
+    endEvent();
+    lock_guard<mutex> lock(statusMutex);
+    trained = false;
+    seen = 0;
+    trainingWindows = max(2 * dimension, static_cast<size_t>(lround(options.trainingSeconds / options.windowSeconds)));
+    fill(mean.begin(), mean.end(), 0.0);
+    fill(comoment.begin(), comoment.end(), 0.0);
+    above = below = 0;
+}
+
+// **An open event ends at the last scored window, so the sink never waits for a clear that cannot come**
+void AnomalyDetector::endEvent() {
+    unique_lock<mutex> lock(statusMutex);
+    if (!inEvent) {
+        return;
+    }
+    inEvent = false;
+    above = below = 0;
+    event.active = false;
+    event.seconds = static_cast<double>(scoredSample - eventStart) / sampleRate;
+    event.sample = scoredSample;
+    event.time = wallClock(scoredAt);
+    activeGauge.set(0);
+    lock.unlock();
+    if (sink) {
+        sink(event);
+    }
+}
+
+void AnomalyDetector::push(const DataBlock& block) {
+    TRACE_SPAN("anomaly");
+    if (retrainRequested.exchange(false)) {
+        startTraining();
+    }
+    const double* values = block.samples.data();
+    size_t blockFrames = block.samples.size() / 3;
+
+    for (size_t f = 0; f < blockFrames; f++) {
+        // **Band energies: every axis through the same filter bank, one lane each**
+        FrameLanes x = loadFrame(values, f);
+        for (size_t b = 0; b < bands; b++) {
+            FrameLanes y = lowPass[b].run(highPass[b].run(x));
+            bandEnergy[b] += y * y;
+        }
+        // **Raw moments about a shift close to the mean, so the DC offset does not cancel precision**
+        for (int axis = 0; axis < 3; axis++) {
+            double v = values[3 * f + axis];
+            double d = v - shift[axis];
+            double d2 = d * d;
+            sum[axis] += d;
+            sum2[axis] += d2;
+            sum3[axis] += d2 * d;
+            sum4[axis] += d2 * d2;
+            high[axis] = max(high[axis], v);
+            low[axis] = min(low[axis], v);
+        }
+        if (++frames == windowFrames) {
+            finishWindow(block.firstSample + f, block.acquiredAt);
+        }
+    }
+}
+
+void AnomalyDetector::finishWindow(uint64_t lastSample, chrono::steady_clock::time_point acquiredAt) {
+    auto start = chrono::steady_clock::now();
+    const double n = static_cast<double>(frames);
+    size_t k = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        double m1 = sum[axis] / n;
+        double m2 = sum2[axis] / n;
+        double m3 = sum3[axis] / n;
+        double m4 = sum4[axis] / n;
+        double variance = max(0.0, m2 - m1 * m1);
+        double centered4 = m4 - 4 * m1 * m3 + 6 * m1 * m1 * m2 - 3 * m1 * m1 * m1 * m1;
+        double windowMean = shift[axis] + m1;
+        double rms = sqrt(variance);
+        features[k++] = 0.5 * log(variance + ENERGY_FLOOR);
+        features[k++] = rms > 0 ? max(high[axis] - windowMean, windowMean - low[axis]) / rms : 0;
+        features[k++] = variance > 0 ? centered4 / (variance * variance) : 0;
+        for (size_t b = 0; b < bands; b++) {
+            features[k++] = log(bandEnergy[b][axis] / n + ENERGY_FLOOR);
+        }
+        shift[axis] = windowMean;
+    }
+    resetWindow();
+    if (settling) {
+        settling = false;
+        return;
+    }
+
+    // **Learn, or score against what was learnt**
+    if (!trained) {
+        train();
+        windowLatency.recordSince(start);
+        return;
+    }
+    size_t worst = 0;
+    double windowScore = score(worst);
+    scoreGauge.set(windowScore);
+    {
+        lock_guard<mutex> lock(statusMutex);
+        lastScore = windowScore;
+        lastFeature = featureNames[worst];
+    }
+    windowLatency.recordSince(start);
+    updateEvent(windowScore, worst, lastSample, acquiredAt);
+}
+
+// Welford update of the mean and the co-moment matrix: O(d²).
+void AnomalyDetector::train() {
+    {
+        lock_guard<mutex> lock(statusMutex);
+        seen++;
+    }
+    for (size_t i = 0; i < dimension; i++) {
+        scratch[i] = features[i] - mean[i];
+        mean[i] += scratch[i] / seen;
+    }
+    for (size_t i = 0; i < dimension; i++) {
+        double* row = &comoment[i * dimension];
+        for (size_t j = 0; j <= i; j++) {
+            row[j] += scratch[i] * (features[j] - mean[j]);
+        }
+    }
+    if (seen >= trainingWindows) {
+        finishTraining();
+    }
+}
+
+// **Regularised covariance -> Cholesky factor (diagonal if it is not positive definite)**
+void AnomalyDetector::finishTraining() {
+    const size_t d = dimension;
+    vector<double>& covariance = comoment;   // Scaled in place; training is over
+    for (size_t i = 0; i < d; i++) {
+        for (size_t j = 0; j <= i; j++) {
+            covariance[i * d + j] /= seen - 1;
+        }
+        double& variance = covariance[i * d + i];
+        variance = variance * (1 + SHRINKAGE) + MIN_VARIANCE;
+        deviation[i] = sqrt(variance);
+    }
+
+    bool positive = true;
+    fill(factor.begin(), factor.end(), 0.0);
+    for (size_t i = 0; i < d && positive; i++) {
+        for (size_t j = 0; j <= i; j++) {
+            double s = covariance[i * d + j];
+            for (size_t m = 0; m < j; m++) {
+                s -= factor[i * d + m] * factor[j * d + m];
+            }
+            if (i == j) {
+                if (s <= 0) {
+                    positive = false;
+                    break;
+                }
+                factor[i * d + i] = sqrt(s);
+            } else {
+                factor[i * d + j] = s / factor[j * d + j];
+            }
+        }
+    }
+    if (!positive) {
+        cerr << "Warning: [Anomaly] baseline covariance is singular, scoring features independently" << endl;
+        fill(factor.begin(), factor.end(), 0.0);
+        for (size_t i = 0; i < d; i++) {
+            factor[i * d + i] = deviation[i];
+        }
+    }
+    {
+        lock_guard<mutex> lock(statusMutex);
+        trained = true;
+    }
+    cout << "[Anomaly] baseline learnt from " << seen << " windows" << endl;
+    if (!options.baselinePath.empty()) {
+        saveBaseline();
+    }
+}
+
+// sqrt(D² / d) with D² = |L⁻¹ (f - mean)|²; worst = the feature with the largest |z|.
+double AnomalyDetector::score(size_t& worst) {
+    const size_t d = dimension;
+    double distance = 0, largest = -1;
+    for (size_t i = 0; i < d; i++) {
+        double residual = features[i] - mean[i];
+        double z = fabs(residual) / deviation[i];
+        if (z > largest) {
+            largest = z;
+            worst = i;
+        }
+        const double* row = &factor[i * d];
+        for (size_t j = 0; j < i; j++) {
+            residual -= row[j] * scratch[j];
+        }
+        scratch[i] = residual / row[i];
+        distance += scratch[i] * scratch[i];
+    }
+    return sqrt(distance / d);
+}
+
+void AnomalyDetector::updateEvent(double windowScore, size_t worst, uint64_t lastSample,
+                                  chrono::steady_clock::time_point acquiredAt) {
+    // **Hysteresis: confirmWindows windows above threshold to start, below threshold × clearRatio to end**
+    unique_lock<mutex> lock(statusMutex);
+    scoredSample = lastSample;
+    scoredAt = acquiredAt;
+    bool changed = false;
+    if (!inEvent) {
+        above = windowScore > options.threshold ? above + 1 : 0;
+        if (above >= options.confirmWindows) {
+            inEvent = true;
+            changed = true;
+            below = 0;
+            eventStart = lastSample;
+            event.active = true;
+            event.score = windowScore;
+            event.feature = featureNames[worst];
+            event.seconds = 0;
+        }
+    } else {
+        if (windowScore > event.score) {
+            event.score = windowScore;
+            event.feature = featureNames[worst];
+        }
+        below = windowScore < options.threshold * options.clearRatio ? below + 1 : 0;
+        if (below >= options.confirmWindows) {
+            inEvent = false;
+            changed = true;
+            above = 0;
+            event.active = false;
+            event.seconds = static_cast<double>(lastSample - eventStart) / sampleRate;
+        }
+    }
+    if (!changed) {
+        return;
+    }
+
+    // Wall-clock time of the block that closed the window
+    event.sample = lastSample;
+    event.time = wallClock(acquiredAt);
+    activeGauge.set(inEvent ? 1 : 0);
+    if (inEvent) {
+        eventCount.inc();
+        events++;
+    }
+    lock.unlock();
+    if (sink) {
+        sink(event);
+    }
+}
+
+string AnomalyDetector::status() {
+    lock_guard<mutex> lock(statusMutex);
+    ostringstream out;
+    if (!trained) {
+        out << "anomaly: training " << seen << "/" << trainingWindows << " windows of "
+            << options.windowSeconds << " s (" << dimension << " features)\n";
+        return out.str();
+    }
+    out << "anomaly: score " << lastScore << " (threshold " << options.threshold << "), furthest feature "
+        << (lastFeature.empty() ? "-" : lastFeature) << ", " << (inEvent ? "event active" : "normal") << ", "
+        << events << " event(s)\n";
+    return out.str();
+}
+
+void AnomalyDetector::appendCsv(const AnomalyEvent& event, ostream& out) {
+    time_t seconds = chrono::system_clock::to_time_t(event.time);
+    long millis = chrono::duration_cast<chrono::milliseconds>(event.time.time_since_epoch()).count() % 1000;
+    struct tm localTime;
+    localtime_r(&seconds, &localTime);
+    char buffer[32];
+    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &localTime);
+    out << buffer << "." << setw(3) << setfill('0') << millis << setfill(' ') << "," << event.sample << ","
+        << (event.active ? "start" : "end") << "," << event.score << "," << event.feature << ","
+        << event.seconds << "\n";
+}
+
+// Rate, window and bands the baseline was learnt with.
+string AnomalyDetector::baselineKey() const {
+    ostringstream out;
+    out << sampleRate << " " << windowFrames;
+    for (double edge : options.bandEdgesHz) {
+        out << " " << edge;
+    }
+    return out.str();
+}
+
+bool AnomalyDetector::loadBaseline() {
+    ifstream in(options.baselinePath);
+    if (!in) {
+        return false;
+    }
+    string line, key;
+    getline(in, line);   // Comment
+    getline(in, key);
+    if (key != "key " + baselineKey()) {
+        cout << "[Anomaly] " << options.baselinePath << " was learnt with other settings, training a new baseline"
+             << endl;
+        return false;
+    }
+    auto readVector = [&in](const char* name, vector<double>& values) {
+        string tag;
+        if (!(in >> tag) || tag != name) {
+            return false;
+        }
+        for (double& value : values) {
+            if (!(in >> value)) {
+                return false;
+            }
+        }
+        return true;
+    };
+    size_t windows = 0;
+    string tag;
+    if (!(in >> tag >> windows) || tag != "windows" || !readVector("mean", mean) ||
+        !readVector("deviation", deviation) || !readVector("factor", factor)) {
+        cerr << "Warning: [Anomaly] " << options.baselinePath << " is damaged, training a new baseline" << endl;
+        startTraining();
+        return false;
+    }
+    seen = windows;
+    cout << "[Anomaly] baseline (" << windows << " windows) loaded from " << options.baselinePath << endl;
+    return true;
+}
+
+// Written to a temporary file and renamed, so a crash never leaves half a baseline.
+void AnomalyDetector::saveBaseline() const {
+    string temporary = options.baselinePath + ".tmp";
+    {
+        ofstream out(temporary, ios::trunc);
+        out << "# ProWaveDAQ anomaly baseline: rate, window frames, band edges; feature mean, deviation, "
+               "Cholesky factor\n";
+        out << "key " << baselineKey() << "\n";
+        out << "windows " << seen << "\n" << setprecision(17);
+        auto writeVector = [&out](const char* name, const vector<double>& values) {
+            out << name;
+            for (double value : values) {
+                out << " " << value;
+            }
+            out << "\n";
+        };
+        writeVector("mean", mean);
+        writeVector("deviation", deviation);
+        writeVector("factor", factor);
+        if (!out.flush()) {
+            cerr << "Warning: [Anomaly] cannot write " << temporary << endl;
+            return;
+        }
+    }
+    if (rename(temporary.c_str(), options.baselinePath.c_str()) != 0) {
+        cerr << "Warning: [Anomaly] cannot replace " << options.baselinePath << endl;
+    }
+}
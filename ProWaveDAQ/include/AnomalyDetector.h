@@ -0,0 +1,148 @@
+#ifndef ANOMALY_DETECTOR_H
+#define ANOMALY_DETECTOR_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Biquad.h"
+#include "DataBlock.h"
+#include "Metrics.h"
+
+using namespace std;
+
+// Settings from Master.ini [Anomaly].
+struct AnomalyOptions {
+    double windowSeconds = 1.0;                          // One feature vector per window
+    double trainingSeconds = 600;                        // Baseline learnt from this much data
+    vector<double> bandEdgesHz = {10, 200, 800, 2000, 3500};   // Consecutive edges form the bands
+    double threshold = 4.0;                              // Score that counts as anomalous
+    double clearRatio = 0.75;                            // Event ends below threshold × clearRatio
+    int confirmWindows = 2;                              // Consecutive windows to start or end an event
+    string baselinePath;                                 // Load / save the learnt baseline ("" = relearn every run)
+};
+
+// Start or end of an anomaly.
+struct AnomalyEvent {
+    bool active = false;                        // true: started, false: ended
+    uint64_t sample = 0;                        // Input sample index at the end of the window
+    chrono::system_clock::time_point time;      // Wall-clock time of that sample
+    double score = 0;                           // Window score (highest of the event when it ends)
+    string feature;                             // Feature furthest from its baseline, e.g. "z_band_800_2000"
+    double seconds = 0;                         // Event duration (ends only)
+};
+
+// AnomalyDetector scores the live stream against a baseline it learns from
+// the first trainingSeconds of data. Per window and axis the features are
+// log rms, crest factor, kurtosis and the log energy of every band
+// (2nd-order Butterworth band-pass bank, one SIMD lane per axis, see
+// Biquad.h), 3 × (3 + bands) values.
+//
+// Training accumulates the feature mean and covariance incrementally
+// (Welford), then factors the ridge-regularised covariance once (Cholesky).
+// Each later window is scored by its Mahalanobis distance normalised by the
+// feature count, sqrt(D² / d): about 1 for baseline data. A window costs
+// O(d²) for d features, negligible next to the per-sample filtering; push()
+// does not allocate.
+//
+// Events start after confirmWindows windows above threshold and end after
+// confirmWindows windows below threshold × clearRatio.
+class AnomalyDetector {
+public:
+    using Sink = function<void(const AnomalyEvent& event)>;
+
+    // Empty if options work at sampleRate, otherwise the reason.
+    static string check(const AnomalyOptions& options, int sampleRate);
+
+    // Loads options.baselinePath when it matches the rate and the features.
+    AnomalyDetector(int sampleRate, const AnomalyOptions& options, Sink sink = nullptr);
+
+    // Feeds one block of interleaved XYZ values. Calls the sink (on this
+    // thread) when an event starts or ends.
+    void push(const DataBlock& block);
+
+    // Redesigns the filters for a new input rate and trains a new baseline.
+    // Both this and retrain() end an open event (the sink is called).
+    void setSampleRate(int sampleRate);
+    int getSampleRate() const { return sampleRate; }
+
+    // Discards the baseline; the next trainingSeconds of data form a new one (any thread).
+    void retrain() { retrainRequested = true; }
+
+    // Training progress or the last score and event state (any thread).
+    string status();
+
+    // One CSV row: time,sample,state,score,feature,seconds.
+    static void appendCsv(const AnomalyEvent& event, ostream& out);
+
+private:
+    int sampleRate;
+    AnomalyOptions options;
+    Sink sink;
+    size_t bands;
+    size_t dimension;                 // Features per window
+    vector<string> featureNames;
+
+    // Per-window accumulators
+    vector<Biquad> highPass;          // One per band
+    vector<Biquad> lowPass;
+    vector<FrameLanes> bandEnergy;
+    double shift[3];                  // Moments are taken about the previous window's mean
+    double sum[3], sum2[3], sum3[3], sum4[3];
+    double high[3], low[3];
+    size_t windowFrames;
+    size_t frames;
+    bool settling;                    // First window after design() is discarded
+    vector<double> features;
+
+    // Baseline: Welford accumulators while training, then mean and factor
+    atomic<bool> retrainRequested;
+    bool trained;
+    size_t trainingWindows;
+    size_t seen;
+    vector<double> mean;
+    vector<double> comoment;          // d × d sums of products of deviations
+    vector<double> deviation;         // Per-feature standard deviation (names the culprit)
+    vector<double> factor;            // Lower-triangular Cholesky factor, row-major d × d
+    vector<double> scratch;
+
+    // Event state
+    int above;
+    int below;
+    bool inEvent;
+    AnomalyEvent event;
+    uint64_t eventStart;
+    uint64_t scoredSample;            // Last sample of the last scored window
+    chrono::steady_clock::time_point scoredAt;
+
+    mutex statusMutex;
+    double lastScore;
+    string lastFeature;
+    uint64_t events;
+
+    HdrHistogram& windowLatency;
+    MetricGauge& scoreGauge;
+    MetricGauge& activeGauge;
+    MetricCounter& eventCount;
+
+    void design();
+    void resetWindow();
+    void startTraining();
+    void endEvent();
+    void finishWindow(uint64_t lastSample, chrono::steady_clock::time_point acquiredAt);
+    void train();
+    void finishTraining();
+    double score(size_t& worst);
+    void updateEvent(double score, size_t worst, uint64_t lastSample, chrono::steady_clock::time_point acquiredAt);
+
+    bool loadBaseline();
+    void saveBaseline() const;
+    string baselineKey() const;
+};
+
+#endif // ANOMALY_DETECTOR_H
@@ -0,0 +1,333 @@
+#include "AsyncAcquisition.h"
+
+// ---------------------------------------------------------------------------
+// Cancellation
+// ---------------------------------------------------------------------------
+bool CancellationToken::isCancelled() const {
+    if (!state) {
+        return false;
+    }
+    lock_guard<mutex> lock(state->stateMutex);
+    return state->cancelled;
+}
+
+uint64_t CancellationToken::onCancel(function<void()> fn) const {
+    if (!state) {
+        return 0;
+    }
+    {
+        lock_guard<mutex> lock(state->stateMutex);
+        if (!state->cancelled) {
+            uint64_t id = state->nextId++;
+            state->callbacks.emplace(id, move(fn));
+            return id;
+        }
+    }
+    fn();
+    return 0;
+}
+
+void CancellationToken::unregister(uint64_t id) const {
+    if (!state || id == 0) {
+        return;
+    }
+    lock_guard<mutex> lock(state->stateMutex);
+    state->callbacks.erase(id);
+}
+
+void CancellationSource::cancel() {
+    map<uint64_t, function<void()>> callbacks;
+    {
+        lock_guard<mutex> lock(state->stateMutex);
+        if (state->cancelled) {
+            return;
+        }
+        state->cancelled = true;
+        callbacks.swap(state->callbacks);
+    }
+    for (auto& entry : callbacks) {
+        entry.second();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Executor
+// ---------------------------------------------------------------------------
+
+// Owns a spawned task: starts on creation, frees its frame when done.
+namespace {
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        suspend_never initial_suspend() noexcept { return {}; }
+        suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() noexcept { terminate(); }
+    };
+};
+
+Detached runDetached(Task<void> task, function<void()> onDone) {
+    co_await task;
+    onDone();
+}
+} // namespace
+
+Executor::~Executor() {
+    stop();
+}
+
+void Executor::post(function<void()> fn) {
+    {
+        lock_guard<mutex> lock(queueMutex);
+        ready.push_back(move(fn));
+    }
+    wakeup.notify_one();
+}
+
+void Executor::postAt(Clock::time_point when, function<void()> fn) {
+    {
+        lock_guard<mutex> lock(queueMutex);
+        timers.push(Timer{when, timerOrder++, move(fn)});
+    }
+    wakeup.notify_one();
+}
+
+void Executor::spawn(Task<void> task) {
+    {
+        lock_guard<mutex> lock(queueMutex);
+        liveTasks++;
+    }
+    auto owned = make_shared<Task<void>>(move(task));
+    post([this, owned]() { runDetached(move(*owned), [this]() { taskFinished(); }); });
+}
+
+void Executor::taskFinished() {
+    lock_guard<mutex> lock(queueMutex);
+    liveTasks--;
+}
+
+// **Runs ready callbacks first, then due timers; sleeps until the next deadline**
+void Executor::run() {
+    unique_lock<mutex> lock(queueMutex);
+    stopped = false;
+    while (!stopped) {
+        auto now = Clock::now();
+        while (!timers.empty() && timers.top().when <= now) {
+            ready.push_back(timers.top().fn);
+            timers.pop();
+        }
+
+        if (!ready.empty()) {
+            function<void()> fn = move(ready.front());
+            ready.pop_front();
+            lock.unlock();
+            fn();
+            lock.lock();
+            continue;
+        }
+
+        if (liveTasks == 0) {
+            break;
+        }
+        if (timers.empty()) {
+            wakeup.wait(lock);
+        } else {
+            wakeup.wait_until(lock, timers.top().when);
+        }
+    }
+}
+
+void Executor::stop() {
+    {
+        lock_guard<mutex> lock(queueMutex);
+        stopped = true;
+    }
+    wakeup.notify_all();
+}
+
+// ---------------------------------------------------------------------------
+// AsyncBlockStream
+// ---------------------------------------------------------------------------
+AsyncBlockStream::AsyncBlockStream(Executor& executor, const string& name, size_t capacity)
+    : executor(executor), capacity(capacity),
+      dropped(Metrics::instance().counter("prowavedaq_async_dropped_total",
+          "Blocks an async consumer lost because it fell behind", Metrics::label("consumer", name))),
+      alive(make_shared<AsyncBlockStream*>(this)) {}
+
+AsyncBlockStream::~AsyncBlockStream() {
+    if (source) {
+        source->setNotify(nullptr);
+    }
+}
+
+void AsyncBlockStream::push(SharedBlock block) {
+    executor.post([stream = weak_ptr<AsyncBlockStream*>(alive), block = move(block)]() mutable {
+        if (auto live = stream.lock()) {
+            (*live)->deliver(move(block));
+        }
+    });
+}
+
+void AsyncBlockStream::close() {
+    executor.post([stream = weak_ptr<AsyncBlockStream*>(alive)]() {
+        if (auto live = stream.lock()) {
+            (*live)->finishClose();
+        }
+    });
+}
+
+// **Moves blocks from the subscription into the stream on the executor thread**
+void AsyncBlockStream::attach(const shared_ptr<Subscription>& subscription) {
+    source = subscription;
+    Subscription* raw = subscription.get();
+    Executor* ex = &executor;
+    subscription->setNotify([ex, stream = weak_ptr<AsyncBlockStream*>(alive), raw]() {
+        ex->post([stream, raw]() {
+            // The stream keeps the subscription (source) alive as long as itself
+            auto live = stream.lock();
+            if (!live) {
+                return;
+            }
+            SharedBlock block;
+            while (raw->tryPop(block)) {
+                (*live)->deliver(move(block));
+            }
+        });
+    });
+}
+
+void AsyncBlockStream::deliver(SharedBlock block) {
+    if (closed) {
+        return;
+    }
+    if (waiter && queue.empty()) {
+        complete(waiter, AwaitStatus::Ok, move(block));
+        return;
+    }
+    if (queue.size() >= capacity) {
+        queue.pop_front();
+        dropped.inc();
+    }
+    queue.push_back(move(block));
+}
+
+void AsyncBlockStream::finishClose() {
+    closed = true;
+    if (waiter && queue.empty()) {
+        complete(waiter, AwaitStatus::Closed);
+    }
+}
+
+void AsyncBlockStream::complete(shared_ptr<Waiter> w, AwaitStatus status, SharedBlock block) {
+    if (w->done) {
+        return;
+    }
+    w->done = true;
+    w->result.status = status;
+    w->result.block = move(block);
+    w->token.unregister(w->cancelId);
+    if (waiter == w) {
+        waiter.reset();
+    }
+    // Resume from the run loop, not from inside the producer's call stack
+    coroutine_handle<> h = w->handle;
+    executor.post([h]() { h.resume(); });
+}
+
+AsyncBlockStream::NextAwaiter AsyncBlockStream::next(Executor::Clock::duration timeout, CancellationToken token) {
+    return NextAwaiter{*this, timeout, move(token), nullptr, {}};
+}
+
+bool AsyncBlockStream::NextAwaiter::await_ready() {
+    if (!stream.queue.empty()) {
+        immediate.status = AwaitStatus::Ok;
+        immediate.block = move(stream.queue.front());
+        stream.queue.pop_front();
+        return true;
+    }
+    if (stream.closed) {
+        immediate.status = AwaitStatus::Closed;
+        return true;
+    }
+    if (token.isCancelled()) {
+        immediate.status = AwaitStatus::Cancelled;
+        return true;
+    }
+    return false;
+}
+
+void AsyncBlockStream::NextAwaiter::await_suspend(coroutine_handle<> h) {
+    waiter = make_shared<Waiter>();
+    waiter->handle = h;
+    waiter->token = token;
+    stream.waiter = waiter;
+
+    // Both callbacks check done first, so stale timers never touch a finished
+    // waiter, and skip a stream that no longer exists
+    weak_ptr<AsyncBlockStream*> s = stream.alive;
+    shared_ptr<Waiter> w = waiter;
+    if (timeout != NO_TIMEOUT) {
+        stream.executor.postAt(Executor::Clock::now() + timeout, [s, w]() {
+            auto live = s.lock();
+            if (live && !w->done) {
+                (*live)->complete(w, AwaitStatus::Timeout);
+            }
+        });
+    }
+    Executor* executor = &stream.executor;
+    waiter->cancelId = token.onCancel([executor, s, w]() {
+        executor->post([s, w]() {
+            auto live = s.lock();
+            if (live && !w->done) {
+                (*live)->complete(w, AwaitStatus::Cancelled);
+            }
+        });
+    });
+}
+
+BlockResult AsyncBlockStream::NextAwaiter::await_resume() {
+    return waiter ? move(waiter->result) : move(immediate);
+}
+
+// ---------------------------------------------------------------------------
+// AsyncDevice
+// ---------------------------------------------------------------------------
+AsyncDevice::AsyncDevice(Executor& executor, ProWaveDAQ& daq, size_t capacity)
+    : executor(executor), daq(daq), stream(executor, "async", capacity) {
+    daq.setBlockSink([this](DataBlock&& block) {
+        stream.push(make_shared<const DataBlock>(move(block)));
+    });
+}
+
+AsyncDevice::~AsyncDevice() {
+    daq.setBlockSink(nullptr);
+}
+
+// **Reads between other coroutines: sleeps on the executor instead of in usleep()**
+Task<void> AsyncDevice::pump(CancellationToken token) {
+    if (daq.isReading()) {
+        cerr << "Error: pump() needs a device without a reader thread" << endl;
+        stream.close();
+        co_return;
+    }
+    daq.startPolling();
+    // **A frame-local guard: also runs if the suspended coroutine is destroyed**
+    struct PollingGuard {
+        ProWaveDAQ& daq;
+        ~PollingGuard() { daq.stopPolling(); }
+    } polling{daq};
+
+    while (daq.isReading() && !token.isCancelled()) {
+        int waitUs = daq.pollOnce();
+        if (waitUs > 0) {
+            co_await executor.sleepFor(chrono::microseconds(waitUs));
+        } else {
+            co_await executor.yield();
+        }
+    }
+    stream.close();
+}
+
+AsyncBlockStream::NextAwaiter AsyncDevice::nextBlock(Executor::Clock::duration timeout, CancellationToken token) {
+    return stream.next(timeout, move(token));
+}
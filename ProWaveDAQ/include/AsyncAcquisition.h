@@ -0,0 +1,351 @@
+#ifndef ASYNC_ACQUISITION_H
+#define ASYNC_ACQUISITION_H
+
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "BlockFanout.h"
+#include "ProWaveDAQ.h"
+
+using namespace std;
+
+// C++20 coroutine interface to the acquisition stream.
+//
+//   Task<void> consume(AsyncDevice& device) {
+//       while (BlockResult r = co_await device.nextBlock(chrono::seconds(1))) {
+//           process(*r.block);
+//       }
+//   }
+//
+// One Executor thread can drive the Modbus transactions of several devices
+// (AsyncDevice::pump) and any number of consumers, instead of one reader
+// thread per device plus one thread per consumer. Coroutines awaiting a
+// stream must run on that stream's executor.
+
+class Executor;
+
+// ---------------------------------------------------------------------------
+// Task<T>: lazily started coroutine; co_await starts it and resumes the
+// awaiting coroutine when it finishes. Errors are reported through return
+// values, as in the rest of the library; an escaping exception terminates.
+// ---------------------------------------------------------------------------
+template <typename T = void>
+class Task;
+
+namespace async_detail {
+
+// Resumes the awaiting coroutine (if any) when a task finishes.
+struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    template <typename Promise>
+    coroutine_handle<> await_suspend(coroutine_handle<Promise> done) noexcept {
+        coroutine_handle<> next = done.promise().continuation;
+        return next ? next : noop_coroutine();
+    }
+    void await_resume() noexcept {}
+};
+
+struct PromiseBase {
+    coroutine_handle<> continuation;
+
+    suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() noexcept { terminate(); }
+};
+
+} // namespace async_detail
+
+template <typename T>
+class Task {
+public:
+    struct promise_type : async_detail::PromiseBase {
+        optional<T> value;
+
+        Task get_return_object() { return Task(coroutine_handle<promise_type>::from_promise(*this)); }
+        void return_value(T v) { value = move(v); }
+    };
+
+    Task(Task&& other) noexcept : handle(exchange(other.handle, {})) {}
+    Task(const Task&) = delete;
+    ~Task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return false; }
+    coroutine_handle<> await_suspend(coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+    T await_resume() { return move(*handle.promise().value); }
+
+private:
+    explicit Task(coroutine_handle<promise_type> handle) : handle(handle) {}
+    coroutine_handle<promise_type> handle;
+};
+
+template <>
+class Task<void> {
+public:
+    struct promise_type : async_detail::PromiseBase {
+        Task get_return_object() { return Task(coroutine_handle<promise_type>::from_promise(*this)); }
+        void return_void() {}
+    };
+
+    Task(Task&& other) noexcept : handle(exchange(other.handle, {})) {}
+    Task(const Task&) = delete;
+    ~Task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return false; }
+    coroutine_handle<> await_suspend(coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+    void await_resume() {}
+
+private:
+    explicit Task(coroutine_handle<promise_type> handle) : handle(handle) {}
+    coroutine_handle<promise_type> handle;
+};
+
+// ---------------------------------------------------------------------------
+// Cancellation: a source cancels, tokens observe. A default token is never
+// cancelled. Callbacks run on the thread calling cancel().
+// ---------------------------------------------------------------------------
+class CancellationToken {
+public:
+    CancellationToken() = default;
+
+    bool isCancelled() const;
+
+    // Runs fn once on cancellation (right away if already cancelled).
+    // Returns an id for unregister(), 0 if fn was not kept.
+    uint64_t onCancel(function<void()> fn) const;
+    void unregister(uint64_t id) const;
+
+private:
+    friend class CancellationSource;
+
+    struct State {
+        mutex stateMutex;
+        bool cancelled = false;
+        uint64_t nextId = 1;
+        map<uint64_t, function<void()>> callbacks;
+    };
+    shared_ptr<State> state;
+
+    explicit CancellationToken(shared_ptr<State> state) : state(move(state)) {}
+};
+
+class CancellationSource {
+public:
+    CancellationSource() : state(make_shared<CancellationToken::State>()) {}
+
+    // Cancels every token of this source; callable from any thread.
+    void cancel();
+
+    CancellationToken token() const { return CancellationToken(state); }
+
+private:
+    shared_ptr<CancellationToken::State> state;
+};
+
+// ---------------------------------------------------------------------------
+// Executor: single-threaded run loop with timers. post() and spawn() may be
+// called from any thread.
+// ---------------------------------------------------------------------------
+class Executor {
+public:
+    using Clock = chrono::steady_clock;
+
+    Executor() = default;
+    ~Executor();
+
+    // Queues fn to run on the executor thread.
+    void post(function<void()> fn);
+
+    // Runs fn on the executor thread once when is reached.
+    void postAt(Clock::time_point when, function<void()> fn);
+
+    // Starts task on the executor; it owns itself until it finishes.
+    void spawn(Task<void> task);
+
+    // Runs on the calling thread until stop() or until every spawned task has finished.
+    void run();
+
+    // Makes run() return after the current callback.
+    void stop();
+
+    // co_await executor.sleepFor(d): resumes on the executor after d.
+    struct SleepAwaiter {
+        Executor& executor;
+        Clock::time_point until;
+
+        bool await_ready() const noexcept { return Clock::now() >= until; }
+        void await_suspend(coroutine_handle<> h) {
+            executor.postAt(until, [h]() { h.resume(); });
+        }
+        void await_resume() const noexcept {}
+    };
+    SleepAwaiter sleepFor(Clock::duration d) { return SleepAwaiter{*this, Clock::now() + d}; }
+
+    // co_await executor.yield(): lets other ready coroutines run first.
+    struct YieldAwaiter {
+        Executor& executor;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(coroutine_handle<> h) {
+            executor.post([h]() { h.resume(); });
+        }
+        void await_resume() const noexcept {}
+    };
+    YieldAwaiter yield() { return YieldAwaiter{*this}; }
+
+private:
+    struct Timer {
+        Clock::time_point when;
+        uint64_t order;           // FIFO among equal deadlines
+        function<void()> fn;
+
+        bool operator>(const Timer& other) const {
+            return when != other.when ? when > other.when : order > other.order;
+        }
+    };
+
+    mutex queueMutex;
+    condition_variable wakeup;
+    deque<function<void()>> ready;
+    priority_queue<Timer, vector<Timer>, greater<Timer>> timers;
+    uint64_t timerOrder = 0;
+    bool stopped = false;
+    int liveTasks = 0;            // Spawned tasks not yet finished (guarded by queueMutex)
+
+    void taskFinished();
+};
+
+// Outcome of co_await on a block stream.
+enum class AwaitStatus { Ok, Timeout, Cancelled, Closed };
+
+struct BlockResult {
+    AwaitStatus status = AwaitStatus::Closed;
+    SharedBlock block;            // Set when status == AwaitStatus::Ok
+
+    explicit operator bool() const { return status == AwaitStatus::Ok; }
+};
+
+// ---------------------------------------------------------------------------
+// AsyncBlockStream: blocks queued for one awaiting consumer on an executor.
+// push() may be called from any thread; when full the oldest block is dropped.
+// Destroy it on the executor thread or once the executor stopped running:
+// callbacks it posted that are still queued are then skipped.
+// ---------------------------------------------------------------------------
+class AsyncBlockStream {
+public:
+    static constexpr Executor::Clock::duration NO_TIMEOUT = Executor::Clock::duration::max();
+
+    AsyncBlockStream(Executor& executor, const string& name, size_t capacity = 256);
+    ~AsyncBlockStream();
+
+    void push(SharedBlock block);
+
+    // Ends the stream; a pending and every later next() complete with Closed
+    // once the queue is drained.
+    void close();
+
+    // Feeds the stream from a BlockFanout subscription (via its notify hook).
+    void attach(const shared_ptr<Subscription>& subscription);
+
+    struct NextAwaiter;
+
+    // co_await stream.next(timeout, token) -> BlockResult
+    NextAwaiter next(Executor::Clock::duration timeout = NO_TIMEOUT, CancellationToken token = {});
+
+    struct Waiter {
+        coroutine_handle<> handle;
+        BlockResult result;
+        bool done = false;
+        CancellationToken token;
+        uint64_t cancelId = 0;
+    };
+
+    struct NextAwaiter {
+        AsyncBlockStream& stream;
+        Executor::Clock::duration timeout;
+        CancellationToken token;
+        shared_ptr<Waiter> waiter;
+        BlockResult immediate;
+
+        bool await_ready();
+        void await_suspend(coroutine_handle<> h);
+        BlockResult await_resume();
+    };
+
+private:
+    Executor& executor;
+    size_t capacity;
+    MetricCounter& dropped;
+
+    // Posted callbacks hold a weak_ptr to it and do nothing once it expired
+    shared_ptr<AsyncBlockStream*> alive;
+
+    // Executor thread only
+    deque<SharedBlock> queue;
+    bool closed = false;
+    shared_ptr<Waiter> waiter;    // Single consumer
+
+    shared_ptr<Subscription> source;
+
+    // Executor thread: queue or hand over one block.
+    void deliver(SharedBlock block);
+    void finishClose();
+
+    // Completes the waiter once (executor thread) and resumes it. w is taken
+    // by value: it is often the waiter member that is reset here.
+    void complete(shared_ptr<Waiter> w, AwaitStatus status, SharedBlock block = nullptr);
+};
+
+// ---------------------------------------------------------------------------
+// AsyncDevice: co_await device.nextBlock() on a ProWaveDAQ.
+//
+// Either call pump() on the executor (no reader thread; Modbus transactions
+// run on the executor between other coroutines), or start the device with
+// startReading() and only await blocks. AsyncDevice installs itself as the
+// device's block sink, so it is used instead of a BlockFanout on that device;
+// for several consumers use a BlockFanout and AsyncBlockStream::attach().
+// ---------------------------------------------------------------------------
+class AsyncDevice {
+public:
+    AsyncDevice(Executor& executor, ProWaveDAQ& daq, size_t capacity = 256);
+    ~AsyncDevice();
+
+    // Drives daq.pollOnce() until token is cancelled or reading stops, then closes the stream.
+    // Polling is stopped however pump() ends, also when its frame is destroyed while suspended.
+    Task<void> pump(CancellationToken token = {});
+
+    AsyncBlockStream::NextAwaiter nextBlock(Executor::Clock::duration timeout = AsyncBlockStream::NO_TIMEOUT,
+                                            CancellationToken token = {});
+
+private:
+    Executor& executor;
+    ProWaveDAQ& daq;
+    AsyncBlockStream stream;
+};
+
+#endif // ASYNC_ACQUISITION_H
@@ -0,0 +1,610 @@
+#include "AsyncFileWriter.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+bool parseWriterBackend(const string& name, WriterBackend& backend) {
+    if (name == "auto") {
+        backend = WriterBackend::Auto;
+    } else if (name == "io_uring") {
+        backend = WriterBackend::IoUring;
+    } else if (name == "threads") {
+        backend = WriterBackend::Threads;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* writerBackendName(WriterBackend backend) {
+    switch (backend) {
+    case WriterBackend::IoUring: return "io_uring";
+    case WriterBackend::Threads: return "threads";
+    default: return "auto";
+    }
+}
+
+unique_ptr<AsyncFileWriter> AsyncFileWriter::create(const WriterOptions& options) {
+    if (options.backend != WriterBackend::Threads) {
+        unique_ptr<IoUringFileWriter> writer = IoUringFileWriter::create(options);
+        if (writer) {
+            return writer;
+        }
+        static atomic<bool> warned(false);
+        if (!warned.exchange(true)) {
+            cerr << "io_uring unavailable (" << strerror(errno) << "), using the thread-pool writer" << endl;
+        }
+    }
+    return make_unique<ThreadPoolFileWriter>(options);
+}
+
+AsyncFileWriter::AsyncFileWriter(const WriterOptions& options, const char* name)
+    : name(name), directRequested(options.direct), direct(false),
+      bufferSize((max<size_t>(options.bufferSize, ALIGNMENT) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT),
+      fd(-1), failed(false), current(-1), fill(0), bufferOffset(0), fileSize(0), nextSeq(0),
+      rewriteSeq(0), rewritePending(false), syncTarget(0), syncInFlight(false),
+      writeLatency(Metrics::instance().latency("prowavedaq_file_write_seconds",
+          "Submission to completion of each file write", Metrics::label("backend", name))),
+      syncLatency(Metrics::instance().latency("prowavedaq_file_sync_seconds",
+          "Duration of each batched fdatasync", Metrics::label("backend", name))),
+      bufferWait(Metrics::instance().latency("prowavedaq_file_buffer_wait_seconds",
+          "Time a writer waited for a free buffer", Metrics::label("backend", name))),
+      syncRequests(Metrics::instance().counter("prowavedaq_file_sync_requests_total",
+          "Sync requests, before batching", Metrics::label("backend", name))),
+      syncsIssued(Metrics::instance().counter("prowavedaq_file_syncs_total",
+          "fdatasync calls issued", Metrics::label("backend", name))),
+      errors(Metrics::instance().counter("prowavedaq_file_errors_total",
+          "Failed file writes and syncs", Metrics::label("backend", name))) {
+    int count = max(options.queueDepth, 2);
+    for (int i = 0; i < count; i++) {
+        // **Aligned for O_DIRECT; the same buffers are registered with io_uring**
+        buffers.push_back(static_cast<char*>(aligned_alloc(ALIGNMENT, bufferSize)));
+        freeBuffers.push_back(count - 1 - i);
+    }
+    writes.resize(count);
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+    for (char* buffer : buffers) {
+        free(buffer);
+    }
+}
+
+bool AsyncFileWriter::open(const string& newPath) {
+    close();
+
+    lock_guard<mutex> lock(writerMutex);
+    direct = false;
+    if (directRequested) {
+        fd = ::open(newPath.c_str(), O_WRONLY | O_CREAT | O_DIRECT, 0644);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size % ALIGNMENT == 0) {
+            direct = true;
+        } else {
+            // **Unsupported filesystem, or an unaligned existing file to append to**
+            static atomic<bool> warned(false);
+            if (!warned.exchange(true)) {
+                cerr << "Warning: direct I/O unavailable for " << newPath << ", writing buffered" << endl;
+            }
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            fd = -1;
+        }
+    }
+    if (!direct) {
+        fd = ::open(newPath.c_str(), O_WRONLY | O_CREAT, 0644);
+    }
+    if (fd < 0) {
+        cerr << "Error: Unable to open " << newPath << ": " << strerror(errno) << endl;
+        return false;
+    }
+
+    off_t end = lseek(fd, 0, SEEK_END);
+    path = newPath;
+    failed = false;
+    fileSize = bufferOffset = end > 0 ? static_cast<uint64_t>(end) : 0;
+    fill = 0;
+    rewritePending = false;
+    return true;
+}
+
+bool AsyncFileWriter::append(const void* data, size_t size) {
+    unique_lock<mutex> lock(writerMutex);
+    if (fd < 0 || failed) {
+        return false;
+    }
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        if (current < 0) {
+            current = takeBuffer(lock);
+            fill = 0;
+        }
+        size_t n = min(size, bufferSize - fill);
+        memcpy(buffers[current] + fill, bytes, n);
+        fill += n;
+        fileSize += n;
+        bytes += n;
+        size -= n;
+        if (fill == bufferSize) {
+            submitCurrent(lock);
+        }
+    }
+    return !failed;
+}
+
+void AsyncFileWriter::sync(SyncCallback done) {
+    unique_lock<mutex> lock(writerMutex);
+    if (fd < 0) {
+        lock.unlock();
+        if (done) {
+            done(true);
+        }
+        return;
+    }
+    submitCurrent(lock);
+    requestedSyncs.push_back(move(done));
+    syncTarget = nextSeq;
+    syncRequests.inc();
+    maybeIssueSync();
+}
+
+bool AsyncFileWriter::close() {
+    unique_lock<mutex> lock(writerMutex);
+    if (fd < 0) {
+        return true;
+    }
+    submitCurrent(lock);
+    changed.wait(lock, [this]() { return inFlight.empty(); });
+    if (current >= 0) {
+        freeBuffers.push_back(current);   // Tail already written (direct I/O)
+        current = -1;
+    }
+    if (direct && fileSize % ALIGNMENT != 0 && ftruncate(fd, fileSize) != 0) {
+        fail("truncate", errno);
+    }
+
+    requestedSyncs.push_back(nullptr);
+    syncTarget = nextSeq;
+    syncRequests.inc();
+    maybeIssueSync();
+    changed.wait(lock, [this]() { return !syncInFlight && requestedSyncs.empty(); });
+
+    ::close(fd);
+    fd = -1;
+    return !failed;
+}
+
+int AsyncFileWriter::takeBuffer(unique_lock<mutex>& lock) {
+    if (freeBuffers.empty()) {
+        auto start = chrono::steady_clock::now();
+        changed.wait(lock, [this]() { return !freeBuffers.empty(); });
+        bufferWait.recordSince(start);
+    }
+    int buffer = freeBuffers.back();
+    freeBuffers.pop_back();
+    return buffer;
+}
+
+void AsyncFileWriter::submitCurrent(unique_lock<mutex>& lock) {
+    if (current < 0 || fill == 0) {
+        return;
+    }
+    if (rewritePending) {
+        // **Never let two writes of the same block race**
+        changed.wait(lock, [this]() { return inFlight.count(rewriteSeq) == 0; });
+        rewritePending = false;
+    }
+
+    int buffer = current;
+    size_t length = fill;
+    size_t tail = direct ? fill % ALIGNMENT : 0;
+    if (tail > 0) {
+        length = fill - tail + ALIGNMENT;
+        memset(buffers[buffer] + fill, 0, length - fill);
+    }
+
+    Write& write = writes[buffer];
+    write.seq = nextSeq++;
+    write.length = length;
+    write.submitted = chrono::steady_clock::now();
+    inFlight.insert(write.seq);
+    uint64_t offset = bufferOffset;
+    current = -1;
+    submitWrite(fd, buffer, offset, length);
+
+    if (tail > 0) {
+        // **Carry the partial block over; the next write rewrites it in place**
+        int next = takeBuffer(lock);
+        memmove(buffers[next], buffers[buffer] + fill - tail, tail);
+        current = next;
+        fill = tail;
+        bufferOffset = offset + length - ALIGNMENT;
+        rewriteSeq = write.seq;
+        rewritePending = true;
+    } else {
+        fill = 0;
+        bufferOffset = offset + length;
+    }
+}
+
+void AsyncFileWriter::maybeIssueSync() {
+    if (syncInFlight || requestedSyncs.empty() || fd < 0) {
+        return;
+    }
+    if (!inFlight.empty() && *inFlight.begin() < syncTarget) {
+        return;   // Issued from writeCompleted() once the covered writes are done
+    }
+    issuedSyncs = move(requestedSyncs);
+    requestedSyncs.clear();
+    syncInFlight = true;
+    syncStarted = chrono::steady_clock::now();
+    syncsIssued.inc();
+    submitSync(fd);
+}
+
+void AsyncFileWriter::writeCompleted(int buffer, long result) {
+    {
+        lock_guard<mutex> lock(writerMutex);
+        Write& write = writes[buffer];
+        writeLatency.recordSince(write.submitted);
+        if (result < 0) {
+            fail("write", static_cast<int>(-result));
+        } else if (static_cast<size_t>(result) != write.length) {
+            fail("write", EIO);
+        }
+        inFlight.erase(write.seq);
+        freeBuffers.push_back(buffer);
+        maybeIssueSync();
+    }
+    changed.notify_all();
+}
+
+void AsyncFileWriter::syncCompleted(int result) {
+    vector<SyncCallback> callbacks;
+    bool ok;
+    {
+        lock_guard<mutex> lock(writerMutex);
+        syncLatency.recordSince(syncStarted);
+        if (result < 0) {
+            fail("sync", -result);
+        }
+        ok = !failed;
+        callbacks = move(issuedSyncs);
+        issuedSyncs.clear();
+    }
+
+    // **Callbacks run before the next sync is issued; close() waits for them**
+    for (const SyncCallback& callback : callbacks) {
+        if (callback) {
+            callback(ok);
+        }
+    }
+    {
+        lock_guard<mutex> lock(writerMutex);
+        syncInFlight = false;
+        maybeIssueSync();
+    }
+    changed.notify_all();
+}
+
+void AsyncFileWriter::fail(const string& what, int error) {
+    errors.inc();
+    if (!failed) {
+        cerr << "Error: Failed to " << what << " " << path << ": " << strerror(error) << endl;
+    }
+    failed = true;
+}
+
+// ---------------------------------------------------------------------------
+// io_uring backend
+// ---------------------------------------------------------------------------
+
+static const uint64_t SYNC_TAG = ~0ULL - 1;
+static const uint64_t WAKE_TAG = ~0ULL;
+
+static int ioUringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int ioUringEnter(int ringFd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+static int ioUringRegister(int ringFd, unsigned opcode, const void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, ringFd, opcode, arg, count));
+}
+
+// The mapped submission and completion rings.
+struct IoUringFileWriter::Ring {
+    int fd = -1;
+    io_uring_params params{};
+    void* sqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    void* cqRing = MAP_FAILED;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    mutex submitMutex;
+
+    ~Ring() {
+        if (sqes != MAP_FAILED) {
+            munmap(sqes, sqesSize);
+        }
+        if (cqRing != MAP_FAILED && cqRing != sqRing) {
+            munmap(cqRing, cqRingSize);
+        }
+        if (sqRing != MAP_FAILED) {
+            munmap(sqRing, sqRingSize);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    bool map() {
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) {
+            sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+        }
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) {
+            return false;
+        }
+        cqRing = single ? sqRing
+                        : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            return false;
+        }
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(
+            mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+
+        char* sq = static_cast<char*>(sqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        char* cq = static_cast<char*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // True when the kernel implements every opcode the writer uses.
+    bool supportsOpcodes() {
+        const unsigned slots = 256;
+        vector<char> storage(sizeof(io_uring_probe) + slots * sizeof(io_uring_probe_op));
+        io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+        if (ioUringRegister(fd, IORING_REGISTER_PROBE, probe, slots) < 0) {
+            return false;
+        }
+        for (unsigned op : {IORING_OP_NOP, IORING_OP_WRITE, IORING_OP_WRITE_FIXED, IORING_OP_FSYNC}) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+unique_ptr<IoUringFileWriter> IoUringFileWriter::create(const WriterOptions& options) {
+    auto ring = make_unique<Ring>();
+    // **Writes in flight, one fsync and the wake-up NOP never exceed the ring**
+    ring->fd = ioUringSetup(static_cast<unsigned>(max(options.queueDepth, 2) + 2), &ring->params);
+    if (ring->fd < 0) {
+        return nullptr;
+    }
+    if (!ring->map()) {
+        return nullptr;
+    }
+    if (!ring->supportsOpcodes()) {
+        errno = ENOSYS;
+        return nullptr;
+    }
+    return unique_ptr<IoUringFileWriter>(new IoUringFileWriter(options, move(ring)));
+}
+
+IoUringFileWriter::IoUringFileWriter(const WriterOptions& options, unique_ptr<Ring> newRing)
+    : AsyncFileWriter(options, "io_uring"), ring(move(newRing)), registered(false) {
+    vector<iovec> iovecs;
+    for (char* buffer : getBuffers()) {
+        iovecs.push_back(iovec{buffer, getBufferSize()});
+    }
+    // **Registration pins the buffers; it can fail under a low RLIMIT_MEMLOCK**
+    registered = ioUringRegister(ring->fd, IORING_REGISTER_BUFFERS, iovecs.data(), iovecs.size()) == 0;
+    reaper = thread(&IoUringFileWriter::reapLoop, this);
+}
+
+IoUringFileWriter::~IoUringFileWriter() {
+    close();
+    submit([](void* sqe) {
+        io_uring_sqe* s = static_cast<io_uring_sqe*>(sqe);
+        s->opcode = IORING_OP_NOP;
+        s->user_data = WAKE_TAG;
+    });
+    reaper.join();
+}
+
+void IoUringFileWriter::submitWrite(int fd, int buffer, uint64_t offset, size_t length) {
+    char* data = getBuffers()[buffer];
+    bool fixed = registered;
+    submit([&](void* sqe) {
+        io_uring_sqe* s = static_cast<io_uring_sqe*>(sqe);
+        s->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        s->fd = fd;
+        s->off = offset;
+        s->addr = reinterpret_cast<uint64_t>(data);
+        s->len = static_cast<uint32_t>(length);
+        if (fixed) {
+            s->buf_index = static_cast<uint16_t>(buffer);
+        }
+        s->user_data = static_cast<uint64_t>(buffer);
+    });
+}
+
+void IoUringFileWriter::submitSync(int fd) {
+    submit([&](void* sqe) {
+        io_uring_sqe* s = static_cast<io_uring_sqe*>(sqe);
+        s->opcode = IORING_OP_FSYNC;
+        s->fd = fd;
+        s->fsync_flags = IORING_FSYNC_DATASYNC;
+        s->user_data = SYNC_TAG;
+    });
+}
+
+void IoUringFileWriter::submit(const function<void(void* sqe)>& prepare) {
+    lock_guard<mutex> lock(ring->submitMutex);
+    unsigned tail = *ring->sqTail;
+    unsigned index = tail & ring->sqMask;
+    io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    prepare(sqe);
+    ring->sqArray[index] = index;
+    atomic_ref<unsigned>(*ring->sqTail).store(tail + 1, memory_order_release);
+
+    // **Submit everything the kernel has not consumed yet (earlier failed enters included)**
+    while (true) {
+        unsigned pending = tail + 1 - atomic_ref<unsigned>(*ring->sqHead).load(memory_order_acquire);
+        if (pending == 0 || ioUringEnter(ring->fd, pending, 0, 0) >= 0) {
+            return;
+        }
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            cerr << "Error: io_uring submission failed: " << strerror(errno) << endl;
+            return;
+        }
+    }
+}
+
+void IoUringFileWriter::reapLoop() {
+    while (true) {
+        if (ioUringEnter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            if (errno != EAGAIN && errno != EBUSY) {
+                cerr << "Error: io_uring wait failed: " << strerror(errno) << endl;
+                return;
+            }
+        }
+
+        bool wake = false;
+        unsigned head = *ring->cqHead;
+        unsigned tail = atomic_ref<unsigned>(*ring->cqTail).load(memory_order_acquire);
+        while (head != tail) {
+            io_uring_cqe cqe = ring->cqes[head & ring->cqMask];
+            atomic_ref<unsigned>(*ring->cqHead).store(++head, memory_order_release);
+            if (cqe.user_data == WAKE_TAG) {
+                wake = true;
+            } else if (cqe.user_data == SYNC_TAG) {
+                syncCompleted(cqe.res);
+            } else {
+                writeCompleted(static_cast<int>(cqe.user_data), cqe.res);
+            }
+        }
+        if (wake) {
+            return;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Thread-pool backend
+// ---------------------------------------------------------------------------
+
+ThreadPoolFileWriter::ThreadPoolFileWriter(const WriterOptions& options)
+    : AsyncFileWriter(options, "threads"), stopping(false) {
+    for (int i = 0; i < max(options.threads, 1); i++) {
+        workers.emplace_back(&ThreadPoolFileWriter::workerLoop, this);
+    }
+}
+
+ThreadPoolFileWriter::~ThreadPoolFileWriter() {
+    close();
+    {
+        lock_guard<mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobReady.notify_all();
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPoolFileWriter::submitWrite(int fd, int buffer, uint64_t offset, size_t length) {
+    {
+        lock_guard<mutex> lock(jobMutex);
+        jobs.push_back(Job{false, fd, buffer, offset, length});
+    }
+    jobReady.notify_one();
+}
+
+void ThreadPoolFileWriter::submitSync(int fd) {
+    {
+        lock_guard<mutex> lock(jobMutex);
+        jobs.push_back(Job{true, fd, -1, 0, 0});
+    }
+    jobReady.notify_one();
+}
+
+void ThreadPoolFileWriter::workerLoop() {
+    while (true) {
+        Job job;
+        {
+            unique_lock<mutex> lock(jobMutex);
+            jobReady.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (jobs.empty()) {
+                return;
+            }
+            job = jobs.front();
+            jobs.pop_front();
+        }
+
+        if (job.sync) {
+            TRACE_SPAN("fsync");
+            syncCompleted(fdatasync(job.fd) == 0 ? 0 : -errno);
+            continue;
+        }
+
+        const char* data = getBuffers()[job.buffer];
+        long result = 0;
+        while (static_cast<size_t>(result) < job.length) {
+            ssize_t n = pwrite(job.fd, data + result, job.length - result, job.offset + result);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                result = n < 0 ? -errno : result;
+                break;
+            }
+            result += n;
+        }
+        writeCompleted(job.buffer, result);
+    }
+}
@@ -0,0 +1,201 @@
+#ifndef ASYNC_FILE_WRITER_H
+#define ASYNC_FILE_WRITER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Metrics.h"
+
+using namespace std;
+
+enum class WriterBackend {
+    Auto,       // io_uring when the kernel allows it, else the thread pool
+    IoUring,
+    Threads
+};
+
+bool parseWriterBackend(const string& name, WriterBackend& backend);
+const char* writerBackendName(WriterBackend backend);
+
+struct WriterOptions {
+    WriterBackend backend = WriterBackend::Auto;
+    size_t bufferSize = 256 * 1024;   // Bytes per write submitted to the kernel
+    int queueDepth = 8;               // Buffers: writes in flight plus the one being filled
+    bool direct = false;              // O_DIRECT (falls back to buffered where unsupported)
+    int threads = 2;                  // Workers of the thread-pool backend
+    bool mapped = false;              // CSVWriter: preallocated, memory-mapped segments instead
+};
+
+// AsyncFileWriter appends to one file at a time without the caller ever
+// waiting for write() or fsync(). append() copies into a pool of aligned
+// buffers; each full buffer is submitted as a positioned write and the caller
+// only waits when all queueDepth buffers are in flight. sync() requests are
+// batched: one fdatasync is issued once every write before it has completed,
+// covering all requests made until then, and their callbacks run on the
+// backend's thread when it returns.
+//
+// With direct I/O, writes are padded to 4 KiB. A sync with a partial tail
+// writes it padded and rewrites that block later, so the file may end in
+// zeros until close() truncates it to its real size.
+//
+// The base class owns buffers, ordering and batching; backends only submit
+// writes and syncs and report completions. One caller thread at a time (the
+// owner serialises its calls); sync callbacks run on a backend thread.
+class AsyncFileWriter {
+public:
+    using SyncCallback = function<void(bool ok)>;
+
+    // Backend per options.backend; Auto falls back to the thread pool when
+    // io_uring cannot be set up. Never returns nullptr.
+    static unique_ptr<AsyncFileWriter> create(const WriterOptions& options = WriterOptions());
+
+    virtual ~AsyncFileWriter();
+
+    // Closes the previous file and opens path for appending.
+    bool open(const string& path);
+    bool isOpen() const { return fd >= 0; }
+
+    // Queues bytes; false once a write has failed.
+    bool append(const void* data, size_t size);
+
+    // Submits buffered bytes and requests an fdatasync; done (may be empty)
+    // runs on the backend's thread once everything appended so far is durable.
+    void sync(SyncCallback done = nullptr);
+
+    // Writes and syncs everything, waits for it, and closes the file.
+    bool close();
+
+    const char* backendName() const { return name; }
+    bool isDirect() const { return direct; }
+    uint64_t size() const { return fileSize; }
+
+protected:
+    static constexpr size_t ALIGNMENT = 4096;
+
+    AsyncFileWriter(const WriterOptions& options, const char* name);
+
+    const vector<char*>& getBuffers() const { return buffers; }
+    size_t getBufferSize() const { return bufferSize; }
+
+    // Backend hooks, called with the writer's lock held; must not block.
+    virtual void submitWrite(int fd, int buffer, uint64_t offset, size_t length) = 0;
+    virtual void submitSync(int fd) = 0;
+
+    // Backend completions (any thread, without the writer's lock).
+    // result: bytes written or -errno.
+    void writeCompleted(int buffer, long result);
+    void syncCompleted(int result);
+
+private:
+    struct Write {
+        uint64_t seq = 0;
+        size_t length = 0;
+        chrono::steady_clock::time_point submitted;
+    };
+
+    const char* name;
+    bool directRequested;
+    bool direct;             // Current file is open with O_DIRECT
+    size_t bufferSize;
+
+    mutex writerMutex;
+    condition_variable changed;
+    vector<char*> buffers;
+    vector<int> freeBuffers;
+    vector<Write> writes;           // By buffer index, while in flight
+
+    int fd;
+    string path;
+    bool failed;
+    int current;                    // Buffer being filled, -1 if none
+    size_t fill;
+    uint64_t bufferOffset;          // File offset of the current buffer
+    uint64_t fileSize;              // Bytes appended to the current file
+    uint64_t nextSeq;
+    set<uint64_t> inFlight;         // Sequence numbers of incomplete writes
+    uint64_t rewriteSeq;            // Write that must finish before its block is rewritten (direct I/O)
+    bool rewritePending;
+
+    vector<SyncCallback> requestedSyncs;  // Waiting for their writes
+    uint64_t syncTarget;                  // Writes with seq < syncTarget must complete first
+    vector<SyncCallback> issuedSyncs;     // Covered by the fdatasync in flight
+    bool syncInFlight;
+    chrono::steady_clock::time_point syncStarted;
+
+    HdrHistogram& writeLatency;     // Submit to completion of each write
+    HdrHistogram& syncLatency;      // Issue to completion of each fdatasync
+    HdrHistogram& bufferWait;       // Time append() waited for a free buffer
+    MetricCounter& syncRequests;
+    MetricCounter& syncsIssued;
+    MetricCounter& errors;
+
+    // Waits for a free buffer.
+    int takeBuffer(unique_lock<mutex>& lock);
+
+    void submitCurrent(unique_lock<mutex>& lock);
+    void maybeIssueSync();
+    void fail(const string& what, int error);
+};
+
+// io_uring backend: writes with IORING_OP_WRITE_FIXED from registered buffers
+// (plain IORING_OP_WRITE when registration is refused) and syncs with
+// IORING_OP_FSYNC; one thread reaps completions. Uses the raw system calls.
+class IoUringFileWriter : public AsyncFileWriter {
+public:
+    // nullptr (with errno set) when the kernel does not allow io_uring.
+    static unique_ptr<IoUringFileWriter> create(const WriterOptions& options);
+    ~IoUringFileWriter() override;
+
+private:
+    struct Ring;
+
+    unique_ptr<Ring> ring;
+    bool registered;        // Buffers registered with the ring
+    thread reaper;
+
+    IoUringFileWriter(const WriterOptions& options, unique_ptr<Ring> ring);
+
+    void submitWrite(int fd, int buffer, uint64_t offset, size_t length) override;
+    void submitSync(int fd) override;
+
+    // Queues one SQE set up by prepare and enters the kernel.
+    void submit(const function<void(void* sqe)>& prepare);
+    void reapLoop();
+};
+
+// Portable backend: a small pool of threads running pwrite() and fdatasync().
+class ThreadPoolFileWriter : public AsyncFileWriter {
+public:
+    explicit ThreadPoolFileWriter(const WriterOptions& options);
+    ~ThreadPoolFileWriter() override;
+
+private:
+    struct Job {
+        bool sync = false;
+        int fd = -1;
+        int buffer = -1;
+        uint64_t offset = 0;
+        size_t length = 0;
+    };
+
+    mutex jobMutex;
+    condition_variable jobReady;
+    deque<Job> jobs;
+    bool stopping;
+    vector<thread> workers;
+
+    void submitWrite(int fd, int buffer, uint64_t offset, size_t length) override;
+    void submitSync(int fd) override;
+    void workerLoop();
+};
+
+#endif // ASYNC_FILE_WRITER_H
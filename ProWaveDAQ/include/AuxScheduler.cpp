@@ -0,0 +1,75 @@
+#include "AuxScheduler.h"
+
+#include <sstream>
+
+bool parseAuxRegister(const string& name, const string& spec, AuxRegister& reg) {
+    istringstream in(spec);
+    string address, type;
+    AuxRegister parsed;
+    parsed.name = name;
+    if (!(in >> address >> parsed.count >> parsed.periodMs >> parsed.priority)) {
+        return false;
+    }
+    try {
+        parsed.address = stoi(address, nullptr, 0);
+    } catch (const exception&) {
+        return false;
+    }
+    if (in >> type) {
+        if (type != "holding" && type != "input") {
+            return false;
+        }
+        parsed.holding = type == "holding";
+    }
+    // Modbus reads at most 125 registers
+    if (parsed.address < 0 || parsed.address > 0xFFFF || parsed.count < 1 || parsed.count > 125 ||
+        parsed.periodMs < 1) {
+        return false;
+    }
+    reg = parsed;
+    return true;
+}
+
+AuxScheduler::AuxScheduler(int baudRate) : baudRate(baudRate > 0 ? baudRate : 9600) {}
+
+void AuxScheduler::add(const AuxRegister& reg) {
+    // **Until measured: RTU frame time (8-byte request, 5 + 2n byte response, 10 bits/byte) plus 1 ms turnaround**
+    double frameUs = (8 + 5 + 2.0 * reg.count) * 10 * 1e6 / baudRate;
+    entries.push_back(Entry{reg, chrono::steady_clock::time_point(), frameUs + 1000});
+}
+
+int AuxScheduler::next(chrono::steady_clock::time_point now, double budgetUs) const {
+    int best = -1;
+    for (size_t i = 0; i < entries.size(); i++) {
+        const Entry& e = entries[i];
+        if (e.due > now || e.expectedUs > budgetUs) {
+            continue;
+        }
+        if (best < 0 || e.reg.priority < entries[best].reg.priority ||
+            (e.reg.priority == entries[best].reg.priority && e.due < entries[best].due)) {
+            best = static_cast<int>(i);
+        }
+    }
+    return best;
+}
+
+chrono::nanoseconds AuxScheduler::completed(int index, chrono::steady_clock::time_point now,
+                                            chrono::nanoseconds duration) {
+    Entry& e = entries[index];
+    // Started at now - duration; the read was due at e.due
+    chrono::nanoseconds late = chrono::duration_cast<chrono::nanoseconds>((now - duration) - e.due);
+    e.expectedUs = 0.75 * e.expectedUs + 0.25 * chrono::duration<double, micro>(duration).count();
+
+    // **Keep the period, but never queue up missed reads**
+    e.due += chrono::milliseconds(e.reg.periodMs);
+    if (e.due <= now) {
+        e.due = now + chrono::milliseconds(e.reg.periodMs);
+    }
+    return late < chrono::nanoseconds(0) ? chrono::nanoseconds(0) : late;
+}
+
+void AuxScheduler::restart(chrono::steady_clock::time_point now) {
+    for (Entry& e : entries) {
+        e.due = now;
+    }
+}
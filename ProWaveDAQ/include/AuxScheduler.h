@@ -0,0 +1,69 @@
+#ifndef AUX_SCHEDULER_H
+#define AUX_SCHEDULER_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// An auxiliary register block polled besides the vibration FIFO.
+struct AuxRegister {
+    string name;             // Metrics label and stream key, e.g. "chipId"
+    int address = 0;
+    int count = 1;           // Registers per read
+    int periodMs = 1000;     // Read at most this often
+    int priority = 1;        // Lower is more urgent among due reads
+    bool holding = false;    // Holding registers (0x03) instead of input registers (0x04)
+};
+
+// One auxiliary read, timestamped like DataBlock.
+struct AuxSample {
+    string name;
+    int address = 0;
+    bool ok = false;
+    vector<uint16_t> values;                       // Empty when the read failed
+    chrono::steady_clock::time_point acquiredAt;
+    uint64_t sampleIndex = 0;                      // Vibration samples acquired before this read
+};
+
+// Parses "address registers periodMs priority [holding]" (address in decimal or 0x hex).
+bool parseAuxRegister(const string& name, const string& spec, AuxRegister& reg);
+
+// Decides which auxiliary read, if any, fits into an idle slot of the bus.
+// The reading loop offers a time budget whenever the data stream is idle;
+// the scheduler returns the most urgent due register whose expected
+// transaction time fits, and learns each register's transaction time.
+class AuxScheduler {
+public:
+    explicit AuxScheduler(int baudRate = 3000000);
+
+    void add(const AuxRegister& reg);
+    bool empty() const { return entries.empty(); }
+    size_t size() const { return entries.size(); }
+    const AuxRegister& get(int index) const { return entries[index].reg; }
+
+    // Index of the due register (lowest priority value, then longest overdue)
+    // whose expected time fits budgetUs, or -1.
+    int next(chrono::steady_clock::time_point now, double budgetUs) const;
+
+    // Records a finished read and schedules the register's next one.
+    // Returns how late the read was against its due time.
+    chrono::nanoseconds completed(int index, chrono::steady_clock::time_point now, chrono::nanoseconds duration);
+
+    // Starts every register over as due now.
+    void restart(chrono::steady_clock::time_point now);
+
+private:
+    struct Entry {
+        AuxRegister reg;
+        chrono::steady_clock::time_point due;
+        double expectedUs;   // Smoothed transaction time
+    };
+
+    int baudRate;
+    vector<Entry> entries;
+};
+
+#endif // AUX_SCHEDULER_H
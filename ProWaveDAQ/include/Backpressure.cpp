@@ -0,0 +1,116 @@
+#include "Backpressure.h"
+
+#include <algorithm>
+
+BackpressureController::BackpressureController(const BackpressureSettings& settings)
+    : settings(settings), level(0), maxLevel(RATE_LEVEL - 1) {
+    reset();
+}
+
+void BackpressureController::reset() {
+    level = 0;
+    windowStart = chrono::steady_clock::time_point();
+    windowSum = 0;
+    windowCount = 0;
+    depth = 0;
+    trend = 0;
+    primed = false;
+    lastChange = chrono::steady_clock::time_point();
+    pressured = false;
+    low = false;
+    recovered = false;
+    recoverDelay = chrono::milliseconds(settings.recoverMs);
+}
+
+void BackpressureController::setMaxLevel(int newMax) {
+    maxLevel = newMax < 0 ? 0 : newMax;
+    if (level > maxLevel) {
+        level = maxLevel;
+    }
+}
+
+const char* BackpressureController::levelName(int level) {
+    switch (level) {
+    case 0:
+        return "normal";
+    case 1:
+        return "large reads";
+    case 2:
+        return "busy polling";
+    case 3:
+        return "priority";
+    default:
+        return "reduced rate";
+    }
+}
+
+bool BackpressureController::observe(uint16_t fifoLength, chrono::steady_clock::time_point now) {
+    if (!settings.enabled) {
+        return false;
+    }
+    if (windowCount == 0) {
+        windowStart = now;
+    }
+    windowSum += fifoLength;
+    windowCount++;
+    if (now - windowStart < WINDOW) {
+        return false;
+    }
+
+    // **Average the window, then smooth its growth against the previous one**
+    double average = windowSum / windowCount;
+    if (primed) {
+        double seconds = chrono::duration<double>(now - windowStart).count();
+        trend = 0.5 * trend + 0.5 * (average - depth) / seconds;
+    }
+    depth = average;
+    primed = true;
+    windowSum = 0;
+    windowCount = 0;
+    return decide(now);
+}
+
+bool BackpressureController::decide(chrono::steady_clock::time_point now) {
+    double capacity = settings.fifoCapacity;
+    bool critical = depth >= settings.criticalWater * capacity;
+    bool filling = depth >= settings.highWater * capacity && trend > 0;
+
+    if (critical || filling) {
+        low = false;
+        // **Filling must persist for stepMs, so a single bus stall does not escalate**
+        if (!pressured) {
+            pressured = true;
+            pressureSince = now;
+        }
+        bool sustained = critical || now - pressureSince >= chrono::milliseconds(settings.stepMs);
+        if (sustained && level < maxLevel && now - lastChange >= chrono::milliseconds(settings.stepMs)) {
+            // **Relapsing soon after a recovery: wait twice as long before the next one**
+            if (recovered && now - lastRecovery < 2 * recoverDelay) {
+                recoverDelay = min(2 * recoverDelay, chrono::milliseconds(MAX_RECOVER_MS));
+            }
+            level++;
+            lastChange = now;
+            return true;
+        }
+        return false;
+    }
+
+    pressured = false;
+    if (depth > settings.lowWater * capacity || level == 0) {
+        low = false;
+        return false;
+    }
+    // **Recover one level per recoverMs spent below the low-water mark**
+    if (!low) {
+        low = true;
+        lowSince = now;
+    } else if (now - lowSince >= recoverDelay) {
+        level--;
+        lastChange = now;
+        lowSince = now;
+        lastRecovery = now;
+        recovered = true;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,83 @@
+#ifndef BACKPRESSURE_H
+#define BACKPRESSURE_H
+
+#include <chrono>
+#include <cstdint>
+
+using namespace std;
+
+// Thresholds are fractions of the sensor FIFO capacity.
+struct BackpressureSettings {
+    bool enabled = true;
+    int fifoCapacity = 4096;       // Values the sensor FIFO holds before samples are lost
+    double highWater = 0.25;       // Escalate after stepMs above this while the FIFO is still filling
+    double criticalWater = 0.75;   // Escalate above this regardless of the trend
+    double lowWater = 0.05;        // Recover one level after recoverMs below this
+    int stepMs = 500;              // Least time between escalations (lets a step take effect)
+    int recoverMs = 10000;         // Time below lowWater before each recovery step (doubles on relapse)
+    int minSampleRate = 0;         // Lowest rate levels >= RATE_LEVEL may fall back to (0 = never)
+};
+
+// Decides how hard the reading loop fights a filling sensor FIFO, from the
+// FIFO length reported at register 0x02. Levels are cumulative:
+//
+//   0  normal        configured read size and poll strategy
+//   1  large reads   read size raised to the maximum
+//   2  busy polling  no idle waits between transactions
+//   3  priority      reading thread gets a higher scheduling priority
+//   4+ reduced rate  sensor sample rate halved once per level above 3
+//
+// The controller only decides; ProWaveDAQ applies the level.
+class BackpressureController {
+public:
+    static constexpr int RATE_LEVEL = 4;
+
+    explicit BackpressureController(const BackpressureSettings& settings = BackpressureSettings());
+
+    // Feeds one FIFO length. Returns true when the level changed.
+    bool observe(uint16_t fifoLength, chrono::steady_clock::time_point now);
+
+    // Starts over at level 0 (e.g. when reading restarts).
+    void reset();
+
+    // Highest level allowed (RATE_LEVEL - 1 when the rate may not be lowered);
+    // a higher current level is lowered to it.
+    void setMaxLevel(int level);
+
+    int getLevel() const { return level; }
+    double getDepth() const { return depth; }      // FIFO length averaged over the last window
+    double getTrend() const { return trend; }      // Smoothed FIFO growth (values/s)
+    const BackpressureSettings& getSettings() const { return settings; }
+
+    static const char* levelName(int level);
+
+private:
+    static constexpr chrono::milliseconds WINDOW{100};
+    static constexpr int MAX_RECOVER_MS = 600000;      // Longest recovery wait after repeated relapses
+
+    BackpressureSettings settings;
+    int level;
+    int maxLevel;
+
+    // Current averaging window
+    chrono::steady_clock::time_point windowStart;
+    double windowSum;
+    int windowCount;
+
+    double depth;
+    double trend;
+    bool primed;                                   // depth holds a completed window
+    chrono::steady_clock::time_point lastChange;
+    chrono::steady_clock::time_point pressureSince;
+    bool pressured;                                // Above highWater and filling (or critical)
+    chrono::steady_clock::time_point lowSince;
+    bool low;
+    chrono::steady_clock::time_point lastRecovery;
+    bool recovered;
+    chrono::milliseconds recoverDelay;             // recoverMs, doubled after each relapse
+
+    // Applies the escalation/recovery rules once per window.
+    bool decide(chrono::steady_clock::time_point now);
+};
+
+#endif // BACKPRESSURE_H
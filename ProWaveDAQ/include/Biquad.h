@@ -0,0 +1,67 @@
+#ifndef BIQUAD_H
+#define BIQUAD_H
+
+#include <cmath>
+
+// One interleaved XYZ frame in a SIMD vector (GCC vector extension: SSE on
+// x86-64, NEON on AArch64); the fourth lane is unused.
+typedef float FrameLanes __attribute__((vector_size(16)));
+
+// Loads frame f of interleaved XYZ values.
+inline FrameLanes loadFrame(const double* values, size_t f) {
+    return FrameLanes{static_cast<float>(values[3 * f]), static_cast<float>(values[3 * f + 1]),
+                      static_cast<float>(values[3 * f + 2]), 0.0f};
+}
+
+// Section Qs of a 4th-order Butterworth filter (two cascaded biquads).
+constexpr double BUTTERWORTH4_Q[2] = {0.54119610, 1.30656296};
+
+// Transposed direct form II biquad filtering every lane of a frame with the
+// same coefficients (RBJ cookbook designs).
+struct Biquad {
+    float b0 = 1, b1 = 0, b2 = 0, a1 = 0, a2 = 0;
+    FrameLanes s1 = {}, s2 = {};
+
+    FrameLanes run(FrameLanes x) {
+        FrameLanes y = b0 * x + s1;
+        s1 = b1 * x - a1 * y + s2;
+        s2 = b2 * x - a2 * y;
+        return y;
+    }
+
+    static Biquad highPass(double cutoff, double rate, double q) {
+        double w0 = 2 * M_PI * cutoff / rate;
+        double alpha = sin(w0) / (2 * q);
+        double c = cos(w0);
+        return normalised((1 + c) / 2, -(1 + c), (1 + c) / 2, 1 + alpha, -2 * c, 1 - alpha);
+    }
+
+    static Biquad lowPass(double cutoff, double rate, double q) {
+        double w0 = 2 * M_PI * cutoff / rate;
+        double alpha = sin(w0) / (2 * q);
+        double c = cos(w0);
+        return normalised((1 - c) / 2, 1 - c, (1 - c) / 2, 1 + alpha, -2 * c, 1 - alpha);
+    }
+
+    // Integrator fused with a 2nd-order high-pass: s / (s² + (w/q)s + w²),
+    // bilinear with the cut-off prewarped. Unlike 1/s it has no pole at DC,
+    // so the output cannot drift; the gain is in units of input × seconds.
+    static Biquad integratingHighPass(double cutoff, double rate, double q) {
+        double k = 2 * rate;
+        double w = k * tan(M_PI * cutoff / rate);
+        return normalised(k, 0, -k, k * k + w * k / q + w * w, 2 * (w * w - k * k), k * k - w * k / q + w * w);
+    }
+
+private:
+    static Biquad normalised(double b0, double b1, double b2, double a0, double a1, double a2) {
+        Biquad section;
+        section.b0 = static_cast<float>(b0 / a0);
+        section.b1 = static_cast<float>(b1 / a0);
+        section.b2 = static_cast<float>(b2 / a0);
+        section.a1 = static_cast<float>(a1 / a0);
+        section.a2 = static_cast<float>(a2 / a0);
+        return section;
+    }
+};
+
+#endif // BIQUAD_H
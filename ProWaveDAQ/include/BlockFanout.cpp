@@ -0,0 +1,584 @@
+#include "BlockFanout.h"
+#include "ProWaveDAQ.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+// Spill record: this header, then values doubles
+struct SpillHeader {
+    uint32_t values;
+    uint16_t fifoBacklog;
+    uint16_t reserved;
+    uint64_t firstSample;
+    uint64_t sequence;
+    int64_t acquiredAt;          // steady_clock ticks
+};
+
+// Bytes read back from the scratch file at a time
+static const size_t SPILL_CHUNK = 256 * 1024;
+
+Subscription::Subscription(const SubscriberOptions& options)
+    : options(options), queuedBytes(0), closed(false),
+      delivered(Metrics::instance().counter("prowavedaq_fanout_delivered_total",
+          "Blocks queued for a consumer", Metrics::label("consumer", options.name))),
+      droppedOldest(Metrics::instance().counter("prowavedaq_fanout_dropped_total",
+          "Blocks a consumer lost to its overflow policy",
+          Metrics::label("consumer", options.name) + "," + Metrics::label("reason", "oldest"))),
+      droppedNewest(Metrics::instance().counter("prowavedaq_fanout_dropped_total",
+          "Blocks a consumer lost to its overflow policy",
+          Metrics::label("consumer", options.name) + "," + Metrics::label("reason", "newest"))),
+      blockTimeouts(Metrics::instance().counter("prowavedaq_fanout_dropped_total",
+          "Blocks a consumer lost to its overflow policy",
+          Metrics::label("consumer", options.name) + "," + Metrics::label("reason", "block_timeout"))),
+      depth(Metrics::instance().gauge("prowavedaq_fanout_queue_depth",
+          "Blocks queued for a consumer", Metrics::label("consumer", options.name))),
+      dwell(Metrics::instance().latency("prowavedaq_block_dwell_seconds",
+          "Time from reading a block off the sensor to a consumer taking it", Metrics::label("consumer", options.name))),
+      spillFd(-1), spillRead(0), spillWrite(0), spilledBlocks(0), spillPendingBytes(0), spillWriting(0),
+      replaying(false), spillWarned(false), spilledTotal(nullptr), spilledBytes(nullptr), replayedTotal(nullptr),
+      spillErrors(nullptr), spillFull(nullptr), spillWriteErrors(nullptr), spillBacklog(nullptr), memoryUsed(nullptr) {
+    if (options.policy == OverflowPolicy::Spill) {
+        string consumer = Metrics::label("consumer", options.name);
+        spilledTotal = &Metrics::instance().counter("prowavedaq_fanout_spilled_blocks_total",
+            "Blocks a consumer's RAM budget could not hold, written to its scratch file", consumer);
+        spilledBytes = &Metrics::instance().counter("prowavedaq_fanout_spilled_bytes_total",
+            "Bytes written to a consumer's scratch file", consumer);
+        replayedTotal = &Metrics::instance().counter("prowavedaq_fanout_replayed_blocks_total",
+            "Spilled blocks read back and delivered", consumer);
+        spillErrors = &Metrics::instance().counter("prowavedaq_fanout_dropped_total",
+            "Blocks a consumer lost to its overflow policy", consumer + "," + Metrics::label("reason", "spill_error"));
+        spillFull = &Metrics::instance().counter("prowavedaq_fanout_dropped_total",
+            "Blocks a consumer lost to its overflow policy", consumer + "," + Metrics::label("reason", "spill_full"));
+        spillWriteErrors = &Metrics::instance().counter("prowavedaq_fanout_spill_write_errors_total",
+            "Failed scratch file writes (the blocks stay in RAM and are retried)", consumer);
+        spillBacklog = &Metrics::instance().gauge("prowavedaq_fanout_spill_backlog_bytes",
+            "Scratch file bytes not yet replayed", consumer);
+        memoryUsed = &Metrics::instance().gauge("prowavedaq_fanout_queue_bytes",
+            "RAM held by a consumer's queued blocks", consumer);
+        spillThread = thread(&Subscription::spillLoop, this);
+    }
+}
+
+Subscription::~Subscription() {
+    close();
+    if (callbackThread.joinable()) {
+        callbackThread.join();
+    }
+    if (spillThread.joinable()) {
+        spillThread.join();
+    }
+    if (spillFd >= 0) {
+        ::close(spillFd);
+    }
+}
+
+bool Subscription::pop(SharedBlock& block, chrono::microseconds timeout) {
+    unique_lock<mutex> lock(queueMutex);
+    auto deadline = chrono::steady_clock::now() + timeout;
+    while (notEmpty.wait_until(lock, deadline,
+               [this]() { return !queue.empty() || readySpill() || (closed && drained()); })) {
+        if (!queue.empty()) {
+            block = move(queue.front());
+            queue.pop_front();
+            if (memoryUsed) {
+                queuedBytes -= blockBytes(*block);
+            }
+        } else if (spilledBlocks > 0 && !replaying) {
+            replay(lock);
+            continue;
+        } else if (spilledBlocks == 0 && spillWriting == 0 && !spillPending.empty()) {
+            // **Nothing in the scratch file: take it before the disk does**
+            block = move(spillPending.front());
+            spillPending.pop_front();
+            spillPendingBytes -= blockBytes(*block);
+        } else {
+            return false;   // Closed and drained
+        }
+        depth.set(queue.size());
+        if (memoryUsed) {
+            updateSpillGauges();
+        }
+        notFull.notify_one();
+        dwell.recordSince(block->acquiredAt);
+        return true;
+    }
+    return false;
+}
+
+bool Subscription::tryPop(SharedBlock& block) {
+    return pop(block, chrono::microseconds(0));
+}
+
+void Subscription::setNotify(function<void()> newNotify) {
+    lock_guard<mutex> lock(queueMutex);
+    notify = move(newNotify);
+}
+
+size_t Subscription::size() {
+    lock_guard<mutex> lock(queueMutex);
+    return queue.size() + spilledBlocks + spillPending.size();
+}
+
+bool Subscription::isClosed() {
+    lock_guard<mutex> lock(queueMutex);
+    return closed && drained();
+}
+
+// **Applies the overflow policy; only OverflowPolicy::Block ever waits**
+void Subscription::offer(const SharedBlock& block) {
+    function<void()> wake;
+    {
+        unique_lock<mutex> lock(queueMutex);
+        if (closed) {
+            return;
+        }
+        if (options.policy == OverflowPolicy::Spill) {
+            // **Behind anything spilled, or beyond the budget: to the spill thread**
+            size_t bytes = blockBytes(*block);
+            if (spilledBlocks > 0 || !spillPending.empty() || !fitsInMemory(bytes)) {
+                if (!fitsPending(bytes)) {
+                    // **The scratch disk is not keeping up: lose the newest rather than outgrow the budget**
+                    spillFull->inc();
+                    return;
+                }
+                spillPending.push_back(block);
+                spillPendingBytes += bytes;
+                spillReady.notify_one();
+            } else {
+                queue.push_back(block);
+                queuedBytes += bytes;
+                depth.set(queue.size());
+            }
+            updateSpillGauges();
+            delivered.inc();
+            wake = notify;
+        } else if (queue.size() >= options.capacity) {
+            switch (options.policy) {
+            case OverflowPolicy::Block:
+                if (!notFull.wait_for(lock, chrono::milliseconds(options.blockTimeoutMs),
+                        [this]() { return queue.size() < options.capacity || closed; })) {
+                    blockTimeouts.inc();
+                    return;
+                }
+                if (closed) {
+                    return;
+                }
+                break;
+            case OverflowPolicy::DropOldest:
+                queue.pop_front();
+                droppedOldest.inc();
+                break;
+            case OverflowPolicy::DropNewest:
+                droppedNewest.inc();
+                return;
+            case OverflowPolicy::Spill:
+                break;
+            }
+        }
+        if (options.policy != OverflowPolicy::Spill) {
+            queue.push_back(block);
+            depth.set(queue.size());
+            delivered.inc();
+            wake = notify;
+        }
+    }
+    notEmpty.notify_one();
+    if (wake) {
+        wake();
+    }
+}
+
+void Subscription::close() {
+    {
+        lock_guard<mutex> lock(queueMutex);
+        closed = true;
+    }
+    notEmpty.notify_all();
+    notFull.notify_all();
+    spillReady.notify_all();
+}
+
+size_t Subscription::blockBytes(const DataBlock& block) {
+    return sizeof(DataBlock) + block.samples.size() * sizeof(double);
+}
+
+// Half of the budget: for the RAM queue, or for the blocks waiting for the scratch disk.
+bool Subscription::withinShare(size_t blocks, size_t bytes) const {
+    return options.memoryBytes > 0 ? bytes <= options.memoryBytes / 2 : blocks <= max<size_t>(1, options.capacity / 2);
+}
+
+bool Subscription::fitsInMemory(size_t bytes) const {
+    return queue.empty() || withinShare(queue.size() + 1, queuedBytes + bytes);   // A single block always fits
+}
+
+bool Subscription::fitsPending(size_t bytes) const {
+    return spillPending.empty() || withinShare(spillPending.size() + 1, spillPendingBytes + bytes);
+}
+
+// A spilled block can be popped: replay the file, or take spillPending once the file is empty.
+bool Subscription::readySpill() const {
+    return (spilledBlocks > 0 && !replaying) || (spilledBlocks == 0 && spillWriting == 0 && !spillPending.empty());
+}
+
+bool Subscription::drained() const {
+    return queue.empty() && spilledBlocks == 0 && spillPending.empty() && !replaying;
+}
+
+void Subscription::updateSpillGauges() {
+    memoryUsed->set(queuedBytes + spillPendingBytes);
+    spillBacklog->set(spillWrite - spillRead);
+}
+
+// **Spill thread: the only writer of the scratch file, never under queueMutex**
+void Subscription::spillLoop() {
+    if (Tracer::isEnabled()) {
+        Tracer::instance().setThreadName(options.name + "_spill");
+    }
+    unique_lock<mutex> lock(queueMutex);
+    while (true) {
+        spillReady.wait(lock, [this]() {
+            return closed || !spillPending.empty() || (spilledBlocks == 0 && !replaying && spillWrite > 0);
+        });
+        if (closed) {
+            return;   // pop() takes what is left in spillPending
+        }
+        // **Everything written has been replayed: start the file over**
+        bool truncate = spilledBlocks == 0 && !replaying && spillWrite > 0;
+        if (truncate) {
+            spillRead = spillWrite = 0;
+        }
+        vector<SharedBlock> batch;
+        size_t bytes = 0;
+        for (const SharedBlock& block : spillPending) {
+            if (bytes >= SPILL_CHUNK) {
+                break;
+            }
+            batch.push_back(block);
+            bytes += sizeof(SpillHeader) + block->samples.size() * sizeof(double);
+        }
+        spillWriting = batch.size();
+        uint64_t offset = spillWrite;
+        lock.unlock();
+
+        if (truncate && ftruncate(spillFd, 0) != 0) {
+            cerr << "Warning: Cannot truncate the spill file of " << options.name << endl;
+        }
+        bool written = batch.empty() || writeSpill(batch, offset, bytes);
+
+        lock.lock();
+        spillWriting = 0;
+        if (written) {
+            for (const SharedBlock& block : batch) {
+                spillPendingBytes -= blockBytes(*block);
+            }
+            spillPending.erase(spillPending.begin(), spillPending.begin() + batch.size());
+            spillWrite += bytes;
+            spilledBlocks += batch.size();
+            spilledTotal->inc(batch.size());
+            spilledBytes->inc(bytes);
+        } else {
+            // **The blocks stay in RAM, where pop() still finds them; retried after a pause**
+            spillWriteErrors->inc();
+        }
+        updateSpillGauges();
+        function<void()> wake = notify;
+        lock.unlock();
+        notEmpty.notify_all();
+        if (wake && !batch.empty()) {
+            wake();
+        }
+        lock.lock();
+        if (!written) {
+            spillReady.wait_for(lock, chrono::seconds(1), [this]() { return closed; });
+        }
+    }
+}
+
+bool Subscription::writeSpill(const vector<SharedBlock>& blocks, uint64_t offset, size_t bytes) {
+    if (spillFd < 0) {
+        // **Unnamed, so nothing is left behind when the process ends**
+        spillFd = open(options.spillDirectory.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+        if (spillFd < 0) {
+            string path = options.spillDirectory + "/prowavedaq_spill_XXXXXX";
+            spillFd = mkostemp(&path[0], O_CLOEXEC);
+            if (spillFd >= 0) {
+                unlink(path.c_str());
+            }
+        }
+        if (spillFd < 0) {
+            if (!spillWarned) {
+                cerr << "Error: Cannot create a spill file in " << options.spillDirectory << " for "
+                     << options.name << ": " << strerror(errno) << endl;
+                spillWarned = true;
+            }
+            return false;
+        }
+    }
+
+    writeBuffer.resize(max(writeBuffer.size(), bytes));
+    char* out = writeBuffer.data();
+    for (const SharedBlock& block : blocks) {
+        SpillHeader header = {};
+        header.values = static_cast<uint32_t>(block->samples.size());
+        header.fifoBacklog = block->fifoBacklog;
+        header.firstSample = block->firstSample;
+        header.sequence = block->sequence;
+        header.acquiredAt = block->acquiredAt.time_since_epoch().count();
+        memcpy(out, &header, sizeof(header));
+        memcpy(out + sizeof(header), block->samples.data(), block->samples.size() * sizeof(double));
+        out += sizeof(header) + block->samples.size() * sizeof(double);
+    }
+    for (size_t done = 0; done < bytes;) {
+        ssize_t n = pwrite(spillFd, writeBuffer.data() + done, bytes - done, offset + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            if (!spillWarned) {
+                cerr << "Error: Spill file write failed for " << options.name << ": "
+                     << (n < 0 ? strerror(errno) : "no space") << endl;
+                spillWarned = true;
+            }
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+// **Oldest spilled blocks back into RAM, one chunk at a time, up to the budget**
+// Called with the queue empty; the file is read with the lock released.
+void Subscription::replay(unique_lock<mutex>& lock) {
+    replaying = true;
+    uint64_t offset = spillRead;
+    uint64_t available = spillWrite - spillRead;
+    size_t records = spilledBlocks;
+    lock.unlock();
+
+    vector<SharedBlock> replayed;
+    size_t consumed = 0;
+    size_t budget = 0;
+    const char* failure = nullptr;
+    size_t length = static_cast<size_t>(min<uint64_t>(SPILL_CHUNK, available));
+    replayBuffer.resize(max(replayBuffer.size(), length));
+    ssize_t got = pread(spillFd, replayBuffer.data(), length, offset);
+    if (got != static_cast<ssize_t>(length)) {
+        failure = got < 0 ? strerror(errno) : "short read";
+    }
+    while (!failure && replayed.size() < records) {
+        SpillHeader header;
+        if (consumed + sizeof(header) > available) {
+            failure = "truncated record";
+            break;
+        }
+        if (consumed + sizeof(header) > length) {
+            break;   // Next chunk
+        }
+        memcpy(&header, replayBuffer.data() + consumed, sizeof(header));
+        size_t bytes = sizeof(header) + static_cast<size_t>(header.values) * sizeof(double);
+        if (consumed + bytes > available) {
+            failure = "corrupt record";
+            break;
+        }
+        if (consumed + bytes > length) {
+            if (consumed > 0) {
+                break;   // Next chunk
+            }
+            // **A record larger than a chunk: read exactly that record**
+            length = bytes;
+            replayBuffer.resize(max(replayBuffer.size(), length));
+            got = pread(spillFd, replayBuffer.data(), length, offset);
+            if (got != static_cast<ssize_t>(length)) {
+                failure = got < 0 ? strerror(errno) : "short read";
+            }
+            continue;
+        }
+        size_t queued = sizeof(DataBlock) + header.values * sizeof(double);
+        if (!replayed.empty() && !withinShare(replayed.size() + 1, budget + queued)) {
+            break;
+        }
+        auto block = make_shared<DataBlock>();
+        block->samples.resize(header.values);
+        memcpy(block->samples.data(), replayBuffer.data() + consumed + sizeof(header), header.values * sizeof(double));
+        block->acquiredAt = chrono::steady_clock::time_point(chrono::steady_clock::duration(header.acquiredAt));
+        block->firstSample = header.firstSample;
+        block->sequence = header.sequence;
+        block->fifoBacklog = header.fifoBacklog;
+        replayed.push_back(move(block));
+        budget += queued;
+        consumed += bytes;
+    }
+    if (!failure && replayed.empty()) {
+        failure = "no complete record";
+    }
+
+    lock.lock();
+    replaying = false;
+    for (SharedBlock& block : replayed) {
+        queuedBytes += blockBytes(*block);
+        queue.push_back(move(block));
+    }
+    spillRead += consumed;
+    spilledBlocks -= replayed.size();
+    replayedTotal->inc(replayed.size());
+    if (failure) {
+        // **Unreadable scratch file: what is left in it is lost, the stream continues from RAM**
+        cerr << "Error: Spill file read failed for " << options.name << ", " << spilledBlocks
+             << " block(s) lost: " << failure << endl;
+        spillErrors->inc(spilledBlocks);
+        spilledBlocks = 0;
+        spillRead = spillWrite;
+    }
+    if (spilledBlocks == 0) {
+        spillReady.notify_one();   // Truncate
+    }
+    depth.set(queue.size());
+    updateSpillGauges();
+    notEmpty.notify_all();
+}
+
+// Drains the queue into the callback until the subscription is closed.
+void Subscription::callbackLoop() {
+    if (Tracer::isEnabled()) {
+        Tracer::instance().setThreadName(options.name);
+    }
+    SharedBlock block;
+    while (true) {
+        if (pop(block, chrono::milliseconds(100))) {
+            callback(block);
+        } else if (isClosed()) {
+            return;
+        }
+    }
+}
+
+BlockFanout::BlockFanout(ProWaveDAQ& daq, size_t inboxCapacity)
+    : daq(daq), running(false), inboxCapacity(inboxCapacity), spillSubscribers(0),
+      sourceDropped(Metrics::instance().counter("prowavedaq_fanout_source_dropped_total",
+          "Blocks dropped because the fan-out dispatcher fell behind the reader")),
+      sourceWaits(Metrics::instance().counter("prowavedaq_fanout_source_waits_total",
+          "Blocks the reader waited to publish because the fan-out inbox was full")) {
+    daq.setBlockSink([this](DataBlock&& block) { publish(move(block)); });
+}
+
+BlockFanout::~BlockFanout() {
+    daq.setBlockSink(nullptr);
+    stop();
+}
+
+shared_ptr<Subscription> BlockFanout::subscribe(const SubscriberOptions& options) {
+    auto subscription = make_shared<Subscription>(options);
+    if (options.policy == OverflowPolicy::Spill) {
+        spillSubscribers++;
+    }
+    lock_guard<mutex> lock(subscribersMutex);
+    subscribers.push_back(subscription);
+    return subscription;
+}
+
+shared_ptr<Subscription> BlockFanout::subscribe(const SubscriberOptions& options, Subscription::Callback callback) {
+    auto subscription = make_shared<Subscription>(options);
+    subscription->callback = move(callback);
+    subscription->callbackThread = thread(&Subscription::callbackLoop, subscription.get());
+    if (options.policy == OverflowPolicy::Spill) {
+        spillSubscribers++;
+    }
+
+    lock_guard<mutex> lock(subscribersMutex);
+    subscribers.push_back(subscription);
+    return subscription;
+}
+
+void BlockFanout::unsubscribe(const shared_ptr<Subscription>& subscription) {
+    {
+        lock_guard<mutex> lock(subscribersMutex);
+        auto removed = remove(subscribers.begin(), subscribers.end(), subscription);
+        if (removed != subscribers.end() && subscription->options.policy == OverflowPolicy::Spill) {
+            spillSubscribers--;
+        }
+        subscribers.erase(removed, subscribers.end());
+    }
+    subscription->close();
+}
+
+void BlockFanout::start() {
+    if (running) {
+        return;
+    }
+    running = true;
+    dispatchThread = thread(&BlockFanout::dispatchLoop, this);
+}
+
+void BlockFanout::stop() {
+    if (running) {
+        {
+            lock_guard<mutex> lock(inboxMutex);   // No publish() between its check and its wait
+            running = false;
+        }
+        inboxReady.notify_all();
+        inboxSpace.notify_all();
+        if (dispatchThread.joinable()) {
+            dispatchThread.join();
+        }
+    }
+
+    lock_guard<mutex> lock(subscribersMutex);
+    for (const auto& subscription : subscribers) {
+        subscription->close();
+    }
+}
+
+void BlockFanout::publish(DataBlock&& block) {
+    auto shared = make_shared<const DataBlock>(move(block));
+    {
+        unique_lock<mutex> lock(inboxMutex);
+        // **A Spill subscriber must not lose blocks: the reader waits for room instead**
+        if (inbox.size() >= inboxCapacity && spillSubscribers > 0 && running) {
+            sourceWaits.inc();
+            inboxSpace.wait(lock, [this]() { return inbox.size() < inboxCapacity || !running; });
+        }
+        if (inbox.size() >= inboxCapacity) {
+            sourceDropped.inc();
+            return;
+        }
+        inbox.push_back(move(shared));
+    }
+    inboxReady.notify_one();
+}
+
+// **Hands each block to every subscriber; only this thread waits on consumers**
+void BlockFanout::dispatchLoop() {
+    if (Tracer::isEnabled()) {
+        Tracer::instance().setThreadName("fanout");
+    }
+    vector<shared_ptr<Subscription>> targets;
+
+    while (true) {
+        SharedBlock block;
+        {
+            unique_lock<mutex> lock(inboxMutex);
+            inboxReady.wait_for(lock, chrono::milliseconds(100), [this]() { return !inbox.empty() || !running; });
+            if (inbox.empty()) {
+                if (!running) {
+                    break;   // stop(): everything published has been dispatched
+                }
+                continue;
+            }
+            block = move(inbox.front());
+            inbox.pop_front();
+        }
+        inboxSpace.notify_one();
+
+        {
+            lock_guard<mutex> lock(subscribersMutex);
+            targets = subscribers;
+        }
+        for (const auto& subscription : targets) {
+            subscription->offer(block);
+        }
+    }
+}
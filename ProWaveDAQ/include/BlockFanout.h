@@ -0,0 +1,203 @@
+#ifndef BLOCK_FANOUT_H
+#define BLOCK_FANOUT_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DataBlock.h"
+#include "Metrics.h"
+
+using namespace std;
+
+class ProWaveDAQ;
+
+// Blocks are shared between consumers by reference count, never copied per consumer.
+using SharedBlock = shared_ptr<const DataBlock>;
+
+// What a subscription does when its queue is full.
+enum class OverflowPolicy {
+    Block,       // Dispatcher waits for room (up to blockTimeoutMs), then drops the new block
+    DropOldest,  // Discard the oldest queued block to make room
+    DropNewest,  // Discard the incoming block
+    Spill        // Keep up to memoryBytes in RAM, append the rest to a scratch file replayed in order
+};
+
+struct SubscriberOptions {
+    string name;                                      // Metrics label, e.g. "recorder"
+    size_t capacity = 256;                            // Queued blocks (~41 samples each)
+    OverflowPolicy policy = OverflowPolicy::DropOldest;
+    int blockTimeoutMs = 100;                         // Longest wait under OverflowPolicy::Block
+    size_t memoryBytes = 0;                           // Spill: RAM budget, queue and write-behind (0 = capacity blocks)
+    string spillDirectory = "/var/tmp";               // Spill: where the unnamed scratch file is created
+};
+
+// One consumer's cursor into the stream: a bounded queue of shared blocks.
+// Consumed either by its own thread (callback) or by pulling with pop(),
+// optionally woken by a notify hook (for executors that multiplex consumers).
+//
+// Under OverflowPolicy::Spill the queue never waits: blocks beyond the RAM
+// budget are handed to the subscription's spill thread, which appends them to
+// an unlinked scratch file; while any are there every new block follows them,
+// so order is kept. pop() reads them back in chunks once the RAM queue is
+// empty, and the file is truncated whenever it has been replayed. No file I/O
+// happens under the queue lock or on the dispatcher, so a slow scratch disk
+// delays only this consumer. Half of the budget holds the RAM queue, the other
+// half the blocks waiting for the scratch disk; when that half is full (the
+// disk fails or falls behind) new blocks are dropped and counted, so RAM never
+// exceeds the budget.
+class Subscription {
+public:
+    using Callback = function<void(const SharedBlock& block)>;
+
+    explicit Subscription(const SubscriberOptions& options);
+    ~Subscription();
+
+    // Waits up to timeout for the next block (including spilled ones). Returns
+    // false on timeout or once closed and drained.
+    bool pop(SharedBlock& block, chrono::microseconds timeout);
+
+    // Returns the next block if one is queued.
+    bool tryPop(SharedBlock& block);
+
+    // Called (on the dispatcher thread) after each block is queued; must not block.
+    void setNotify(function<void()> notify);
+
+    const string& getName() const { return options.name; }
+
+    // Blocks waiting to be popped, in RAM or spilled.
+    size_t size();
+
+    // True once closed and every block has been popped.
+    bool isClosed();
+
+private:
+    friend class BlockFanout;
+
+    SubscriberOptions options;
+    mutex queueMutex;
+    condition_variable notEmpty;
+    condition_variable notFull;
+    deque<SharedBlock> queue;
+    size_t queuedBytes;
+    bool closed;
+    function<void()> notify;
+
+    Callback callback;           // Set for thread-per-consumer subscriptions
+    thread callbackThread;
+
+    MetricCounter& delivered;
+    MetricCounter& droppedOldest;
+    MetricCounter& droppedNewest;
+    MetricCounter& blockTimeouts;
+    MetricGauge& depth;
+    HdrHistogram& dwell;         // Acquisition to pop(), i.e. to the consumer
+
+    // Queues a block according to the policy (dispatcher thread).
+    void offer(const SharedBlock& block);
+
+    // Wakes all waiters; pop() returns false once the queue is drained.
+    void close();
+
+    // OverflowPolicy::Spill: behind the RAM queue, oldest first, come the
+    // records in the scratch file, then spillPending (whose first
+    // spillWriting blocks are being written)
+    int spillFd;                 // Unlinked scratch file, opened on the first spill
+    uint64_t spillRead;          // Byte offsets of the oldest and the next record
+    uint64_t spillWrite;
+    size_t spilledBlocks;        // Records in [spillRead, spillWrite)
+    deque<SharedBlock> spillPending;
+    size_t spillPendingBytes;
+    size_t spillWriting;
+    bool replaying;              // A pop() is reading records back
+    condition_variable spillReady;
+    thread spillThread;
+    vector<char> writeBuffer;    // Spill thread only
+    bool spillWarned;            // Spill thread only
+    vector<char> replayBuffer;   // The replaying pop() only
+    MetricCounter* spilledTotal;
+    MetricCounter* spilledBytes;
+    MetricCounter* replayedTotal;
+    MetricCounter* spillErrors;
+    MetricCounter* spillFull;    // Dropped: the write-behind half of the budget was full
+    MetricCounter* spillWriteErrors;
+    MetricGauge* spillBacklog;
+    MetricGauge* memoryUsed;
+
+    void callbackLoop();
+
+    // Spill thread: writes spillPending to the scratch file in batches.
+    void spillLoop();
+    // Appends blocks at offset; false (after a warning) if they could not be stored.
+    bool writeSpill(const vector<SharedBlock>& blocks, uint64_t offset, size_t bytes);
+    // Moves the oldest spilled blocks back into the RAM queue; unlocks for the read.
+    void replay(unique_lock<mutex>& lock);
+    bool readySpill() const;
+    bool drained() const;
+    bool withinShare(size_t blocks, size_t bytes) const;
+    bool fitsInMemory(size_t bytes) const;
+    bool fitsPending(size_t bytes) const;
+    void updateSpillGauges();
+    static size_t blockBytes(const DataBlock& block);
+};
+
+// BlockFanout receives every block from ProWaveDAQ's reader thread once and
+// hands the same shared block to each subscriber from its dispatcher thread.
+// Consumers only affect each other through OverflowPolicy::Block; the reader
+// thread never waits for a consumer. The inbox holds at most inboxCapacity
+// blocks: when it is full the reader's block is dropped, except while a Spill
+// subscriber exists, which must not lose blocks: then the reader waits for the
+// dispatcher (which waits only on OverflowPolicy::Block consumers, each at most
+// blockTimeoutMs). stop() dispatches whatever is still in the inbox.
+class BlockFanout {
+public:
+    // Registers as the block sink of daq. inboxCapacity bounds the blocks
+    // waiting for the dispatcher.
+    explicit BlockFanout(ProWaveDAQ& daq, size_t inboxCapacity = 4096);
+    ~BlockFanout();
+
+    // Pull-mode subscription.
+    shared_ptr<Subscription> subscribe(const SubscriberOptions& options);
+
+    // Subscription served by its own thread, calling callback for every block.
+    shared_ptr<Subscription> subscribe(const SubscriberOptions& options, Subscription::Callback callback);
+
+    // Closes the subscription (its thread drains the queue and exits).
+    void unsubscribe(const shared_ptr<Subscription>& subscription);
+
+    // Starts/stops the dispatcher thread. stop() closes all subscriptions.
+    void start();
+    void stop();
+
+private:
+    ProWaveDAQ& daq;
+    atomic<bool> running;
+    thread dispatchThread;
+
+    size_t inboxCapacity;
+    mutex inboxMutex;
+    condition_variable inboxReady;
+    condition_variable inboxSpace;
+    deque<SharedBlock> inbox;     // Published by the reader, not yet dispatched
+
+    mutex subscribersMutex;
+    vector<shared_ptr<Subscription>> subscribers;
+
+    atomic<int> spillSubscribers; // Subscribers with OverflowPolicy::Spill
+    MetricCounter& sourceDropped; // Blocks lost because the inbox was full
+    MetricCounter& sourceWaits;   // Blocks the reader waited to publish (Spill subscribers)
+
+    // Reader thread: queues a block for the dispatcher; waits only for a full
+    // inbox, and only while a Spill subscriber exists.
+    void publish(DataBlock&& block);
+
+    void dispatchLoop();
+};
+
+#endif // BLOCK_FANOUT_H
@@ -0,0 +1,50 @@
+#include "BlockKernels.h"
+#include "SimdKernels.h"
+
+// Instantiates the kernel table for one compile-time channel count.
+template <int Channels>
+static BlockKernels makeKernels(int channels) {
+    BlockKernels k;
+    k.channels = channels;
+    k.specialised = Channels != kernels::DYNAMIC_CHANNELS;
+    k.convert = &kernels::convert<int16_t, double>;
+    k.deinterleave = &kernels::deinterleave<Channels, int16_t, double>;
+    k.formatRows = &kernels::formatRows<Channels, double>;
+    k.accumulateStats = &kernels::accumulateStats<Channels, double>;
+    return k;
+}
+
+// Conversion through the best SIMD kernels of this CPU (any channel count).
+static void convertSimd(const uint16_t* regs, size_t values, int, double* out) {
+    SimdKernels::best().convertd(regs, values, out);
+}
+
+// 3-channel deinterleave through the best SIMD kernels of this CPU.
+static void deinterleave3Simd(const uint16_t* regs, size_t frames, int, double* const* axes) {
+    SimdKernels::best().deinterleave3d(regs, frames, axes[0], axes[1], axes[2]);
+}
+
+BlockKernels BlockKernels::select(int channels) {
+    BlockKernels k;
+    switch (channels) {
+    case 1:
+        k = makeKernels<1>(channels);
+        break;
+    case 2:
+        k = makeKernels<2>(channels);
+        break;
+    case 3:
+        k = makeKernels<3>(channels);
+        k.deinterleave = &deinterleave3Simd;
+        break;
+    default:
+        k = makeKernels<kernels::DYNAMIC_CHANNELS>(channels);
+        break;
+    }
+    k.convert = &convertSimd;
+    return k;
+}
+
+BlockKernels BlockKernels::generic(int channels) {
+    return makeKernels<kernels::DYNAMIC_CHANNELS>(channels);
+}
@@ -0,0 +1,140 @@
+#ifndef BLOCK_KERNELS_H
+#define BLOCK_KERNELS_H
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+using namespace std;
+
+// Block-processing kernels templated on the channel count and sample type.
+//
+// With a fixed Channels the frame layout is a compile-time constant, so the
+// per-frame loops are fully unrolled and the compiler can vectorise them. The
+// same templates instantiated with DYNAMIC_CHANNELS take the channel count at
+// runtime and serve as the generic fallback. BlockKernels::select() picks the
+// specialisation for a given channel count.
+namespace kernels {
+
+constexpr int DYNAMIC_CHANNELS = 0;
+
+// Raw sample formats delivered by the sensor in its input registers.
+template <typename Sample>
+struct SampleTraits;
+
+// ±4 g full scale: one LSB is 1/8192 g.
+template <>
+struct SampleTraits<int16_t> {
+    static constexpr double scale = 1.0 / 8192.0;
+    static constexpr int16_t decode(uint16_t word) { return static_cast<int16_t>(word); }
+};
+
+// Interleaved frame layout: Channels values per frame.
+template <int Channels>
+struct FrameLayout {
+    static_assert(Channels >= 0, "channel count must not be negative");
+
+    // Channels when fixed at compile time, otherwise the runtime value.
+    static constexpr int channels(int runtimeChannels) {
+        return Channels != DYNAMIC_CHANNELS ? Channels : runtimeChannels;
+    }
+};
+
+// Running statistics of one channel over a block.
+struct ChannelStats {
+    double min = numeric_limits<double>::infinity();
+    double max = -numeric_limits<double>::infinity();
+    double sum = 0;
+    double sumSquares = 0;
+    size_t count = 0;
+};
+
+// Register words -> scaled interleaved values. Every value is decoded the
+// same way whatever its channel, so this is one flat loop for any channel
+// count (the channel argument only matches the kernel table).
+template <typename Sample, typename Out>
+void convert(const uint16_t* regs, size_t values, int, Out* out) {
+    using Traits = SampleTraits<Sample>;
+    for (size_t i = 0; i < values; i++) {
+        out[i] = static_cast<Out>(Traits::decode(regs[i]) * Traits::scale);
+    }
+}
+
+// Register words -> one scaled array per channel (structure of arrays).
+template <int Channels, typename Sample, typename Out>
+void deinterleave(const uint16_t* regs, size_t frames, int runtimeChannels, Out* const* axes) {
+    using Traits = SampleTraits<Sample>;
+    const int channels = FrameLayout<Channels>::channels(runtimeChannels);
+
+    for (size_t f = 0; f < frames; f++) {
+        for (int c = 0; c < channels; c++) {
+            axes[c][f] = static_cast<Out>(Traits::decode(regs[f * channels + c]) * Traits::scale);
+        }
+    }
+}
+
+// Appends frames as CSV rows. Values are printed like ostream's default
+// (%g, 6 significant digits), so files are unchanged byte for byte.
+template <int Channels, typename Value>
+void formatRows(const Value* values, size_t frames, int runtimeChannels, string& text) {
+    const int channels = FrameLayout<Channels>::channels(runtimeChannels);
+
+    // Upper bound of one %g value ("-1.23457e-308") plus separator
+    constexpr size_t MAX_FIELD = 16;
+    size_t start = text.size();
+    text.resize(start + frames * channels * MAX_FIELD);
+    char* p = &text[start];
+    char* end = &text[0] + text.size();
+
+    for (size_t f = 0; f < frames; f++) {
+        for (int c = 0; c < channels; c++) {
+            p = to_chars(p, end, values[f * channels + c], chars_format::general, 6).ptr;
+            *p++ = c < channels - 1 ? ',' : '\n';
+        }
+    }
+    text.resize(p - &text[0]);
+}
+
+// Accumulates per-channel min/max/sum/sum of squares into stats[0..channels).
+template <int Channels, typename Value>
+void accumulateStats(const Value* values, size_t frames, int runtimeChannels, ChannelStats* stats) {
+    const int channels = FrameLayout<Channels>::channels(runtimeChannels);
+
+    for (size_t f = 0; f < frames; f++) {
+        for (int c = 0; c < channels; c++) {
+            double v = values[f * channels + c];
+            stats[c].min = v < stats[c].min ? v : stats[c].min;
+            stats[c].max = v > stats[c].max ? v : stats[c].max;
+            stats[c].sum += v;
+            stats[c].sumSquares += v * v;
+        }
+    }
+    for (int c = 0; c < channels; c++) {
+        stats[c].count += frames;
+    }
+}
+
+} // namespace kernels
+
+// Kernel table for one channel count (int16 registers, double values).
+struct BlockKernels {
+    int channels;              // Channel count the table was selected for
+    bool specialised;          // False when the generic fallback is used
+
+    void (*convert)(const uint16_t* regs, size_t values, int channels, double* out);
+    void (*deinterleave)(const uint16_t* regs, size_t frames, int channels, double* const* axes);
+    void (*formatRows)(const double* values, size_t frames, int channels, string& text);
+    void (*accumulateStats)(const double* values, size_t frames, int channels, kernels::ChannelStats* stats);
+
+    // Returns the compile-time specialisation for channels (1, 2 or 3) or the
+    // generic kernels for any other count. convert, and for 3 channels
+    // deinterleave, use the SIMD kernels selected for this CPU (see SimdKernels.h).
+    static BlockKernels select(int channels);
+
+    // The generic kernels, regardless of channel count (for comparison).
+    static BlockKernels generic(int channels);
+};
+
+#endif // BLOCK_KERNELS_H
@@ -1,8 +1,22 @@
 #include "CSVWriter.h"
+#include <iomanip>
+#include <sstream>
 
 // Constructor: Initializes the CSVWriter and generates the initial CSV filename.
-CSVWriter::CSVWriter(int numChannels, const string& outputDir, const string& label)
-    : numChannels(numChannels), outputDir(outputDir), label(label) {
+CSVWriter::CSVWriter(int numChannels, const string& outputDir, const string& label, int syncIntervalMs,
+                     const WriterOptions& writerOptions)
+    : numChannels(numChannels), blockKernels(BlockKernels::select(numChannels)), outputDir(outputDir), label(label),
+      bytesMetric(Metrics::instance().rate("prowavedaq_writer_bytes", "Bytes written to CSV files")),
+      writeLatency(Metrics::instance().latency("prowavedaq_writer_write_seconds", "Duration of CSVWriter::addDataBlock()")),
+      file(writerOptions.mapped ? nullptr : AsyncFileWriter::create(writerOptions)),
+      mapped(writerOptions.mapped ? new MappedFileWriter(outputDir) : nullptr),
+      syncIntervalMs(syncIntervalMs), durability(Durability::Periodic), lastSync(chrono::steady_clock::now()),
+      writtenAge(Metrics::instance().latency("prowavedaq_sample_age_written_seconds",
+          "Time from acquisition until the block was queued for writing")),
+      syncedAge(Metrics::instance().latency("prowavedaq_sample_age_synced_seconds",
+          "Time from acquisition until the block was durable on disk")),
+      fileWrittenAge(new HdrHistogram()), fileSyncedAge(new HdrHistogram()),
+      commitScheduled(false), stopping(false) {
     currentFilename = generateFilename(); // Generate the first filename
 
     // Create the "output" directory if it does not exist
@@ -16,32 +30,183 @@ CSVWriter::CSVWriter(int numChannels, const string& outputDir, const string& lab
         cout << "Creating output directory: " << outputDir << endl;
         fs::create_directories(outputDir);
     }
+    journal.reset(new RecordingJournal(outputDir));
+    committer = thread(&CSVWriter::commitLoop, this);
+}
+
+// Destructor: makes the last file durable.
+CSVWriter::~CSVWriter() {
+    {
+        lock_guard<mutex> lock(fileMutex);
+        stopping = true;
+    }
+    commitWake.notify_all();
+    committer.join();
+    lock_guard<mutex> lock(fileMutex);
+    closeFile();
 }
 
 // Writes a block of data to the CSV file.
 void CSVWriter::addDataBlock(vector<double>&& dataBlock) {
+    TRACE_SPAN("addDataBlock");
     lock_guard<mutex> lock(fileMutex); // Ensure thread safety
-    ofstream file(currentFilename, ios::app); // Open file in append mode
+    auto start = chrono::steady_clock::now();
+    writeRows(dataBlock);
+    writeLatency.recordSince(start);
+}
+
+// Writes a block of data and records how old it is when written and when synced.
+void CSVWriter::addDataBlock(const DataBlock& block) {
+    TRACE_SPAN("addDataBlock");
+    lock_guard<mutex> lock(fileMutex); // Ensure thread safety
+    auto start = chrono::steady_clock::now();
+    if (!writeRows(block.samples)) {
+        return;
+    }
+    writeLatency.recordSince(start);
+
+    writtenAge.recordSince(block.acquiredAt);
+    fileWrittenAge->recordSince(block.acquiredAt);
+    unsynced.push_back(block.acquiredAt);
+
+    if (durability == Durability::Group) {
+        // **One sync per window, however many blocks it covers**
+        if (!commitScheduled) {
+            commitScheduled = true;
+            commitDue = chrono::steady_clock::now() + chrono::milliseconds(syncIntervalMs);
+            commitWake.notify_all();
+        }
+    } else if (durability == Durability::Periodic && syncIntervalMs > 0 &&
+               chrono::steady_clock::now() - lastSync >= chrono::milliseconds(syncIntervalMs)) {
+        syncFile();
+    }
+}
+
+void CSVWriter::commitLoop() {
+    unique_lock<mutex> lock(fileMutex);
+    while (!stopping) {
+        if (!commitScheduled) {
+            commitWake.wait(lock);
+            continue;
+        }
+        if (commitWake.wait_until(lock, commitDue) == cv_status::timeout || chrono::steady_clock::now() >= commitDue) {
+            commitScheduled = false;
+            syncFile();
+        }
+    }
+}
+
+bool CSVWriter::writeRows(const vector<double>& dataBlock) {
+    bool open = mapped ? mapped->isOpen() || mapped->open(currentFilename)
+                       : file->isOpen() || file->open(currentFilename);
+    if (!open) {
+        cerr << "Error: Unable to open CSV file: " << currentFilename << endl;
+        return false;
+    }
 
     // Write data in rows, separating values with commas
-    for (size_t i = 0; i < dataBlock.size(); i += numChannels) {
-        for (int j = 0; j < numChannels; ++j) {
-            file << dataBlock[i + j];
-            if (j < numChannels - 1) {
-                file << ",";
-            }
+    string text;
+    blockKernels.formatRows(dataBlock.data(), dataBlock.size() / numChannels, numChannels, text);
+
+    if (!(mapped ? mapped->append(text.data(), text.size()) : file->append(text.data(), text.size()))) {
+        cerr << "Error: Failed to write CSV file: " << currentFilename << endl;
+        return false;
+    }
+
+    bytesMetric.add(text.size());
+    return true;
+}
+
+void CSVWriter::syncFile() {
+    if (mapped ? !mapped->isOpen() : !file->isOpen()) {
+        return;
+    }
+    // **The histograms outlive the sync: closeFile() waits for it before replacing them**
+    HdrHistogram* fileSynced = fileSyncedAge.get();
+    HdrHistogram* synced = &syncedAge;
+    RecordingJournal* commits = journal.get();
+    string name = fs::path(currentFilename).filename().string();
+    uint64_t bytes = mapped ? mapped->size() : file->size();
+    auto record = [acquired = move(unsynced), fileSynced, synced, commits, name, bytes](bool ok) {
+        if (!ok) {
+            return;
+        }
+        commits->committed(name, bytes);
+        auto now = chrono::steady_clock::now();
+        for (const auto& acquiredAt : acquired) {
+            uint64_t age = chrono::duration_cast<chrono::nanoseconds>(now - acquiredAt).count();
+            synced->record(age);
+            fileSynced->record(age);
         }
-        file << "\n";
+    };
+    if (mapped) {
+        mapped->sync(move(record));
+    } else {
+        file->sync(move(record));
     }
-    file.close();
+    unsynced.clear();
+    lastSync = chrono::steady_clock::now();
+}
+
+// Appends one line per closed file to <outputDir>/latency_summary.csv.
+void CSVWriter::closeFile() {
+    if (mapped ? !mapped->isOpen() : !file->isOpen()) {
+        return;
+    }
+    syncFile();
+    commitScheduled = false;
+    uint64_t bytes = mapped ? mapped->size() : file->size();
+    if (mapped ? mapped->close() : file->close()) {
+        journal->closed(fs::path(currentFilename).filename().string(), bytes);
+    }
+
+    HdrSnapshot w = fileWrittenAge->snapshot();
+    HdrSnapshot d = fileSyncedAge->snapshot();
+    if (w.count > 0) {
+        string summaryPath = outputDir + "/latency_summary.csv";
+        bool exists = fs::exists(summaryPath);
+        ofstream summary(summaryPath, ios::app);
+        if (!exists) {
+            summary << "file,blocks,written_p50_ms,written_p99_ms,written_max_ms,"
+                       "synced_p50_ms,synced_p99_ms,synced_max_ms\n";
+        }
+        summary << fixed << setprecision(3)
+                << fs::path(currentFilename).filename().string() << "," << w.count << ","
+                << w.p50 / 1e6 << "," << w.p99 / 1e6 << "," << w.max / 1e6 << ","
+                << d.p50 / 1e6 << "," << d.p99 / 1e6 << "," << d.max / 1e6 << "\n";
+        cout << "Latency " << fs::path(currentFilename).filename().string()
+             << ": written " << HdrHistogram::format(w, 1e6, "ms")
+             << " | synced " << HdrHistogram::format(d, 1e6, "ms") << endl;
+    }
+    fileWrittenAge.reset(new HdrHistogram());
+    fileSyncedAge.reset(new HdrHistogram());
 }
 
 // Updates the filename when a new save unit is triggered.
 void CSVWriter::updateFilename() {
+    TRACE_SPAN("updateFilename");
     lock_guard<mutex> lock(fileMutex); // Ensure thread safety
+    closeFile();
     currentFilename = generateFilename();
 }
 
+void CSVWriter::setSyncInterval(int intervalMs) {
+    lock_guard<mutex> lock(fileMutex);
+    syncIntervalMs = intervalMs;
+}
+
+void CSVWriter::setDurability(Durability newDurability) {
+    lock_guard<mutex> lock(fileMutex);
+    durability = newDurability;
+}
+
+void CSVWriter::setSegmentSize(int values) {
+    lock_guard<mutex> lock(fileMutex);
+    if (mapped) {
+        mapped->setCapacity(static_cast<size_t>(values) * MAX_VALUE_CHARS);
+    }
+}
+
 // Generates a new CSV filename based on the current timestamp.
 #include <chrono>
 #include <iomanip>
@@ -61,7 +226,12 @@ string CSVWriter::generateFilename() {
     ostringstream oss;
     oss << outputDir << "/"
         << put_time(&local_time, "%Y%m%d%H%M%S")  // Year-Month-Day Hour-Minute-Second
-        << "_" << label << ".csv";
+        << "_" << label;
 
-    return oss.str();
+    // **A second segment within the same second gets -2, -3, ... instead of replacing the first**
+    string filename = oss.str() + ".csv";
+    for (int n = 2; filename == currentFilename || fs::exists(filename); n++) {
+        filename = oss.str() + "-" + to_string(n) + ".csv";
+    }
+    return filename;
 }
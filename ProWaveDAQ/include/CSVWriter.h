@@ -8,6 +8,16 @@
 #include <mutex>
 #include <chrono>
 #include <filesystem>
+#include <memory>
+#include <thread>
+#include <condition_variable>
+#include "AsyncFileWriter.h"
+#include "BlockKernels.h"
+#include "MappedFileWriter.h"
+#include "RecordingJournal.h"
+#include "DataBlock.h"
+#include "Metrics.h"
+#include "Trace.h"
 
 using namespace std;
 namespace fs = filesystem;
@@ -16,23 +26,81 @@ namespace fs = filesystem;
 class CSVWriter {
 public:
     // Constructor: Initializes CSVWriter with the number of channels, output directory, and label.
-    CSVWriter(int numChannels, const string& outputDir, const string& label);
-    
+    // syncIntervalMs: how often written data is fsync'ed (0 = only when a file is closed).
+    // writerOptions: backend doing the writes and syncs off the calling thread.
+    CSVWriter(int numChannels, const string& outputDir, const string& label, int syncIntervalMs = 1000,
+              const WriterOptions& writerOptions = WriterOptions());
+
+    // Destructor: syncs and closes the current file.
+    ~CSVWriter();
+
     // Writes a block of data to the current CSV file.
     void addDataBlock(vector<double>&& dataBlock);
-    
+
+    // Writes a block and tracks its age from acquisition until written and until synced.
+    void addDataBlock(const DataBlock& block);
+
     // Updates the filename when a new save unit is triggered.
     void updateFilename();
 
+    // Changes the periodic fsync interval (0 = only when a file is closed).
+    void setSyncInterval(int intervalMs);
+
+    // When written data is synced (see Durability); the interval is syncIntervalMs.
+    void setDurability(Durability durability);
+
+    // Values per segment, sizing the preallocated files of the mapped mode.
+    void setSegmentSize(int values);
+
 private:
+    // Longest field of a sensor value (int16 / 8192 printed as %g, e.g. "-0.00012207,")
+    static constexpr size_t MAX_VALUE_CHARS = 12;
+
     int numChannels;         // Number of data channels
+    BlockKernels blockKernels; // Row formatting specialised for numChannels
     string outputDir;        // Directory where CSV files will be stored
     string label;            // Label used in the filename
     string currentFilename;  // Current CSV filename
     mutex fileMutex;         // Mutex for thread safety
+    MetricRate& bytesMetric; // Bytes written to CSV files
+    HdrHistogram& writeLatency; // Duration of each addDataBlock() (ns)
+
+    // End-to-end sample latency: acquisition -> queued for writing -> fdatasync() returned
+    unique_ptr<AsyncFileWriter> file; // Writes currentFilename (opened on first write)
+    unique_ptr<MappedFileWriter> mapped; // Replaces file in the preallocated, mapped mode
+    int syncIntervalMs;      // Periodic fsync interval (0 = on close only)
+    Durability durability;
+    chrono::steady_clock::time_point lastSync;
+    vector<chrono::steady_clock::time_point> unsynced; // Acquisition times written since the last sync
+    HdrHistogram& writtenAge;                // Live, all files
+    HdrHistogram& syncedAge;                 // Live, all files
+    unique_ptr<HdrHistogram> fileWrittenAge; // Current file only
+    unique_ptr<HdrHistogram> fileSyncedAge;  // Current file only
+
+    unique_ptr<RecordingJournal> journal; // Committed lengths of the files in outputDir
+
+    // Group commit: the first block after a sync schedules the next one syncIntervalMs later
+    thread committer;
+    condition_variable commitWake;
+    bool commitScheduled;
+    chrono::steady_clock::time_point commitDue;
+    bool stopping;
 
     // Generates a new CSV filename based on the current timestamp.
     string generateFilename();
+
+    // Formats rows and appends them to the current file; returns false on I/O error.
+    bool writeRows(const vector<double>& dataBlock);
+
+    // Requests a sync of the current file; the age of every block it makes durable
+    // is recorded when it completes.
+    void syncFile();
+
+    // Runs the scheduled group commits.
+    void commitLoop();
+
+    // Syncs and closes the current file, then appends its latency summary.
+    void closeFile();
 };
 
 #endif // CSV_WRITER_H
@@ -0,0 +1,104 @@
+#include "ConfigWatcher.h"
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+ConfigWatcher::ConfigWatcher(const vector<string>& paths, ChangeFn onChange, int debounceMs)
+    : paths(paths), onChange(move(onChange)), debounceMs(debounceMs), inotifyFd(-1), running(false) {}
+
+ConfigWatcher::~ConfigWatcher() {
+    stop();
+}
+
+bool ConfigWatcher::start() {
+    if (running) {
+        return true;
+    }
+
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) {
+        cerr << "Error: Unable to initialize inotify, configuration is not watched" << endl;
+        return false;
+    }
+
+    for (const string& path : paths) {
+        fs::path dir = fs::path(path).parent_path();
+        if (dir.empty()) {
+            dir = fs::current_path();
+        }
+        int wd = inotify_add_watch(inotifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0) {
+            cerr << "Error: Unable to watch " << dir.string() << endl;
+            continue;
+        }
+        watchedDirs[wd] = dir.string();
+    }
+
+    running = true;
+    watchThread = thread(&ConfigWatcher::watchLoop, this);
+    return true;
+}
+
+void ConfigWatcher::stop() {
+    if (running) {
+        running = false;
+        if (watchThread.joinable()) {
+            watchThread.join();
+        }
+    }
+    if (inotifyFd >= 0) {
+        close(inotifyFd);
+        inotifyFd = -1;
+        watchedDirs.clear();
+    }
+}
+
+bool ConfigWatcher::isWatched(int wd, const string& name) const {
+    auto dir = watchedDirs.find(wd);
+    if (dir == watchedDirs.end()) {
+        return false;
+    }
+    fs::path changed = fs::absolute(fs::path(dir->second) / name).lexically_normal();
+    for (const string& path : paths) {
+        if (fs::absolute(path).lexically_normal() == changed) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Polls with a short timeout so stop() is noticed promptly; a pending change
+// fires once no further event arrived for debounceMs.
+void ConfigWatcher::watchLoop() {
+    alignas(inotify_event) char buffer[4096];
+    bool changed = false;
+    auto lastEvent = chrono::steady_clock::now();
+
+    while (running) {
+        pollfd pfd = {inotifyFd, POLLIN, 0};
+        if (poll(&pfd, 1, 100) > 0) {
+            ssize_t n;
+            while ((n = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+                for (char* p = buffer; p < buffer + n;) {
+                    auto* event = reinterpret_cast<inotify_event*>(p);
+                    if (event->len > 0 && isWatched(event->wd, event->name)) {
+                        changed = true;
+                        lastEvent = chrono::steady_clock::now();
+                    }
+                    p += sizeof(inotify_event) + event->len;
+                }
+            }
+        }
+
+        if (changed && chrono::steady_clock::now() - lastEvent >= chrono::milliseconds(debounceMs)) {
+            changed = false;
+            onChange();
+        }
+    }
+}
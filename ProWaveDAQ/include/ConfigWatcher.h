@@ -0,0 +1,46 @@
+#ifndef CONFIG_WATCHER_H
+#define CONFIG_WATCHER_H
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// ConfigWatcher calls onChange when one of the watched files is rewritten.
+// The parent directories are watched with inotify, so files replaced by an
+// editor (write to a temp file + rename) are picked up as well. Bursts of
+// events are coalesced into one call once the files have been quiet for
+// debounceMs.
+class ConfigWatcher {
+public:
+    using ChangeFn = function<void()>;
+
+    ConfigWatcher(const vector<string>& paths, ChangeFn onChange, int debounceMs = 200);
+    ~ConfigWatcher();
+
+    // Starts the watcher thread. Returns false if inotify is unavailable.
+    bool start();
+
+    // Stops the watcher thread.
+    void stop();
+
+private:
+    vector<string> paths;
+    ChangeFn onChange;
+    int debounceMs;
+    int inotifyFd;
+    map<int, string> watchedDirs;   // Watch descriptor -> directory
+    atomic<bool> running;
+    thread watchThread;
+
+    void watchLoop();
+
+    // True if the event names one of the watched files.
+    bool isWatched(int wd, const string& name) const;
+};
+
+#endif // CONFIG_WATCHER_H
@@ -0,0 +1,114 @@
+#include "ControlServer.h"
+
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+ControlServer::ControlServer(Handler handler)
+    : handler(move(handler)), listenFd(-1), running(false) {}
+
+ControlServer::~ControlServer() {
+    stop();
+}
+
+bool ControlServer::start(const string& path) {
+    if (running) {
+        return true;
+    }
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        cerr << "Error: Control socket path too long: " << path << endl;
+        return false;
+    }
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        cerr << "Error: Unable to create control socket!" << endl;
+        return false;
+    }
+
+    unlink(path.c_str()); // Remove a socket left behind by a previous run
+    if (::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listenFd, 4) < 0) {
+        cerr << "Error: Unable to bind control socket: " << path << endl;
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+
+    socketPath = path;
+    running = true;
+    serverThread = thread(&ControlServer::serveLoop, this);
+    cout << "Control socket listening on " << path << endl;
+    return true;
+}
+
+void ControlServer::stop() {
+    if (running) {
+        running = false;
+        if (serverThread.joinable()) {
+            serverThread.join();
+        }
+    }
+    if (listenFd >= 0) {
+        close(listenFd);
+        listenFd = -1;
+        unlink(socketPath.c_str());
+    }
+}
+
+void ControlServer::serveLoop() {
+    while (running) {
+        pollfd pfd = {listenFd, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0) {
+            continue;
+        }
+        int clientFd = accept(listenFd, nullptr, nullptr);
+        if (clientFd >= 0) {
+            handleClient(clientFd);
+            close(clientFd);
+        }
+    }
+}
+
+// Serves one connection: one response line per command line until EOF.
+void ControlServer::handleClient(int clientFd) {
+    string buffer;
+    char chunk[256];
+
+    while (running) {
+        pollfd pfd = {clientFd, POLLIN, 0};
+        int ready = poll(&pfd, 1, 200);
+        if (ready == 0) {
+            continue;
+        }
+        if (ready < 0) {
+            return;
+        }
+        ssize_t n = recv(clientFd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            return;
+        }
+        buffer.append(chunk, n);
+
+        size_t newline;
+        while ((newline = buffer.find('\n')) != string::npos) {
+            string command = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            if (!command.empty() && command.back() == '\r') {
+                command.pop_back();
+            }
+            if (command.empty()) {
+                continue;
+            }
+            string response = handler(command) + "\n";
+            send(clientFd, response.data(), response.size(), MSG_NOSIGNAL);
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef CONTROL_SERVER_H
+#define CONTROL_SERVER_H
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+// ControlServer accepts line-based commands on a local Unix domain socket, e.g.
+//
+//   echo "label bearing_a" | socat - UNIX-CONNECT:/tmp/prowavedaq.sock
+//
+// Each line is passed to the handler and its return value is sent back.
+class ControlServer {
+public:
+    using Handler = function<string(const string& command)>;
+
+    explicit ControlServer(Handler handler);
+    ~ControlServer();
+
+    // Creates the socket at path (replacing a stale one). Returns false on failure.
+    bool start(const string& path);
+
+    // Stops the server thread and removes the socket file.
+    void stop();
+
+private:
+    Handler handler;
+    string socketPath;
+    int listenFd;
+    atomic<bool> running;
+    thread serverThread;
+
+    void serveLoop();
+    void handleClient(int clientFd);
+};
+
+#endif // CONTROL_SERVER_H
@@ -0,0 +1,19 @@
+#ifndef DATA_BLOCK_H
+#define DATA_BLOCK_H
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// One block of acquired vibration data together with its provenance.
+struct DataBlock {
+    vector<double> samples;                       // Interleaved XYZ values in g
+    chrono::steady_clock::time_point acquiredAt;  // When readLoop() received the block from the sensor
+    uint64_t firstSample = 0;                     // Index of the first 3-axis sample since startReading()
+    uint64_t sequence = 0;                        // Read counter value when the block was published
+    uint16_t fifoBacklog = 0;                     // Values still in the sensor FIFO after this block was read
+};
+
+#endif // DATA_BLOCK_H
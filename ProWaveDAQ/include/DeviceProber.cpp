@@ -0,0 +1,108 @@
+#include "DeviceProber.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <regex>
+#include <sstream>
+#include <thread>
+#include <modbus/modbus.h>
+
+namespace fs = std::filesystem;
+
+DeviceProber::DeviceProber(const ProbeOptions& options) : options(options) {}
+
+vector<string> DeviceProber::listPorts(const string& pattern) {
+    vector<string> ports;
+    regex portRegex(pattern);
+
+    error_code ec;
+    for (const auto& entry : fs::directory_iterator("/dev/", ec)) {
+        string path = entry.path().string();
+        if (regex_match(path, portRegex)) {
+            ports.push_back(path);
+        }
+    }
+    sort(ports.begin(), ports.end());
+    return ports;
+}
+
+bool DeviceProber::probePort(const string& port, ProbeResult& result) const {
+    for (int baudRate : options.baudRates) {
+        modbus_t* ctx = modbus_new_rtu(port.c_str(), baudRate, 'N', 8, 1);
+        if (!ctx) {
+            continue;
+        }
+        if (modbus_connect(ctx) == -1) {
+            // **The port itself cannot be opened: other baud rates will not help**
+            modbus_free(ctx);
+            return false;
+        }
+        modbus_set_response_timeout(ctx, 0, options.timeoutMs * 1000);
+
+        for (int slaveID : options.slaveIDs) {
+            uint16_t chipId[3];
+            if (modbus_set_slave(ctx, slaveID) == -1) {
+                continue;
+            }
+            if (modbus_read_input_registers(ctx, 0x80, 3, chipId) == 3) {
+                result.port = port;
+                result.baudRate = baudRate;
+                result.slaveID = slaveID;
+                copy(chipId, chipId + 3, result.chipId);
+                modbus_close(ctx);
+                modbus_free(ctx);
+                return true;
+            }
+            modbus_flush(ctx); // Drop a late or garbled reply before the next attempt
+        }
+        modbus_close(ctx);
+        modbus_free(ctx);
+    }
+    return false;
+}
+
+vector<ProbeResult> DeviceProber::probe() {
+    vector<string> ports = options.ports.empty() ? listPorts(options.portPattern) : options.ports;
+
+    // **One thread per port; each writes only its own slot**
+    vector<ProbeResult> results(ports.size());
+    unique_ptr<bool[]> found(new bool[ports.size()]());
+    vector<thread> workers;
+    for (size_t i = 0; i < ports.size(); i++) {
+        workers.emplace_back([&, i]() {
+            auto start = chrono::steady_clock::now();
+            found[i] = probePort(ports[i], results[i]);
+            results[i].seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    vector<ProbeResult> sensors;
+    for (size_t i = 0; i < ports.size(); i++) {
+        if (found[i]) {
+            sensors.push_back(results[i]);
+        } else {
+            cerr << "No sensor on " << ports[i] << " (" << fixed << setprecision(2)
+                 << results[i].seconds << " s)" << endl;
+        }
+    }
+    return sensors;
+}
+
+string DeviceProber::toIni(const ProbeResult& result, int sampleRate, const string& section) {
+    ostringstream out;
+    out << "; ChipID " << hex << result.chipId[0] << ", " << result.chipId[1] << ", "
+        << result.chipId[2] << dec << "\n"
+        << "[" << section << "]\n"
+        << "serialPort = " << result.port << "\n"
+        << "baudRate = " << result.baudRate << "\n"
+        << "sampleRate = " << sampleRate << "\n"
+        << "slaveID = " << result.slaveID << "\n";
+    return out.str();
+}
@@ -0,0 +1,51 @@
+#ifndef DEVICE_PROBER_H
+#define DEVICE_PROBER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// A sensor that answered a chip ID read at 0x80.
+struct ProbeResult {
+    string port;          // Serial port path
+    int baudRate = 0;     // Baud rate that worked
+    int slaveID = 0;      // Modbus slave ID that answered
+    uint16_t chipId[3] = {0, 0, 0};
+    double seconds = 0;   // Time spent probing this port
+};
+
+// Search space for DeviceProber.
+struct ProbeOptions {
+    vector<string> ports;                      // Explicit ports; empty = scan /dev
+    string portPattern = "/dev/tty(USB|ACM)[0-9]+";
+    vector<int> baudRates = {3000000, 921600, 460800, 230400, 115200, 19200, 9600};
+    vector<int> slaveIDs = {1, 2, 3, 4};
+    int timeoutMs = 50;                        // Response timeout per attempt
+};
+
+// DeviceProber finds sensors by trying every baud rate / slave ID combination
+// on each candidate port. Ports are probed concurrently (one thread each), so
+// discovery takes as long as the slowest port rather than the sum of all ports.
+class DeviceProber {
+public:
+    explicit DeviceProber(const ProbeOptions& options = ProbeOptions());
+
+    // Lists serial ports in /dev matching the pattern, sorted.
+    static vector<string> listPorts(const string& pattern);
+
+    // Probes all candidate ports in parallel and returns the sensors found.
+    vector<ProbeResult> probe();
+
+    // Formats a result as a ProWaveDAQ.ini section.
+    static string toIni(const ProbeResult& result, int sampleRate, const string& section = "ProWaveDAQ");
+
+private:
+    ProbeOptions options;
+
+    // Tries each baud rate and slave ID on one port; stops at the first answer.
+    bool probePort(const string& port, ProbeResult& result) const;
+};
+
+#endif // DEVICE_PROBER_H
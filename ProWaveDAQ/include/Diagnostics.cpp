@@ -0,0 +1,177 @@
+#include "Diagnostics.h"
+
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <unistd.h>
+
+Diagnostics::Diagnostics(ProWaveDAQ& daq, const DiagnosticOptions& options)
+    : daq(daq), options(options) {}
+
+vector<DiagnosticTrial> Diagnostics::run() {
+    PollConfig original = daq.getPollConfig();
+    vector<DiagnosticTrial> trials;
+
+    // **Measure the raw loop: backpressure would change the settings under test**
+    BackpressureSettings pressure = daq.getBackpressure();
+    BackpressureSettings disabled = pressure;
+    disabled.enabled = false;
+    daq.setBackpressure(disabled);
+
+    for (int readSize : options.readSizes) {
+        for (PollStrategy strategy : options.strategies) {
+            PollConfig config = original;
+            config.readSize = readSize;
+            config.strategy = strategy;
+            cerr << "Diagnosing readSize=" << readSize << " pollStrategy=" << pollStrategyName(strategy) << "..." << endl;
+            trials.push_back(runTrial(config));
+        }
+    }
+
+    daq.setPollConfig(original);
+    daq.setBackpressure(pressure);
+    return trials;
+}
+
+// **Runs the reading loop for one combination; statistics come from the transaction observer**
+DiagnosticTrial Diagnostics::runTrial(const PollConfig& config) {
+    DiagnosticTrial trial;
+    daq.setPollConfig(config);
+    trial.config = daq.getPollConfig();
+
+    auto transactionTime = make_unique<HdrHistogram>();
+    bool measuring = false;
+    auto measureStart = chrono::steady_clock::now();
+
+    // FIFO length regression sums (time in seconds from measureStart)
+    double n = 0, sumT = 0, sumF = 0, sumTT = 0, sumTF = 0;
+
+    daq.setTransactionObserver([&](const ModbusTransaction& t) {
+        if (!measuring) {
+            return;
+        }
+        if (!t.ok) {
+            trial.errors++;
+            return;
+        }
+        if (t.registers > 1) {
+            trial.dataReads++;
+            trial.samples += (t.registers - 1) / 3;
+            transactionTime->record(t.duration.count());
+        } else {
+            trial.lengthPolls++;
+        }
+
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - measureStart).count();
+        n++;
+        sumT += seconds;
+        sumF += t.fifoLength;
+        sumTT += seconds * seconds;
+        sumTF += seconds * t.fifoLength;
+        trial.fifoMax = max(trial.fifoMax, t.fifoLength);
+    });
+
+    daq.startPolling();
+    auto start = chrono::steady_clock::now();
+    auto warmupEnd = start + chrono::duration_cast<chrono::steady_clock::duration>(
+        chrono::duration<double>(options.warmupSeconds));
+    auto end = warmupEnd + chrono::duration_cast<chrono::steady_clock::duration>(
+        chrono::duration<double>(options.trialSeconds));
+
+    auto now = start;
+    while (now < end && daq.isReading()) {
+        if (!measuring && now >= warmupEnd) {
+            measuring = true;
+            measureStart = now;
+        }
+        int waitUs = daq.pollOnce();
+        if (waitUs > 0) {
+            usleep(waitUs);
+        }
+        now = chrono::steady_clock::now();
+    }
+    daq.stopPolling();
+    daq.setTransactionObserver(nullptr);
+
+    // **Summarise against sampleRate 3-axis samples (sampleRate × 3 values) per second**
+    int sampleRate = daq.getSampleRate();
+    trial.seconds = measuring ? chrono::duration<double>(now - measureStart).count() : 0;
+    trial.samplesPerSecond = trial.seconds > 0 ? trial.samples / trial.seconds : 0;
+    trial.achievedRatio = sampleRate > 0 ? trial.samplesPerSecond / sampleRate : 0;
+    if (n > 1 && n * sumTT - sumT * sumT > 0) {
+        trial.fifoTrend = (n * sumTF - sumT * sumF) / (n * sumTT - sumT * sumT);
+    }
+    trial.fifoMean = n > 0 ? sumF / n : 0;
+    trial.transaction = transactionTime->snapshot();
+
+    double incomingValues = sampleRate * 3.0;
+    if (trial.errors > 0) {
+        trial.reason = to_string(trial.errors) + " failed transactions";
+    } else if (trial.achievedRatio < MIN_RATIO) {
+        ostringstream reason;
+        reason << fixed << setprecision(1) << "only " << trial.achievedRatio * 100 << "% of the sample rate";
+        trial.reason = reason.str();
+    } else if (trial.fifoTrend > MAX_TREND * incomingValues) {
+        ostringstream reason;
+        reason << fixed << setprecision(0) << "FIFO grows by " << trial.fifoTrend << " values/s";
+        trial.reason = reason.str();
+    } else {
+        trial.sustainable = true;
+    }
+    return trial;
+}
+
+const DiagnosticTrial* Diagnostics::recommended(const vector<DiagnosticTrial>& trials) {
+    const DiagnosticTrial* best = nullptr;
+    auto rate = [](const DiagnosticTrial& t) { return (t.dataReads + t.lengthPolls) / max(t.seconds, 1e-9); };
+    for (const auto& trial : trials) {
+        if (trial.sustainable && (!best || rate(trial) < rate(*best))) {
+            best = &trial;
+        }
+    }
+    return best;
+}
+
+string Diagnostics::report(const vector<DiagnosticTrial>& trials) const {
+    ostringstream out;
+    int sampleRate = daq.getSampleRate();
+    out << "Diagnostics for " << daq.getSerialPort() << " at " << daq.getBaudRate() << " baud, "
+        << sampleRate << " Hz (" << sampleRate * 3 << " values/s)\n\n";
+
+    out << left << setw(6) << "read" << setw(8) << "poll"
+        << right << setw(11) << "samples/s" << setw(8) << "ratio"
+        << setw(12) << "fifo trend" << setw(10) << "fifo avg" << setw(9) << "fifo max"
+        << setw(9) << "reads/s" << setw(9) << "polls/s"
+        << setw(10) << "txn p50" << setw(10) << "txn p99" << setw(10) << "txn max"
+        << "  verdict\n";
+
+    out << fixed;
+    for (const auto& t : trials) {
+        double seconds = max(t.seconds, 1e-9);
+        out << left << setw(6) << t.config.readSize << setw(8) << pollStrategyName(t.config.strategy)
+            << right << setprecision(0) << setw(11) << t.samplesPerSecond
+            << setprecision(3) << setw(8) << t.achievedRatio
+            << setprecision(1) << setw(12) << t.fifoTrend << setw(10) << t.fifoMean << setw(9) << t.fifoMax
+            << setprecision(0) << setw(9) << t.dataReads / seconds << setw(9) << t.lengthPolls / seconds
+            << setprecision(0) << setw(8) << t.transaction.p50 / 1e3 << "us"
+            << setw(8) << t.transaction.p99 / 1e3 << "us"
+            << setw(8) << t.transaction.max / 1e3 << "us"
+            << "  " << (t.sustainable ? "ok" : "NO: " + t.reason) << "\n";
+    }
+
+    const DiagnosticTrial* best = recommended(trials);
+    out << "\n";
+    if (best) {
+        out << "SUSTAINABLE: recommended [ProWaveDAQ] settings (fewest transactions/s)\n"
+            << "readSize = " << best->config.readSize << "\n"
+            << "pollStrategy = " << pollStrategyName(best->config.strategy) << "\n";
+    } else {
+        double bestRatio = 0;
+        for (const auto& t : trials) {
+            bestRatio = max(bestRatio, t.achievedRatio);
+        }
+        out << "NOT SUSTAINABLE: best trial reached " << setprecision(1) << bestRatio * 100
+            << "% of the sample rate; lower sampleRate or raise baudRate\n";
+    }
+    return out.str();
+}
@@ -0,0 +1,71 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <string>
+#include <vector>
+
+#include "HdrHistogram.h"
+#include "ProWaveDAQ.h"
+
+using namespace std;
+
+struct DiagnosticOptions {
+    vector<int> readSizes = {12, 30, 60, 90, 123};            // Values per data transaction
+    vector<PollStrategy> strategies = {PollStrategy::Sleep, PollStrategy::Busy, PollStrategy::Paced};
+    double trialSeconds = 3.0;                                // Measured time per combination
+    double warmupSeconds = 0.5;                               // Not measured: drains the FIFO backlog
+};
+
+// Result of one read size / poll strategy combination.
+struct DiagnosticTrial {
+    PollConfig config;
+    double seconds = 0;                 // Measured wall time
+    uint64_t samples = 0;               // 3-axis samples read
+    double samplesPerSecond = 0;
+    double achievedRatio = 0;           // samplesPerSecond / sampleRate
+    double fifoTrend = 0;               // Least-squares FIFO length slope (values/s); > 0 = falling behind
+    double fifoMean = 0;
+    uint16_t fifoMax = 0;
+    uint64_t dataReads = 0;
+    uint64_t lengthPolls = 0;           // FIFO-length-only reads
+    uint64_t errors = 0;
+    HdrSnapshot transaction;            // Data transaction time (ns)
+    bool sustainable = false;
+    string reason;                      // Why it is not sustainable
+};
+
+// Measures whether a port/baud/sample-rate combination keeps up with the
+// sensor: for every read size and poll strategy it runs the reading loop
+// for a while on the calling thread (no per-transaction output), and
+// compares achieved samples/s with the sample rate, watches the FIFO depth
+// trend and records the transaction time distribution.
+//
+// A trial is sustainable when it reaches MIN_RATIO of the sample rate, the
+// FIFO does not grow by more than MAX_TREND of the incoming values and no
+// transaction fails.
+class Diagnostics {
+public:
+    static constexpr double MIN_RATIO = 0.99;
+    static constexpr double MAX_TREND = 0.01;
+
+    // daq must be initialised (initDevices) and not reading.
+    Diagnostics(ProWaveDAQ& daq, const DiagnosticOptions& options = DiagnosticOptions());
+
+    // Runs every combination; restores the device's poll settings afterwards.
+    vector<DiagnosticTrial> run();
+
+    // Table of all trials, a verdict and the recommended ProWaveDAQ.ini settings.
+    string report(const vector<DiagnosticTrial>& trials) const;
+
+    // The sustainable trial with the fewest transactions per second
+    // (most idle bus time), or nullptr if none is sustainable.
+    static const DiagnosticTrial* recommended(const vector<DiagnosticTrial>& trials);
+
+private:
+    ProWaveDAQ& daq;
+    DiagnosticOptions options;
+
+    DiagnosticTrial runTrial(const PollConfig& config);
+};
+
+#endif // DIAGNOSTICS_H
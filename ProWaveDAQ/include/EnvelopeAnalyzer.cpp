@@ -0,0 +1,246 @@
+#include "EnvelopeAnalyzer.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+// Envelope low-pass cut-off as a fraction of the envelope rate (anti-aliasing before decimation)
+static const double ENVELOPE_CUTOFF = 0.4;
+
+// Mean of a full-wave rectified sine is 2/pi of its amplitude
+static const float RECTIFIED_GAIN = static_cast<float>(M_PI / 2);
+
+static const char* AXIS_NAMES[3] = {"x", "y", "z"};
+
+string EnvelopeAnalyzer::check(const EnvelopeOptions& options, int sampleRate) {
+    if (sampleRate <= 0) {
+        return "sample rate must be positive";
+    }
+    if (options.bandLowHz <= 0 || options.bandHighHz <= options.bandLowHz || options.bandHighHz >= sampleRate / 2.0) {
+        return "band must satisfy 0 < bandLowHz < bandHighHz < sampleRate / 2";
+    }
+    if (options.decimation < 1) {
+        return "decimation must be >= 1";
+    }
+    if (options.fftSize < 64 || options.fftSize > 65536 || (options.fftSize & (options.fftSize - 1)) != 0) {
+        return "fftSize must be a power of two in 64..65536";
+    }
+    if (options.cadenceSeconds <= 0) {
+        return "cadenceSeconds must be positive";
+    }
+    return "";
+}
+
+EnvelopeAnalyzer::EnvelopeAnalyzer(int sampleRate, const EnvelopeOptions& options, Sink sink)
+    : sampleRate(sampleRate), options(options), sink(move(sink)), phase(0), history(options.fftSize),
+      head(0), filled(0), sinceSpectrum(0), cadenceSamples(1), window(options.fftSize),
+      twiddles(options.fftSize / 2), bitReversed(options.fftSize), xy(options.fftSize), z(options.fftSize),
+      lastResolutionHz(0), haveSpectrum(false),
+      processLatency(Metrics::instance().latency("prowavedaq_envelope_process_seconds",
+          "Envelope demodulation of one block")),
+      spectrumLatency(Metrics::instance().latency("prowavedaq_envelope_spectrum_seconds",
+          "One envelope spectrum (all axes)")) {
+    const size_t n = options.fftSize;
+    int bits = 0;
+    while ((size_t(1) << bits) < n) {
+        bits++;
+    }
+    for (size_t i = 0; i < n; i++) {
+        window[i] = static_cast<float>(0.5 - 0.5 * cos(2 * M_PI * i / n));
+        uint32_t reversed = 0;
+        for (int b = 0; b < bits; b++) {
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        bitReversed[i] = reversed;
+    }
+    for (size_t k = 0; k < n / 2; k++) {
+        twiddles[k] = polar(1.0f, static_cast<float>(-2 * M_PI * k / n));
+    }
+    spectrum.amplitude.reserve(3 * (n / 2 + 1));
+    for (int axis = 0; axis < 3; axis++) {
+        string labels = Metrics::label("axis", AXIS_NAMES[axis]);
+        peakHzGauges[axis] = &Metrics::instance().gauge("prowavedaq_envelope_peak_hz",
+            "Frequency of the largest envelope spectrum line", labels);
+        peakGauges[axis] = &Metrics::instance().gauge("prowavedaq_envelope_peak_g",
+            "Amplitude of the largest envelope spectrum line", labels);
+        rmsGauges[axis] = &Metrics::instance().gauge("prowavedaq_envelope_rms_g",
+            "Envelope rms about its mean", labels);
+        lastPeakHz[axis] = lastPeakAmplitude[axis] = lastRms[axis] = 0;
+    }
+    design();
+}
+
+void EnvelopeAnalyzer::setSampleRate(int newSampleRate) {
+    {
+        // summary() reads the rate from other threads; this thread alone writes it
+        lock_guard<mutex> lock(summaryMutex);
+        sampleRate = newSampleRate;
+    }
+    design();
+}
+
+// **Filters for the current rate; the envelope window starts over**
+void EnvelopeAnalyzer::design() {
+    double envelopeRate = static_cast<double>(sampleRate) / options.decimation;
+    double cutoff = min(ENVELOPE_CUTOFF * envelopeRate, 0.45 * sampleRate);
+    for (int i = 0; i < 2; i++) {
+        band[i] = Biquad::highPass(options.bandLowHz, sampleRate, BUTTERWORTH4_Q[i]);
+        band[2 + i] = Biquad::lowPass(options.bandHighHz, sampleRate, BUTTERWORTH4_Q[i]);
+        smooth[i] = Biquad::lowPass(cutoff, sampleRate, BUTTERWORTH4_Q[i]);
+    }
+    phase = 0;
+    head = 0;
+    filled = 0;
+    sinceSpectrum = 0;
+    cadenceSamples = max<size_t>(1, static_cast<size_t>(lround(options.cadenceSeconds * envelopeRate)));
+
+    spectrum.resolutionHz = envelopeRate / options.fftSize;
+    spectrum.bins = min(options.fftSize / 2 + 1, static_cast<size_t>(cutoff / spectrum.resolutionHz) + 1);
+    spectrum.amplitude.assign(3 * spectrum.bins, 0.0f);   // Within the reserved capacity
+}
+
+void EnvelopeAnalyzer::push(const DataBlock& block) {
+    TRACE_SPAN("envelope");
+    auto start = chrono::steady_clock::now();
+    const double* values = block.samples.data();
+    size_t frames = block.samples.size() / 3;
+    const size_t n = options.fftSize;
+
+    for (size_t f = 0; f < frames; f++) {
+        // **One frame per vector: X, Y and Z go through every stage side by side**
+        FrameLanes x = loadFrame(values, f);
+        for (Biquad& section : band) {
+            x = section.run(x);
+        }
+        x = x < 0 ? -x : x;
+        for (Biquad& section : smooth) {
+            x = section.run(x);
+        }
+        if (++phase < options.decimation) {
+            continue;
+        }
+        phase = 0;
+        history[head] = x;
+        head = head + 1 == n ? 0 : head + 1;
+        filled = min(filled + 1, n);
+        if (++sinceSpectrum >= cadenceSamples && filled == n) {
+            sinceSpectrum = 0;
+            computeSpectrum(block.firstSample + f, block.acquiredAt);
+        }
+    }
+    processLatency.recordSince(start);
+}
+
+// In-place radix-2 decimation-in-time FFT of data in bit-reversed order.
+void EnvelopeAnalyzer::fft(vector<complex<float>>& data) const {
+    const size_t n = data.size();
+    for (size_t length = 2; length <= n; length <<= 1) {
+        size_t half = length / 2;
+        size_t stride = n / length;
+        for (size_t i = 0; i < n; i += length) {
+            for (size_t j = 0; j < half; j++) {
+                // **Plain multiply: complex<float>'s operator* checks for NaN/inf on every call**
+                const complex<float>& w = twiddles[j * stride];
+                const complex<float>& b = data[i + j + half];
+                complex<float> v(b.real() * w.real() - b.imag() * w.imag(), b.real() * w.imag() + b.imag() * w.real());
+                complex<float> u = data[i + j];
+                data[i + j] = u + v;
+                data[i + j + half] = u - v;
+            }
+        }
+    }
+}
+
+void EnvelopeAnalyzer::computeSpectrum(uint64_t lastSample, chrono::steady_clock::time_point acquiredAt) {
+    TRACE_SPAN("envelopeSpectrum");
+    auto start = chrono::steady_clock::now();
+    const size_t n = options.fftSize;
+
+    FrameLanes mean = {};
+    for (const FrameLanes& v : history) {
+        mean += v;
+    }
+    mean /= static_cast<float>(n);
+
+    // **X + iY in one complex FFT, Z in another; the oldest sample first**
+    FrameLanes sumSquares = {};
+    for (size_t i = 0; i < n; i++) {
+        FrameLanes v = history[head + i < n ? head + i : head + i - n] - mean;
+        sumSquares += v * v;
+        v *= window[i];
+        xy[bitReversed[i]] = complex<float>(v[0], v[1]);
+        z[bitReversed[i]] = complex<float>(v[2], 0.0f);
+    }
+    fft(xy);
+    fft(z);
+
+    // Single-sided amplitude: 2 / sum(window) = 4 / n, in g of envelope
+    const float scale = 4.0f / n * RECTIFIED_GAIN;
+    float* amplitudes[3] = {&spectrum.amplitude[0], &spectrum.amplitude[spectrum.bins],
+                            &spectrum.amplitude[2 * spectrum.bins]};
+    for (size_t k = 0; k < spectrum.bins; k++) {
+        complex<float> a = xy[k];
+        complex<float> b = conj(xy[k == 0 ? 0 : n - k]);
+        complex<float> x = (a + b) * 0.5f;
+        complex<float> y = (a - b) * complex<float>(0.0f, -0.5f);
+        float factor = k == 0 ? scale / 2 : scale;
+        amplitudes[0][k] = abs(x) * factor;
+        amplitudes[1][k] = abs(y) * factor;
+        amplitudes[2][k] = abs(z[k]) * factor;
+    }
+
+    spectrum.lastSample = lastSample;
+    spectrum.acquiredAt = acquiredAt;
+    for (int axis = 0; axis < 3; axis++) {
+        const float* line = amplitudes[axis];
+        size_t peak = spectrum.bins > 1 ? max_element(line + 1, line + spectrum.bins) - line : 0;
+        spectrum.peakHz[axis] = static_cast<float>(peak * spectrum.resolutionHz);
+        spectrum.peakAmplitude[axis] = line[peak];
+        spectrum.rms[axis] = sqrt(sumSquares[axis] / n) * RECTIFIED_GAIN;
+        peakHzGauges[axis]->set(spectrum.peakHz[axis]);
+        peakGauges[axis]->set(spectrum.peakAmplitude[axis]);
+        rmsGauges[axis]->set(spectrum.rms[axis]);
+    }
+    {
+        lock_guard<mutex> lock(summaryMutex);
+        copy(spectrum.peakHz, spectrum.peakHz + 3, lastPeakHz);
+        copy(spectrum.peakAmplitude, spectrum.peakAmplitude + 3, lastPeakAmplitude);
+        copy(spectrum.rms, spectrum.rms + 3, lastRms);
+        lastResolutionHz = spectrum.resolutionHz;
+        haveSpectrum = true;
+    }
+    spectrumLatency.recordSince(start);
+    if (sink) {
+        sink(spectrum);
+    }
+}
+
+string EnvelopeAnalyzer::summary() {
+    lock_guard<mutex> lock(summaryMutex);
+    ostringstream out;
+    if (!haveSpectrum) {
+        out << "envelope: no spectrum yet (" << options.fftSize * options.decimation / static_cast<double>(sampleRate)
+            << " s of data per window)\n";
+        return out.str();
+    }
+    out << "envelope " << options.bandLowHz << "-" << options.bandHighHz << " Hz, resolution "
+        << lastResolutionHz << " Hz\n";
+    for (int axis = 0; axis < 3; axis++) {
+        out << AXIS_NAMES[axis] << ": peak " << lastPeakHz[axis] << " Hz " << lastPeakAmplitude[axis]
+            << " g, rms " << lastRms[axis] << " g\n";
+    }
+    return out.str();
+}
+
+void EnvelopeAnalyzer::appendCsv(const EnvelopeSpectrum& spectrum, ostream& out) {
+    for (int axis = 0; axis < 3; axis++) {
+        out << spectrum.lastSample << "," << AXIS_NAMES[axis] << "," << spectrum.resolutionHz << ","
+            << spectrum.peakHz[axis] << "," << spectrum.peakAmplitude[axis] << "," << spectrum.rms[axis];
+        const float* line = &spectrum.amplitude[axis * spectrum.bins];
+        for (size_t k = 0; k < spectrum.bins; k++) {
+            out << "," << line[k];
+        }
+        out << "\n";
+    }
+}
@@ -0,0 +1,117 @@
+#ifndef ENVELOPE_ANALYZER_H
+#define ENVELOPE_ANALYZER_H
+
+#include <chrono>
+#include <complex>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Biquad.h"
+#include "DataBlock.h"
+#include "Metrics.h"
+
+using namespace std;
+
+// Settings from Master.ini [Envelope].
+struct EnvelopeOptions {
+    double bandLowHz = 1500;      // Band-pass around the bearing resonance
+    double bandHighHz = 3500;
+    int decimation = 8;           // Envelope rate = sampleRate / decimation
+    size_t fftSize = 1024;        // Envelope samples per spectrum (power of two)
+    double cadenceSeconds = 1.0;  // Between spectra (windows overlap when shorter than the window)
+};
+
+// Envelope spectrum of the last fftSize envelope samples of every axis.
+struct EnvelopeSpectrum {
+    uint64_t lastSample = 0;                    // Input sample index of the newest envelope sample
+    chrono::steady_clock::time_point acquiredAt;
+    double resolutionHz = 0;
+    size_t bins = 0;                            // Bins per axis, from 0 Hz up to the envelope cut-off
+    vector<float> amplitude;                    // 3 × bins, axis-major (g, single-sided)
+    float peakHz[3] = {};                       // Largest bin above 0 Hz
+    float peakAmplitude[3] = {};
+    float rms[3] = {};                          // Envelope rms about its mean (g)
+};
+
+// EnvelopeAnalyzer computes the envelope spectrum of every axis online, for
+// bearing-fault frequencies (BPFO, BPFI, ...) that modulate a high-frequency
+// resonance:
+//   band-pass (4th-order Butterworth high-pass + low-pass) -> full-wave
+//   rectify -> 4th-order Butterworth low-pass at 0.4 × the envelope rate ->
+//   decimate -> mean removal, Hann window, FFT.
+//
+// The filters run on the interleaved XYZ frames with one SIMD lane per axis
+// (see Biquad.h). The FFT transforms X and Y as one complex signal and Z on
+// its own. Every buffer is allocated in the constructor, so push() does not
+// allocate.
+class EnvelopeAnalyzer {
+public:
+    using Sink = function<void(const EnvelopeSpectrum& spectrum)>;
+
+    // Empty if options work at sampleRate, otherwise the reason.
+    static string check(const EnvelopeOptions& options, int sampleRate);
+
+    EnvelopeAnalyzer(int sampleRate, const EnvelopeOptions& options, Sink sink = nullptr);
+
+    // Feeds one block of interleaved XYZ values. Calls the sink (on this
+    // thread) each time a spectrum is due.
+    void push(const DataBlock& block);
+
+    // Redesigns the filters for a new input rate and restarts the window.
+    void setSampleRate(int sampleRate);
+    int getSampleRate() const { return sampleRate; }
+
+    // Peak frequency, amplitude and rms per axis of the last spectrum (any thread).
+    string summary();
+
+    // One CSV row per axis: sample,axis,resolution_hz,peak_hz,peak_g,rms_g, then every bin (g).
+    static void appendCsv(const EnvelopeSpectrum& spectrum, ostream& out);
+
+private:
+    static constexpr int BAND_SECTIONS = 4;      // 2 high-pass + 2 low-pass
+    static constexpr int ENVELOPE_SECTIONS = 2;
+
+    int sampleRate;                 // Written under summaryMutex (push thread only)
+    const EnvelopeOptions options;  // Fixed at construction, so summary() may read it
+    Sink sink;
+
+    Biquad band[BAND_SECTIONS];
+    Biquad smooth[ENVELOPE_SECTIONS];
+    int phase;                      // Input frames since the last kept envelope sample
+    vector<FrameLanes> history;     // Last fftSize envelope samples (ring)
+    size_t head;                    // Next write position in history
+    size_t filled;
+    size_t sinceSpectrum;           // Envelope samples since the last spectrum
+    size_t cadenceSamples;
+
+    // FFT scratch, sized once
+    vector<float> window;
+    vector<complex<float>> twiddles;
+    vector<uint32_t> bitReversed;
+    vector<complex<float>> xy;
+    vector<complex<float>> z;
+    EnvelopeSpectrum spectrum;
+
+    mutex summaryMutex;             // Guards sampleRate writes and the last* summary values
+    float lastPeakHz[3];
+    float lastPeakAmplitude[3];
+    float lastRms[3];
+    double lastResolutionHz;
+    bool haveSpectrum;
+
+    HdrHistogram& processLatency;    // push() of one block
+    HdrHistogram& spectrumLatency;   // One spectrum (both FFTs)
+    MetricGauge* peakHzGauges[3];
+    MetricGauge* peakGauges[3];
+    MetricGauge* rmsGauges[3];
+
+    void design();
+    void computeSpectrum(uint64_t lastSample, chrono::steady_clock::time_point acquiredAt);
+    void fft(vector<complex<float>>& data) const;
+};
+
+#endif // ENVELOPE_ANALYZER_H
@@ -0,0 +1,133 @@
+#include "HdrHistogram.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+
+HdrHistogram::HdrHistogram() {
+    for (int i = 0; i < MAX_WRITERS; i++) {
+        shards[i].store(nullptr, memory_order_relaxed);
+    }
+}
+
+HdrHistogram::~HdrHistogram() {
+    for (int i = 0; i < MAX_WRITERS; i++) {
+        delete shards[i].load(memory_order_relaxed);
+    }
+}
+
+// **Writer indexes are handed out per thread and returned when it exits**
+// (both constant-initialised, so usable from any static constructor)
+static mutex writerMutex;
+static bool writerUsed[64];
+
+namespace {
+struct WriterSlot {
+    int index = -1;
+
+    explicit WriterSlot(int writers) {
+        lock_guard<mutex> lock(writerMutex);
+        bool* free = find(writerUsed, writerUsed + writers, false);
+        if (free != writerUsed + writers) {
+            *free = true;
+            index = static_cast<int>(free - writerUsed);
+        }
+    }
+
+    ~WriterSlot() {
+        if (index >= 0) {
+            lock_guard<mutex> lock(writerMutex);
+            writerUsed[index] = false;   // The next thread continues this thread's counts
+        }
+    }
+};
+} // namespace
+
+int HdrHistogram::claimWriterIndex() {
+    static_assert(sizeof(writerUsed) == MAX_WRITERS, "one flag per writer index");
+    static thread_local WriterSlot slot(MAX_WRITERS);
+    return slot.index;
+}
+
+// Only the thread holding the writer index allocates its shard.
+HdrHistogram::Shard* HdrHistogram::addShard(int writer) {
+    Shard* shard = new Shard();
+    shards[writer].store(shard, memory_order_release);
+    return shard;
+}
+
+uint64_t HdrHistogram::valueAt(size_t index) {
+    if (index < SUB_BUCKET_COUNT) {
+        return index;
+    }
+    uint64_t exponent = index / SUB_BUCKET_HALF - 1;
+    uint64_t sub = index - exponent * SUB_BUCKET_HALF;
+    return ((sub + 1) << exponent) - 1;
+}
+
+HdrSnapshot HdrHistogram::snapshot() const {
+    HdrSnapshot s;
+
+    // **Merge the writers' counts once so all percentiles come from the same data**
+    static thread_local uint64_t copy[BUCKETS];
+    fill(copy, copy + BUCKETS, 0);
+    uint64_t sum = 0;
+    auto merge = [&](const Shard& shard) {
+        for (size_t i = 0; i < BUCKETS; i++) {
+            copy[i] += shard.counts[i].load(memory_order_relaxed);
+        }
+        sum += shard.sum.load(memory_order_relaxed);
+        s.max = max(s.max, shard.max.load(memory_order_relaxed));
+    };
+    merge(shared);
+    for (int w = 0; w < MAX_WRITERS; w++) {
+        if (const Shard* shard = shards[w].load(memory_order_acquire)) {
+            merge(*shard);
+        }
+    }
+    uint64_t total = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        total += copy[i];
+    }
+    s.count = total;
+    if (total == 0) {
+        s.max = 0;
+        return s;
+    }
+    s.mean = static_cast<double>(sum) / total;
+
+    const double targets[] = {0.5, 0.99, 0.999};
+    uint64_t* outputs[] = {&s.p50, &s.p99, &s.p999};
+    size_t next = 0;
+    bool minFound = false;
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < BUCKETS && next < 3; i++) {
+        if (copy[i] == 0) {
+            continue;
+        }
+        if (!minFound) {
+            s.min = valueAt(i);
+            minFound = true;
+        }
+        seen += copy[i];
+        while (next < 3 && seen >= targets[next] * total) {
+            *outputs[next] = min(valueAt(i), s.max);
+            next++;
+        }
+    }
+    return s;
+}
+
+string HdrHistogram::format(const HdrSnapshot& s, double scale, const string& unit) {
+    ostringstream out;
+    out << fixed << setprecision(3)
+        << "count=" << s.count
+        << " p50=" << s.p50 / scale << unit
+        << " p99=" << s.p99 / scale << unit
+        << " p99.9=" << s.p999 / scale << unit
+        << " max=" << s.max / scale << unit
+        << " mean=" << s.mean / scale << unit;
+    return out.str();
+}
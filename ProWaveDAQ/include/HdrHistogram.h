@@ -0,0 +1,123 @@
+#ifndef HDR_HISTOGRAM_H
+#define HDR_HISTOGRAM_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+// Percentile summary of an HdrHistogram at one point in time.
+struct HdrSnapshot {
+    uint64_t count = 0;
+    uint64_t min = 0;
+    uint64_t max = 0;
+    double mean = 0;
+    uint64_t p50 = 0;
+    uint64_t p99 = 0;
+    uint64_t p999 = 0;
+};
+
+// High dynamic range histogram of non-negative integer values (nanoseconds
+// for latencies). Buckets are log-linear: 64 linear sub-buckets per power of
+// two, i.e. about 1.6% relative precision from 1 up to 2^40.
+//
+// record() and snapshot() may be called concurrently from any thread: the
+// shared latency histograms get values from the writer, backend and sync
+// threads, and from two CSVWriters during a segment or label switch. Each
+// writer thread records into its own counts (allocated on its first record),
+// with plain relaxed loads and stores, so record() costs a few nanoseconds;
+// snapshot() merges them. Threads beyond MAX_WRITERS alive at once share one
+// set of counts updated with atomic read-modify-writes.
+class HdrHistogram {
+public:
+    HdrHistogram();
+    ~HdrHistogram();
+    HdrHistogram(const HdrHistogram&) = delete;
+    HdrHistogram& operator=(const HdrHistogram&) = delete;
+
+    // Records one value; values above the trackable range land in the top bucket.
+    void record(uint64_t value) {
+        size_t i = indexOf(value);
+        int writer = writerIndex();
+        Shard* shard = writer >= 0 ? shards[writer].load(memory_order_acquire) : &shared;
+        if (!shard) {
+            shard = addShard(writer);
+        }
+        if (writer >= 0) {
+            // **Only this thread writes its shard: no locked instructions**
+            shard->counts[i].store(shard->counts[i].load(memory_order_relaxed) + 1, memory_order_relaxed);
+            shard->count.store(shard->count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+            shard->sum.store(shard->sum.load(memory_order_relaxed) + value, memory_order_relaxed);
+            if (value > shard->max.load(memory_order_relaxed)) {
+                shard->max.store(value, memory_order_relaxed);
+            }
+        } else {
+            shard->counts[i].fetch_add(1, memory_order_relaxed);
+            shard->count.fetch_add(1, memory_order_relaxed);
+            shard->sum.fetch_add(value, memory_order_relaxed);
+            uint64_t highest = shard->max.load(memory_order_relaxed);
+            while (value > highest && !shard->max.compare_exchange_weak(highest, value, memory_order_relaxed)) {
+            }
+        }
+    }
+
+    // Records the elapsed time since start in nanoseconds.
+    void recordSince(chrono::steady_clock::time_point start) {
+        record(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+    }
+
+    // Computes count, min, max, mean and p50/p99/p99.9.
+    HdrSnapshot snapshot() const;
+
+    // Formats a snapshot with values divided by `scale` (e.g. 1e3 for ns -> us).
+    static string format(const HdrSnapshot& s, double scale, const string& unit);
+
+private:
+    static const int SUB_BUCKET_BITS = 7;                          // 128 sub-buckets
+    static const uint64_t SUB_BUCKET_COUNT = 1ULL << SUB_BUCKET_BITS;
+    static const uint64_t SUB_BUCKET_HALF = SUB_BUCKET_COUNT / 2;
+    static const int MAX_BITS = 40;                                // Largest trackable value ~1.1e12
+    static const size_t BUCKETS = (MAX_BITS - SUB_BUCKET_BITS + 3) * SUB_BUCKET_HALF;
+    static const int MAX_WRITERS = 64;                             // Writer threads with their own counts
+
+    struct Shard {
+        atomic<uint64_t> counts[BUCKETS] = {};
+        atomic<uint64_t> count{0};
+        atomic<uint64_t> sum{0};
+        atomic<uint64_t> max{0};
+    };
+
+    // Writer index of the calling thread: 0..MAX_WRITERS-1, reused once a
+    // thread exits, or -1 while MAX_WRITERS threads hold one. The cache is
+    // constant-initialised, so the hot path has no thread_local guard.
+    static int writerIndex() {
+        static thread_local int index = -2;
+        if (__builtin_expect(index == -2, 0)) {
+            index = claimWriterIndex();
+        }
+        return index;
+    }
+    static int claimWriterIndex();
+
+    atomic<Shard*> shards[MAX_WRITERS];
+    Shard shared;                                                  // Writers without an index of their own
+
+    Shard* addShard(int writer);
+
+    // Values below 128 map 1:1; above, the exponent selects a block of 64 sub-buckets.
+    static size_t indexOf(uint64_t value) {
+        if (value < SUB_BUCKET_COUNT) {
+            return value;
+        }
+        int exponent = 63 - __builtin_clzll(value) - (SUB_BUCKET_BITS - 1);
+        size_t index = exponent * SUB_BUCKET_HALF + (value >> exponent);
+        return index < BUCKETS ? index : BUCKETS - 1;
+    }
+
+    // Highest value that maps to the given bucket.
+    static uint64_t valueAt(size_t index);
+};
+
+#endif // HDR_HISTOGRAM_H
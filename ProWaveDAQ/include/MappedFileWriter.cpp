@@ -0,0 +1,235 @@
+#include "MappedFileWriter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <future>
+#include <iostream>
+#include <sys/mman.h>
+#include <unistd.h>
+
+MappedFileWriter::MappedFileWriter(const string& spareDirectory)
+    : sparePath(spareDirectory + "/.next_segment.tmp"), capacity(0), length(0), failed(false),
+      stopping(false), spareReady(false), sparePending(false),
+      prepareLatency(Metrics::instance().latency("prowavedaq_mapped_prepare_seconds",
+          "Time to preallocate and map the next segment file")),
+      syncLatency(Metrics::instance().latency("prowavedaq_mapped_sync_seconds",
+          "Duration of each fdatasync of a mapped segment")),
+      spareMisses(Metrics::instance().counter("prowavedaq_mapped_spare_misses_total",
+          "Segments opened before their preallocated file was ready")),
+      grows(Metrics::instance().counter("prowavedaq_mapped_grows_total",
+          "Segments that outgrew their preallocated size")) {
+    unlink(sparePath.c_str());   // Left over from a crash
+    helper = thread(&MappedFileWriter::helperLoop, this, &prepareJobs);
+    syncer = thread(&MappedFileWriter::helperLoop, this, &syncJobs);
+}
+
+MappedFileWriter::~MappedFileWriter() {
+    close();
+    {
+        lock_guard<mutex> lock(helperMutex);
+        stopping = true;
+    }
+    helperWake.notify_all();
+    helper.join();
+    syncer.join();
+    if (spareReady) {
+        releaseMapping(spare, 0);
+        unlink(sparePath.c_str());
+    }
+}
+
+void MappedFileWriter::setCapacity(size_t bytes) {
+    capacity = bytes;
+    prepareSpare();
+}
+
+bool MappedFileWriter::open(const string& newPath) {
+    close();
+
+    Mapping mapping;
+    {
+        unique_lock<mutex> lock(helperMutex);
+        spareDone.wait(lock, [this]() { return !sparePending; });
+        if (spareReady) {
+            mapping = spare;
+            spare = Mapping();
+            spareReady = false;
+        }
+    }
+    // **Never over an existing file: a name clash must not replace an earlier recording**
+    if (mapping.data && renameat2(AT_FDCWD, sparePath.c_str(), AT_FDCWD, newPath.c_str(), RENAME_NOREPLACE) != 0) {
+        cerr << "Error: Unable to rename " << sparePath << " to " << newPath << ": " << strerror(errno) << endl;
+        releaseMapping(mapping, 0);
+        unlink(sparePath.c_str());
+    }
+    if (!mapping.data) {
+        spareMisses.inc();
+        if (!createMapping(newPath, capacity, mapping)) {
+            return false;
+        }
+    }
+
+    path = newPath;
+    file = mapping;
+    length = 0;
+    failed = false;
+    prepareSpare();
+    return true;
+}
+
+bool MappedFileWriter::append(const void* bytes, size_t size) {
+    if (!isOpen() || failed) {
+        return false;
+    }
+    if (length + size > file.capacity && !grow(length + size)) {
+        failed = true;
+        return false;
+    }
+    memcpy(file.data + length, bytes, size);
+    length += size;
+    return true;
+}
+
+void MappedFileWriter::sync(SyncCallback done) {
+    if (!isOpen()) {
+        if (done) {
+            done(true);
+        }
+        return;
+    }
+    // **fdatasync writes back the dirty mapped pages too, without touching the mapping**
+    int fd = file.fd;
+    post(syncJobs, [this, fd, done = move(done)]() {
+        auto start = chrono::steady_clock::now();
+        bool ok = fdatasync(fd) == 0;
+        syncLatency.recordSince(start);
+        if (done) {
+            done(ok);
+        }
+    });
+}
+
+bool MappedFileWriter::close() {
+    if (!isOpen()) {
+        return true;
+    }
+    // **Queued behind this file's syncs, so their callbacks have run when it returns**
+    auto closed = make_shared<promise<bool>>();
+    future<bool> result = closed->get_future();
+    post(syncJobs, [mapping = file, bytes = length, closed]() mutable {
+        munmap(mapping.data, mapping.capacity);
+        bool ok = ftruncate(mapping.fd, bytes) == 0 && fdatasync(mapping.fd) == 0;
+        ::close(mapping.fd);
+        closed->set_value(ok);
+    });
+    file = Mapping();
+    bool ok = result.get() && !failed;
+    if (!ok) {
+        cerr << "Error: Failed to close " << path << endl;
+    }
+    return ok;
+}
+
+bool MappedFileWriter::createMapping(const string& path, size_t capacity, Mapping& mapping) {
+    long page = sysconf(_SC_PAGESIZE);
+    size_t bytes = (max<size_t>(capacity, page) + page - 1) / page * page;
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        cerr << "Error: Unable to create " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    // **Allocate contiguous blocks now; fall back to a sparse file where unsupported**
+    int error = fallocate(fd, 0, 0, bytes) == 0 ? 0 : errno;
+    if ((error == EOPNOTSUPP || error == ENOSYS) && ftruncate(fd, bytes) == 0) {
+        error = 0;
+    }
+    void* data = error ? MAP_FAILED : mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (data == MAP_FAILED) {
+        cerr << "Error: Unable to preallocate " << path << ": " << strerror(error ? error : errno) << endl;
+        ::close(fd);
+        unlink(path.c_str());
+        return false;
+    }
+    mapping.fd = fd;
+    mapping.data = static_cast<char*>(data);
+    mapping.capacity = bytes;
+    return true;
+}
+
+void MappedFileWriter::releaseMapping(Mapping& mapping, size_t length) {
+    munmap(mapping.data, mapping.capacity);
+    if (ftruncate(mapping.fd, length) != 0) {
+        cerr << "Error: Failed to truncate a mapped file: " << strerror(errno) << endl;
+    }
+    ::close(mapping.fd);
+    mapping = Mapping();
+}
+
+// **Doubles the file and the mapping; only when a segment outgrows its estimate**
+bool MappedFileWriter::grow(size_t needed) {
+    size_t bytes = max(needed, file.capacity * 2);
+    int error = fallocate(file.fd, 0, 0, bytes) == 0 ? 0 : errno;
+    if ((error == EOPNOTSUPP || error == ENOSYS) && ftruncate(file.fd, bytes) == 0) {
+        error = 0;
+    }
+    void* data = error ? MAP_FAILED : mremap(file.data, file.capacity, bytes, MREMAP_MAYMOVE);
+    if (data == MAP_FAILED) {
+        cerr << "Error: Unable to grow " << path << ": " << strerror(error ? error : errno) << endl;
+        return false;
+    }
+    grows.inc();
+    file.data = static_cast<char*>(data);
+    file.capacity = bytes;
+    return true;
+}
+
+void MappedFileWriter::prepareSpare() {
+    {
+        lock_guard<mutex> lock(helperMutex);
+        if (capacity == 0 || spareReady || sparePending) {
+            return;
+        }
+        sparePending = true;
+    }
+    size_t bytes = capacity;
+    post(prepareJobs, [this, bytes]() {
+        auto start = chrono::steady_clock::now();
+        Mapping mapping;
+        bool ok = createMapping(sparePath, bytes, mapping);
+        prepareLatency.recordSince(start);
+        {
+            lock_guard<mutex> lock(helperMutex);
+            spare = mapping;
+            spareReady = ok;
+            sparePending = false;
+        }
+        spareDone.notify_all();
+    });
+}
+
+void MappedFileWriter::post(deque<function<void()>>& jobs, function<void()> job) {
+    {
+        lock_guard<mutex> lock(helperMutex);
+        jobs.push_back(move(job));
+    }
+    helperWake.notify_all();   // Both threads wait on it
+}
+
+void MappedFileWriter::helperLoop(deque<function<void()>>* jobs) {
+    while (true) {
+        function<void()> job;
+        {
+            unique_lock<mutex> lock(helperMutex);
+            helperWake.wait(lock, [this, jobs]() { return stopping || !jobs->empty(); });
+            if (jobs->empty()) {
+                return;
+            }
+            job = move(jobs->front());
+            jobs->pop_front();
+        }
+        job();
+    }
+}
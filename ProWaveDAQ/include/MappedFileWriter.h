@@ -0,0 +1,97 @@
+#ifndef MAPPED_FILE_WRITER_H
+#define MAPPED_FILE_WRITER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Metrics.h"
+
+using namespace std;
+
+// MappedFileWriter records each file into space allocated up front and
+// mapped into memory: append() is a memcpy, so the file is neither grown nor
+// its size updated while recording. A helper thread prepares the next file
+// (fallocate + populated mapping) under a temporary name while the current
+// one is written; open() only renames it, never over an existing file. A
+// second thread runs syncs and closes, so durability does not wait behind a
+// preallocation. close() truncates the file to the bytes appended and syncs it.
+//
+// A file holds zeros past the appended bytes until it is closed (also after
+// a crash). Appending past the capacity grows the file and the mapping.
+class MappedFileWriter {
+public:
+    using SyncCallback = function<void(bool ok)>;
+
+    // spareDirectory: where the next file is prepared; must be on the same
+    // filesystem as the files opened (they are renamed into place).
+    explicit MappedFileWriter(const string& spareDirectory);
+    ~MappedFileWriter();
+
+    // Bytes preallocated for each file from the next prepared one on.
+    void setCapacity(size_t bytes);
+
+    // Closes the previous file and starts path from the prepared spare; false if path exists.
+    bool open(const string& path);
+    bool isOpen() const { return file.data != nullptr; }
+
+    // Copies bytes into the mapping; false once growing the file failed.
+    bool append(const void* bytes, size_t size);
+
+    // fdatasync()s the file on the sync thread, then calls done there.
+    void sync(SyncCallback done = nullptr);
+
+    // Unmaps, truncates to the appended length, syncs and closes; waits for it.
+    bool close();
+
+    uint64_t size() const { return length; }
+
+private:
+    struct Mapping {
+        int fd = -1;
+        char* data = nullptr;
+        size_t capacity = 0;
+    };
+
+    string sparePath;
+    size_t capacity;
+
+    // Current file (caller thread)
+    string path;
+    Mapping file;
+    size_t length;
+    bool failed;
+
+    // Helper threads and the spare they prepare
+    mutex helperMutex;
+    condition_variable helperWake;
+    condition_variable spareDone;
+    deque<function<void()>> prepareJobs;   // Spare preparation (helper)
+    deque<function<void()>> syncJobs;      // Syncs and closes, in order (syncer)
+    bool stopping;
+    Mapping spare;
+    bool spareReady;
+    bool sparePending;
+    thread helper;
+    thread syncer;
+
+    HdrHistogram& prepareLatency;   // fallocate + mmap of one spare
+    HdrHistogram& syncLatency;
+    MetricCounter& spareMisses;     // Files opened without a prepared spare
+    MetricCounter& grows;
+
+    // Creates path (which must not exist) with capacity bytes allocated and mapped.
+    static bool createMapping(const string& path, size_t capacity, Mapping& mapping);
+    static void releaseMapping(Mapping& mapping, size_t length);
+
+    bool grow(size_t needed);
+    void prepareSpare();
+    void post(deque<function<void()>>& jobs, function<void()> job);
+    void helperLoop(deque<function<void()>>* jobs);
+};
+
+#endif // MAPPED_FILE_WRITER_H
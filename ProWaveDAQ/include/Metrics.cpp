@@ -0,0 +1,310 @@
+#include "Metrics.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Histogram: one slot per bound plus the implicit +Inf bucket.
+MetricHistogram::MetricHistogram(const vector<double>& bounds)
+    : bounds(bounds), buckets(new atomic<uint64_t>[bounds.size() + 1]) {
+    sort(this->bounds.begin(), this->bounds.end());
+    for (size_t i = 0; i <= this->bounds.size(); i++) {
+        buckets[i].store(0, memory_order_relaxed);
+    }
+}
+
+// Records one observation into the first bucket whose bound is >= v.
+void MetricHistogram::observe(double v) {
+    size_t i = lower_bound(bounds.begin(), bounds.end(), v) - bounds.begin();
+    buckets[i].fetch_add(1, memory_order_relaxed);
+    total.fetch_add(1, memory_order_relaxed);
+
+    double old = sumValue.load(memory_order_relaxed);
+    while (!sumValue.compare_exchange_weak(old, old + v, memory_order_relaxed)) {
+    }
+}
+
+MetricRate::MetricRate(MetricCounter& counter, MetricGauge& perSecond)
+    : counter(counter), perSecond(perSecond),
+      windowStart(chrono::steady_clock::now()), windowStartValue(counter.value()) {}
+
+// Adds to the counter; the rate gauge is recomputed at most once per second.
+void MetricRate::add(uint64_t n) {
+    counter.inc(n);
+    update();
+}
+
+// Closes the window once a second has passed, whether or not anything was added.
+void MetricRate::update() {
+    auto now = chrono::steady_clock::now();
+    lock_guard<mutex> lock(windowMutex);
+    chrono::duration<double> elapsed = now - windowStart;
+    if (elapsed.count() >= 1.0) {
+        uint64_t current = counter.value();
+        perSecond.set((current - windowStartValue) / elapsed.count());
+        windowStart = now;
+        windowStartValue = current;
+    }
+}
+
+Metrics& Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::Family& Metrics::family(const string& name, const string& help, const string& type) {
+    Family& f = families[name];
+    if (f.type.empty()) {
+        f.help = help;
+        f.type = type;
+    }
+    return f;
+}
+
+MetricCounter& Metrics::counter(const string& name, const string& help, const string& labels) {
+    lock_guard<mutex> lock(registryMutex);
+    auto& slot = family(name, help, "counter").counters[labels];
+    if (!slot) {
+        slot.reset(new MetricCounter());
+    }
+    return *slot;
+}
+
+MetricGauge& Metrics::gauge(const string& name, const string& help, const string& labels) {
+    lock_guard<mutex> lock(registryMutex);
+    auto& slot = family(name, help, "gauge").gauges[labels];
+    if (!slot) {
+        slot.reset(new MetricGauge());
+    }
+    return *slot;
+}
+
+MetricHistogram& Metrics::histogram(const string& name, const string& help,
+                                    const vector<double>& bounds, const string& labels) {
+    lock_guard<mutex> lock(registryMutex);
+    auto& slot = family(name, help, "histogram").histograms[labels];
+    if (!slot) {
+        slot.reset(new MetricHistogram(bounds));
+    }
+    return *slot;
+}
+
+HdrHistogram& Metrics::latency(const string& name, const string& help, const string& labels) {
+    lock_guard<mutex> lock(registryMutex);
+    auto& slot = family(name, help, "summary").latencies[labels];
+    if (!slot) {
+        slot.reset(new HdrHistogram());
+    }
+    return *slot;
+}
+
+// Registers <name>_total and <name>_per_second and ties them together.
+MetricRate& Metrics::rate(const string& name, const string& help, const string& labels) {
+    MetricCounter& c = counter(name + "_total", help, labels);
+    MetricGauge& g = gauge(name + "_per_second", help + " (per second)", labels);
+
+    lock_guard<mutex> lock(registryMutex);
+    auto& slot = rates[name + "{" + labels + "}"];
+    if (!slot) {
+        slot.reset(new MetricRate(c, g));
+    }
+    return *slot;
+}
+
+string Metrics::label(const string& key, const string& value) {
+    string escaped;
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return key + "=\"" + escaped + "\"";
+}
+
+// Joins a metric's own labels with an extra label (used for "le").
+static string withLabels(const string& labels, const string& extra) {
+    if (labels.empty() && extra.empty()) {
+        return "";
+    }
+    if (labels.empty()) {
+        return "{" + extra + "}";
+    }
+    if (extra.empty()) {
+        return "{" + labels + "}";
+    }
+    return "{" + labels + "," + extra + "}";
+}
+
+string Metrics::renderPrometheus() {
+    lock_guard<mutex> lock(registryMutex);
+    ostringstream out;
+    out.precision(10);
+
+    // **A source that stopped adding still has its rate fall to 0**
+    for (auto& [key, r] : rates) {
+        r->update();
+    }
+
+    for (const auto& [name, f] : families) {
+        out << "# HELP " << name << " " << f.help << "\n";
+        out << "# TYPE " << name << " " << f.type << "\n";
+
+        for (const auto& [labels, c] : f.counters) {
+            out << name << withLabels(labels, "") << " " << c->value() << "\n";
+        }
+        for (const auto& [labels, g] : f.gauges) {
+            out << name << withLabels(labels, "") << " " << g->value() << "\n";
+        }
+        for (const auto& [labels, h] : f.histograms) {
+            uint64_t cumulative = 0;
+            const auto& bounds = h->getBounds();
+            for (size_t i = 0; i < bounds.size(); i++) {
+                cumulative += h->bucketCount(i);
+                ostringstream le;
+                le.precision(10);
+                le << "le=\"" << bounds[i] << "\"";
+                out << name << "_bucket" << withLabels(labels, le.str()) << " " << cumulative << "\n";
+            }
+            cumulative += h->bucketCount(bounds.size());
+            out << name << "_bucket" << withLabels(labels, "le=\"+Inf\"") << " " << cumulative << "\n";
+            out << name << "_sum" << withLabels(labels, "") << " " << h->sum() << "\n";
+            out << name << "_count" << withLabels(labels, "") << " " << h->count() << "\n";
+        }
+        for (const auto& [labels, h] : f.latencies) {
+            HdrSnapshot snap = h->snapshot();
+            out << name << withLabels(labels, "quantile=\"0.5\"") << " " << snap.p50 / 1e9 << "\n";
+            out << name << withLabels(labels, "quantile=\"0.99\"") << " " << snap.p99 / 1e9 << "\n";
+            out << name << withLabels(labels, "quantile=\"0.999\"") << " " << snap.p999 / 1e9 << "\n";
+            out << name << "_sum" << withLabels(labels, "") << " " << snap.mean * snap.count / 1e9 << "\n";
+            out << name << "_count" << withLabels(labels, "") << " " << snap.count << "\n";
+        }
+    }
+    return out.str();
+}
+
+string Metrics::latencyReport() {
+    lock_guard<mutex> lock(registryMutex);
+    ostringstream out;
+    for (const auto& [name, f] : families) {
+        for (const auto& [labels, h] : f.latencies) {
+            out << name << withLabels(labels, "") << ": "
+                << HdrHistogram::format(h->snapshot(), 1e3, "us") << "\n";
+        }
+    }
+    return out.str();
+}
+
+MetricsServer::MetricsServer() : listenFd(-1), running(false) {}
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
+
+// Binds to 127.0.0.1:<port> only; the endpoint is not meant to be reachable remotely.
+bool MetricsServer::start(int port) {
+    if (running) {
+        return true;
+    }
+
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        cerr << "Error: Unable to create metrics socket!" << endl;
+        return false;
+    }
+
+    int reuse = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listenFd, 4) < 0) {
+        cerr << "Error: Unable to bind metrics endpoint on port " << port << endl;
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+
+    running = true;
+    serverThread = thread(&MetricsServer::serveLoop, this);
+    cout << "Metrics available at http://127.0.0.1:" << port << "/metrics" << endl;
+    return true;
+}
+
+void MetricsServer::stop() {
+    if (running) {
+        running = false;
+        if (serverThread.joinable()) {
+            serverThread.join();
+        }
+    }
+    if (listenFd >= 0) {
+        close(listenFd);
+        listenFd = -1;
+    }
+}
+
+// Polls with a short timeout so stop() is noticed promptly.
+void MetricsServer::serveLoop() {
+    while (running) {
+        pollfd pfd = {listenFd, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0) {
+            continue;
+        }
+        int clientFd = accept(listenFd, nullptr, nullptr);
+        if (clientFd >= 0) {
+            handleClient(clientFd);
+            close(clientFd);
+        }
+    }
+}
+
+void MetricsServer::handleClient(int clientFd) {
+    char request[1024];
+    pollfd pfd = {clientFd, POLLIN, 0};
+    if (poll(&pfd, 1, 1000) <= 0) {
+        return;
+    }
+    ssize_t n = recv(clientFd, request, sizeof(request) - 1, 0);
+    if (n <= 0) {
+        return;
+    }
+    request[n] = '\0';
+
+    string body;
+    string status;
+    if (strncmp(request, "GET /metrics", 12) == 0 || strncmp(request, "GET / ", 6) == 0) {
+        status = "200 OK";
+        body = Metrics::instance().renderPrometheus();
+    } else {
+        status = "404 Not Found";
+        body = "not found\n";
+    }
+
+    ostringstream response;
+    response << "HTTP/1.0 " << status << "\r\n"
+             << "Content-Type: text/plain; version=0.0.4\r\n"
+             << "Content-Length: " << body.size() << "\r\n"
+             << "Connection: close\r\n\r\n"
+             << body;
+
+    string data = response.str();
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t w = send(clientFd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (w <= 0) {
+            break;
+        }
+        sent += w;
+    }
+}
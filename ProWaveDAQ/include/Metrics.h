@@ -0,0 +1,143 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "HdrHistogram.h"
+
+using namespace std;
+
+// Monotonically increasing counter (errors, samples, bytes).
+class MetricCounter {
+public:
+    void inc(uint64_t n = 1) { count.fetch_add(n, memory_order_relaxed); }
+    uint64_t value() const { return count.load(memory_order_relaxed); }
+
+private:
+    atomic<uint64_t> count{0};
+};
+
+// Point-in-time value (queue depth, current rate).
+class MetricGauge {
+public:
+    void set(double v) { current.store(v, memory_order_relaxed); }
+    double value() const { return current.load(memory_order_relaxed); }
+
+private:
+    atomic<double> current{0.0};
+};
+
+// Cumulative bucket histogram in the Prometheus sense (upper bounds, "le").
+class MetricHistogram {
+public:
+    explicit MetricHistogram(const vector<double>& bounds);
+
+    // Records one observation.
+    void observe(double v);
+
+    const vector<double>& getBounds() const { return bounds; }
+    uint64_t bucketCount(size_t i) const { return buckets[i].load(memory_order_relaxed); }
+    uint64_t count() const { return total.load(memory_order_relaxed); }
+    double sum() const { return sumValue.load(memory_order_relaxed); }
+
+private:
+    vector<double> bounds;                  // Sorted upper bounds, +Inf implied
+    unique_ptr<atomic<uint64_t>[]> buckets; // Non-cumulative count per bound (+1 for +Inf)
+    atomic<uint64_t> total{0};
+    atomic<double> sumValue{0.0};
+};
+
+// Counter paired with a gauge holding its per-second rate, refreshed at most once per
+// second by add() or by a scrape, so a stalled source reads 0.
+class MetricRate {
+public:
+    MetricRate(MetricCounter& counter, MetricGauge& perSecond);
+
+    // Adds n to the counter and rolls the rate window when a second has elapsed.
+    void add(uint64_t n);
+
+    // Rolls the window without adding (renderPrometheus() calls it on every scrape).
+    void update();
+
+    double perSecondValue() const { return perSecond.value(); }
+    uint64_t totalValue() const { return counter.value(); }
+
+private:
+    MetricCounter& counter;
+    MetricGauge& perSecond;
+    mutex windowMutex;
+    chrono::steady_clock::time_point windowStart;
+    uint64_t windowStartValue;
+};
+
+// Process-wide registry of named metrics, rendered in Prometheus text format.
+class Metrics {
+public:
+    static Metrics& instance();
+
+    // Returns the metric registered under name{labels}, creating it on first use.
+    MetricCounter& counter(const string& name, const string& help, const string& labels = "");
+    MetricGauge& gauge(const string& name, const string& help, const string& labels = "");
+    MetricHistogram& histogram(const string& name, const string& help,
+                               const vector<double>& bounds, const string& labels = "");
+    MetricRate& rate(const string& name, const string& help, const string& labels = "");
+
+    // HDR latency histogram recorded in nanoseconds, exported as a summary in seconds.
+    HdrHistogram& latency(const string& name, const string& help, const string& labels = "");
+
+    // Formats a single label pair, e.g. device="/dev/ttyUSB0".
+    static string label(const string& key, const string& value);
+
+    // Renders all registered metrics in Prometheus exposition format.
+    string renderPrometheus();
+
+    // Human-readable p50/p99/p99.9/max of every latency histogram.
+    string latencyReport();
+
+private:
+    Metrics() = default;
+
+    struct Family {
+        string help;
+        string type;
+        map<string, unique_ptr<MetricCounter>> counters;
+        map<string, unique_ptr<MetricGauge>> gauges;
+        map<string, unique_ptr<MetricHistogram>> histograms;
+        map<string, unique_ptr<HdrHistogram>> latencies;
+    };
+
+    mutex registryMutex;
+    map<string, Family> families;
+    map<string, unique_ptr<MetricRate>> rates;
+
+    Family& family(const string& name, const string& help, const string& type);
+};
+
+// Minimal HTTP server exposing Metrics::renderPrometheus() on 127.0.0.1.
+class MetricsServer {
+public:
+    MetricsServer();
+    ~MetricsServer();
+
+    // Starts listening on the given port. Returns false if the socket cannot be bound.
+    bool start(int port);
+
+    // Stops the server thread and closes the listening socket.
+    void stop();
+
+private:
+    int listenFd;
+    atomic<bool> running;
+    thread serverThread;
+
+    void serveLoop();
+    void handleClient(int clientFd);
+};
+
+#endif // METRICS_H
@@ -1,17 +1,15 @@
 #include "ProWaveDAQ.h"
 
+#include <cerrno>
+#include <cstring>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 // **Scan for available Modbus devices**
 void ProWaveDAQ::scanDevices() {
-    vector<string> devices;
-    regex usbPattern("/dev/ttyUSB[0-9]+");
-
     // **Scan the `/dev/` directory for ttyUSB devices**
-    for (const auto& entry : fs::directory_iterator("/dev/")) {
-        string path = entry.path().string();
-        if (regex_match(path, usbPattern)) {
-            devices.push_back(path);
-        }
-    }
+    vector<string> devices = DeviceProber::listPorts("/dev/ttyUSB[0-9]+");
 
     // **If no devices are found**
     if (devices.empty()) {
@@ -26,6 +24,31 @@ void ProWaveDAQ::scanDevices() {
     }
 }
 
+// **Names of the poll strategies as written in ProWaveDAQ.ini**
+bool parsePollStrategy(const string& name, PollStrategy& strategy) {
+    if (name == "sleep") {
+        strategy = PollStrategy::Sleep;
+    } else if (name == "busy") {
+        strategy = PollStrategy::Busy;
+    } else if (name == "paced") {
+        strategy = PollStrategy::Paced;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* pollStrategyName(PollStrategy strategy) {
+    switch (strategy) {
+    case PollStrategy::Busy:
+        return "busy";
+    case PollStrategy::Paced:
+        return "paced";
+    default:
+        return "sleep";
+    }
+}
+
 // **Callback function for parsing the INI configuration file**
 static int handler(void* user, const char* section, const char* name, const char* value) {
     auto* ini_data = reinterpret_cast<std::map<std::string, std::map<std::string, std::string>>*>(user);
@@ -36,7 +59,11 @@ static int handler(void* user, const char* section, const char* name, const char
 // **Constructor**
 ProWaveDAQ::ProWaveDAQ()
     : ctx(nullptr), serialPort("/dev/ttyUSB0"), baudRate(3000000), sampleRate(7812),
-    slaveID(1), counter(0), reading(false) {}
+    pendingSampleRate(0), nominalSampleRate(7812), slaveID(1), counter(0), reading(false), latestFirstSample(0), latestBacklog(0), samplesAcquired(0), hasSink(false),
+    priorityRaised(false), priorityTid(0), savedNice(0), blockKernels(BlockKernels::select(3)), pollPending(false),
+    samplesMetric(nullptr), transactionLatency(nullptr),
+    readInterval(nullptr), fifoDepth(nullptr), errorCounter(nullptr),
+    backpressureLevel(nullptr), fifoTrend(nullptr), escalations(nullptr), recoveries(nullptr), auxLateness(nullptr) {}
 
 // **Destructor**
 ProWaveDAQ::~ProWaveDAQ() {
@@ -63,11 +90,50 @@ void ProWaveDAQ::initDevices(const char* filename) {
         sampleRate = std::stoi(ini_data["ProWaveDAQ"]["sampleRate"]);
         slaveID = std::stoi(ini_data["ProWaveDAQ"]["slaveID"]);
 
+        // **Optional reading-loop tuning (see --diagnose for measured values)**
+        PollConfig config;
+        if (ini_data["ProWaveDAQ"].count("readSize")) {
+            config.readSize = std::stoi(ini_data["ProWaveDAQ"]["readSize"]);
+        }
+        if (ini_data["ProWaveDAQ"].count("pollStrategy") &&
+            !parsePollStrategy(ini_data["ProWaveDAQ"]["pollStrategy"], config.strategy)) {
+            cerr << "Error: Unknown pollStrategy " << ini_data["ProWaveDAQ"]["pollStrategy"]
+                 << " (sleep, busy or paced); using sleep" << endl;
+        }
+        setPollConfig(config);
+
+        // **FIFO backpressure: on by default; lowering the rate needs minSampleRate**
+        BackpressureSettings pressure;
+        if (ini_data["ProWaveDAQ"].count("backpressure")) {
+            pressure.enabled = std::stoi(ini_data["ProWaveDAQ"]["backpressure"]) != 0;
+        }
+        if (ini_data["ProWaveDAQ"].count("fifoCapacity")) {
+            pressure.fifoCapacity = std::stoi(ini_data["ProWaveDAQ"]["fifoCapacity"]);
+        }
+        if (ini_data["ProWaveDAQ"].count("minSampleRate")) {
+            pressure.minSampleRate = std::stoi(ini_data["ProWaveDAQ"]["minSampleRate"]);
+        }
+        setBackpressure(pressure);
+        nominalSampleRate = sampleRate.load();
+
+        // **Auxiliary registers: name = address registers periodMs priority [holding]**
+        auxScheduler = AuxScheduler(baudRate);
+        for (const auto& entry : ini_data["AuxRegisters"]) {
+            AuxRegister reg;
+            if (parseAuxRegister(entry.first, entry.second, reg)) {
+                addAuxRegister(reg);
+            } else {
+                cerr << "Error: Invalid auxiliary register " << entry.first << " = " << entry.second << endl;
+            }
+        }
+
         cout << "Loaded settings from INI file:\n"
              << "Serial Port: " << serialPort << "\n"
              << "Baud Rate: " << baudRate << "\n"
              << "Sample Rate: " << sampleRate << "\n"
-             << "Slave ID: " << slaveID << endl;
+             << "Slave ID: " << slaveID << "\n"
+             << "Read Size: " << pollConfig.readSize << " (" << pollStrategyName(pollConfig.strategy) << ")\n"
+             << "Auxiliary Registers: " << auxScheduler.size() << endl;
     } catch (const std::exception& e) {
         cerr << "Error parsing INI file: " << e.what() << endl;
         return;
@@ -108,7 +174,7 @@ void ProWaveDAQ::initDevices(const char* filename) {
     if (modbus_read_input_registers(ctx, 0x80, 3, chip_id) == -1) {
         cerr << "Failed to read Chip ID!" << endl;
     } else {
-        cout << "ChipID: " << hex << chip_id[0] << ", " << chip_id[1] << ", " << chip_id[2] << endl;
+        cout << "ChipID: " << hex << chip_id[0] << ", " << chip_id[1] << ", " << chip_id[2] << dec << endl;
     }
 
     // **Step 4: Set Sample Rate**
@@ -127,56 +193,218 @@ void ProWaveDAQ::startReading() {
         return;
     }
 
-    reading = true;
+    startPolling();
     readingThread = thread(&ProWaveDAQ::readLoop, this);
 }
 
-// **Stop reading vibration data**
-void ProWaveDAQ::stopReading() {
+// **Stop the reading loop, keeping the connection**
+void ProWaveDAQ::stopPolling() {
     if (reading) {
         reading = false;
         if (readingThread.joinable()) {
             readingThread.join();
         }
     }
-    modbus_close(ctx);
-    modbus_free(ctx);
+    // **The reader thread restores its own priority; this covers callers of pollOnce()**
+    setReaderPriority(false);
+}
+
+// **Stop reading vibration data**
+void ProWaveDAQ::stopReading() {
+    stopPolling();
+    if (ctx) {
+        modbus_close(ctx);
+        modbus_free(ctx);
+        ctx = nullptr;
+    }
+}
+
+// **Register per-device metrics**
+void ProWaveDAQ::bindMetrics() {
+    Metrics& m = Metrics::instance();
+    string device = Metrics::label("device", serialPort);
+
+    samplesMetric = &m.rate("prowavedaq_samples", "3-axis samples acquired from the sensor", device);
+    transactionLatency = &m.latency("prowavedaq_modbus_transaction_seconds",
+        "Modbus request-to-response time", device);
+    readInterval = &m.latency("prowavedaq_read_interval_seconds",
+        "Time between successful FIFO data reads", device);
+    fifoDepth = &m.histogram("prowavedaq_fifo_depth",
+        "Sensor FIFO length reported at register 0x02",
+        {0, 6, 16, 32, 64, 123, 256, 512, 1024, 2048, 4096}, device);
+    errorCounter = &m.counter("prowavedaq_modbus_errors_total", "Failed Modbus transactions", device);
+    backpressureLevel = &m.gauge("prowavedaq_backpressure_level",
+        "FIFO backpressure level (0 normal, 1 large reads, 2 busy polling, 3 priority, 4+ reduced rate)", device);
+    fifoTrend = &m.gauge("prowavedaq_fifo_trend_values_per_second", "Smoothed sensor FIFO growth", device);
+    escalations = &m.counter("prowavedaq_backpressure_changes_total", "Backpressure level changes",
+        device + "," + Metrics::label("direction", "up"));
+    recoveries = &m.counter("prowavedaq_backpressure_changes_total", "Backpressure level changes",
+        device + "," + Metrics::label("direction", "down"));
+
+    auxLateness = &m.latency("prowavedaq_aux_lateness_seconds",
+        "Delay of auxiliary reads past their period, waiting for idle bus time", device);
+    auxReads.clear();
+    auxValues.clear();
+    for (size_t i = 0; i < auxScheduler.size(); i++) {
+        const AuxRegister& reg = auxScheduler.get(i);
+        string labels = device + "," + Metrics::label("register", reg.name);
+        auxReads.push_back(&m.counter("prowavedaq_aux_reads_total", "Auxiliary register reads", labels));
+        auxValues.emplace_back();
+        for (int r = 0; r < reg.count; r++) {
+            auxValues.back().push_back(&m.gauge("prowavedaq_aux_value", "Latest auxiliary register value",
+                labels + "," + Metrics::label("offset", to_string(r))));
+        }
+    }
+}
+
+// **Read input registers and record transaction latency / errors**
+int ProWaveDAQ::readRegisters(int addr, int nb, uint16_t* dest) {
+    TRACE_SPAN(nb > 1 ? "modbus_read_data" : "modbus_read_length");
+    auto start = chrono::steady_clock::now();
+    int rc = modbus_read_input_registers(ctx, addr, nb, dest);
+    auto duration = chrono::steady_clock::now() - start;
+    transactionLatency->record(chrono::duration_cast<chrono::nanoseconds>(duration).count());
+    if (rc == -1) {
+        errorCounter->inc();
+    } else if (addr == 0x02) {
+        fifoDepth->observe(dest[0]);
+    }
+    if (transactionObserver && addr == 0x02) {
+        transactionObserver(ModbusTransaction{addr, nb, rc != -1, rc != -1 ? dest[0] : uint16_t(0),
+            chrono::duration_cast<chrono::nanoseconds>(duration)});
+    }
+    return rc;
 }
 
 // **Read vibration data (main reading loop)**
 void ProWaveDAQ::readLoop() {
-    int maxSize = 41 * 3;
-    uint16_t vib_data[maxSize + 1];
-    modbus_read_input_registers(ctx, 0x02, 1, vib_data);
-    int thisLen = vib_data[0];
-    int lestLen;
-    cout << "Data Length: " << dec << thisLen << endl;
-
+    if (Tracer::isEnabled()) {
+        Tracer::instance().setThreadName("reader " + serialPort);
+    }
     cout << "Reading loop started..." << endl;
     while (reading) {
-        lestLen = thisLen;
-        if (vib_data[0] >= maxSize) {
-            modbus_read_input_registers(ctx, 0x02, maxSize + 1, vib_data);
-            thisLen = maxSize;
-        } else if (vib_data[0] <= 6) {
-            usleep(1000);
-            modbus_read_input_registers(ctx, 0x02, 1, vib_data);
-            thisLen = vib_data[0];
-            continue;
-        } else {
-            modbus_read_input_registers(ctx, 0x02, vib_data[0] + 1, vib_data);
-            thisLen = vib_data[0];
+        int waitUs = pollOnce();
+        if (waitUs > 0) {
+            TRACE_SPAN("poll_sleep");
+            usleep(waitUs);
         }
+    }
+    setReaderPriority(false);
+}
 
-        lock_guard<mutex> lock(dataMutex);
-        latestData.clear();
+// **Prepare for reading without a reader thread (the caller drives pollOnce)**
+void ProWaveDAQ::startPolling() {
+    if (reading) {
+        cerr << "Reading is already running!" << endl;
+        return;
+    }
 
-        for (int i = 1; i <= lestLen; i++) {
-            latestData.push_back(static_cast<double>(static_cast<int16_t>(vib_data[i])) / 8192.0);
+    bindMetrics();
+    samplesAcquired = 0;
+    if (readRegisters(0x02, 1, vib_data) == -1) {
+        vib_data[0] = 0;
+    }
+    cout << "Data Length: " << dec << vib_data[0] << endl;
+    lastRead = chrono::steady_clock::now();
+    pollPending = false;
+    backpressure.reset();
+    backpressure.setMaxLevel(maxBackpressureLevel());
+    auxScheduler.restart(lastRead);
+    activePoll = pollConfig;
+    backpressureLevel->set(0);
+    reading = true;
+}
+
+// **One step of the reading loop: at most one data transaction**
+int ProWaveDAQ::pollOnce() {
+    // **Reconfigure between transactions, never in the middle of one**
+    // (a configured rate replaces any rate backpressure has lowered)
+    int newRate = pendingSampleRate.exchange(0);
+    if (newRate > 0) {
+        backpressure.setMaxLevel(maxBackpressureLevel());
+        applyBackpressureLevel(backpressure.getLevel());
+    }
+
+    // **Request what the FIFO reported last time, capped to the read size**
+    int available = vib_data[0];
+    bool enough = activePoll.strategy == PollStrategy::Paced ? available >= activePoll.readSize : available > 6;
+    if (!enough) {
+        // **Bus idle: fit a due auxiliary read in before waiting**
+        if (!pollPending && pollAuxRegisters(available)) {
+            pollPending = true;
+            return 0;
         }
+        if (pollPending || activePoll.strategy == PollStrategy::Busy) {
+            pollPending = false;
+            if (readRegisters(0x02, 1, vib_data) == -1) {
+                vib_data[0] = 0;
+            } else {
+                updateBackpressure();
+            }
+            return 0;
+        }
+        pollPending = true; // Re-read the FIFO length after the wait
+        return idleWaitUs(available);
+    }
+    int request = min(available, activePoll.readSize);
+
+    if (readRegisters(0x02, request + 1, vib_data) == -1) {
+        vib_data[0] = 0;
+        return 0;
+    }
+    updateBackpressure();
+
+    readInterval->recordSince(lastRead);
+    lastRead = chrono::steady_clock::now();
 
+    // **vib_data[0] now holds the new FIFO length, followed by `request` values**
+    DataBlock block;
+    {
+        lock_guard<mutex> lock(dataMutex);
+        latestData.resize(request);
+        blockKernels.convert(vib_data + 1, request, 3, latestData.data());
+
+        latestTime = lastRead;
+        latestFirstSample = samplesAcquired;
+        latestBacklog = vib_data[0];
+        samplesAcquired += request / 3;
         counter++;
+        samplesMetric->add(request / 3);
+
+        if (hasSink) {
+            block.samples = latestData;
+            block.acquiredAt = latestTime;
+            block.firstSample = latestFirstSample;
+            block.sequence = counter;
+            block.fifoBacklog = latestBacklog;
+        }
+    }
+
+    // **Push every block to the sink, so no consumer depends on polling fast enough**
+    lock_guard<mutex> lock(sinkMutex);
+    if (blockSink && !block.samples.empty()) {
+        blockSink(move(block));
+    }
+    return 0;
+}
+
+// **Register the per-block callback**
+void ProWaveDAQ::setBlockSink(BlockSink sink) {
+    lock_guard<mutex> lock(sinkMutex);
+    hasSink = static_cast<bool>(sink);
+    blockSink = move(sink);
+}
+
+// **Write the new sample rate (reader thread, between transactions)**
+void ProWaveDAQ::applySampleRate(int rate) {
+    if (!ctx || modbus_write_register(ctx, 0x01, rate) == -1) {
+        cerr << "Error: Failed to set Sample Rate to " << rate << " Hz!" << endl;
+        return;
     }
+    sampleRate = rate;
+
+    lock_guard<mutex> lock(dataMutex);
+    cout << "Sample Rate changed to " << rate << " Hz at sample " << samplesAcquired << endl;
 }
 
 // **Retrieve the latest vibration data**
@@ -185,6 +413,18 @@ vector<double> ProWaveDAQ::getData() {
     return latestData;
 }
 
+// **Retrieve the latest block with its acquisition time**
+DataBlock ProWaveDAQ::getDataBlock() {
+    lock_guard<mutex> lock(dataMutex);
+    DataBlock block;
+    block.samples = latestData;
+    block.acquiredAt = latestTime;
+    block.firstSample = latestFirstSample;
+    block.sequence = counter;
+    block.fifoBacklog = latestBacklog;
+    return block;
+}
+
 // **Get the number of data reads**
 int ProWaveDAQ::getCounter() const {
     return counter;
@@ -194,3 +434,234 @@ int ProWaveDAQ::getCounter() const {
 int ProWaveDAQ::getSampleRate() const {
     return sampleRate;
 }
+
+// **Check whether reading is active**
+bool ProWaveDAQ::isReading() const {
+    return reading;
+}
+
+const string& ProWaveDAQ::getSerialPort() const {
+    return serialPort;
+}
+
+int ProWaveDAQ::getBaudRate() const {
+    return baudRate;
+}
+
+// **Set read size and idle strategy (between reading sessions only)**
+void ProWaveDAQ::setPollConfig(const PollConfig& config) {
+    if (reading) {
+        cerr << "Error: Poll settings cannot change while reading" << endl;
+        return;
+    }
+    pollConfig = config;
+    pollConfig.readSize = max(3, min(config.readSize, MAX_REQUEST)) / 3 * 3;
+    pollConfig.sleepUs = max(0, config.sleepUs);
+    activePoll = pollConfig;
+}
+
+PollConfig ProWaveDAQ::getPollConfig() const {
+    return pollConfig;
+}
+
+// **Register the diagnostics hook (between reading sessions only)**
+void ProWaveDAQ::setTransactionObserver(TransactionObserver observer) {
+    if (reading) {
+        cerr << "Error: Transaction observer cannot change while reading" << endl;
+        return;
+    }
+    transactionObserver = move(observer);
+}
+
+// **Set the backpressure controller (between reading sessions only)**
+void ProWaveDAQ::setBackpressure(const BackpressureSettings& settings) {
+    if (reading) {
+        cerr << "Error: Backpressure settings cannot change while reading" << endl;
+        return;
+    }
+    backpressure = BackpressureController(settings);
+}
+
+BackpressureSettings ProWaveDAQ::getBackpressure() const {
+    return backpressure.getSettings();
+}
+
+// **How long pollOnce() waits for the FIFO to fill**
+int ProWaveDAQ::idleWaitUs(int available) const {
+    if (activePoll.strategy != PollStrategy::Paced) {
+        return activePoll.sleepUs;
+    }
+    // Time for the missing values to arrive at sampleRate 3-axis samples per second
+    double missing = activePoll.readSize - available;
+    return max(100, static_cast<int>(missing * 1e6 / (max(1, sampleRate.load()) * 3)));
+}
+
+// **Feed the FIFO length to the backpressure controller (reading thread)**
+void ProWaveDAQ::updateBackpressure() {
+    int previous = backpressure.getLevel();
+    bool changed = backpressure.observe(vib_data[0], chrono::steady_clock::now());
+    fifoTrend->set(backpressure.getTrend());
+    if (!changed) {
+        return;
+    }
+
+    int level = backpressure.getLevel();
+    (level > previous ? escalations : recoveries)->inc();
+    cout << "Backpressure level " << level << " (" << BackpressureController::levelName(level) << "): FIFO "
+         << static_cast<int>(backpressure.getDepth()) << "/" << backpressure.getSettings().fifoCapacity
+         << " values, trend " << showpos << static_cast<int>(backpressure.getTrend()) << noshowpos
+         << " values/s, at sample " << samplesAcquired << endl;
+    applyBackpressureLevel(level);
+}
+
+// **Each level keeps the measures of the levels below it**
+void ProWaveDAQ::applyBackpressureLevel(int level) {
+    activePoll = pollConfig;
+    if (level >= 1) {
+        activePoll.readSize = MAX_REQUEST;
+    }
+    if (level >= 2) {
+        activePoll.strategy = PollStrategy::Busy;
+    }
+    setReaderPriority(level >= 3);
+
+    int rate = rateForLevel(level);
+    if (rate != sampleRate) {
+        applySampleRate(rate);
+    }
+    backpressureLevel->set(level);
+}
+
+int ProWaveDAQ::rateForLevel(int level) const {
+    int halvings = max(0, level - BackpressureController::RATE_LEVEL + 1);
+    return max(1, nominalSampleRate.load() >> halvings);
+}
+
+int ProWaveDAQ::maxBackpressureLevel() const {
+    int minRate = backpressure.getSettings().minSampleRate;
+    int level = BackpressureController::RATE_LEVEL - 1;
+    if (minRate <= 0) {
+        return level;
+    }
+    while (rateForLevel(level + 1) >= minRate && rateForLevel(level + 1) < rateForLevel(level)) {
+        level++;
+    }
+    return level;
+}
+
+// **Register an auxiliary read (between reading sessions only)**
+void ProWaveDAQ::addAuxRegister(const AuxRegister& reg) {
+    if (reading) {
+        cerr << "Error: Auxiliary registers cannot change while reading" << endl;
+        return;
+    }
+    auxScheduler.add(reg);
+}
+
+void ProWaveDAQ::setAuxSink(AuxSink sink) {
+    lock_guard<mutex> lock(auxMutex);
+    auxSink = move(sink);
+}
+
+vector<AuxSample> ProWaveDAQ::getAuxSamples() {
+    lock_guard<mutex> lock(auxMutex);
+    vector<AuxSample> samples;
+    for (const auto& entry : latestAux) {
+        samples.push_back(entry.second);
+    }
+    return samples;
+}
+
+// **Auxiliary reads only use idle time the FIFO can spare**
+// The data stream is caught up when this is called (FIFO nearly empty). A
+// read is allowed when its expected time fills at most half of the FIFO
+// headroom below the backpressure high-water mark, and never while
+// backpressure is active, so the data stream keeps the bus it needs.
+bool ProWaveDAQ::pollAuxRegisters(int available) {
+    if (auxScheduler.empty() || backpressure.getLevel() > 0) {
+        return false;
+    }
+    const BackpressureSettings& pressure = backpressure.getSettings();
+    double headroom = pressure.fifoCapacity * pressure.highWater - available;
+    double budgetUs = 0.5 * headroom / (max(1, sampleRate.load()) * 3.0) * 1e6;
+
+    auto start = chrono::steady_clock::now();
+    int index = auxScheduler.next(start, budgetUs);
+    if (index < 0) {
+        return false;
+    }
+    const AuxRegister& reg = auxScheduler.get(index);
+
+    TRACE_SPAN("modbus_read_aux");
+    auxBuffer.resize(reg.count);
+    int rc = reg.holding ? modbus_read_registers(ctx, reg.address, reg.count, auxBuffer.data())
+                         : modbus_read_input_registers(ctx, reg.address, reg.count, auxBuffer.data());
+    auto end = chrono::steady_clock::now();
+    auto duration = chrono::duration_cast<chrono::nanoseconds>(end - start);
+    transactionLatency->record(duration.count());
+    auxLateness->record(auxScheduler.completed(index, end, duration).count());
+
+    AuxSample sample;
+    sample.name = reg.name;
+    sample.address = reg.address;
+    sample.ok = rc != -1;
+    sample.acquiredAt = end;
+    sample.sampleIndex = samplesAcquired;
+    if (sample.ok) {
+        sample.values = auxBuffer;
+        auxReads[index]->inc();
+        for (int r = 0; r < reg.count; r++) {
+            auxValues[index][r]->set(auxBuffer[r]);
+        }
+    } else {
+        errorCounter->inc();
+    }
+
+    lock_guard<mutex> lock(auxMutex);
+    if (auxSink) {
+        auxSink(sample);
+    }
+    latestAux[reg.name] = move(sample);
+    return true;
+}
+
+// **Raise the reading thread's priority (needs CAP_SYS_NICE) or restore the value it had**
+void ProWaveDAQ::setReaderPriority(bool raise) {
+    if (raise == priorityRaised) {
+        return;
+    }
+    if (!raise) {
+        if (setpriority(PRIO_PROCESS, priorityTid, savedNice) == -1) {
+            cerr << "Warning: Unable to restore reader priority: " << strerror(errno) << endl;
+        }
+        priorityRaised = false;
+        return;
+    }
+    pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+    errno = 0;
+    int nice = getpriority(PRIO_PROCESS, tid);
+    if (nice == -1 && errno != 0) {
+        cerr << "Warning: Unable to read reader priority: " << strerror(errno) << endl;
+        return;
+    }
+    if (setpriority(PRIO_PROCESS, tid, min(nice, -10)) == -1) {
+        cerr << "Warning: Unable to change reader priority: " << strerror(errno) << endl;
+        return;
+    }
+    priorityRaised = true;
+    priorityTid = tid;
+    savedNice = nice;
+}
+
+// **Request a sample rate change (applied by readLoop)**
+void ProWaveDAQ::requestSampleRate(int rate) {
+    if (rate == nominalSampleRate) {
+        return;
+    }
+    nominalSampleRate = rate;
+    if (reading) {
+        pendingSampleRate = rate;
+    } else {
+        applySampleRate(rate);
+    }
+}
@@ -14,18 +14,54 @@
 #include <mutex>
 #include <regex>
 #include <filesystem>
+#include <functional>
 
 // Include INIReader for configuration parsing
 #include "./iniReader/INIReader.h"
 extern "C" {
 #include "./iniReader/ini.h"
 }
+#include "AuxScheduler.h"
+#include "Backpressure.h"
+#include "BlockKernels.h"
+#include "DataBlock.h"
+#include "DeviceProber.h"
+#include "Metrics.h"
+#include "Trace.h"
 
 using namespace std;
 namespace fs = std::filesystem;
 
+// What pollOnce() does while the FIFO holds too little for a data read.
+enum class PollStrategy {
+    Sleep,   // Wait sleepUs, then re-read the FIFO length (reads whatever has arrived)
+    Busy,    // Re-read the FIFO length immediately
+    Paced    // Wait until a full readSize should have arrived, then read it
+};
+
+// Parses "sleep", "busy" or "paced". Returns false for anything else.
+bool parsePollStrategy(const string& name, PollStrategy& strategy);
+const char* pollStrategyName(PollStrategy strategy);
+
+struct PollConfig {
+    int readSize = 41 * 3;                     // Values per data transaction (multiple of 3, 3..123)
+    PollStrategy strategy = PollStrategy::Sleep;
+    int sleepUs = 1000;                        // Wait of PollStrategy::Sleep
+};
+
+// One Modbus read as seen by a transaction observer.
+struct ModbusTransaction {
+    int address;                   // 0x02 for FIFO length/data
+    int registers;                 // Registers requested (1 = FIFO length only)
+    bool ok;
+    uint16_t fifoLength;           // FIFO length after the read (when ok)
+    chrono::nanoseconds duration;  // Request-to-response time
+};
+
 class ProWaveDAQ {
 public:
+    static const int MAX_REQUEST = 41 * 3;     // Most values one data transaction can return
+
     // Constructor & Destructor
     ProWaveDAQ();
     ~ProWaveDAQ();
@@ -36,19 +72,72 @@ public:
     // Starts reading vibration data.
     void startReading();
 
-    // Stops reading vibration data.
+    // Prepares for reading without starting the reader thread; the caller then
+    // drives pollOnce() (e.g. from an executor serving several devices).
+    void startPolling();
+
+    // Performs at most one Modbus data transaction. Returns how long to wait in
+    // microseconds before the next call (0 = call again right away).
+    int pollOnce();
+
+    // Stops the reader thread or polling; the connection stays open.
+    void stopPolling();
+
+    // Stops reading vibration data and closes the connection.
     void stopReading();
 
     // Retrieves the most recent vibration data.
     vector<double> getData();
 
+    // Retrieves the most recent block with its acquisition timestamp and sample index.
+    DataBlock getDataBlock();
+
+    // Called on the reader thread with every block as it is read; must not block.
+    using BlockSink = function<void(DataBlock&& block)>;
+    void setBlockSink(BlockSink sink);
+
     // Returns the current data read count.
     int getCounter() const;
 
     // Returns the sample rate.
     int getSampleRate() const;
 
-    // Scans for connected devices.
+    // True between startReading()/startPolling() and stopPolling()/stopReading().
+    bool isReading() const;
+
+    const string& getSerialPort() const;
+    int getBaudRate() const;
+
+    // Read size and idle strategy of the reading loop ([ProWaveDAQ] readSize
+    // and pollStrategy). Only changed while not reading.
+    void setPollConfig(const PollConfig& config);
+    PollConfig getPollConfig() const;
+
+    // FIFO backpressure controller settings ([ProWaveDAQ] backpressure,
+    // fifoCapacity, minSampleRate). Only changed while not reading.
+    void setBackpressure(const BackpressureSettings& settings);
+    BackpressureSettings getBackpressure() const;
+
+    // Adds an auxiliary register read in bus idle time ([AuxRegisters] in the
+    // INI file); call after initDevices() and while not reading.
+    void addAuxRegister(const AuxRegister& reg);
+
+    // Called on the reading thread with every auxiliary read; must not block.
+    using AuxSink = function<void(const AuxSample& sample)>;
+    void setAuxSink(AuxSink sink);
+
+    // The latest read of every auxiliary register.
+    vector<AuxSample> getAuxSamples();
+
+    // Called on the reading thread after every read of register 0x02; set only while not reading.
+    using TransactionObserver = function<void(const ModbusTransaction& transaction)>;
+    void setTransactionObserver(TransactionObserver observer);
+
+    // Changes the sample rate without stopping acquisition; the reader thread
+    // writes register 0x01 between two transactions.
+    void requestSampleRate(int rate);
+
+    // Scans for connected devices (lists ports only; see DeviceProber to identify sensors).
     void scanDevices();
 
 private:
@@ -56,17 +145,86 @@ private:
     modbus_t* ctx;          // Modbus context
     string serialPort;      // Serial port used for communication
     int baudRate;           // Baud rate for serial communication
-    int sampleRate;         // Sampling rate for data acquisition
+    atomic<int> sampleRate; // Sampling rate for data acquisition
+    atomic<int> pendingSampleRate; // Requested rate not yet written (0 = none)
+    atomic<int> nominalSampleRate; // Configured rate; backpressure may run below it
     int slaveID;            // Modbus slave ID
     atomic<int> counter;    // Counter for data reads
     atomic<bool> reading;   // Flag to indicate if reading is active
     thread readingThread;   // Thread handling data reading
 
     vector<double> latestData; // Stores the latest acquired data
+    chrono::steady_clock::time_point latestTime; // When latestData was published
+    uint64_t latestFirstSample;                  // Sample index of latestData[0]
+    uint16_t latestBacklog;                      // FIFO length left after latestData was read
+    uint64_t samplesAcquired;                    // 3-axis samples read since startReading()
     mutex dataMutex;           // Mutex to ensure thread safety
+    BlockSink blockSink;       // Receives every block (see setBlockSink)
+    mutex sinkMutex;           // Guards blockSink
+    atomic<bool> hasSink;      // blockSink is set (checked without sinkMutex)
+    mutex auxMutex;            // Guards auxSink and latestAux
+    AuxSink auxSink;           // Receives every auxiliary read
+    map<string, AuxSample> latestAux;            // Latest read per auxiliary register
+
+    // Reading state carried between pollOnce() calls
+    PollConfig pollConfig;                        // Read size and idle strategy
+    PollConfig activePoll;                        // pollConfig as adjusted by backpressure
+    BackpressureController backpressure;          // Escalates as the sensor FIFO fills
+    bool priorityRaised;                          // Reading thread runs at a raised priority
+    AuxScheduler auxScheduler;                    // Auxiliary reads fitted into idle bus time
+    vector<uint16_t> auxBuffer;                   // Registers of the auxiliary read in progress
+    pid_t priorityTid;                            // Thread whose priority was raised
+    int savedNice;                                // Its nice value before it was raised
+    TransactionObserver transactionObserver;      // Diagnostics hook (see setTransactionObserver)
+    uint16_t vib_data[MAX_REQUEST + 1];           // FIFO length + XYZ values
+    chrono::steady_clock::time_point lastRead;    // Previous successful data read
+    BlockKernels blockKernels;                    // XYZ conversion, unrolled for 3 channels
+    bool pollPending;                             // FIFO length must be re-read next call
+
+    // Metrics (labelled with the serial port, bound in startReading)
+    MetricRate* samplesMetric;            // Samples (3-axis frames) acquired
+    HdrHistogram* transactionLatency;     // Modbus request-to-response time (ns)
+    HdrHistogram* readInterval;           // Time between successful data reads (ns)
+    MetricHistogram* fifoDepth;           // Sensor FIFO length reported at register 0x02
+    MetricCounter* errorCounter;          // Failed Modbus transactions
+    MetricGauge* backpressureLevel;       // Current backpressure level
+    MetricGauge* fifoTrend;               // Smoothed FIFO growth (values/s)
+    MetricCounter* escalations;           // Backpressure level raised
+    MetricCounter* recoveries;            // Backpressure level lowered
+    HdrHistogram* auxLateness;            // Auxiliary read start after its due time (ns)
+    vector<MetricCounter*> auxReads;      // Per auxiliary register
+    vector<vector<MetricGauge*>> auxValues; // Per auxiliary register and register offset
 
     // Internal function for reading data in a loop.
     void readLoop();
+
+    // Registers this device's metrics.
+    void bindMetrics();
+
+    // Reads input registers, recording latency and errors.
+    int readRegisters(int addr, int nb, uint16_t* dest);
+
+    // Writes the sample rate register and logs the sample index it applies from.
+    void applySampleRate(int rate);
+
+    // Microseconds to wait while the FIFO holds `available` values, per the poll strategy.
+    int idleWaitUs(int available) const;
+
+    // Feeds the FIFO length just read to the backpressure controller and applies level changes.
+    void updateBackpressure();
+
+    // Applies a backpressure level: read size, poll strategy, priority and sample rate.
+    void applyBackpressureLevel(int level);
+
+    // Sample rate for a backpressure level, and the highest level minSampleRate allows.
+    int rateForLevel(int level) const;
+    int maxBackpressureLevel() const;
+
+    // Runs one due auxiliary read if it fits the FIFO headroom. Returns true if the bus was used.
+    bool pollAuxRegisters(int available);
+
+    // Raises or restores the scheduling priority of the calling (reading) thread.
+    void setReaderPriority(bool raise);
 };
 
 #endif // PROWAVEDAQ_H
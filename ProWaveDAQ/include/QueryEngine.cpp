@@ -0,0 +1,494 @@
+#include "QueryEngine.h"
+#include "Biquad.h"
+#include "RecordingJournal.h"
+#include "RetentionManager.h"
+#include "SegmentCodec.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+// The band-pass filters run this many periods of the low band edge before a file is aggregated
+static const double SETTLE_PERIODS = 10;
+
+static const char* AGGREGATE_NAMES[] = {"mean", "rms", "peak", "min", "max", "band"};
+
+void QueryEngine::Partial::merge(const Partial& other) {
+    if (channels.empty()) {
+        *this = other;
+        return;
+    }
+    frames += other.frames;
+    for (size_t c = 0; c < channels.size() && c < other.channels.size(); c++) {
+        channels[c].sum += other.channels[c].sum;
+        channels[c].sumSquares += other.channels[c].sumSquares;
+        channels[c].min = std::min(channels[c].min, other.channels[c].min);
+        channels[c].max = std::max(channels[c].max, other.channels[c].max);
+    }
+}
+
+QueryEngine::QueryEngine(const QuerySpec& spec) : spec(spec) {}
+
+bool QueryEngine::parseAggregate(const string& text, QuerySpec& spec) {
+    static const QueryAggregate simple[] = {QueryAggregate::Mean, QueryAggregate::Rms, QueryAggregate::Peak,
+                                            QueryAggregate::Min, QueryAggregate::Max};
+    for (int i = 0; i < 5; i++) {
+        if (text == AGGREGATE_NAMES[i]) {
+            spec.aggregate = simple[i];
+            return true;
+        }
+    }
+    double low, high;
+    if (sscanf(text.c_str(), "band:%lf-%lf", &low, &high) == 2 && low > 0 && high > low) {
+        spec.aggregate = QueryAggregate::BandEnergy;
+        spec.bandLowHz = low;
+        spec.bandHighHz = high;
+        return true;
+    }
+    return false;
+}
+
+time_t QueryEngine::parseTime(const string& text) {
+    static const char* FORMATS[] = {"%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M:%S", "%Y-%m-%d", "%Y%m%d%H%M%S"};
+    for (const char* format : FORMATS) {
+        tm local = {};
+        const char* end = strptime(text.c_str(), format, &local);
+        if (end && *end == '\0') {
+            local.tm_isdst = -1;
+            return mktime(&local);
+        }
+    }
+    return 0;
+}
+
+// **Plan: matching sessions, their segments in the time range, and their features**
+vector<QueryEngine::Task> QueryEngine::plan() {
+    vector<Task> tasks;
+    error_code error;
+    for (const auto& entry : fs::directory_iterator(spec.root, error)) {
+        string session = entry.path().filename().string();
+        if (!entry.is_directory(error) || RetentionManager::segmentStart(session) == 0 || session.size() < 16 ||
+            fnmatch(spec.labelPattern.c_str(), session.substr(15).c_str(), 0) != 0) {
+            continue;
+        }
+        vector<fs::path> segments;
+        fs::path features;
+        for (const auto& file : fs::directory_iterator(entry.path(), error)) {
+            string name = file.path().filename().string();
+            if (RetentionManager::isSegment(name)) {
+                segments.push_back(file.path());
+            } else if (name == RetentionManager::FEATURES_FILE) {
+                features = file.path();
+            }
+        }
+        sort(segments.begin(), segments.end(), [](const fs::path& a, const fs::path& b) {
+            return RecordingJournal::segmentBefore(a.filename().string(), b.filename().string());
+        });
+
+        size_t before = tasks.size();
+        for (size_t i = 0; i < segments.size(); i++) {
+            // A segment ends where the next one starts
+            time_t start = RetentionManager::segmentStart(segments[i].filename().string());
+            time_t next = i + 1 < segments.size() ? RetentionManager::segmentStart(segments[i + 1].filename().string()) : 0;
+            if ((spec.to && start >= spec.to) || (spec.from && next && next <= spec.from)) {
+                runStats.skippedFiles++;
+                continue;
+            }
+            Task task;
+            task.source = segments[i].extension() == ".csv" ? Source::Csv : Source::Pwc;
+            task.path = segments[i];
+            task.session = session;
+            task.start = start;
+            task.bytes = fs::file_size(segments[i], error);
+            tasks.push_back(task);
+        }
+        if (!features.empty()) {
+            if (spec.aggregate == QueryAggregate::BandEnergy) {
+                cerr << "Warning: " << features << " has no spectral content, skipped" << endl;
+                runStats.skippedFiles++;
+            } else {
+                Task task;
+                task.source = Source::Features;
+                task.path = features;
+                task.session = session;
+                task.bytes = fs::file_size(features, error);
+                tasks.push_back(task);
+            }
+        }
+        if (tasks.size() > before) {
+            runStats.sessions++;
+        }
+    }
+    // **Largest first, so no worker is left with a big file at the end**
+    sort(tasks.begin(), tasks.end(), [](const Task& a, const Task& b) { return a.bytes > b.bytes; });
+    return tasks;
+}
+
+vector<QueryRow> QueryEngine::run() {
+    auto started = chrono::steady_clock::now();
+    runStats = QueryStats();
+    vector<Task> tasks = plan();
+
+    size_t workers = spec.threads > 0 ? spec.threads : max(1u, thread::hardware_concurrency());
+    workers = max<size_t>(1, min(workers, tasks.size()));
+    vector<deque<size_t>> queues(workers);
+    vector<mutex> queueMutexes(workers);
+    for (size_t i = 0; i < tasks.size(); i++) {
+        queues[i % workers].push_back(i);
+    }
+
+    // **Work stealing: own queue from the front (largest left), the others' from the back (smallest)**
+    auto next = [&](size_t self, size_t& index) {
+        for (size_t k = 0; k < workers; k++) {
+            size_t victim = (self + k) % workers;
+            lock_guard<mutex> lock(queueMutexes[victim]);
+            if (queues[victim].empty()) {
+                continue;
+            }
+            if (k == 0) {
+                index = queues[victim].front();
+                queues[victim].pop_front();
+            } else {
+                index = queues[victim].back();
+                queues[victim].pop_back();
+            }
+            return true;
+        }
+        return false;
+    };
+    vector<Partials> partials(workers);
+    vector<QueryStats> counts(workers);
+    vector<thread> threads;
+    for (size_t w = 0; w < workers; w++) {
+        threads.emplace_back([&, w]() {
+            size_t index;
+            while (next(w, index)) {
+                const Task& task = tasks[index];
+                if (!execute(task, partials[w])) {
+                    counts[w].skippedFiles++;
+                    continue;
+                }
+                counts[w].bytes += task.bytes;
+                (task.source == Source::Csv ? counts[w].csvFiles
+                 : task.source == Source::Pwc ? counts[w].pwcFiles : counts[w].featureFiles)++;
+            }
+        });
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+
+    // **Merge the workers' partial aggregates**
+    Partials merged;
+    for (size_t w = 0; w < workers; w++) {
+        for (const auto& [key, partial] : partials[w]) {
+            merged[key].merge(partial);
+        }
+        runStats.csvFiles += counts[w].csvFiles;
+        runStats.pwcFiles += counts[w].pwcFiles;
+        runStats.featureFiles += counts[w].featureFiles;
+        runStats.skippedFiles += counts[w].skippedFiles;
+        runStats.bytes += counts[w].bytes;
+    }
+    vector<QueryRow> rows;
+    rows.reserve(merged.size());
+    for (const auto& [key, partial] : merged) {
+        QueryRow row;
+        row.session = key.first;
+        row.windowStart = key.second * spec.windowSeconds;
+        row.frames = partial.frames;
+        int channels = static_cast<int>(partial.channels.size());
+        if (spec.channel >= 0) {
+            row.values.push_back(spec.channel < channels ? value(partial, spec.channel) : NAN);
+        } else {
+            for (int c = 0; c < channels; c++) {
+                row.values.push_back(value(partial, c));
+            }
+        }
+        rows.push_back(move(row));
+    }
+    runStats.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    return rows;
+}
+
+double QueryEngine::value(const Partial& partial, int channel) const {
+    const ChannelPartial& c = partial.channels[channel];
+    double n = static_cast<double>(partial.frames);
+    double mean = c.sum / n;
+    switch (spec.aggregate) {
+    case QueryAggregate::Mean:
+        return mean;
+    case QueryAggregate::Rms:
+        return sqrt(max(0.0, c.sumSquares / n - mean * mean));
+    case QueryAggregate::Peak:
+        return max(c.max - mean, mean - c.min);
+    case QueryAggregate::Min:
+        return c.min;
+    case QueryAggregate::Max:
+        return c.max;
+    case QueryAggregate::BandEnergy:
+        return c.sumSquares / n;
+    }
+    return NAN;
+}
+
+bool QueryEngine::execute(const Task& task, Partials& partials) {
+    // **Memory-mapped, read once front to back**
+    int fd = open(task.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    size_t size = info.st_size;
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    const char* data = static_cast<const char*>(mapped);
+
+    bool answered = false;
+    if (task.source == Source::Features) {
+        answered = aggregateFeatures(task, data, size, partials);
+    } else {
+        vector<double> values;
+        int channels = 0;
+        if (task.source == Source::Csv) {
+            answered = parseCsv(data, size, values, channels);
+        } else {
+            vector<int16_t> raw;
+            answered = SegmentCodec::decode(string_view(data, size), raw, channels);
+            values.resize(raw.size());
+            for (size_t i = 0; i < raw.size(); i++) {
+                values[i] = raw[i] / 8192.0;
+            }
+        }
+        if (answered && channels > 4 && spec.aggregate == QueryAggregate::BandEnergy) {
+            answered = false;   // One SIMD lane per channel
+        }
+        if (answered) {
+            aggregate(task, values, channels, partials);
+        }
+    }
+    munmap(mapped, size);
+    if (!answered) {
+        cerr << "Warning: cannot answer from " << task.path << ", skipped" << endl;
+    }
+    return answered;
+}
+
+// Whole rows of equal width; a torn last row (or preallocated zero fill) ends the data.
+bool QueryEngine::parseCsv(const char* data, size_t size, vector<double>& values, int& channels) {
+    const char* end = data + size;
+    const char* firstLine = static_cast<const char*>(memchr(data, '\n', size));
+    if (!firstLine) {
+        return false;
+    }
+    channels = 1 + count(data, firstLine, ',');
+    values.reserve(size / (8 * channels) * channels);
+    const char* p = data;
+    while (p < end && *p != '\0') {
+        const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!lineEnd) {
+            break;
+        }
+        for (int c = 0; c < channels; c++) {
+            double v;
+            auto [next, error] = from_chars(p, lineEnd, v);
+            if (error != errc() || (c + 1 < channels ? *next != ',' : next != lineEnd)) {
+                return false;
+            }
+            values.push_back(v);
+            p = next + 1;
+        }
+    }
+    return !values.empty();
+}
+
+void QueryEngine::aggregate(const Task& task, const vector<double>& values, int channels, Partials& partials) {
+    const double rate = spec.sampleRate;
+    size_t frames = values.size() / channels;
+
+    // **Frames inside [from, to)**
+    size_t first = 0, last = frames;
+    if (spec.from > task.start) {
+        first = min(frames, static_cast<size_t>(ceil((spec.from - task.start) * rate)));
+    }
+    if (spec.to) {
+        last = spec.to > task.start ? min(frames, static_cast<size_t>(ceil((spec.to - task.start) * rate))) : 0;
+    }
+    if (first >= last) {
+        return;
+    }
+
+    const bool band = spec.aggregate == QueryAggregate::BandEnergy;
+    Biquad filters[4];
+    auto frameAt = [&](size_t f) {
+        FrameLanes x = {};
+        for (int c = 0; c < channels; c++) {
+            x[c] = static_cast<float>(values[f * channels + c]);
+        }
+        return x;
+    };
+    auto filter = [&](FrameLanes x) {
+        for (Biquad& section : filters) {
+            x = section.run(x);
+        }
+        return x;
+    };
+    if (band) {
+        for (int i = 0; i < 2; i++) {
+            filters[i] = Biquad::highPass(spec.bandLowHz, rate, BUTTERWORTH4_Q[i]);
+            filters[2 + i] = Biquad::lowPass(min(spec.bandHighHz, 0.49 * rate), rate, BUTTERWORTH4_Q[i]);
+        }
+        // Settle on the start of the range so the step into the data is not counted
+        size_t settle = min(last - first, static_cast<size_t>(SETTLE_PERIODS * rate / spec.bandLowHz));
+        for (size_t f = first; f < first + settle; f++) {
+            filter(frameAt(f));
+        }
+    }
+
+    size_t f = first;
+    while (f < last) {
+        // **One window at a time: frames up to the next window boundary**
+        int64_t window = static_cast<int64_t>(floor((task.start + f / rate) / spec.windowSeconds));
+        double boundary = (window + 1) * spec.windowSeconds - task.start;
+        size_t stop = min(last, max(f + 1, static_cast<size_t>(ceil(boundary * rate))));
+        Partial& partial = partials[Key(task.session, window)];
+        if (partial.channels.empty()) {
+            partial.channels.assign(channels, ChannelPartial{0, 0, numeric_limits<double>::infinity(),
+                                                             -numeric_limits<double>::infinity()});
+        }
+        partial.frames += stop - f;
+        for (; f < stop; f++) {
+            const double* frame = &values[f * channels];
+            FrameLanes y = {};
+            if (band) {
+                y = filter(frameAt(f));
+            }
+            for (int c = 0; c < channels; c++) {
+                ChannelPartial& p = partial.channels[c];
+                double v = frame[c];
+                p.sum += v;
+                p.sumSquares += band ? static_cast<double>(y[c]) * y[c] : v * v;
+                p.min = v < p.min ? v : p.min;
+                p.max = v > p.max ? v : p.max;
+            }
+        }
+    }
+}
+
+// features.csv rows: segment,window,frames, then mean,rms,min,max per channel.
+bool QueryEngine::aggregateFeatures(const Task& task, const char* data, size_t size, Partials& partials) {
+    const char* end = data + size;
+    const char* p = static_cast<const char*>(memchr(data, '\n', size));
+    if (!p) {
+        return false;
+    }
+    int channels = (count(data, p, ',') + 1 - 3) / 4;
+    if (channels < 1) {
+        return false;
+    }
+    p++;
+    string segment;
+    time_t segmentStart = 0;
+    double windowFrames = 0;   // Frames of a segment's first (full) window
+    vector<double> fields(3 + 4 * channels);
+    while (p < end) {
+        const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!lineEnd) {
+            break;
+        }
+        const char* comma = static_cast<const char*>(memchr(p, ',', lineEnd - p));
+        if (!comma) {
+            return false;
+        }
+        if (segment.compare(0, string::npos, p, comma - p) != 0) {
+            segment.assign(p, comma - p);
+            segmentStart = RetentionManager::segmentStart(segment);
+            windowFrames = 0;
+        }
+        const char* q = comma + 1;
+        for (size_t i = 1; i < fields.size(); i++) {
+            auto [next, error] = from_chars(q, lineEnd, fields[i]);
+            if (error != errc() || (i + 1 < fields.size() ? *next != ',' : next != lineEnd)) {
+                return false;
+            }
+            q = next + 1;
+        }
+        p = lineEnd + 1;
+
+        double index = fields[1], frames = fields[2];
+        if (windowFrames == 0) {
+            windowFrames = frames;
+        }
+        double start = segmentStart + index * windowFrames / spec.sampleRate;
+        if ((spec.from && start < spec.from) || (spec.to && start >= spec.to) || frames <= 0) {
+            continue;
+        }
+        // **A feature window counts whole, in the query window it starts in**
+        Partial& partial = partials[Key(task.session, static_cast<int64_t>(floor(start / spec.windowSeconds)))];
+        if (partial.channels.empty()) {
+            partial.channels.assign(channels, ChannelPartial{0, 0, numeric_limits<double>::infinity(),
+                                                             -numeric_limits<double>::infinity()});
+        }
+        partial.frames += static_cast<uint64_t>(frames);
+        for (int c = 0; c < channels && c < static_cast<int>(partial.channels.size()); c++) {
+            double mean = fields[3 + 4 * c], rms = fields[4 + 4 * c];
+            ChannelPartial& out = partial.channels[c];
+            out.sum += mean * frames;
+            out.sumSquares += (rms * rms + mean * mean) * frames;
+            out.min = min(out.min, fields[5 + 4 * c]);
+            out.max = max(out.max, fields[6 + 4 * c]);
+        }
+    }
+    return true;
+}
+
+void QueryEngine::printCsv(const vector<QueryRow>& rows, const QuerySpec& spec, ostream& out) {
+    string aggregate = AGGREGATE_NAMES[static_cast<int>(spec.aggregate)];
+    size_t columns = 0;
+    for (const QueryRow& row : rows) {
+        columns = max(columns, row.values.size());
+    }
+    out << "session,window_start,frames";
+    for (size_t c = 0; c < columns; c++) {
+        out << ",ch" << (spec.channel >= 0 ? spec.channel + 1 : static_cast<int>(c) + 1) << "_" << aggregate;
+    }
+    out << "\n";
+    for (const QueryRow& row : rows) {
+        time_t seconds = static_cast<time_t>(floor(row.windowStart));
+        int millis = static_cast<int>(lround((row.windowStart - seconds) * 1000));
+        tm local;
+        localtime_r(&seconds, &local);
+        char buffer[32];
+        strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &local);
+        out << row.session << "," << buffer;
+        if (millis) {
+            out << "." << setw(3) << setfill('0') << millis << setfill(' ');
+        }
+        out << "," << row.frames;
+        for (double v : row.values) {
+            out << "," << v;
+        }
+        out << "\n";
+    }
+}
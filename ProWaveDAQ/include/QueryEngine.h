@@ -0,0 +1,130 @@
+#ifndef QUERY_ENGINE_H
+#define QUERY_ENGINE_H
+
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+namespace fs = filesystem;
+
+enum class QueryAggregate {
+    Mean,
+    Rms,          // About the window mean
+    Peak,         // Largest |value - window mean|
+    Min,
+    Max,
+    BandEnergy    // Mean square of the 4th-order Butterworth band-passed signal (g²)
+};
+
+// One offline query over the recorded sessions (main --query).
+struct QuerySpec {
+    string root = "output/ProWaveDAQ";  // Parent of the session folders
+    string labelPattern = "*";           // Shell pattern on the session label
+    time_t from = 0;                     // Local time range, 0 = open
+    time_t to = 0;
+    QueryAggregate aggregate = QueryAggregate::Rms;
+    double bandLowHz = 0;                // BandEnergy only
+    double bandHighHz = 0;
+    double windowSeconds = 10;           // Windows are aligned to multiples of this since the epoch
+    int channel = -1;                    // 0-based, -1 = every channel
+    int sampleRate = 7812;               // Segments do not record their rate
+    int threads = 0;                     // 0 = one per core
+};
+
+// One window of one session.
+struct QueryRow {
+    string session;                      // Session folder name
+    double windowStart = 0;              // Seconds since the epoch
+    uint64_t frames = 0;
+    vector<double> values;               // Per channel (or the selected one)
+};
+
+// What QueryEngine::run() read.
+struct QueryStats {
+    int sessions = 0;
+    int csvFiles = 0;
+    int pwcFiles = 0;
+    int featureFiles = 0;                // Sessions answered (partly) from features.csv
+    int skippedFiles = 0;                // Outside the range, unreadable, or unable to answer
+    uint64_t bytes = 0;
+    double seconds = 0;
+};
+
+// QueryEngine answers aggregate queries over the sessions RetentionManager
+// and CSVWriter leave under root:
+//   plan    - session folders matching labelPattern; segments outside the
+//             time range are pruned by the start time in their names. A
+//             session's features.csv (RetentionManager) answers mean, rms,
+//             peak, min and max for segments that were reduced, at its own
+//             window resolution.
+//   execute - one task per file on a work-stealing thread pool (each
+//             worker takes its largest file first; idle workers steal the
+//             smallest from the back of the others' queues). Files are memory-mapped; .pwc segments are decoded
+//             directly, CSV segments parsed with from_chars.
+//   merge   - every worker keeps its own partial aggregates (count, sums,
+//             extremes) per session and window; a window split across two
+//             segment files is merged at the end.
+class QueryEngine {
+public:
+    explicit QueryEngine(const QuerySpec& spec);
+
+    // "mean", "rms", "peak", "min", "max" or "band:<low>-<high>"; false if unknown.
+    static bool parseAggregate(const string& text, QuerySpec& spec);
+
+    // "YYYY-MM-DD", "YYYY-MM-DD HH:MM:SS" or "YYYYMMDDHHMMSS" as local time; 0 if invalid.
+    static time_t parseTime(const string& text);
+
+    vector<QueryRow> run();
+    const QueryStats& stats() const { return runStats; }
+
+    // Header plus one line per row: session,window_start,frames,<value per channel>.
+    static void printCsv(const vector<QueryRow>& rows, const QuerySpec& spec, ostream& out);
+
+private:
+    enum class Source { Csv, Pwc, Features };
+
+    struct Task {
+        Source source;
+        fs::path path;
+        string session;
+        time_t start = 0;          // Segment start (Csv, Pwc)
+        uint64_t bytes = 0;
+    };
+
+    struct ChannelPartial {
+        double sum = 0;
+        double sumSquares = 0;     // Of the value, or of the band-passed value for BandEnergy
+        double min = 0;
+        double max = 0;
+    };
+
+    struct Partial {
+        uint64_t frames = 0;
+        vector<ChannelPartial> channels;
+
+        void merge(const Partial& other);
+    };
+
+    using Key = pair<string, int64_t>;   // Session, window index
+    using Partials = map<Key, Partial>;
+
+    QuerySpec spec;
+    QueryStats runStats;
+
+    vector<Task> plan();
+    // False if the task could not be answered.
+    bool execute(const Task& task, Partials& partials);
+    void aggregate(const Task& task, const vector<double>& values, int channels, Partials& partials);
+    bool aggregateFeatures(const Task& task, const char* data, size_t size, Partials& partials);
+
+    static bool parseCsv(const char* data, size_t size, vector<double>& values, int& channels);
+    double value(const Partial& partial, int channel) const;
+};
+
+#endif // QUERY_ENGINE_H
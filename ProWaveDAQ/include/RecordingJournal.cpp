@@ -0,0 +1,290 @@
+#include "RecordingJournal.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+#include <vector>
+
+bool parseDurability(const string& name, Durability& durability) {
+    if (name == "none") {
+        durability = Durability::None;
+    } else if (name == "periodic") {
+        durability = Durability::Periodic;
+    } else if (name == "group") {
+        durability = Durability::Group;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* durabilityName(Durability durability) {
+    switch (durability) {
+    case Durability::None: return "none";
+    case Durability::Group: return "group";
+    default: return "periodic";
+    }
+}
+
+// FNV-1a: enough to tell a complete record from a torn one.
+static uint32_t checksum(const string& text) {
+    uint32_t hash = 2166136261u;
+    for (unsigned char c : text) {
+        hash = (hash ^ c) * 16777619u;
+    }
+    return hash;
+}
+
+static bool writeAll(int fd, const string& text) {
+    size_t written = 0;
+    while (written < text.size()) {
+        ssize_t n = write(fd, text.data() + written, text.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+RecordingJournal::RecordingJournal(const string& folder)
+    : folder(folder), path(folder + "/" + FILE_NAME) {
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        cerr << "Error: Unable to open commit journal " << path << ": " << strerror(errno) << endl;
+    }
+}
+
+RecordingJournal::~RecordingJournal() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+void RecordingJournal::committed(const string& file, uint64_t bytes) {
+    append('C', file, bytes);
+}
+
+void RecordingJournal::closed(const string& file, uint64_t bytes) {
+    append('F', file, bytes);
+}
+
+string RecordingJournal::record(char type, const string& file, uint64_t bytes) {
+    string body = string(1, type) + " " + to_string(bytes) + " " + file;
+    ostringstream line;
+    line << type << " " << bytes << " " << hex << setw(8) << setfill('0') << checksum(body) << " " << file << "\n";
+    return line.str();
+}
+
+bool RecordingJournal::parse(const string& line, char& type, uint64_t& bytes, string& file) {
+    istringstream fields(line);
+    string sum;
+    if (!(fields >> type >> bytes >> sum) || !getline(fields >> ws, file)) {
+        return false;
+    }
+    return record(type, file, bytes) == line + "\n";
+}
+
+void RecordingJournal::append(char type, const string& file, uint64_t bytes) {
+    lock_guard<mutex> lock(journalMutex);
+    if (fd < 0) {
+        return;
+    }
+    string line = record(type, file, bytes);
+    if (!writeAll(fd, line) || fdatasync(fd) != 0) {
+        cerr << "Error: Failed to write commit journal " << path << ": " << strerror(errno) << endl;
+        return;
+    }
+    // **Only the last records matter: start over once a closed segment makes the rest history**
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (type != 'C' && size > static_cast<off_t>(COMPACT_BYTES)) {
+        compact(line);
+    }
+}
+
+void RecordingJournal::compact(const string& line) {
+    string temporary = path + ".tmp";
+    int out = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        return;
+    }
+    bool ok = writeAll(out, line) && fdatasync(out) == 0;
+    close(out);
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0) {
+        unlink(temporary.c_str());
+        return;
+    }
+    int dir = open(folder.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir >= 0) {
+        fsync(dir);
+        close(dir);
+    }
+    close(fd);
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+}
+
+RecoveryReport RecordingJournal::recover(const string& root) {
+    RecoveryReport report;
+    auto start = chrono::steady_clock::now();
+    error_code error;
+    if (fs::is_directory(root, error)) {
+        for (const auto& entry : fs::directory_iterator(root, error)) {
+            if (!entry.is_directory(error)) {
+                continue;
+            }
+            try {
+                recoverSession(entry.path(), report);
+            } catch (const fs::filesystem_error& e) {
+                cerr << "Error: Recovery of " << entry.path().string() << " failed: " << e.what() << endl;
+            }
+        }
+    }
+    report.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return report;
+}
+
+// True for bytes CSVWriter produces ("%g" values, commas, newlines).
+static bool isCsvByte(unsigned char c) {
+    return (c >= '0' && c <= '9') || c == '.' || c == ',' || c == '-' || c == '+' || c == 'e' || c == '\n' ||
+           c == 'n' || c == 'a' || c == 'i' || c == 'f';
+}
+
+bool RecordingJournal::segmentBefore(const string& a, const string& b) {
+    int time = a.compare(0, 14, b, 0, 14);
+    if (time != 0) {
+        return time < 0;
+    }
+    // "<label>" < "<label>-2" < ... < "<label>-9" < "<label>-10": a longer stem is a later one
+    size_t stemA = min(a.rfind('.'), a.size());
+    size_t stemB = min(b.rfind('.'), b.size());
+    if (stemA != stemB) {
+        return stemA < stemB;
+    }
+    return a.compare(0, stemA, b, 0, stemB) < 0;
+}
+
+bool RecordingJournal::recoverSession(const fs::path& folder, RecoveryReport& report) {
+    error_code error;
+    fs::remove(folder / ".next_segment.tmp", error);   // Unused preallocated segment
+
+    // **The last segment is the newest "<yyyymmddHHMMSS>_<label>[-n].csv"**
+    string last;
+    for (const auto& entry : fs::directory_iterator(folder)) {
+        string name = entry.path().filename().string();
+        if (entry.is_regular_file() && name.size() > 19 && name[14] == '_' &&
+            name.compare(name.size() - 4, 4, ".csv") == 0 &&
+            name.find_first_not_of("0123456789") == 14 && (last.empty() || segmentBefore(last, name))) {
+            last = name;
+        }
+    }
+    if (last.empty()) {
+        return false;
+    }
+    report.sessions++;
+
+    // **Only the journal's tail: the last segment's records are the newest**
+    uint64_t committed = 0;
+    bool complete = false;
+    string journalPath = (folder / FILE_NAME).string();
+    int journal = open(journalPath.c_str(), O_RDONLY);
+    if (journal >= 0) {
+        off_t size = lseek(journal, 0, SEEK_END);
+        off_t from = size > static_cast<off_t>(JOURNAL_TAIL) ? size - static_cast<off_t>(JOURNAL_TAIL) : 0;
+        string tail(size - from, '\0');
+        ssize_t n = pread(journal, &tail[0], tail.size(), from);
+        close(journal);
+        tail.resize(n > 0 ? n : 0);
+        // **Drop a torn last record, so that the next one starts on its own line**
+        size_t end = tail.rfind('\n');
+        end = end == string::npos ? 0 : end + 1;
+        if (end < tail.size() && (end > 0 || from == 0) && truncate(journalPath.c_str(), from + end) != 0) {
+            cerr << "Error: Unable to trim " << journalPath << ": " << strerror(errno) << endl;
+        }
+
+        istringstream lines(tail);
+        string line;
+        bool first = from > 0;   // Starts mid-line
+        while (getline(lines, line)) {
+            if (first || lines.eof()) {
+                first = false;
+                continue;   // Partial, or missing its newline (torn)
+            }
+            char type;
+            uint64_t bytes;
+            string file;
+            if (!parse(line, type, bytes, file) || file != last) {
+                continue;
+            }
+            if (type == 'C') {
+                committed = max(committed, bytes);
+            } else {
+                committed = bytes;
+                complete = true;
+            }
+        }
+    }
+
+    string segmentPath = (folder / last).string();
+    uint64_t size = fs::file_size(segmentPath);
+    uint64_t cut;
+    if (complete && size >= committed) {
+        cut = committed;
+    } else {
+        // **Scan only what no sync covered: cut after the last row before the first foreign byte**
+        int fd = open(segmentPath.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        uint64_t offset = min(committed, size);
+        cut = offset;
+        vector<char> chunk(64 * 1024);
+        bool stop = false;
+        while (!stop && offset < size) {
+            ssize_t n = pread(fd, chunk.data(), chunk.size(), offset);
+            if (n <= 0) {
+                break;
+            }
+            for (ssize_t i = 0; i < n; i++) {
+                unsigned char c = chunk[i];
+                if (!isCsvByte(c)) {
+                    stop = true;
+                    break;
+                }
+                if (c == '\n') {
+                    cut = offset + i + 1;
+                }
+            }
+            offset += n;
+        }
+        close(fd);
+    }
+
+    if (cut < size) {
+        if (truncate(segmentPath.c_str(), cut) != 0) {
+            cerr << "Error: Unable to trim " << segmentPath << ": " << strerror(errno) << endl;
+            return false;
+        }
+        int fd = open(segmentPath.c_str(), O_WRONLY);
+        if (fd >= 0) {
+            fsync(fd);
+            close(fd);
+        }
+        report.repaired++;
+        report.bytesTrimmed += size - cut;
+        cout << "Recovered " << segmentPath << ": trimmed " << size - cut << " bytes to " << cut
+             << " (committed " << committed << ")" << endl;
+    }
+    if (!complete || cut != committed) {
+        RecordingJournal(folder.string()).append('R', last, cut);
+    }
+    return cut < size;
+}
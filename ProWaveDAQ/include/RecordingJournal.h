@@ -0,0 +1,76 @@
+#ifndef RECORDING_JOURNAL_H
+#define RECORDING_JOURNAL_H
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+
+using namespace std;
+namespace fs = filesystem;
+
+// When recorded data is made durable.
+enum class Durability {
+    None,       // Only closed segments are synced
+    Periodic,   // Sync when a block arrives syncIntervalMs after the last sync
+    Group       // Every block is committed within syncIntervalMs, batched into one sync
+};
+
+bool parseDurability(const string& name, Durability& durability);
+const char* durabilityName(Durability durability);
+
+// Outcome of RecordingJournal::recover().
+struct RecoveryReport {
+    int sessions = 0;            // Session folders checked
+    int repaired = 0;            // Segments trimmed
+    uint64_t bytesTrimmed = 0;
+    double milliseconds = 0;
+};
+
+// Append-only commit journal of one session folder ("commit.journal").
+// Each line is "<C|F|R> <bytes> <checksum> <file>": C after a sync made the
+// first bytes of file durable, F when file was closed complete at bytes, R
+// when recovery trimmed it to bytes. A torn last line fails its checksum and
+// is ignored. Records are synced before the call returns.
+class RecordingJournal {
+public:
+    static constexpr const char* FILE_NAME = "commit.journal";
+
+    explicit RecordingJournal(const string& folder);
+    ~RecordingJournal();
+
+    void committed(const string& file, uint64_t bytes);
+    void closed(const string& file, uint64_t bytes);
+
+    // Repairs the last segment of every session folder under root, reading
+    // only each journal's tail and the segment's uncommitted bytes: the
+    // segment is cut after its last complete row, and never before the last
+    // committed length. Earlier segments were closed before the next one was
+    // opened and are not touched.
+    static RecoveryReport recover(const string& root);
+
+    // Recording order of two segment file names: by their timestamp, then by
+    // the -2, -3, ... suffix CSVWriter adds to segments of the same second
+    // (never a plain string compare: "-2.csv" sorts before ".csv").
+    static bool segmentBefore(const string& a, const string& b);
+
+private:
+    static constexpr size_t JOURNAL_TAIL = 64 * 1024;       // Bytes of a journal read by recovery
+    static constexpr uint64_t COMPACT_BYTES = 1024 * 1024;  // Journal size that is compacted on the next close
+
+    mutex journalMutex;
+    string folder;
+    string path;
+    int fd;
+
+    void append(char type, const string& file, uint64_t bytes);
+
+    // Rewrites the journal as its last record (atomic rename).
+    void compact(const string& line);
+
+    static string record(char type, const string& file, uint64_t bytes);
+    static bool parse(const string& line, char& type, uint64_t& bytes, string& file);
+    static bool recoverSession(const fs::path& folder, RecoveryReport& report);
+};
+
+#endif // RECORDING_JOURNAL_H
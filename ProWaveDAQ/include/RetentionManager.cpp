@@ -0,0 +1,429 @@
+#include "RetentionManager.h"
+#include "BlockKernels.h"
+#include "RecordingJournal.h"
+#include "SegmentCodec.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/statvfs.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// ioprio_set(2) has no glibc wrapper
+static const int IOPRIO_WHO_PROCESS = 1;
+static const int IOPRIO_CLASS_IDLE = 3;
+static const int IOPRIO_CLASS_SHIFT = 13;
+
+static const size_t IO_CHUNK = 1 << 20;   // Pacing granularity
+
+RetentionManager::RetentionManager(const RetentionPolicy& policy, FolderFn activeFolder)
+    : policy(policy), activeFolder(move(activeFolder)), budgetWarned(false), stopping(false),
+      paceStart(chrono::steady_clock::now()), paceBytes(0),
+      usageBytes(Metrics::instance().gauge("prowavedaq_retention_bytes",
+          "Size of the output directory after the last retention pass")),
+      compactedSegments(Metrics::instance().counter("prowavedaq_retention_compacted_total",
+          "Segments compacted into the binary form")),
+      reducedSegments(Metrics::instance().counter("prowavedaq_retention_reduced_total",
+          "Segments replaced by their features")),
+      deletedSegments(Metrics::instance().counter("prowavedaq_retention_deleted_total",
+          "Segments deleted to stay within the disk budget")) {}
+
+RetentionManager::~RetentionManager() {
+    stop();
+}
+
+void RetentionManager::start() {
+    if (worker.joinable()) {
+        return;
+    }
+    stopping = false;
+    worker = thread(&RetentionManager::workerLoop, this);
+}
+
+void RetentionManager::stop() {
+    {
+        lock_guard<mutex> lock(stopMutex);
+        stopping = true;
+    }
+    stopWake.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+bool RetentionManager::isStopping() {
+    lock_guard<mutex> lock(stopMutex);
+    return stopping;
+}
+
+void RetentionManager::workerLoop() {
+    // **Idle I/O class: the disk only serves this thread when nothing else wants it**
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+    if (Tracer::isEnabled()) {
+        Tracer::instance().setThreadName("retention");
+    }
+
+    while (true) {
+        try {
+            RetentionReport report = runPass();
+            if (report.compacted || report.reduced || report.deleted) {
+                cout << "Retention: " << report.deleted << " segment(s) deleted, " << report.reduced
+                     << " reduced to features, " << report.compacted << " compacted; "
+                     << report.bytesBefore / 1000000 << " MB -> " << report.bytesAfter / 1000000 << " MB" << endl;
+            }
+        } catch (const fs::filesystem_error& e) {
+            cerr << "Error: Retention pass failed: " << e.what() << endl;   // Retried next pass
+        }
+        unique_lock<mutex> lock(stopMutex);
+        if (stopWake.wait_for(lock, chrono::seconds(policy.intervalSeconds), [this]() { return stopping; })) {
+            return;
+        }
+    }
+}
+
+RetentionReport RetentionManager::runPass() {
+    TRACE_SPAN("retentionPass");
+    RetentionReport report;
+    uint64_t totalBytes = 0;
+    vector<Session> sessions = listSessions(totalBytes);
+    report.bytesBefore = totalBytes;
+
+    enforceBudget(sessions, totalBytes, report);
+
+    time_t now = time(nullptr);
+    for (Session& session : sessions) {
+        if (isStopping()) {
+            break;
+        }
+        double ageHours = session.newest ? difftime(now, session.newest) / 3600 : 0;
+        if (policy.featuresAfterHours > 0 && ageHours >= policy.featuresAfterHours) {
+            reduceSession(session, report);
+        } else if (policy.compactAfterHours > 0 && ageHours >= policy.compactAfterHours) {
+            for (const fs::path& segment : session.segments) {
+                if (segment.extension() == ".csv" && compactSegment(segment)) {
+                    report.compacted++;
+                    compactedSegments.inc();
+                }
+            }
+        }
+    }
+
+    listSessions(totalBytes);
+    report.bytesAfter = totalBytes;
+    usageBytes.set(static_cast<double>(totalBytes));
+    return report;
+}
+
+bool RetentionManager::isSegment(const string& name) {
+    // "<yyyymmddHHMMSS>_<label>.csv" as written by CSVWriter, or its .pwc
+    if (name.size() <= 19 || name[14] != '_' || name.find_first_not_of("0123456789") != 14) {
+        return false;
+    }
+    string extension = name.substr(name.size() - 4);
+    return extension == ".csv" || extension == SegmentCodec::EXTENSION;
+}
+
+time_t RetentionManager::segmentStart(const string& name) {
+    tm local = {};
+    if (sscanf(name.c_str(), "%4d%2d%2d%2d%2d%2d", &local.tm_year, &local.tm_mon, &local.tm_mday,
+               &local.tm_hour, &local.tm_min, &local.tm_sec) != 6) {
+        return 0;
+    }
+    local.tm_year -= 1900;
+    local.tm_mon -= 1;
+    local.tm_isdst = -1;
+    return mktime(&local);
+}
+
+vector<RetentionManager::Session> RetentionManager::listSessions(uint64_t& totalBytes) {
+    vector<Session> sessions;
+    totalBytes = 0;
+    error_code error;
+    string active = activeFolder ? activeFolder() : "";
+    for (const auto& entry : fs::directory_iterator(policy.root, error)) {
+        if (!entry.is_directory(error)) {
+            totalBytes += entry.is_regular_file(error) ? entry.file_size(error) : 0;
+            continue;
+        }
+        Session session;
+        session.folder = entry.path();
+        for (const auto& file : fs::recursive_directory_iterator(entry.path(), error)) {
+            if (!file.is_regular_file(error)) {
+                continue;
+            }
+            uint64_t size = file.file_size(error);
+            session.bytes += error ? 0 : size;
+            if (file.path().parent_path() == entry.path() && isSegment(file.path().filename().string())) {
+                session.segments.push_back(file.path());
+            }
+        }
+        totalBytes += session.bytes;
+        if (!active.empty() && fs::equivalent(entry.path(), active, error)) {
+            continue;   // Being recorded
+        }
+        sort(session.segments.begin(), session.segments.end(), [](const fs::path& a, const fs::path& b) {
+            return RecordingJournal::segmentBefore(a.filename().string(), b.filename().string());
+        });
+        if (!session.segments.empty()) {
+            session.newest = segmentStart(session.segments.back().filename().string());
+        }
+        sessions.push_back(move(session));
+    }
+    // **Session folders start with their creation time**
+    sort(sessions.begin(), sessions.end(),
+         [](const Session& a, const Session& b) { return a.folder.filename() < b.folder.filename(); });
+    return sessions;
+}
+
+void RetentionManager::enforceBudget(vector<Session>& sessions, uint64_t& totalBytes, RetentionReport& report) {
+    auto overBudget = [&]() {
+        if (policy.budgetBytes > 0 && totalBytes > policy.budgetBytes) {
+            return true;
+        }
+        struct statvfs fsStats;
+        return policy.minFreeBytes > 0 && statvfs(policy.root.c_str(), &fsStats) == 0 &&
+               static_cast<uint64_t>(fsStats.f_bavail) * fsStats.f_frsize < policy.minFreeBytes;
+    };
+
+    // **Oldest data first; a session folder goes once its last segment is gone**
+    while (!sessions.empty() && overBudget()) {
+        Session& oldest = sessions.front();
+        int deleted = 0;
+        uint64_t freed = 0;
+        while (!oldest.segments.empty() && overBudget()) {
+            error_code error;
+            uint64_t size = fs::file_size(oldest.segments.front(), error);
+            if (fs::remove(oldest.segments.front(), error)) {
+                totalBytes -= min(totalBytes, size);
+                oldest.bytes -= min(oldest.bytes, size);
+                freed += size;
+                deleted++;
+            }
+            oldest.segments.erase(oldest.segments.begin());
+        }
+        if (oldest.segments.empty()) {
+            error_code error;
+            fs::remove_all(oldest.folder, error);
+            totalBytes -= min(totalBytes, oldest.bytes);
+            freed += oldest.bytes;
+        }
+        cout << "Retention: deleted " << deleted << " segment(s) of " << oldest.folder.string() << " ("
+             << freed / 1000000 << " MB) to stay within the disk budget" << endl;
+        report.deleted += deleted;
+        deletedSegments.inc(deleted);
+        if (oldest.segments.empty()) {
+            sessions.erase(sessions.begin());
+        }
+    }
+
+    bool stillOver = overBudget();
+    if (stillOver && !budgetWarned) {
+        cerr << "Warning: " << policy.root << " is over its disk budget with only the current recording left" << endl;
+    }
+    budgetWarned = stillOver;
+}
+
+bool RetentionManager::compactSegment(const fs::path& segment) {
+    TRACE_SPAN("compactSegment");
+    string csv, packed;
+    if (unreadable.count(segment) || !readFile(segment, csv)) {
+        return false;
+    }
+    if (!SegmentCodec::encode(csv, packed)) {
+        unreadable.insert(segment);   // Not exactly reproducible: stays CSV
+        return false;
+    }
+    fs::path target = segment;
+    target.replace_extension(SegmentCodec::EXTENSION);
+    fs::path temporary = target.string() + ".tmp";
+    if (!writeFile(temporary, packed)) {
+        return false;
+    }
+    error_code error;
+    fs::rename(temporary, target, error);
+    if (error) {
+        fs::remove(temporary, error);
+        return false;
+    }
+    syncDirectory(segment.parent_path());
+    fs::remove(segment, error);
+    return true;
+}
+
+bool RetentionManager::reduceSession(Session& session, RetentionReport& report) {
+    TRACE_SPAN("reduceSession");
+    if (session.segments.empty()) {
+        return true;
+    }
+    fs::path featuresPath = session.folder / FEATURES_FILE;
+    fs::path temporary = featuresPath.string() + ".tmp";
+
+    // **Segments already in features.csv were reduced before a crash: only delete them**
+    string text;
+    set<string> reduced;
+    error_code error;
+    if (fs::exists(featuresPath, error)) {
+        if (!readFile(featuresPath, text)) {
+            return false;
+        }
+        istringstream rows(text);
+        string row;
+        getline(rows, row);   // Header
+        while (getline(rows, row)) {
+            reduced.insert(row.substr(0, row.find(',')));
+        }
+    }
+
+    vector<fs::path> consumed;
+    for (const fs::path& segment : session.segments) {
+        string stem = segment.stem().string();
+        if (reduced.count(stem)) {
+            consumed.push_back(segment);
+            continue;
+        }
+        string data, packed;
+        if (unreadable.count(segment)) {
+            continue;
+        }
+        if (!readFile(segment, data)) {
+            return false;
+        }
+        const string& encoded = segment.extension() == ".csv" ? packed : data;
+        vector<int16_t> raw;
+        int channels;
+        if ((segment.extension() == ".csv" && !SegmentCodec::encode(data, packed)) ||
+            !SegmentCodec::decode(encoded, raw, channels)) {
+            unreadable.insert(segment);   // Not a complete segment: left for the budget
+            continue;
+        }
+        if (text.empty()) {
+            text = "segment,window,frames";
+            for (int c = 0; c < channels; c++) {
+                string ch = "ch" + to_string(c + 1);
+                text += "," + ch + "_mean," + ch + "_rms," + ch + "_min," + ch + "_max";
+            }
+            text += "\n";
+        }
+
+        // **One row per window: mean, rms about the mean, min and max of every channel**
+        vector<double> values(raw.size());
+        for (size_t i = 0; i < raw.size(); i++) {
+            values[i] = raw[i] / 8192.0;
+        }
+        BlockKernels kernels = BlockKernels::select(channels);
+        size_t frames = values.size() / channels;
+        size_t window = max(policy.featureFrames, 1);
+        ostringstream rows;
+        for (size_t start = 0, index = 0; start < frames; start += window, index++) {
+            size_t count = min(window, frames - start);
+            vector<kernels::ChannelStats> stats(channels);
+            kernels.accumulateStats(values.data() + start * channels, count, channels, stats.data());
+            rows << stem << "," << index << "," << count;
+            for (const auto& s : stats) {
+                double mean = s.sum / s.count;
+                double rms = sqrt(max(0.0, s.sumSquares / s.count - mean * mean));
+                rows << "," << mean << "," << rms << "," << s.min << "," << s.max;
+            }
+            rows << "\n";
+        }
+        text += rows.str();
+        consumed.push_back(segment);
+    }
+    if (consumed.empty()) {
+        return true;
+    }
+
+    if (!writeFile(temporary, text)) {
+        return false;
+    }
+    fs::rename(temporary, featuresPath, error);
+    if (error) {
+        fs::remove(temporary, error);
+        return false;
+    }
+    syncDirectory(session.folder);
+    for (const fs::path& segment : consumed) {
+        fs::remove(segment, error);
+    }
+    report.reduced += consumed.size();
+    reducedSegments.inc(consumed.size());
+    return true;
+}
+
+bool RetentionManager::readFile(const fs::path& path, string& data) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    off_t size = lseek(fd, 0, SEEK_END);
+    data.resize(size > 0 ? size : 0);
+    size_t done = 0;
+    bool ok = true;
+    while (ok && done < data.size()) {
+        ssize_t n = pread(fd, &data[done], min(IO_CHUNK, data.size() - done), done);
+        ok = n > 0 && pace(n);
+        done += ok ? n : 0;
+    }
+    // **Read once: keep the page cache for the live writer**
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    return ok;
+}
+
+bool RetentionManager::writeFile(const fs::path& path, const string& data) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        cerr << "Error: Unable to create " << path.string() << ": " << strerror(errno) << endl;
+        return false;
+    }
+    size_t done = 0;
+    bool ok = true;
+    while (ok && done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, min(IO_CHUNK, data.size() - done));
+        ok = n > 0 && pace(n);
+        done += ok ? n : 0;
+    }
+    ok = ok && fdatasync(fd) == 0;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    if (!ok) {
+        unlink(path.c_str());
+    }
+    return ok;
+}
+
+// **Token bucket at ioBytesPerSecond with at most one second of credit**
+bool RetentionManager::pace(uint64_t bytes) {
+    if (policy.ioBytesPerSecond <= 0) {
+        return !isStopping();
+    }
+    auto now = chrono::steady_clock::now();
+    auto due = [this]() {
+        return paceStart + chrono::duration_cast<chrono::steady_clock::duration>(
+            chrono::duration<double>(paceBytes / policy.ioBytesPerSecond));
+    };
+    if (due() < now - chrono::seconds(1)) {
+        paceStart = now - chrono::seconds(1);
+        paceBytes = 0;
+    }
+    paceBytes += bytes;
+    unique_lock<mutex> lock(stopMutex);
+    return !stopWake.wait_until(lock, due(), [this]() { return stopping; });
+}
+
+void RetentionManager::syncDirectory(const fs::path& folder) {
+    int fd = open(folder.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
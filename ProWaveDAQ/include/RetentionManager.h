@@ -0,0 +1,122 @@
+#ifndef RETENTION_MANAGER_H
+#define RETENTION_MANAGER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Metrics.h"
+
+using namespace std;
+namespace fs = filesystem;
+
+// Retention settings from Master.ini [Retention]. A session's age is that of
+// its newest segment (from the file name, so compaction does not reset it);
+// 0 disables a limit.
+struct RetentionPolicy {
+    string root = "output/ProWaveDAQ";  // Parent of the session folders
+    uint64_t budgetBytes = 0;            // Total size of root
+    uint64_t minFreeBytes = 0;           // Free space kept on root's filesystem
+    double compactAfterHours = 24;       // CSV segments -> SegmentCodec (.pwc)
+    double featuresAfterHours = 0;       // Segments -> one features.csv row per window
+    int featureFrames = 7812;            // Frames per feature window (one second at the sample rate)
+    double ioBytesPerSecond = 8e6;       // Compaction read + write rate limit
+    int intervalSeconds = 60;            // Between passes
+};
+
+// Outcome of one RetentionManager pass.
+struct RetentionReport {
+    int compacted = 0;          // Segments stored as .pwc
+    int reduced = 0;            // Segments replaced by features
+    int deleted = 0;            // Segments deleted for the budget
+    uint64_t bytesBefore = 0;
+    uint64_t bytesAfter = 0;
+};
+
+// RetentionManager keeps the recordings under root within a disk budget on a
+// background thread at idle I/O priority (and lowest CPU priority). Each pass:
+//   1. deletes the oldest segments, oldest session first, while root is over
+//      budgetBytes or its filesystem has less than minFreeBytes free;
+//   2. reduces sessions older than featuresAfterHours to features.csv
+//      (per window: mean, rms about the mean, min and max of every channel);
+//   3. compacts the CSV segments of sessions older than compactAfterHours.
+// The session being recorded is never touched. Compaction I/O is paced to
+// ioBytesPerSecond and dropped from the page cache, so the live writer keeps
+// the disk and the cache even on I/O schedulers without an idle class.
+// Every rewrite goes to a temporary file that is synced and renamed before
+// its source is removed.
+class RetentionManager {
+public:
+    using FolderFn = function<string()>;
+
+    // activeFolder: the session folder being recorded ("" when none).
+    RetentionManager(const RetentionPolicy& policy, FolderFn activeFolder);
+    ~RetentionManager();
+
+    void start();
+    void stop();
+
+    // One pass on the calling thread.
+    RetentionReport runPass();
+
+    static constexpr const char* FEATURES_FILE = "features.csv";
+
+    // "<yyyymmddHHMMSS>_<label>[-n].csv" or its .pwc, as CSVWriter names segments.
+    static bool isSegment(const string& name);
+    // Local time in a segment or session folder name (0 if there is none).
+    static time_t segmentStart(const string& name);
+
+private:
+    struct Session {
+        fs::path folder;
+        vector<fs::path> segments;   // .csv and .pwc, oldest first
+        uint64_t bytes = 0;          // All files
+        time_t newest = 0;           // Start of the newest segment (0 = none)
+    };
+
+    RetentionPolicy policy;
+    FolderFn activeFolder;
+    bool budgetWarned;
+    set<fs::path> unreadable;   // Segments SegmentCodec rejected (read once per run)
+
+    mutex stopMutex;
+    condition_variable stopWake;
+    bool stopping;
+    thread worker;
+
+    // Compaction pacing
+    chrono::steady_clock::time_point paceStart;
+    uint64_t paceBytes;
+
+    MetricGauge& usageBytes;
+    MetricCounter& compactedSegments;
+    MetricCounter& reducedSegments;
+    MetricCounter& deletedSegments;
+
+    void workerLoop();
+
+    // Session folders under root, oldest first, without the active one.
+    vector<Session> listSessions(uint64_t& totalBytes);
+
+    void enforceBudget(vector<Session>& sessions, uint64_t& totalBytes, RetentionReport& report);
+    bool compactSegment(const fs::path& segment);
+    bool reduceSession(Session& session, RetentionReport& report);
+
+    // Whole-file read and synced write, both paced; false once stopping.
+    bool readFile(const fs::path& path, string& data);
+    bool writeFile(const fs::path& path, const string& data);
+    bool pace(uint64_t bytes);
+
+    bool isStopping();
+    static void syncDirectory(const fs::path& folder);
+};
+
+#endif // RETENTION_MANAGER_H
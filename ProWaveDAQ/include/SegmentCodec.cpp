@@ -0,0 +1,131 @@
+#include "SegmentCodec.h"
+#include "BlockKernels.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+static const char MAGIC[4] = {'P', 'W', 'C', '1'};
+
+bool SegmentCodec::encode(const string& csv, string& out) {
+    if (csv.empty() || csv.back() != '\n') {
+        return false;
+    }
+    int channels = 1;
+    for (size_t i = 0; csv[i] != '\n'; i++) {
+        channels += csv[i] == ',';
+    }
+    if (channels > 255) {
+        return false;
+    }
+
+    // **Back to register values: a value that is not one of them rejects the segment**
+    vector<int16_t> values;
+    values.reserve(csv.size() / 8);
+    const char* p = csv.data();
+    const char* end = p + csv.size();
+    int column = 0;
+    while (p < end) {
+        double v;
+        auto parsed = from_chars(p, end, v);
+        if (parsed.ec != errc() || parsed.ptr == end) {
+            return false;
+        }
+        double raw = nearbyint(v * 8192.0);
+        if (raw < -32768 || raw > 32767) {
+            return false;
+        }
+        values.push_back(static_cast<int16_t>(raw));
+        char separator = column < channels - 1 ? ',' : '\n';
+        if (*parsed.ptr != separator) {
+            return false;
+        }
+        column = column < channels - 1 ? column + 1 : 0;
+        p = parsed.ptr + 1;
+    }
+    size_t frames = values.size() / channels;
+
+    // **Accept only what decodes to the same bytes (CSVWriter prints 6 significant digits)**
+    vector<double> scaled(values.size());
+    for (size_t i = 0; i < values.size(); i++) {
+        scaled[i] = values[i] / 8192.0;
+    }
+    string check;
+    check.reserve(csv.size());
+    BlockKernels::select(channels).formatRows(scaled.data(), frames, channels, check);
+    if (check != csv) {
+        return false;
+    }
+
+    out.assign(HEADER_BYTES, '\0');
+    memcpy(&out[0], MAGIC, sizeof(MAGIC));
+    out[4] = static_cast<char>(channels);
+    uint64_t count = frames;
+    for (int i = 0; i < 8; i++) {
+        out[8 + i] = static_cast<char>(count >> (8 * i));
+    }
+    vector<int16_t> previous(channels, 0);
+    for (size_t i = 0; i < values.size(); i++) {
+        int c = i % channels;
+        int32_t delta = values[i] - previous[c];
+        previous[c] = values[i];
+        uint32_t zigzag = (static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31);
+        while (zigzag >= 0x80) {
+            out.push_back(static_cast<char>(zigzag | 0x80));
+            zigzag >>= 7;
+        }
+        out.push_back(static_cast<char>(zigzag));
+    }
+    return true;
+}
+
+bool SegmentCodec::decode(string_view data, vector<int16_t>& values, int& channels) {
+    if (data.size() < HEADER_BYTES || memcmp(data.data(), MAGIC, sizeof(MAGIC)) != 0 || data[4] == 0) {
+        return false;
+    }
+    channels = static_cast<unsigned char>(data[4]);
+    uint64_t frames = 0;
+    for (int i = 0; i < 8; i++) {
+        frames |= static_cast<uint64_t>(static_cast<unsigned char>(data[8 + i])) << (8 * i);
+    }
+    if (frames > (data.size() - HEADER_BYTES) / channels) {
+        return false;   // At least one byte per value
+    }
+
+    values.resize(frames * channels);
+    vector<int16_t> previous(channels, 0);
+    size_t pos = HEADER_BYTES;
+    for (size_t i = 0; i < values.size(); i++) {
+        uint32_t zigzag = 0;
+        for (int shift = 0;; shift += 7) {
+            if (pos == data.size() || shift > 14) {
+                return false;
+            }
+            unsigned char byte = data[pos++];
+            zigzag |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+        int32_t delta = static_cast<int32_t>(zigzag >> 1) ^ -static_cast<int32_t>(zigzag & 1);
+        int c = i % channels;
+        previous[c] = static_cast<int16_t>(previous[c] + delta);
+        values[i] = previous[c];
+    }
+    return pos == data.size();
+}
+
+bool SegmentCodec::decodeCsv(const string& data, string& csv) {
+    vector<int16_t> values;
+    int channels;
+    if (!decode(data, values, channels)) {
+        return false;
+    }
+    vector<double> scaled(values.size());
+    for (size_t i = 0; i < values.size(); i++) {
+        scaled[i] = values[i] / 8192.0;
+    }
+    csv.clear();
+    BlockKernels::select(channels).formatRows(scaled.data(), values.size() / channels, channels, csv);
+    return true;
+}
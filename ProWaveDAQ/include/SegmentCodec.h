@@ -0,0 +1,40 @@
+#ifndef SEGMENT_CODEC_H
+#define SEGMENT_CODEC_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Compact binary form of a recorded CSV segment (".pwc").
+//
+// Every value CSVWriter prints is an int16 register scaled by 1/8192, so the
+// codec stores the register values instead: per channel the difference to the
+// previous sample, zigzag-encoded as a varint (1-2 bytes for typical
+// vibration data instead of ~10 characters). encode() only succeeds when
+// decoding reproduces the CSV byte for byte.
+//
+// Layout: "PWC1", channels (uint8), 3 reserved bytes, frames (uint64 LE),
+// then frames x channels varints.
+class SegmentCodec {
+public:
+    static constexpr const char* EXTENSION = ".pwc";
+
+    // csv: whole rows of equal width. False if it is not exactly reproducible
+    // from int16 values (torn row, foreign content).
+    static bool encode(const string& csv, string& out);
+
+    // Register values, interleaved; false if data is not a valid segment
+    // (data may be a memory-mapped file).
+    static bool decode(string_view data, vector<int16_t>& values, int& channels);
+
+    // The CSV text encode() was given.
+    static bool decodeCsv(const string& data, string& csv);
+
+private:
+    static constexpr size_t HEADER_BYTES = 16;
+};
+
+#endif // SEGMENT_CODEC_H
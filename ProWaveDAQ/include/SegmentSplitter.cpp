@@ -0,0 +1,62 @@
+#include "SegmentSplitter.h"
+
+#include <stdexcept>
+#include <string>
+
+// A segment must take at least one value, or push() would never get past it.
+static int checkedTargetSize(int size) {
+    if (size < 1) {
+        throw invalid_argument("SegmentSplitter: segment size must be at least 1, got " + to_string(size));
+    }
+    return size;
+}
+
+SegmentSplitter::SegmentSplitter(int targetSize, WriteFn write, RotateFn rotate, int channels)
+    : targetSize(checkedTargetSize(targetSize)), nextTargetSize(targetSize), channels(channels), filled(0),
+      write(move(write)), rotate(move(rotate)) {}
+
+DataBlock SegmentSplitter::slice(const DataBlock& block, size_t begin, size_t end) const {
+    DataBlock chunk;
+    chunk.samples.assign(block.samples.begin() + begin, block.samples.begin() + end);
+    chunk.acquiredAt = block.acquiredAt;
+    chunk.firstSample = block.firstSample + begin / channels;
+    return chunk;
+}
+
+// Splits the block on segment boundaries; a block may span several segments.
+void SegmentSplitter::push(const DataBlock& block) {
+    size_t offset = 0;
+    size_t total = block.samples.size();
+
+    while (total - offset >= static_cast<size_t>(targetSize - filled)) {
+        size_t take = targetSize - filled;
+        if (offset == 0 && take == total) {
+            write(block);
+        } else {
+            write(slice(block, offset, offset + take));
+        }
+        rotate();
+        offset += take;
+        filled = 0;
+        targetSize = nextTargetSize;
+        if (offset == total) {
+            return;
+        }
+    }
+
+    // **Remaining data is less than a full segment**
+    filled += total - offset;
+    if (offset == 0) {
+        write(block);
+    } else {
+        write(slice(block, offset, total));
+    }
+}
+
+void SegmentSplitter::setTargetSize(int size) {
+    nextTargetSize = checkedTargetSize(size);
+}
+
+int SegmentSplitter::getFilled() const {
+    return filled;
+}
@@ -0,0 +1,46 @@
+#ifndef SEGMENT_SPLITTER_H
+#define SEGMENT_SPLITTER_H
+
+#include <functional>
+#include <vector>
+#include "DataBlock.h"
+
+using namespace std;
+
+// SegmentSplitter cuts the continuous sample stream into save units of a fixed
+// number of values, so that every CSV file holds exactly SaveUnit seconds of data.
+class SegmentSplitter {
+public:
+    using WriteFn = function<void(const DataBlock&)>;
+    using RotateFn = function<void()>;
+
+    // targetSize: number of values per segment (SaveUnit * sampleRate * channels),
+    // at least 1; throws invalid_argument otherwise.
+    // channels: values per sample, used to keep firstSample of split chunks exact.
+    SegmentSplitter(int targetSize, WriteFn write, RotateFn rotate, int channels = 3);
+
+    // Feeds one acquired block. Data that completes the current segment is written,
+    // followed by a rotation; the remainder starts the next segment. Blocks that
+    // fit are passed through without a copy.
+    void push(const DataBlock& block);
+
+    // Number of values already written into the current segment.
+    int getFilled() const;
+
+    // Changes the segment size; the current segment keeps its size. Throws
+    // invalid_argument if size is below 1.
+    void setTargetSize(int size);
+
+private:
+    int targetSize;  // Values per segment
+    int nextTargetSize; // Size for segments started after the current one
+    int channels;    // Values per sample
+    int filled;      // Values written to the current segment
+    WriteFn write;   // Receives each chunk of the current segment
+    RotateFn rotate; // Called when a segment is complete
+
+    // Copies values [begin, end) of block into a chunk with the same timestamp.
+    DataBlock slice(const DataBlock& block, size_t begin, size_t end) const;
+};
+
+#endif // SEGMENT_SPLITTER_H
@@ -0,0 +1,270 @@
+#include "SimdKernels.h"
+#include "BlockKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+static const float SCALE_F = 1.0f / 8192.0f;
+
+// **Scalar reference (also handles the tail of the vector kernels)**
+static void convertScalar(const uint16_t* regs, size_t values, double* out) {
+    kernels::convert<int16_t, double>(regs, values, 0, out);
+}
+
+template <typename Out>
+static void deinterleaveScalar(const uint16_t* regs, size_t frames, Out* x, Out* y, Out* z) {
+    Out* axes[] = {x, y, z};
+    kernels::deinterleave<3, int16_t, Out>(regs, frames, 3, axes);
+}
+
+#if defined(__SSE2__)
+// Sign-extends 8 int16 lanes into two scaled float vectors.
+static inline void widenSse2(__m128i v, __m128 scale, __m128& lo, __m128& hi) {
+    lo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)), scale);
+    hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)), scale);
+}
+
+// 4 XYZ frames in v0..v2 (x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3) -> x, y, z.
+static inline void splitSse2(__m128 v0, __m128 v1, __m128 v2, __m128& x, __m128& y, __m128& z) {
+    // Each axis: gather its 4 values pairwise into two registers, then pick lanes 0 and 2
+    __m128 x01 = _mm_shuffle_ps(v0, v0, _MM_SHUFFLE(3, 0, 3, 0)); // x0 x1 x0 x1
+    __m128 x23 = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(1, 1, 2, 2)); // x2 x2 x3 x3
+    x = _mm_shuffle_ps(x01, x23, _MM_SHUFFLE(2, 0, 1, 0));
+    __m128 y01 = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(0, 0, 0, 1)); // y0 x0 y1 y1
+    __m128 y23 = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(2, 2, 3, 3)); // y2 y2 y3 y3
+    y = _mm_shuffle_ps(y01, y23, _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 z01 = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(1, 1, 2, 2)); // z0 z0 z1 z1
+    __m128 z23 = _mm_shuffle_ps(v2, v2, _MM_SHUFFLE(3, 3, 0, 0)); // z2 z2 z3 z3
+    z = _mm_shuffle_ps(z01, z23, _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+// Deinterleaves 8 frames (3 x 128-bit loads) into two x/y/z float vectors each.
+static inline void loadSse2(const uint16_t* regs, __m128* x, __m128* y, __m128* z) {
+    const __m128 scale = _mm_set1_ps(SCALE_F);
+    __m128 f[6];
+    for (int i = 0; i < 3; i++) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(regs + i * 8));
+        widenSse2(v, scale, f[2 * i], f[2 * i + 1]);
+    }
+    splitSse2(f[0], f[1], f[2], x[0], y[0], z[0]);
+    splitSse2(f[3], f[4], f[5], x[1], y[1], z[1]);
+}
+
+// Stores 4 floats as doubles (exact widening).
+static inline void storeWidenedSse2(double* out, __m128 v) {
+    _mm_storeu_pd(out, _mm_cvtps_pd(v));
+    _mm_storeu_pd(out + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+}
+
+// 8 values per step: int16 -> float (exact) -> double.
+static void convertdSse2(const uint16_t* regs, size_t values, double* out) {
+    const __m128 scale = _mm_set1_ps(SCALE_F);
+    size_t i = 0;
+    for (; i + 8 <= values; i += 8) {
+        __m128 lo, hi;
+        widenSse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(regs + i)), scale, lo, hi);
+        storeWidenedSse2(out + i, lo);
+        storeWidenedSse2(out + i + 4, hi);
+    }
+    convertScalar(regs + i, values - i, out + i);
+}
+
+static void deinterleave3fSse2(const uint16_t* regs, size_t frames, float* x, float* y, float* z) {
+    size_t f = 0;
+    for (; f + 8 <= frames; f += 8) {
+        __m128 vx[2], vy[2], vz[2];
+        loadSse2(regs + f * 3, vx, vy, vz);
+        for (int i = 0; i < 2; i++) {
+            _mm_storeu_ps(x + f + 4 * i, vx[i]);
+            _mm_storeu_ps(y + f + 4 * i, vy[i]);
+            _mm_storeu_ps(z + f + 4 * i, vz[i]);
+        }
+    }
+    deinterleaveScalar(regs + f * 3, frames - f, x + f, y + f, z + f);
+}
+
+static void deinterleave3dSse2(const uint16_t* regs, size_t frames, double* x, double* y, double* z) {
+    size_t f = 0;
+    for (; f + 8 <= frames; f += 8) {
+        __m128 vx[2], vy[2], vz[2];
+        loadSse2(regs + f * 3, vx, vy, vz);
+        for (int i = 0; i < 2; i++) {
+            storeWidenedSse2(x + f + 4 * i, vx[i]);
+            storeWidenedSse2(y + f + 4 * i, vy[i]);
+            storeWidenedSse2(z + f + 4 * i, vz[i]);
+        }
+    }
+    deinterleaveScalar(regs + f * 3, frames - f, x + f, y + f, z + f);
+}
+#endif // __SSE2__
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+// 8 XYZ frames in v0..v2 -> x, y, z: blend each axis' lanes together, then
+// permute them into order.
+TARGET_AVX2 static inline void splitAvx2(__m256 v0, __m256 v1, __m256 v2, __m256& x, __m256& y, __m256& z) {
+    const __m256i orderX = _mm256_setr_epi32(0, 3, 6, 1, 4, 7, 2, 5);
+    const __m256i orderY = _mm256_setr_epi32(1, 4, 7, 2, 5, 0, 3, 6);
+    const __m256i orderZ = _mm256_setr_epi32(2, 5, 0, 3, 6, 1, 4, 7);
+    x = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(v0, v1, 0x92), v2, 0x24), orderX);
+    y = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(v0, v1, 0x24), v2, 0x49), orderY);
+    z = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(v0, v1, 0x49), v2, 0x92), orderZ);
+}
+
+// Deinterleaves 16 frames (3 x 256-bit loads) into two x/y/z float vectors each.
+TARGET_AVX2 static inline void loadAvx2(const uint16_t* regs, __m256* x, __m256* y, __m256* z) {
+    const __m256 scale = _mm256_set1_ps(SCALE_F);
+    __m256 f[6];
+    for (int i = 0; i < 6; i++) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(regs + i * 8));
+        f[i] = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(v)), scale);
+    }
+    splitAvx2(f[0], f[1], f[2], x[0], y[0], z[0]);
+    splitAvx2(f[3], f[4], f[5], x[1], y[1], z[1]);
+}
+
+TARGET_AVX2 static void deinterleave3fAvx2(const uint16_t* regs, size_t frames, float* x, float* y, float* z) {
+    size_t f = 0;
+    for (; f + 16 <= frames; f += 16) {
+        __m256 vx[2], vy[2], vz[2];
+        loadAvx2(regs + f * 3, vx, vy, vz);
+        for (int i = 0; i < 2; i++) {
+            _mm256_storeu_ps(x + f + 8 * i, vx[i]);
+            _mm256_storeu_ps(y + f + 8 * i, vy[i]);
+            _mm256_storeu_ps(z + f + 8 * i, vz[i]);
+        }
+    }
+    deinterleaveScalar(regs + f * 3, frames - f, x + f, y + f, z + f);
+}
+
+// Stores 8 floats as doubles (exact widening).
+TARGET_AVX2 static inline void storeWidenedAvx2(double* out, __m256 v) {
+    _mm256_storeu_pd(out, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+    _mm256_storeu_pd(out + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+}
+
+// 8 values per step: int16 -> float (exact) -> double.
+TARGET_AVX2 static void convertdAvx2(const uint16_t* regs, size_t values, double* out) {
+    const __m256 scale = _mm256_set1_ps(SCALE_F);
+    size_t i = 0;
+    for (; i + 8 <= values; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(regs + i));
+        storeWidenedAvx2(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(v)), scale));
+    }
+    convertScalar(regs + i, values - i, out + i);
+}
+
+TARGET_AVX2 static void deinterleave3dAvx2(const uint16_t* regs, size_t frames, double* x, double* y, double* z) {
+    size_t f = 0;
+    for (; f + 16 <= frames; f += 16) {
+        __m256 vx[2], vy[2], vz[2];
+        loadAvx2(regs + f * 3, vx, vy, vz);
+        for (int i = 0; i < 2; i++) {
+            storeWidenedAvx2(x + f + 8 * i, vx[i]);
+            storeWidenedAvx2(y + f + 8 * i, vy[i]);
+            storeWidenedAvx2(z + f + 8 * i, vz[i]);
+        }
+    }
+    deinterleaveScalar(regs + f * 3, frames - f, x + f, y + f, z + f);
+}
+#endif // x86
+
+#if defined(__aarch64__)
+// vld3q_s16 deinterleaves 8 frames in one load.
+static inline void loadNeon(const uint16_t* regs, float32x4_t* x, float32x4_t* y, float32x4_t* z) {
+    int16x8x3_t v = vld3q_s16(reinterpret_cast<const int16_t*>(regs));
+    float32x4_t* axes[] = {x, y, z};
+    for (int c = 0; c < 3; c++) {
+        axes[c][0] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v.val[c]))), SCALE_F);
+        axes[c][1] = vmulq_n_f32(vcvtq_f32_s32(vmovl_high_s16(v.val[c])), SCALE_F);
+    }
+}
+
+static void deinterleave3fNeon(const uint16_t* regs, size_t frames, float* x, float* y, float* z) {
+    size_t f = 0;
+    for (; f + 8 <= frames; f += 8) {
+        float32x4_t vx[2], vy[2], vz[2];
+        loadNeon(regs + f * 3, vx, vy, vz);
+        for (int i = 0; i < 2; i++) {
+            vst1q_f32(x + f + 4 * i, vx[i]);
+            vst1q_f32(y + f + 4 * i, vy[i]);
+            vst1q_f32(z + f + 4 * i, vz[i]);
+        }
+    }
+    deinterleaveScalar(regs + f * 3, frames - f, x + f, y + f, z + f);
+}
+
+// Stores 4 floats as doubles (exact widening).
+static inline void storeWidenedNeon(double* out, float32x4_t v) {
+    vst1q_f64(out, vcvt_f64_f32(vget_low_f32(v)));
+    vst1q_f64(out + 2, vcvt_high_f64_f32(v));
+}
+
+static void convertdNeon(const uint16_t* regs, size_t values, double* out) {
+    size_t i = 0;
+    for (; i + 8 <= values; i += 8) {
+        int16x8_t v = vld1q_s16(reinterpret_cast<const int16_t*>(regs + i));
+        storeWidenedNeon(out + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), SCALE_F));
+        storeWidenedNeon(out + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_high_s16(v)), SCALE_F));
+    }
+    convertScalar(regs + i, values - i, out + i);
+}
+
+static void deinterleave3dNeon(const uint16_t* regs, size_t frames, double* x, double* y, double* z) {
+    size_t f = 0;
+    for (; f + 8 <= frames; f += 8) {
+        float32x4_t vx[2], vy[2], vz[2];
+        loadNeon(regs + f * 3, vx, vy, vz);
+        for (int i = 0; i < 2; i++) {
+            storeWidenedNeon(x + f + 4 * i, vx[i]);
+            storeWidenedNeon(y + f + 4 * i, vy[i]);
+            storeWidenedNeon(z + f + 4 * i, vz[i]);
+        }
+    }
+    deinterleaveScalar(regs + f * 3, frames - f, x + f, y + f, z + f);
+}
+#endif // __aarch64__
+
+static const SimdKernels scalarKernels = {"scalar", &convertScalar, &deinterleaveScalar<float>,
+                                          &deinterleaveScalar<double>};
+#if defined(__SSE2__)
+static const SimdKernels sse2Kernels = {"sse2", &convertdSse2, &deinterleave3fSse2, &deinterleave3dSse2};
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+static const SimdKernels avx2Kernels = {"avx2", &convertdAvx2, &deinterleave3fAvx2, &deinterleave3dAvx2};
+#endif
+#if defined(__aarch64__)
+static const SimdKernels neonKernels = {"neon", &convertdNeon, &deinterleave3fNeon, &deinterleave3dNeon};
+#endif
+
+// **Runtime CPU feature detection**
+vector<const SimdKernels*> SimdKernels::available() {
+    vector<const SimdKernels*> list = {&scalarKernels};
+#if defined(__SSE2__)
+    list.push_back(&sse2Kernels);
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        list.push_back(&avx2Kernels);
+    }
+#endif
+#if defined(__aarch64__)
+    list.push_back(&neonKernels); // Advanced SIMD is mandatory on AArch64
+#endif
+    return list;
+}
+
+const SimdKernels& SimdKernels::best() {
+    static const SimdKernels* selected = available().back();
+    return *selected;
+}
+
+const SimdKernels& SimdKernels::scalar() {
+    return scalarKernels;
+}
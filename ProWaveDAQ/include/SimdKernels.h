@@ -0,0 +1,37 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Vectorised conversion of the int16 register payload, scaled by 1/8192 in
+// the same pass: convertd keeps the interleaved layout (the readLoop() path,
+// via BlockKernels::select()), deinterleave3f/3d split XYZ into per-axis
+// arrays.
+//
+// One table per instruction set; best() picks the fastest one the CPU
+// supports at runtime (AVX2 or SSE2 on x86-64, NEON on AArch64) and falls
+// back to the scalar kernel elsewhere. All variants produce bit-identical
+// results: int16 * 2^-13 is exact in float and double.
+struct SimdKernels {
+    const char* name; // "scalar", "sse2", "avx2" or "neon"
+
+    void (*convertd)(const uint16_t* regs, size_t values, double* out);
+
+    void (*deinterleave3f)(const uint16_t* regs, size_t frames, float* x, float* y, float* z);
+    void (*deinterleave3d)(const uint16_t* regs, size_t frames, double* x, double* y, double* z);
+
+    // Fastest kernels supported by this CPU (detected once).
+    static const SimdKernels& best();
+
+    // Portable reference implementation.
+    static const SimdKernels& scalar();
+
+    // Every variant this CPU can run, scalar first.
+    static vector<const SimdKernels*> available();
+};
+
+#endif // SIMD_KERNELS_H
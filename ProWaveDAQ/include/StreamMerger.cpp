@@ -0,0 +1,308 @@
+#include "StreamMerger.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+StreamMerger::StreamMerger(const vector<MergeInput>& configs, Sink sink, const MergeOptions& options)
+    : sink(move(sink)), options(options), hasEpoch(false), newestTime(0), started(false), timelineStart(0),
+      nextFrame(0),
+      frames(Metrics::instance().counter("prowavedaq_merge_frames_total", "Aligned frames emitted")),
+      skipped(Metrics::instance().counter("prowavedaq_merge_skipped_frames_total",
+          "Frames skipped because the merge fell behind by more than its history")),
+      latency(Metrics::instance().gauge("prowavedaq_merge_latency_seconds",
+          "Newest acquisition time minus the time of the last emitted frame")) {
+    for (const MergeInput& config : configs) {
+        Input in;
+        in.config = config;
+        int rate = max(config.sampleRate, 1);
+        in.capacity = max<size_t>(static_cast<size_t>(this->options.historySeconds * rate), 64);
+        in.ring.assign(in.capacity * 3, numeric_limits<double>::quiet_NaN());
+
+        string label = Metrics::label("device", config.name);
+        in.missing = &Metrics::instance().counter("prowavedaq_merge_missing_total",
+            "Frames an input had no samples for", label);
+        in.restarts = &Metrics::instance().counter("prowavedaq_merge_clock_restarts_total",
+            "Clock models restarted after a sample counter reset or timestamp jump", label);
+        in.drift = &Metrics::instance().gauge("prowavedaq_merge_clock_drift_ppm",
+            "Estimated sample rate error against the nominal rate", label);
+        in.offset = &Metrics::instance().gauge("prowavedaq_merge_clock_offset_seconds",
+            "Estimated time of sample 0 relative to the first input", label);
+        inputs.push_back(move(in));
+    }
+    if (this->options.outputRate <= 0) {
+        this->options.outputRate = inputs.empty() ? 1 : max(inputs[0].config.sampleRate, 1);
+    }
+    this->options.blockFrames = max<size_t>(this->options.blockFrames, 1);
+}
+
+void StreamMerger::push(size_t index, const DataBlock& block) {
+    size_t count = block.samples.size() / 3;
+    if (index >= inputs.size() || count == 0) {
+        return;
+    }
+
+    lock_guard<mutex> lock(mergeMutex);
+    if (!hasEpoch) {
+        hasEpoch = true;
+        epoch = block.acquiredAt;
+    }
+    double t = chrono::duration<double>(block.acquiredAt - epoch).count();
+    newestTime = max(newestTime, t);
+
+    Input& in = inputs[index];
+    int64_t first = static_cast<int64_t>(block.firstSample);
+    int64_t last = first + static_cast<int64_t>(count) - 1;
+    if (in.newest >= 0 && last <= in.newest && first >= in.oldest) {
+        return;   // Already stored (e.g. the same block polled twice)
+    }
+    if (in.newest >= 0 && first <= in.newest) {
+        // **The sample counter went backwards: reading restarted**
+        restart(in);
+    }
+    store(in, block);
+    observe(in, last + 1 + block.fifoBacklog / 3, t);
+    emit();
+}
+
+MergeClock StreamMerger::clock(size_t index) {
+    lock_guard<mutex> lock(mergeMutex);
+    MergeClock result;
+    if (index >= inputs.size() || !inputs[index].hasModel) {
+        return result;
+    }
+    const Input& in = inputs[index];
+    result.valid = true;
+    result.rate = 1.0 / in.b;
+    result.driftPpm = (result.rate / max(in.config.sampleRate, 1) - 1) * 1e6;
+    if (inputs[0].hasModel) {
+        const Input& ref = inputs[0];
+        double zero = in.t0 + in.a - in.b * in.k0;
+        double refZero = ref.t0 + ref.a - ref.b * ref.k0;
+        result.offsetSeconds = zero - refZero;
+    }
+    return result;
+}
+
+uint64_t StreamMerger::framesEmitted() {
+    lock_guard<mutex> lock(mergeMutex);
+    return nextFrame;
+}
+
+void StreamMerger::restart(Input& in) {
+    if (in.hasModel) {
+        in.restarts->inc();
+    }
+    fill(in.ring.begin(), in.ring.end(), numeric_limits<double>::quiet_NaN());
+    in.newest = -1;
+    in.hasModel = false;
+    in.recent.clear();
+    in.lateObservations = 0;
+}
+
+void StreamMerger::store(Input& in, const DataBlock& block) {
+    int64_t first = static_cast<int64_t>(block.firstSample);
+    if (in.newest < 0) {
+        in.oldest = first;
+        in.newest = first - 1;
+    }
+
+    // **Mark skipped samples as missing; at most one ring's worth matters**
+    int64_t gapStart = max(in.newest + 1, first - static_cast<int64_t>(in.capacity));
+    for (int64_t k = gapStart; k < first; k++) {
+        double* slot = &in.ring[(k % in.capacity) * 3];
+        slot[0] = slot[1] = slot[2] = numeric_limits<double>::quiet_NaN();
+    }
+
+    size_t count = block.samples.size() / 3;
+    for (size_t i = 0; i < count; i++) {
+        double* slot = &in.ring[((first + i) % in.capacity) * 3];
+        slot[0] = block.samples[i * 3];
+        slot[1] = block.samples[i * 3 + 1];
+        slot[2] = block.samples[i * 3 + 2];
+    }
+    in.newest = first + static_cast<int64_t>(count) - 1;
+}
+
+// **One observation: by time t the sensor had produced `produced` samples**
+void StreamMerger::observe(Input& in, int64_t produced, double t) {
+    if (in.hasModel) {
+        double residual = t - (in.t0 + in.a + in.b * (produced - in.k0));
+        if (residual < -options.resetSeconds) {
+            // Earlier than the model allows: the clock or the rate changed
+            in.restarts->inc();
+            in.hasModel = false;
+        } else if (residual > options.resetSeconds) {
+            // A single late block is a stall; a run of them means the model is wrong
+            if (++in.lateObservations < MAX_LATE_OBSERVATIONS) {
+                return;
+            }
+            in.restarts->inc();
+            in.hasModel = false;
+        } else {
+            in.lateObservations = 0;
+        }
+    }
+
+    if (!in.hasModel) {
+        in.hasModel = true;
+        in.k0 = produced;
+        in.t0 = t;
+        in.a = 0;
+        in.b = 1.0 / max(in.config.sampleRate, 1);
+        in.w = in.mx = in.my = in.cxx = in.cxy = 0;
+        in.firstObservation = in.lastObservation = t;
+        in.recent.clear();
+        in.lateObservations = 0;
+    }
+
+    // **Exponentially forgetting weighted regression (West's update)**
+    double x = static_cast<double>(produced - in.k0);
+    double y = t - in.t0;
+    double decay = exp(-max(t - in.lastObservation, 0.0) / options.clockWindowSeconds);
+    in.lastObservation = t;
+    in.w = in.w * decay + 1;
+    in.cxx *= decay;
+    in.cxy *= decay;
+    double dx = x - in.mx;
+    in.mx += dx / in.w;
+    in.my += (y - in.my) / in.w;
+    in.cxx += dx * (x - in.mx);
+    in.cxy += dx * (y - in.my);
+    if (t - in.firstObservation >= MIN_FIT_SECONDS && in.cxx > 0 && in.cxy > 0) {
+        in.b = in.cxy / in.cxx;
+    }
+
+    // **Offset from the least delayed recent observation**
+    in.recent.emplace_back(x, y);
+    while (in.recent.size() > 1 && (y - in.recent.front().second > options.envelopeSeconds || in.recent.size() > 4096)) {
+        in.recent.pop_front();
+    }
+    double a = numeric_limits<double>::infinity();
+    for (const auto& [ox, oy] : in.recent) {
+        a = min(a, oy - in.b * ox);
+    }
+    in.a = a;
+
+    in.drift->set((1.0 / (in.b * max(in.config.sampleRate, 1)) - 1) * 1e6);
+    if (inputs[0].hasModel) {
+        const Input& ref = inputs[0];
+        in.offset->set((in.t0 + in.a - in.b * in.k0) - (ref.t0 + ref.a - ref.b * ref.k0));
+    }
+}
+
+double StreamMerger::indexAt(const Input& in, double t) const {
+    return in.k0 + (t - in.t0 - in.a) / in.b;
+}
+
+bool StreamMerger::sampleAt(const Input& in, double t, double* out) const {
+    double x = indexAt(in, t);
+    double base = floor(x);
+    int64_t i = static_cast<int64_t>(base);
+    if (i - 1 < in.oldest || i + 2 > in.newest || i - 1 <= in.newest - static_cast<int64_t>(in.capacity)) {
+        return false;
+    }
+
+    // **4-point Lagrange weights for nodes -1, 0, 1, 2 at fraction mu**
+    double mu = x - base;
+    double c[4] = {
+        -mu * (mu - 1) * (mu - 2) / 6,
+        (mu + 1) * (mu - 1) * (mu - 2) / 2,
+        -(mu + 1) * mu * (mu - 2) / 2,
+        (mu + 1) * mu * (mu - 1) / 6,
+    };
+    double sum[3] = {0, 0, 0};
+    for (int p = 0; p < 4; p++) {
+        const double* slot = &in.ring[((i - 1 + p) % in.capacity) * 3];
+        for (int ch = 0; ch < 3; ch++) {
+            sum[ch] += c[p] * slot[ch];
+        }
+    }
+    if (isnan(sum[0]) || isnan(sum[1]) || isnan(sum[2])) {
+        return false;
+    }
+    copy(sum, sum + 3, out);
+    return true;
+}
+
+void StreamMerger::emit() {
+    if (!started) {
+        // **Wait for every input, or start without the missing ones after maxLatency**
+        bool all = true, any = false;
+        for (const Input& in : inputs) {
+            all = all && in.hasModel;
+            any = any || in.hasModel;
+        }
+        if (!any || (!all && newestTime < options.maxLatencySeconds)) {
+            return;
+        }
+        timelineStart = -numeric_limits<double>::infinity();
+        for (const Input& in : inputs) {
+            if (in.hasModel) {
+                timelineStart = max(timelineStart, in.t0 + in.a + in.b * (in.oldest + 1 - in.k0));
+            }
+        }
+        started = true;
+        nextFrame = 0;
+    }
+
+    double rate = options.outputRate;
+    size_t width = inputs.size() * 3;
+    vector<double> frame(width);
+    while (true) {
+        double t = timelineStart + nextFrame / rate;
+        if (newestTime - t > options.historySeconds) {
+            // **Too far behind to interpolate: jump to maxLatency before the newest data**
+            flush();
+            uint64_t target = static_cast<uint64_t>(ceil((newestTime - options.maxLatencySeconds - timelineStart) * rate));
+            skipped.inc(target - nextFrame);
+            nextFrame = target;
+            continue;
+        }
+
+        bool any = false, ready = true;
+        for (const Input& in : inputs) {
+            if (in.hasModel) {
+                any = true;
+                ready = ready && indexAt(in, t) <= in.newest - 2;
+            }
+        }
+        bool overdue = t + options.maxLatencySeconds <= newestTime;
+        if (!(any && ready) && !overdue) {
+            break;
+        }
+
+        for (size_t i = 0; i < inputs.size(); i++) {
+            Input& in = inputs[i];
+            if (!in.hasModel || !sampleAt(in, t, &frame[i * 3])) {
+                fill(frame.begin() + i * 3, frame.begin() + i * 3 + 3, numeric_limits<double>::quiet_NaN());
+                in.missing->inc();
+            }
+        }
+        if (pending.values.empty()) {
+            pending.firstFrame = nextFrame;
+            pending.firstTime = epoch + chrono::duration_cast<chrono::steady_clock::duration>(
+                chrono::duration<double>(t));
+            pending.rate = rate;
+            pending.inputs = inputs.size();
+        }
+        pending.values.insert(pending.values.end(), frame.begin(), frame.end());
+        frames.inc();
+        latency.set(newestTime - t);
+        nextFrame++;
+        if (pending.frames() >= options.blockFrames) {
+            flush();
+        }
+    }
+    flush();
+}
+
+void StreamMerger::flush() {
+    if (pending.values.empty()) {
+        return;
+    }
+    if (sink) {
+        sink(pending);
+    }
+    pending.values.clear();
+}
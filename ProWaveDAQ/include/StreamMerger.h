@@ -0,0 +1,148 @@
+#ifndef STREAM_MERGER_H
+#define STREAM_MERGER_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "DataBlock.h"
+#include "Metrics.h"
+
+using namespace std;
+
+// One stream fed into the merger.
+struct MergeInput {
+    string name;             // Metrics label, e.g. the serial port
+    int sampleRate = 7812;   // Nominal rate (Hz); the real rate is estimated
+};
+
+struct MergeOptions {
+    double outputRate = 0;            // Shared timeline rate (Hz); 0 = the first input's rate
+    double maxLatencySeconds = 0.25;  // Emit a frame this long after its time even if a device lags
+    double historySeconds = 2.0;      // Samples kept per device for interpolation
+    double clockWindowSeconds = 30;   // Forgetting time of the drift regression
+    double envelopeSeconds = 2.0;     // Observations searched for the least delayed one
+    double resetSeconds = 0.05;       // Timestamp error that restarts a device's clock model
+    size_t blockFrames = 256;         // Most frames per emitted MergedBlock
+};
+
+// Aligned frames of all inputs: frame i holds, for each input in order, its
+// X, Y and Z values interpolated at firstTime + i / rate. NaN marks frames an
+// input has no samples for (not started, gap, or late beyond maxLatency).
+struct MergedBlock {
+    uint64_t firstFrame = 0;                     // Frame index on the shared timeline
+    chrono::steady_clock::time_point firstTime;
+    double rate = 0;
+    size_t inputs = 0;
+    vector<double> values;                       // frames × inputs × 3
+
+    size_t frames() const { return inputs ? values.size() / (inputs * 3) : 0; }
+};
+
+// Current clock estimate of one input, relative to the host steady clock.
+struct MergeClock {
+    bool valid = false;
+    double offsetSeconds = 0;   // Time of the input's sample 0 minus that of input 0
+    double driftPpm = 0;        // Real sample rate against the nominal one
+    double rate = 0;            // Estimated sample rate (Hz)
+};
+
+// StreamMerger aligns blocks from several unsynchronised ProWaveDAQ
+// instances onto one timeline.
+//
+// Each input's clock is modelled as t(k) = a + b·k, the host time at which
+// sample k left the sensor. A block read at acquiredAt tells us the sensor had
+// produced firstSample + frames + fifoBacklog/3 samples by then; the rate b
+// comes from a regression over these observations (forgetting older ones over
+// clockWindowSeconds), and the offset a from the least delayed recent
+// observation, since transfer and scheduling delays only ever make a block
+// look late. Frames are then interpolated with a 4-point Lagrange (cubic)
+// fractional delay.
+//
+// Time only advances with the data: a frame is emitted once every input has
+// samples past it, or when the newest acquisition time seen is maxLatency
+// beyond it. Memory is bounded by historySeconds per input.
+class StreamMerger {
+public:
+    using Sink = function<void(const MergedBlock& block)>;
+
+    StreamMerger(const vector<MergeInput>& inputs, Sink sink, const MergeOptions& options = MergeOptions());
+
+    // Feeds a block of one input (any thread). May call the sink, under the
+    // merger's lock: the sink must not push.
+    void push(size_t input, const DataBlock& block);
+
+    MergeClock clock(size_t input);
+    uint64_t framesEmitted();
+
+private:
+    static constexpr double MIN_FIT_SECONDS = 1.0;     // Observation span before the rate is fitted
+    static constexpr int MAX_LATE_OBSERVATIONS = 16;   // Consecutive late blocks that restart the model
+
+    struct Input {
+        MergeInput config;
+
+        // Samples by absolute index, NaN where missing
+        vector<double> ring;
+        size_t capacity = 0;
+        int64_t newest = -1;           // Highest sample index stored
+        int64_t oldest = 0;            // Lowest index usable since the last restart
+
+        // Clock model: t(k) = t0 + a + b·(k - k0), seconds since the merger epoch
+        bool hasModel = false;
+        int64_t k0 = 0;
+        double t0 = 0;
+        double a = 0;
+        double b = 0;
+
+        // Exponentially weighted means and co-moments of (k - k0, t - t0)
+        double w = 0, mx = 0, my = 0, cxx = 0, cxy = 0;
+        double firstObservation = 0;
+        double lastObservation = 0;
+        deque<pair<double, double>> recent;   // Observations for the delay envelope
+        int lateObservations = 0;
+
+        MetricCounter* missing = nullptr;
+        MetricCounter* restarts = nullptr;
+        MetricGauge* drift = nullptr;
+        MetricGauge* offset = nullptr;
+    };
+
+    mutex mergeMutex;
+    vector<Input> inputs;
+    Sink sink;
+    MergeOptions options;
+
+    bool hasEpoch;
+    chrono::steady_clock::time_point epoch;  // acquiredAt of the first block
+    double newestTime;                       // Latest acquisition time seen (seconds since epoch)
+
+    bool started;
+    double timelineStart;                    // Time of frame 0
+    uint64_t nextFrame;
+    MergedBlock pending;
+
+    MetricCounter& frames;
+    MetricCounter& skipped;
+    MetricGauge& latency;
+
+    void restart(Input& in);
+    void store(Input& in, const DataBlock& block);
+    void observe(Input& in, int64_t produced, double t);
+
+    // Fractional sample index of input in at time t.
+    double indexAt(const Input& in, double t) const;
+
+    // Interpolates the input's 3 channels at time t into out; false if samples are missing.
+    bool sampleAt(const Input& in, double t, double* out) const;
+
+    // Emits every frame that is ready or overdue.
+    void emit();
+    void flush();
+};
+
+#endif // STREAM_MERGER_H
@@ -0,0 +1,144 @@
+#include "Trace.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+#include <unistd.h>
+
+atomic<bool> Tracer::enabled(false);
+
+Tracer::Tracer() : epoch(chrono::steady_clock::now()), capacity(1 << 16), nextTid(1) {}
+
+Tracer& Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::enable(size_t eventsPerThread) {
+    {
+        lock_guard<mutex> lock(buffersMutex);
+        capacity = eventsPerThread;
+    }
+    enabled = true;
+}
+
+void Tracer::disable() {
+    enabled = false;
+}
+
+uint64_t Tracer::now() const {
+    // Never 0, so TraceSpan can use 0 as "not recording"
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch).count() + 1;
+}
+
+// Registers the calling thread's buffer on first use, reusing the ring of an
+// exited thread if there is one, and hands it back when the thread exits: the
+// rings never outnumber the threads alive at once.
+TraceBuffer* Tracer::threadBuffer() {
+    struct Owner {
+        TraceBuffer* buffer = nullptr;
+        ~Owner() {
+            if (buffer) {
+                Tracer::instance().releaseBuffer(buffer);
+            }
+        }
+    };
+    thread_local Owner owner;
+    if (!owner.buffer) {
+        lock_guard<mutex> lock(buffersMutex);
+        for (const auto& buffer : buffers) {
+            if (!buffer->inUse) {
+                // **Reset under the lock, so the dump never sees a half-reused ring**
+                buffer->events.assign(capacity, TraceEvent());
+                buffer->head.store(0, memory_order_relaxed);
+                buffer->tid = nextTid++;
+                buffer->threadName.clear();
+                buffer->inUse = true;
+                owner.buffer = buffer.get();
+                break;
+            }
+        }
+        if (!owner.buffer) {
+            buffers.emplace_back(new TraceBuffer(capacity, nextTid++));
+            owner.buffer = buffers.back().get();
+        }
+    }
+    return owner.buffer;
+}
+
+void Tracer::releaseBuffer(TraceBuffer* buffer) {
+    lock_guard<mutex> lock(buffersMutex);
+    buffer->inUse = false;
+}
+
+// Writes value as a JSON string literal.
+static void writeJsonString(ostream& out, string_view value) {
+    out << '"';
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out << "\\u" << hex << setw(4) << setfill('0') << static_cast<int>(c) << dec << setfill(' ');
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+void Tracer::setThreadName(const string& name) {
+    TraceBuffer* buffer = threadBuffer();
+    lock_guard<mutex> lock(buffersMutex);
+    buffer->threadName = name;
+}
+
+void Tracer::record(const char* name, uint64_t beginNs, uint64_t endNs) {
+    TraceBuffer* buffer = threadBuffer();
+    uint64_t head = buffer->head.load(memory_order_relaxed);
+    buffer->events[head % buffer->events.size()] = {name, beginNs, endNs};
+    buffer->head.store(head + 1, memory_order_release);
+}
+
+// Spans still being overwritten while the dump runs may be torn; dump after
+// the capture window (or accept a few damaged events at the ring's tail).
+bool Tracer::dumpChromeTrace(const string& path) {
+    ofstream out(path);
+    if (!out) {
+        cerr << "Error: Unable to write trace file: " << path << endl;
+        return false;
+    }
+
+    int pid = getpid();
+    bool first = true;
+    out << fixed << setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    lock_guard<mutex> lock(buffersMutex);
+    for (const auto& buffer : buffers) {
+        if (!buffer->threadName.empty()) {
+            out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+                << ",\"tid\":" << buffer->tid << ",\"args\":{\"name\":";
+            writeJsonString(out, buffer->threadName);
+            out << "}}";
+            first = false;
+        }
+
+        uint64_t head = buffer->head.load(memory_order_acquire);
+        uint64_t size = buffer->events.size();
+        uint64_t begin = head > size ? head - size : 0;
+        for (uint64_t i = begin; i < head; i++) {
+            const TraceEvent& e = buffer->events[i % size];
+            out << (first ? "" : ",") << "\n{\"name\":";
+            writeJsonString(out, e.name);
+            out << ",\"ph\":\"X\",\"pid\":" << pid
+                << ",\"tid\":" << buffer->tid
+                << ",\"ts\":" << e.beginNs / 1000.0
+                << ",\"dur\":" << (e.endNs - e.beginNs) / 1000.0 << "}";
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+    cout << "Trace written to " << path << endl;
+    return static_cast<bool>(out);
+}
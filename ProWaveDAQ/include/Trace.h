@@ -0,0 +1,92 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// One completed span, timestamps in nanoseconds since the tracer epoch.
+struct TraceEvent {
+    const char* name;   // Static string naming the span
+    uint64_t beginNs;
+    uint64_t endNs;
+};
+
+// Per-thread ring of trace events. Only the owning thread writes; the dump
+// reads up to the published head, so recording never takes a lock. When its
+// thread exits the ring is kept for the dump until a new thread reuses it.
+struct TraceBuffer {
+    TraceBuffer(size_t capacity, int tid) : events(capacity), head(0), tid(tid), inUse(true) {}
+
+    vector<TraceEvent> events;
+    atomic<uint64_t> head;   // Total events written (index = head % capacity)
+    int tid;                 // Small sequential thread id for the trace
+    string threadName;
+    bool inUse;              // Owned by a live thread (guarded by buffersMutex)
+};
+
+// Tracer collects begin/end spans from all threads and writes them as a
+// Chrome trace (JSON "traceEvents"), viewable in chrome://tracing or Perfetto.
+class Tracer {
+public:
+    static Tracer& instance();
+
+    // Starts recording; each thread keeps its last eventsPerThread spans.
+    void enable(size_t eventsPerThread = 1 << 16);
+    void disable();
+
+    static bool isEnabled() { return enabled.load(memory_order_relaxed); }
+
+    // Names the calling thread in the trace.
+    void setThreadName(const string& name);
+
+    // Appends a span to the calling thread's buffer.
+    void record(const char* name, uint64_t beginNs, uint64_t endNs);
+
+    // Nanoseconds since the tracer epoch.
+    uint64_t now() const;
+
+    // Writes all buffered spans as Chrome trace JSON. Returns false on I/O error.
+    bool dumpChromeTrace(const string& path);
+
+private:
+    Tracer();
+
+    static atomic<bool> enabled;
+    chrono::steady_clock::time_point epoch;
+    size_t capacity;
+    mutex buffersMutex;                      // Guards registration and reuse only
+    vector<unique_ptr<TraceBuffer>> buffers;
+    int nextTid;
+
+    TraceBuffer* threadBuffer();
+    void releaseBuffer(TraceBuffer* buffer);
+};
+
+// RAII span: records [construction, destruction) when tracing is enabled.
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name)
+        : name(name), beginNs(Tracer::isEnabled() ? Tracer::instance().now() : 0) {}
+
+    ~TraceSpan() {
+        if (beginNs && Tracer::isEnabled()) {
+            Tracer::instance().record(name, beginNs, Tracer::instance().now());
+        }
+    }
+
+private:
+    const char* name;
+    uint64_t beginNs;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(traceSpan_, __LINE__)(name)
+
+#endif // TRACE_H
@@ -0,0 +1,180 @@
+#include "VelocityMonitor.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+// Standard gravity: g -> mm/s²
+static const float G_MM_PER_S2 = 9806.65f;
+
+// Readings start once this many periods of the high-pass corner have passed
+static const double SETTLE_PERIODS = 10;
+
+static const char* AXIS_NAMES[3] = {"x", "y", "z"};
+
+string VelocityMonitor::check(const VelocityOptions& options, int sampleRate) {
+    if (sampleRate <= 0) {
+        return "sample rate must be positive";
+    }
+    if (options.highPassHz <= 0 || options.lowPassHz <= options.highPassHz || options.lowPassHz >= sampleRate / 2.0) {
+        return "band must satisfy 0 < highPassHz < lowPassHz < sampleRate / 2";
+    }
+    if (options.windowsSeconds.empty()) {
+        return "windowsSeconds needs at least one window";
+    }
+    for (double seconds : options.windowsSeconds) {
+        if (seconds * options.highPassHz < 1) {
+            return "every window must span at least one period of highPassHz";
+        }
+    }
+    for (size_t i = 1; i < options.zoneLimits.size(); i++) {
+        if (options.zoneLimits[i] <= options.zoneLimits[i - 1]) {
+            return "zoneLimits must be increasing";
+        }
+    }
+    return "";
+}
+
+VelocityMonitor::VelocityMonitor(int sampleRate, const VelocityOptions& options, Sink sink)
+    : sampleRate(sampleRate), options(options), sink(move(sink)), settleFrames(0),
+      windows(options.windowsSeconds.size()),
+      processLatency(Metrics::instance().latency("prowavedaq_velocity_process_seconds",
+          "Velocity integration of one block")) {
+    for (size_t w = 0; w < windows.size(); w++) {
+        ostringstream seconds;
+        seconds << options.windowsSeconds[w];
+        for (int axis = 0; axis < 3; axis++) {
+            string labels = Metrics::label("axis", AXIS_NAMES[axis]) + "," + Metrics::label("window", seconds.str());
+            windows[w].velocityGauges[axis] = &Metrics::instance().gauge("prowavedaq_velocity_rms_mm_s",
+                "Band-limited velocity rms over the window", labels);
+            windows[w].displacementGauges[axis] = options.displacement
+                ? &Metrics::instance().gauge("prowavedaq_displacement_rms_um",
+                      "Band-limited displacement rms over the window", labels)
+                : nullptr;
+        }
+    }
+    design();
+}
+
+void VelocityMonitor::setSampleRate(int newSampleRate) {
+    sampleRate = newSampleRate;
+    design();
+}
+
+// **Filters for the current rate; every window starts over once they settle**
+void VelocityMonitor::design() {
+    velocity[0] = Biquad::highPass(options.highPassHz, sampleRate, BUTTERWORTH4_Q[0]);
+    velocity[1] = Biquad::integratingHighPass(options.highPassHz, sampleRate, BUTTERWORTH4_Q[1]);
+    velocity[2] = Biquad::lowPass(options.lowPassHz, sampleRate, BUTTERWORTH4_Q[0]);
+    velocity[3] = Biquad::lowPass(options.lowPassHz, sampleRate, BUTTERWORTH4_Q[1]);
+    displacement = Biquad::integratingHighPass(options.highPassHz, sampleRate, M_SQRT1_2);
+    settleFrames = static_cast<size_t>(lround(SETTLE_PERIODS * sampleRate / options.highPassHz));
+    for (size_t w = 0; w < windows.size(); w++) {
+        Window& window = windows[w];
+        window.frames = max<size_t>(1, static_cast<size_t>(lround(options.windowsSeconds[w] * sampleRate)));
+        window.filled = 0;
+        fill(window.velocitySquares, window.velocitySquares + 3, 0.0);
+        fill(window.displacementSquares, window.displacementSquares + 3, 0.0);
+    }
+}
+
+void VelocityMonitor::push(const DataBlock& block) {
+    TRACE_SPAN("velocity");
+    auto start = chrono::steady_clock::now();
+    const double* values = block.samples.data();
+    size_t frames = block.samples.size() / 3;
+
+    for (size_t f = 0; f < frames; f++) {
+        // **One frame per vector: mm/s² -> mm/s [-> mm], all axes side by side**
+        FrameLanes v = loadFrame(values, f) * G_MM_PER_S2;
+        for (Biquad& section : velocity) {
+            v = section.run(v);
+        }
+        FrameLanes d = {};
+        if (options.displacement) {
+            d = displacement.run(v) * 1000.0f;
+        }
+        if (settleFrames > 0) {
+            settleFrames--;
+            continue;
+        }
+        FrameLanes v2 = v * v;
+        FrameLanes d2 = d * d;
+        for (Window& window : windows) {
+            for (int axis = 0; axis < 3; axis++) {
+                window.velocitySquares[axis] += v2[axis];
+                window.displacementSquares[axis] += d2[axis];
+            }
+            if (++window.filled == window.frames) {
+                finishWindow(window, block.firstSample + f, block.acquiredAt);
+            }
+        }
+    }
+    processLatency.recordSince(start);
+}
+
+void VelocityMonitor::finishWindow(Window& window, uint64_t lastSample, chrono::steady_clock::time_point acquiredAt) {
+    const double n = static_cast<double>(window.frames);
+    reading.lastSample = lastSample;
+    reading.acquiredAt = acquiredAt;
+    reading.windowSeconds = n / sampleRate;
+    double highest = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        reading.velocityRms[axis] = sqrt(window.velocitySquares[axis] / n);
+        reading.displacementRms[axis] = sqrt(window.displacementSquares[axis] / n);
+        window.velocitySquares[axis] = window.displacementSquares[axis] = 0;
+        highest = max(highest, reading.velocityRms[axis]);
+        window.velocityGauges[axis]->set(reading.velocityRms[axis]);
+        if (window.displacementGauges[axis]) {
+            window.displacementGauges[axis]->set(reading.displacementRms[axis]);
+        }
+    }
+    // Zone A below the first limit, one letter further per limit reached
+    reading.zone = static_cast<char>('A' + (upper_bound(options.zoneLimits.begin(), options.zoneLimits.end(), highest) -
+                                            options.zoneLimits.begin()));
+    window.filled = 0;
+    {
+        lock_guard<mutex> lock(summaryMutex);
+        window.last = reading;
+        window.haveReading = true;
+    }
+    if (sink) {
+        sink(reading);
+    }
+}
+
+string VelocityMonitor::summary() {
+    lock_guard<mutex> lock(summaryMutex);
+    ostringstream out;
+    out << "velocity " << options.highPassHz << "-" << options.lowPassHz << " Hz rms (mm/s)"
+        << (options.displacement ? ", displacement rms (um)" : "") << "\n";
+    for (size_t w = 0; w < windows.size(); w++) {
+        const Window& window = windows[w];
+        out << options.windowsSeconds[w] << " s: ";
+        if (!window.haveReading) {
+            out << "no reading yet\n";
+            continue;
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            out << AXIS_NAMES[axis] << " " << window.last.velocityRms[axis];
+            if (options.displacement) {
+                out << " / " << window.last.displacementRms[axis];
+            }
+            out << ", ";
+        }
+        out << "zone " << window.last.zone << "\n";
+    }
+    return out.str();
+}
+
+void VelocityMonitor::appendCsv(const VelocityReading& reading, ostream& out) {
+    out << reading.lastSample << "," << reading.windowSeconds;
+    for (double rms : reading.velocityRms) {
+        out << "," << rms;
+    }
+    for (double rms : reading.displacementRms) {
+        out << "," << rms;
+    }
+    out << "," << reading.zone << "\n";
+}
@@ -0,0 +1,103 @@
+#ifndef VELOCITY_MONITOR_H
+#define VELOCITY_MONITOR_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Biquad.h"
+#include "DataBlock.h"
+#include "Metrics.h"
+
+using namespace std;
+
+// Settings from Master.ini [Velocity].
+struct VelocityOptions {
+    double highPassHz = 10;                     // ISO 10816 band: 10-1000 Hz
+    double lowPassHz = 1000;
+    vector<double> windowsSeconds = {1, 60};    // One reading per window length
+    bool displacement = false;                  // Also integrate velocity to displacement
+    vector<double> zoneLimits = {1.4, 2.8, 4.5};   // Velocity rms (mm/s) at the A/B, B/C and C/D boundaries
+};
+
+// Band-limited rms of one window.
+struct VelocityReading {
+    uint64_t lastSample = 0;                    // Input sample index of the window's last frame
+    chrono::steady_clock::time_point acquiredAt;
+    double windowSeconds = 0;
+    double velocityRms[3] = {};                 // mm/s
+    double displacementRms[3] = {};             // µm (0 unless displacement is enabled)
+    char zone = 'A';                            // Evaluation zone of the highest axis
+};
+
+// VelocityMonitor turns the acceleration stream (g) into band-limited
+// velocity, and optionally displacement, and reports their rms per axis over
+// every configured window:
+//   acceleration (g x 9806.65 = mm/s²) -> 2nd-order Butterworth high-pass
+//   -> integrator fused with a 2nd-order high-pass (together a 4th-order
+//   Butterworth high-pass of the velocity) -> 4th-order Butterworth low-pass
+//   -> velocity (mm/s) [-> integrator fused with a 2nd-order high-pass
+//   -> displacement (mm, reported x 1000 in µm)].
+// The fused sections have no pole at DC, so sensor offset and rounding
+// cannot make the integrals drift; the filter state carries across blocks.
+// Each stage filters all three axes of a frame in one SIMD vector (see
+// Biquad.h). Readings before the filters have settled are skipped.
+class VelocityMonitor {
+public:
+    using Sink = function<void(const VelocityReading& reading)>;
+
+    // Empty if options work at sampleRate, otherwise the reason.
+    static string check(const VelocityOptions& options, int sampleRate);
+
+    VelocityMonitor(int sampleRate, const VelocityOptions& options, Sink sink = nullptr);
+
+    // Feeds one block of interleaved XYZ values. Calls the sink (on this
+    // thread) whenever a window completes.
+    void push(const DataBlock& block);
+
+    // Redesigns the filters for a new input rate; the windows start over.
+    void setSampleRate(int sampleRate);
+    int getSampleRate() const { return sampleRate; }
+
+    // Latest reading of every window (any thread).
+    string summary();
+
+    // One CSV row: sample,window_s,vx,vy,vz (mm/s),dx,dy,dz (µm),zone.
+    static void appendCsv(const VelocityReading& reading, ostream& out);
+
+private:
+    struct Window {
+        size_t frames = 0;              // Window length
+        size_t filled = 0;
+        double velocitySquares[3] = {};
+        double displacementSquares[3] = {};
+        VelocityReading last;           // Guarded by summaryMutex
+        bool haveReading = false;
+        MetricGauge* velocityGauges[3];
+        MetricGauge* displacementGauges[3];
+    };
+
+    static constexpr int VELOCITY_SECTIONS = 4;   // High-pass, integrating high-pass, 2 low-pass
+
+    int sampleRate;
+    VelocityOptions options;
+    Sink sink;
+
+    Biquad velocity[VELOCITY_SECTIONS];
+    Biquad displacement;
+    size_t settleFrames;                // Frames left before readings start
+    vector<Window> windows;
+    VelocityReading reading;
+
+    mutex summaryMutex;
+    HdrHistogram& processLatency;
+
+    void design();
+    void finishWindow(Window& window, uint64_t lastSample, chrono::steady_clock::time_point acquiredAt);
+};
+
+#endif // VELOCITY_MONITOR_H
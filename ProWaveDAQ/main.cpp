@@ -1,6 +1,24 @@
 #include "ProWaveDAQ.h"
-#include "CSVWriter.h"
+#include "QueryEngine.h"
+#include "AcquisitionSession.h"
+#include "BlockFanout.h"
+#include "ConfigWatcher.h"
+#include "ControlServer.h"
+#include "DeviceProber.h"
+#include "AnomalyDetector.h"
+#include "EnvelopeAnalyzer.h"
+#include "VelocityMonitor.h"
+#include "Diagnostics.h"
+#include "Metrics.h"
+#include "RetentionManager.h"
+#include "SegmentCodec.h"
+#include "Trace.h"
 #include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <iomanip>
+#include <csignal>
 #include <algorithm>
 #include <thread>
 #include <chrono>
@@ -40,127 +58,702 @@ void resetTerminalMode( void ) {
     fcntl(STDIN_FILENO, F_SETFL, flags & ~O_NONBLOCK);
 }
 
-// Get current time as a formatted string (YYYYMMDDHHMMSS)
-string getCurrentTime( void ) {
-    auto now = chrono::system_clock::now();
-    time_t now_time = chrono::system_clock::to_time_t(now);
-    struct tm localTime;
-    localtime_r(&now_time, &localTime); // Convert to local time
+// Set by signal handlers and polled by the main loop
+static volatile sig_atomic_t quitSignal = 0;
+static volatile sig_atomic_t segmentSignal = 0;
+static volatile sig_atomic_t reloadSignal = 0;
+
+// SIGINT/SIGTERM: shut down cleanly; SIGUSR1: start a new segment; SIGHUP: reload configuration
+static void onSignal(int sig) {
+    if (sig == SIGUSR1) {
+        segmentSignal = 1;
+    } else if (sig == SIGHUP) {
+        reloadSignal = 1;
+    } else {
+        quitSignal = 1;
+    }
+}
+
+static const string masterIniPath = "API/Master.ini";
+static const string deviceIniPath = "API/ProWaveDAQ.ini";
+
+// Reads the recorder settings from Master.ini.
+static SessionConfig readSessionConfig(const INIReader& reader) {
+    SessionConfig config;
+    config.saveUnitSeconds = reader.GetInteger("SaveUnit", "second", 60);
+    config.syncIntervalMs = reader.GetInteger("Output", "syncIntervalMs", 1000);
+    config.outputRoot = reader.Get("Output", "directory", "output/ProWaveDAQ");
+    config.writer.direct = reader.GetBoolean("Output", "directIO", false);
+    config.writer.mapped = reader.GetBoolean("Output", "preallocate", false);
+    string backend = reader.Get("Output", "writerBackend", "auto");
+    if (!parseWriterBackend(backend, config.writer.backend)) {
+        cerr << "Warning: unknown [Output] writerBackend '" << backend << "', using auto" << endl;
+        config.writer.backend = WriterBackend::Auto;
+    }
+    string durability = reader.Get("Output", "durability", "periodic");
+    if (!parseDurability(durability, config.durability)) {
+        cerr << "Warning: unknown [Output] durability '" << durability << "', using periodic" << endl;
+        config.durability = Durability::Periodic;
+    }
+    string overflow = reader.Get("Output", "overflow", "spill");
+    if (overflow != "spill" && overflow != "block") {
+        cerr << "Warning: unknown [Output] overflow '" << overflow << "', using spill" << endl;
+    }
+    config.spill = overflow != "block";
+    config.spillMemoryBytes = static_cast<size_t>(max(1L, reader.GetInteger("Output", "spillMemoryMB", 64))) << 20;
+    config.spillDirectory = reader.Get("Output", "spillDirectory", "/var/tmp");
+    return config;
+}
+
+// Reads [Retention]; sizes are given in MB.
+static RetentionPolicy readRetentionPolicy(const INIReader& reader, const SessionConfig& config, int sampleRate) {
+    RetentionPolicy policy;
+    policy.root = config.outputRoot;
+    policy.budgetBytes = static_cast<uint64_t>(max(0.0, reader.GetReal("Retention", "budgetMB", 0)) * 1e6);
+    policy.minFreeBytes = static_cast<uint64_t>(max(0.0, reader.GetReal("Retention", "minFreeMB", 0)) * 1e6);
+    policy.compactAfterHours = reader.GetReal("Retention", "compactAfterHours", 24);
+    policy.featuresAfterHours = reader.GetReal("Retention", "featuresAfterHours", 0);
+    policy.featureFrames = sampleRate;
+    policy.ioBytesPerSecond = reader.GetReal("Retention", "ioMBps", 8) * 1e6;
+    policy.intervalSeconds = max(1L, reader.GetInteger("Retention", "intervalSeconds", 60));
+    return policy;
+}
+
+// Reads [Envelope].
+static EnvelopeOptions readEnvelopeOptions(const INIReader& reader) {
+    EnvelopeOptions options;
+    options.bandLowHz = reader.GetReal("Envelope", "bandLowHz", options.bandLowHz);
+    options.bandHighHz = reader.GetReal("Envelope", "bandHighHz", options.bandHighHz);
+    options.decimation = reader.GetInteger("Envelope", "decimation", options.decimation);
+    options.fftSize = max(0L, reader.GetInteger("Envelope", "fftSize", options.fftSize));
+    options.cadenceSeconds = reader.GetReal("Envelope", "cadenceSeconds", options.cadenceSeconds);
+    return options;
+}
+
+// Comma-separated numbers, e.g. "10,200,800".
+static vector<double> parseList(const string& text) {
+    vector<double> values;
+    istringstream list(text);
+    string item;
+    while (getline(list, item, ',')) {
+        values.push_back(atof(item.c_str()));
+    }
+    return values;
+}
+
+// Reads [Velocity].
+static VelocityOptions readVelocityOptions(const INIReader& reader) {
+    VelocityOptions options;
+    options.highPassHz = reader.GetReal("Velocity", "highPassHz", options.highPassHz);
+    options.lowPassHz = reader.GetReal("Velocity", "lowPassHz", options.lowPassHz);
+    string windows = reader.Get("Velocity", "windowsSeconds", "");
+    if (!windows.empty()) {
+        options.windowsSeconds = parseList(windows);
+    }
+    options.displacement = reader.GetBoolean("Velocity", "displacement", options.displacement);
+    string zones = reader.Get("Velocity", "zoneLimits", "");
+    if (!zones.empty()) {
+        options.zoneLimits = parseList(zones);
+    }
+    return options;
+}
+
+// Reads [Anomaly].
+static AnomalyOptions readAnomalyOptions(const INIReader& reader) {
+    AnomalyOptions options;
+    options.windowSeconds = reader.GetReal("Anomaly", "windowSeconds", options.windowSeconds);
+    options.trainingSeconds = reader.GetReal("Anomaly", "trainingSeconds", options.trainingSeconds);
+    string edges = reader.Get("Anomaly", "bandEdgesHz", "");
+    if (!edges.empty()) {
+        options.bandEdgesHz = parseList(edges);
+    }
+    options.threshold = reader.GetReal("Anomaly", "threshold", options.threshold);
+    options.clearRatio = reader.GetReal("Anomaly", "clearRatio", options.clearRatio);
+    options.confirmWindows = reader.GetInteger("Anomaly", "confirmWindows", options.confirmWindows);
+    options.baselinePath = reader.Get("Anomaly", "baselinePath", "");
+    return options;
+}
+
+// Checks the recorder settings used both at startup and on reload; "" when valid.
+static string validateSessionConfig(const SessionConfig& config) {
+    if (config.saveUnitSeconds < 1 || config.saveUnitSeconds > 86400) {
+        return "[SaveUnit] second must be 1..86400";
+    }
+    if (config.syncIntervalMs < 0) {
+        return "[Output] syncIntervalMs must be >= 0";
+    }
+    if (config.outputRoot.empty()) {
+        return "[Output] directory must not be empty";
+    }
+    return "";
+}
+
+// Re-reads both INI files and applies the settings that can change live:
+// SaveUnit (next segment), [Output] settings and the sample rate. Nothing is
+// applied unless every value is valid. Connection settings need a restart.
+static string reloadConfig(AcquisitionSession& session, ProWaveDAQ& daq) {
+    INIReader master(masterIniPath);
+    INIReader device(deviceIniPath);
+    if (master.ParseError() != 0) {
+        return "ERR cannot parse " + masterIniPath;
+    }
+    if (device.ParseError() != 0) {
+        return "ERR cannot parse " + deviceIniPath;
+    }
+
+    SessionConfig config = readSessionConfig(master);
+    int sampleRate = device.GetInteger("ProWaveDAQ", "sampleRate", daq.getSampleRate());
+
+    string invalid = validateSessionConfig(config);
+    if (!invalid.empty()) {
+        return "ERR " + invalid;
+    }
+    WriterBackend backend;
+    if (!parseWriterBackend(master.Get("Output", "writerBackend", "auto"), backend)) {
+        return "ERR [Output] writerBackend must be auto, io_uring or threads";
+    }
+    Durability durability;
+    if (!parseDurability(master.Get("Output", "durability", "periodic"), durability)) {
+        return "ERR [Output] durability must be none, periodic or group";
+    }
+    if (sampleRate < 1 || sampleRate > 65535) {
+        return "ERR [ProWaveDAQ] sampleRate must be 1..65535";
+    }
+
+    session.applyConfig(config);
+    daq.requestSampleRate(sampleRate);
+    return "OK configuration reloaded";
+}
+
+// Runs a reload and logs its outcome (used for SIGHUP and file changes).
+static void reloadAndLog(AcquisitionSession& session, ProWaveDAQ& daq) {
+    string result = reloadConfig(session, daq);
+    if (result.compare(0, 3, "ERR") == 0) {
+        cerr << "Configuration not reloaded: " << result.substr(4) << endl;
+    } else {
+        cout << "Configuration reloaded" << endl;
+    }
+}
+
+// One line per auxiliary register: latest values, age and vibration sample index.
+static string auxReport(ProWaveDAQ& daq) {
+    ostringstream out;
+    auto now = chrono::steady_clock::now();
+    for (const AuxSample& sample : daq.getAuxSamples()) {
+        out << sample.name << " @0x" << hex << sample.address << dec << " =";
+        if (sample.ok) {
+            for (uint16_t value : sample.values) {
+                out << " " << value;
+            }
+        } else {
+            out << " (read failed)";
+        }
+        out << " age=" << chrono::duration_cast<chrono::milliseconds>(now - sample.acquiredAt).count()
+            << "ms sample=" << sample.sampleIndex << "\n";
+    }
+    return out.str();
+}
+
+// One analysis of the live stream: the analyzer, its CSV output and its fan-out subscription.
+template <typename Analyzer>
+struct AnalysisStage {
+    unique_ptr<Analyzer> analyzer;
+    string path;                      // CSV output, empty for none
+    ofstream csv;
+    shared_ptr<Subscription> subscription;
+
+    Analyzer* get() const { return analyzer.get(); }
+
+    // Unsubscribes, which joins the subscriber thread; the analyzer stays for a last summary.
+    void stop(BlockFanout& fanout) {
+        if (subscription) {
+            fanout.unsubscribe(subscription);
+            subscription.reset();
+        }
+    }
+};
+
+// Every optional analysis stage; null analyzers are disabled.
+struct AnalysisStages {
+    AnalysisStage<EnvelopeAnalyzer> envelope;
+    AnalysisStage<VelocityMonitor> velocity;
+    AnalysisStage<AnomalyDetector> anomaly;
+
+    void stop(BlockFanout& fanout) {
+        envelope.stop(fanout);
+        velocity.stop(fanout);
+        anomaly.stop(fanout);
+    }
+};
+
+// Starts one stage as a fan-out subscriber that follows device rate changes, writing its
+// results to the CSV named by [section] pathKey; onOutput sees each result first. False,
+// with a warning, if the options do not work at the device rate.
+template <typename Analyzer, typename Options, typename OnOutput>
+static bool startStage(AnalysisStage<Analyzer>& stage, const INIReader& reader, const string& section,
+                       const string& pathKey, const Options& options, BlockFanout& fanout, ProWaveDAQ& daq,
+                       OnOutput onOutput) {
+    string problem = Analyzer::check(options, daq.getSampleRate());
+    if (!problem.empty()) {
+        cerr << "Warning: [" << section << "] disabled: " << problem << endl;
+        return false;
+    }
+    stage.path = reader.Get(section, pathKey, "");
+    if (!stage.path.empty()) {
+        stage.csv.open(stage.path, ios::app);
+    }
+    stage.analyzer.reset(new Analyzer(daq.getSampleRate(), options, [&stage, onOutput](const auto& output) {
+        onOutput(output);
+        if (stage.csv.is_open()) {
+            Analyzer::appendCsv(output, stage.csv);
+            stage.csv.flush();
+        }
+    }));
+    SubscriberOptions subscriberOptions;
+    subscriberOptions.name = section;
+    transform(section.begin(), section.end(), subscriberOptions.name.begin(), ::tolower);
+    stage.subscription = fanout.subscribe(subscriberOptions, [&stage, &daq](const SharedBlock& block) {
+        if (daq.getSampleRate() != stage.analyzer->getSampleRate()) {
+            stage.analyzer->setSampleRate(daq.getSampleRate());
+        }
+        stage.analyzer->push(*block);
+    });
+    return true;
+}
+
+// Executes one control command received on the control socket.
+static string handleCommand(AcquisitionSession& session, ProWaveDAQ& daq, const AnalysisStages& stages,
+                            const string& line, atomic<bool>& quit) {
+    istringstream in(line);
+    string command, argument, extra;
+    in >> command >> argument >> extra;
+
+    if (command == "label" && !argument.empty()) {
+        session.startRecording(argument, extra);
+        return "OK recording " + argument;
+    } else if (command == "folder" && !argument.empty()) {
+        session.changeOutputRoot(argument);
+        return "OK output root " + argument;
+    } else if (command == "segment") {
+        session.newSegment();
+        return "OK new segment";
+    } else if (command == "stop") {
+        session.stopRecording();
+        return "OK stopped";
+    } else if (command == "status") {
+        return "OK " + session.status();
+    } else if (command == "stats") {
+        return Metrics::instance().latencyReport() + "OK";
+    } else if (command == "reload") {
+        return reloadConfig(session, daq);
+    } else if (command == "aux") {
+        return auxReport(daq) + "OK";
+    } else if (command == "envelope") {
+        EnvelopeAnalyzer* envelope = stages.envelope.get();
+        return envelope ? envelope->summary() + "OK" : "ERR [Envelope] enabled = 0";
+    } else if (command == "anomaly") {
+        AnomalyDetector* anomaly = stages.anomaly.get();
+        if (!anomaly) {
+            return "ERR [Anomaly] enabled = 0";
+        }
+        if (argument == "retrain") {
+            anomaly->retrain();
+            return "OK retraining";
+        }
+        return anomaly->status() + "OK";
+    } else if (command == "velocity") {
+        VelocityMonitor* velocity = stages.velocity.get();
+        return velocity ? velocity->summary() + "OK" : "ERR [Velocity] enabled = 0";
+    } else if (command == "quit") {
+        quit = true;
+        return "OK quitting";
+    }
+    return "ERR commands: label <name> [root], folder <root>, segment, stop, status, stats, reload, aux, envelope, "
+           "anomaly [retrain], velocity, quit";
+}
+
+// --probe [port,...]: finds sensors and prints a ready-to-use ProWaveDAQ.ini.
+static int runProbe(const string& portList) {
+    ProbeOptions options;
+    istringstream ports(portList);
+    string port;
+    while (getline(ports, port, ',')) {
+        if (!port.empty()) {
+            options.ports.push_back(port);
+        }
+    }
+
+    INIReader current("API/ProWaveDAQ.ini");
+    int sampleRate = current.GetInteger("ProWaveDAQ", "sampleRate", 7812);
+
+    auto start = chrono::steady_clock::now();
+    vector<ProbeResult> sensors = DeviceProber(options).probe();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    cerr << "Found " << sensors.size() << " sensor(s) in " << elapsed.count() << " s" << endl;
 
-    char buffer[20];
-    strftime(buffer, sizeof(buffer), "%Y%m%d%H%M%S", &localTime);
-    return string(buffer);
+    // **Configuration goes to stdout so it can be redirected into API/ProWaveDAQ.ini**
+    for (size_t i = 0; i < sensors.size(); i++) {
+        string section = i == 0 ? "ProWaveDAQ" : "ProWaveDAQ_" + to_string(i + 1);
+        cout << DeviceProber::toIni(sensors[i], sampleRate, section) << endl;
+    }
+    return sensors.empty() ? 1 : 0;
 }
 
-int main( void ) {
+// --diagnose [seconds]: measures which read size / poll strategy keeps up with the sensor.
+static int runDiagnose(const string& seconds) {
+    DiagnosticOptions options;
+    if (!seconds.empty()) {
+        options.trialSeconds = atof(seconds.c_str());
+    }
+    if (options.trialSeconds <= 0) {
+        cerr << "Usage: main --diagnose [seconds per trial]" << endl;
+        return 1;
+    }
+
     ProWaveDAQ daq;
+    daq.initDevices(deviceIniPath.c_str());
+    Diagnostics diagnostics(daq, options);
+    vector<DiagnosticTrial> trials = diagnostics.run();
+    cout << diagnostics.report(trials);
+    return Diagnostics::recommended(trials) ? 0 : 2;
+}
+
+// --expand <segment.pwc>: prints a compacted segment as the CSV it was recorded as.
+static int runExpand(const string& path) {
+    ifstream in(path, ios::binary);
+    string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    string csv;
+    if (path.empty() || !in || !SegmentCodec::decodeCsv(data, csv)) {
+        cerr << "Usage: main --expand <segment.pwc> > segment.csv" << endl;
+        return 1;
+    }
+    cout << csv;
+    return 0;
+}
+
+// --query [options]: aggregates over recorded sessions (see QueryEngine.h).
+static int runQuery(int argc, char** argv) {
+    INIReader master(masterIniPath);
+    INIReader device(deviceIniPath);
+    QuerySpec spec;
+    spec.root = readSessionConfig(master).outputRoot;
+    spec.sampleRate = device.GetInteger("ProWaveDAQ", "sampleRate", spec.sampleRate);
+    bool valid = true;
+    for (int i = 2; i < argc && valid; i += 2) {
+        string option = argv[i];
+        string value = i + 1 < argc ? argv[i + 1] : "";
+        if (value.empty()) {
+            valid = false;
+        } else if (option == "--root") {
+            spec.root = value;
+        } else if (option == "--label") {
+            spec.labelPattern = value;
+        } else if (option == "--from" || option == "--to") {
+            time_t time = QueryEngine::parseTime(value);
+            (option == "--from" ? spec.from : spec.to) = time;
+            valid = time != 0;
+        } else if (option == "--aggregate") {
+            valid = QueryEngine::parseAggregate(value, spec);
+        } else if (option == "--window") {
+            spec.windowSeconds = atof(value.c_str());
+            valid = spec.windowSeconds > 0;
+        } else if (option == "--channel") {
+            size_t axis = string("xyz").find(value);
+            spec.channel = value.size() == 1 && axis != string::npos ? static_cast<int>(axis) : atoi(value.c_str()) - 1;
+            valid = spec.channel >= 0;
+        } else if (option == "--rate") {
+            spec.sampleRate = atoi(value.c_str());
+            valid = spec.sampleRate > 0;
+        } else if (option == "--threads") {
+            spec.threads = atoi(value.c_str());
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        cerr << "Usage: main --query [--label <pattern>] [--from <time>] [--to <time>]" << endl
+             << "                    [--aggregate mean|rms|peak|min|max|band:<low>-<high>] [--window <seconds>]" << endl
+             << "                    [--channel x|y|z|<n>] [--root <dir>] [--rate <Hz>] [--threads <n>]" << endl
+             << "Times: YYYY-MM-DD[ HH:MM:SS] or YYYYMMDDHHMMSS (local). Results go to stdout as CSV." << endl;
+        return 1;
+    }
+
+    QueryEngine engine(spec);
+    vector<QueryRow> rows = engine.run();
+    QueryEngine::printCsv(rows, spec, cout);
+    const QueryStats& stats = engine.stats();
+    cerr << "Query: " << stats.sessions << " session(s), " << stats.csvFiles << " CSV + " << stats.pwcFiles
+         << " .pwc segment(s), " << stats.featureFiles << " features file(s), " << stats.skippedFiles << " skipped; "
+         << stats.bytes / 1000000.0 << " MB in " << stats.seconds << " s" << endl;
+    return 0;
+}
+
+// Prompts for a label on the terminal (blocking, with echo).
+static string promptLabel( void ) {
+    string label;
+    cout << "Please enter the label of the data (type 'exit' to exit): ";
+    cin >> label;
+    return label;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && string(argv[1]) == "--probe") {
+        return runProbe(argc > 2 ? argv[2] : "");
+    }
+    if (argc > 1 && string(argv[1]) == "--diagnose") {
+        return runDiagnose(argc > 2 ? argv[2] : "");
+    }
+    if (argc > 1 && string(argv[1]) == "--expand") {
+        return runExpand(argc > 2 ? argv[2] : "");
+    }
+    if (argc > 1 && string(argv[1]) == "--query") {
+        return runQuery(argc, argv);
+    }
+
+    // --headless [label]: no terminal interaction, driven by the control socket and signals
+    bool headless = argc > 1 && string(argv[1]) == "--headless";
+    string initialLabel = (headless && argc > 2) ? argv[2] : "";
+
+    // Load configuration file for setting parameters
+    INIReader reader(masterIniPath);
+
+    if (reader.ParseError() < 0) {
+        cerr << "Cannot load INI file: " << masterIniPath << endl;
+        return 1;
+    }
+
+    // Expose metrics on localhost when [Metrics] port is set (0 disables)
+    MetricsServer metricsServer;
+    int metricsPort = reader.GetInteger("Metrics", "port", 0);
+    if (metricsPort > 0) {
+        metricsServer.start(metricsPort);
+    }
+
+    // Chrome trace of the first [Trace] seconds of acquisition (0 disables)
+    int traceSeconds = reader.GetInteger("Trace", "seconds", 0);
+    string tracePath = reader.Get("Trace", "path", "trace.json");
+    bool traceDumped = false;
+    if (traceSeconds > 0) {
+        Tracer::instance().enable();
+        Tracer::instance().setThreadName("main");
+    }
 
-    while (true) {
-        system("clear");
+    // Read the "SaveUnit" setting (time interval in seconds) and the [Output] settings
+    SessionConfig config = readSessionConfig(reader);
+    string invalid = validateSessionConfig(config);
+    if (!invalid.empty()) {
+        cerr << "Error: " << invalid << endl;
+        return 1;
+    }
+    cout << "[SaveUnit] second = " << config.saveUnitSeconds << endl;
+    if (config.writer.mapped) {
+        cout << "[Output] preallocated, memory-mapped segments" << endl;
+    } else {
+        cout << "[Output] writerBackend = " << writerBackendName(config.writer.backend)
+             << (config.writer.direct ? ", direct I/O" : "") << endl;
+    }
+    cout << "[Output] durability = " << durabilityName(config.durability) << endl;
 
-        // Load configuration file for setting parameters
-        const string iniFilePath = "API/Master.ini";
-        INIReader reader(iniFilePath);
+    // **Repair the segments an unclean shutdown left behind before recording anything new**
+    RecoveryReport recovery = RecordingJournal::recover(config.outputRoot);
+    cout << "Recovery: " << recovery.sessions << " session(s) checked, " << recovery.repaired
+         << " segment(s) repaired, " << recovery.bytesTrimmed << " bytes trimmed in " << fixed
+         << setprecision(1) << recovery.milliseconds << " ms" << defaultfloat << setprecision(6) << endl;
 
-        if (reader.ParseError() < 0) {
-            cerr << "Cannot load INI file: " << iniFilePath << endl;
-            return 1;
+    // **Connect once; the device keeps streaming across label changes**
+    ProWaveDAQ daq;
+    daq.initDevices(deviceIniPath.c_str());
+    cout << "ProWaveDAQ Sample Rate: " << daq.getSampleRate() << " Hz" << endl;
+    daq.startReading();
+
+    // **Every consumer subscribes to the fan-out; the recorder is the first one**
+    BlockFanout fanout(daq);
+    fanout.start();
+    AcquisitionSession session(daq, fanout, config);
+    session.start();
+
+    // **Keep the output directory within its disk budget, never touching the live session**
+    RetentionPolicy retentionPolicy = readRetentionPolicy(reader, config, daq.getSampleRate());
+    RetentionManager retention(retentionPolicy, [&session]() { return session.recordingFolder(); });
+    retention.start();
+    cout << "[Retention] budget " << retentionPolicy.budgetBytes / 1000000 << " MB (0 = unlimited), compact after "
+         << retentionPolicy.compactAfterHours << " h, features after " << retentionPolicy.featuresAfterHours << " h" << endl;
+
+    atomic<bool> quit(false);
+    // **Optional analyses of the live stream, each one more fan-out subscriber**
+    AnalysisStages stages;
+
+    // Envelope spectra ([Envelope])
+    if (reader.GetBoolean("Envelope", "enabled", false)) {
+        EnvelopeOptions envelopeOptions = readEnvelopeOptions(reader);
+        if (startStage(stages.envelope, reader, "Envelope", "path", envelopeOptions, fanout, daq,
+                       [](const EnvelopeSpectrum&) {})) {
+            cout << "[Envelope] " << envelopeOptions.bandLowHz << "-" << envelopeOptions.bandHighHz << " Hz, "
+                 << envelopeOptions.fftSize << "-point spectrum every " << envelopeOptions.cadenceSeconds << " s"
+                 << (stages.envelope.path.empty() ? "" : " -> " + stages.envelope.path) << endl;
         }
+    }
 
-        // Read the "SaveUnit" setting (time interval in seconds)
-        const string targetSection = "SaveUnit";
-        const string targetKey = "second";
-        int SaveUnit = reader.GetInteger(targetSection, targetKey, 60);
-        cout << "[" << targetSection << "] " << targetKey << " = " << SaveUnit << endl;
+    // Velocity (and displacement) rms per axis and window ([Velocity])
+    if (reader.GetBoolean("Velocity", "enabled", false)) {
+        VelocityOptions velocityOptions = readVelocityOptions(reader);
+        if (startStage(stages.velocity, reader, "Velocity", "path", velocityOptions, fanout, daq,
+                       [](const VelocityReading&) {})) {
+            cout << "[Velocity] " << velocityOptions.highPassHz << "-" << velocityOptions.lowPassHz << " Hz rms over "
+                 << velocityOptions.windowsSeconds.size() << " window(s)"
+                 << (velocityOptions.displacement ? ", with displacement" : "")
+                 << (stages.velocity.path.empty() ? "" : " -> " + stages.velocity.path) << endl;
+        }
+    }
 
-        daq.initDevices("API/ProWaveDAQ.ini");
+    // Anomaly events against a learnt baseline ([Anomaly]); optionally records while one is open
+    atomic<bool> anomalyOpen(false);
+    bool anomalyRecord = false;
+    double anomalyPostSeconds = 0;
+    if (reader.GetBoolean("Anomaly", "enabled", false)) {
+        AnomalyOptions anomalyOptions = readAnomalyOptions(reader);
+        if (startStage(stages.anomaly, reader, "Anomaly", "eventsPath", anomalyOptions, fanout, daq,
+                       [&anomalyOpen](const AnomalyEvent& event) {
+                           anomalyOpen = event.active;
+                           cout << "[Anomaly] " << (event.active ? "started" : "ended") << ", score " << event.score
+                                << ", furthest feature " << event.feature << endl;
+                       })) {
+            anomalyRecord = reader.GetBoolean("Anomaly", "record", false);
+            anomalyPostSeconds = max(0.0, reader.GetReal("Anomaly", "postSeconds", 10));
+            cout << "[Anomaly] " << anomalyOptions.windowSeconds << " s windows, baseline from "
+                 << anomalyOptions.trainingSeconds << " s, threshold " << anomalyOptions.threshold
+                 << (anomalyRecord ? ", records events" : "")
+                 << (stages.anomaly.path.empty() ? "" : " -> " + stages.anomaly.path) << endl;
+        }
+    }
 
-        int ProWaveDAQSampleRate = daq.getSampleRate();
-        cout << "ProWaveDAQ Sample Rate: " << ProWaveDAQSampleRate << " Hz" << endl;
+    ControlServer control([&](const string& command) {
+        return handleCommand(session, daq, stages, command, quit);
+    });
+    string controlSocket = reader.Get("Control", "socket", "");
+    if (!controlSocket.empty()) {
+        control.start(controlSocket);
+    }
 
-        // * 3 channels
-        int targetSize = SaveUnit * ProWaveDAQSampleRate * 3;
-        int prevCounter = 0;
+    // **Reload automatically when either INI file is saved ([Control] watchConfig)**
+    atomic<bool> reloadRequested(false);
+    ConfigWatcher watcher({masterIniPath, deviceIniPath}, [&]() { reloadRequested = true; });
+    if (reader.GetBoolean("Control", "watchConfig", false)) {
+        watcher.start();
+    }
 
-        daq.startReading();
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    signal(SIGUSR1, onSignal);
+    signal(SIGHUP, onSignal);
 
+    if (!headless) {
         system("clear"); // Clear terminal screen for better readability
         cout << "============================== Label Creation ============================" << endl;
-        string label;
-        cout << "Please enter the label of the data (type 'exit' to exit): ";
-        cin >> label;
-        string folder = getCurrentTime() + "_" + label;
+        string label = promptLabel();
         if (label == "exit") {
-            return 1;
+            quit = true;
+        } else {
+            session.startRecording(label);
         }
+        setNonBlockingMode();
 
-        fs::create_directory("output/ProWaveDAQ/" + folder);
+        cout << "============================== Data Acquisition ============================" << endl;
+        cout << "Press 'L' for a new label, 'N' for a new segment, 'S' for latency statistics," << endl
+             << "'T' to dump the trace, 'Q' to exit..." << endl;
+    } else if (!initialLabel.empty()) {
+        session.startRecording(initialLabel);
+    }
 
-        // **Initialize CSVWriter**
-        CSVWriter csvWriter(3, "output/ProWaveDAQ/" + folder, label);
+    auto acquisitionStart = chrono::steady_clock::now();
+    bool anomalyRecording = false;
+    uint64_t anomalyTicket = 0;          // Stops only the recording the trigger started
+    chrono::steady_clock::time_point anomalyStopAt;
+    char ch;
+    while (!quit && !quitSignal) {
+        // **Dump the trace once the capture window has elapsed**
+        if (Tracer::isEnabled() && !traceDumped &&
+            chrono::steady_clock::now() - acquisitionStart >= chrono::seconds(traceSeconds)) {
+            Tracer::instance().dumpChromeTrace(tracePath);
+            Tracer::instance().disable();
+            traceDumped = true;
+        }
 
-        char ch;
-        setNonBlockingMode();
-        bool isRunning = true;
-        int dataSize = 0;
+        if (segmentSignal) {
+            segmentSignal = 0;
+            session.newSegment();
+        }
 
-        cout << "============================== Data Acquisition ============================" << endl;
-        cout << "Press 'Q' to exit..." << endl;
-        while ( isRunning ) {
-            int currentCounter = daq.getCounter();
-
-            if (read(STDIN_FILENO, &ch, 1) > 0) {
-                if (ch == 'Q' || ch == 'q') {
-                    isRunning = false;
-                    cout << "Saving final data before exit..." << endl;
-                    resetTerminalMode(); // Restore terminal settings before exiting
-                    return 1;
+        // **[Anomaly] record: from the event start until postSeconds after it ends, unless already recording**
+        if (anomalyRecord) {
+            if (anomalyOpen) {
+                anomalyStopAt = chrono::steady_clock::time_point::max();
+                if (!anomalyRecording && session.recordingFolder().empty()) {
+                    anomalyTicket = session.startRecording("anomaly");
+                    anomalyRecording = true;
+                }
+            } else if (anomalyRecording) {
+                auto now = chrono::steady_clock::now();
+                if (anomalyStopAt == chrono::steady_clock::time_point::max()) {
+                    anomalyStopAt = now + chrono::duration_cast<chrono::steady_clock::duration>(
+                        chrono::duration<double>(anomalyPostSeconds));
+                } else if (now >= anomalyStopAt) {
+                    // A label set meanwhile takes over the recording
+                    session.stopRecording(anomalyTicket);
+                    anomalyRecording = false;
                 }
-                cout << "You pressed: " << ch << endl;
             }
+        }
 
-            // **Only process new data when the counter changes**
-            if (currentCounter > prevCounter) {
-                vector<double> data = daq.getData();
-                dataSize += data.size(); 
+        if (reloadSignal || reloadRequested) {
+            reloadSignal = 0;
+            reloadRequested = false;
+            reloadAndLog(session, daq);
+        }
 
-                if (dataSize < targetSize) {
-                    csvWriter.addDataBlock(move(data));
+        if (!headless && read(STDIN_FILENO, &ch, 1) > 0) {
+            if (ch == 'L' || ch == 'l') {
+                // **Acquisition keeps running while the new label is typed**
+                resetTerminalMode();
+                string label = promptLabel();
+                setNonBlockingMode();
+                if (label == "exit") {
+                    quit = true;
                 } else {
-                    int dataActualSize = data.size();  // **Prevent misuse of dataSize**
-                    int emptySpace = targetSize - (dataSize - dataActualSize);
-
-                    // **If dataSize > targetSize, split data into batches**
-                    while (dataSize >= targetSize) {
-                        vector<double> batch(data.begin(), data.begin() + emptySpace);
-                        csvWriter.addDataBlock(move(batch));
-
-                        // **Update filename after each full batch**
-                        csvWriter.updateFilename();
-                        cout << "CSV Saved & Filename Updated" << endl;
-
-                        dataSize -= targetSize;
-                    }
-
-                    int pending = dataActualSize - emptySpace;
-
-                    // **Handle remaining data that is less than targetSize**
-                    if ( pending ) {
-                        vector<double> remainingData(data.begin() + emptySpace, data.end());
-                        csvWriter.addDataBlock(move(remainingData));
-                        dataSize = pending;
-                    } else {
-                        dataSize = 0;
-                    }
+                    session.startRecording(label);
                 }
-                prevCounter += 1;
+            } else if (ch == 'N' || ch == 'n') {
+                session.newSegment();
+            } else if (ch == 'S' || ch == 's') {
+                cout << session.status() << endl;
+                cout << Metrics::instance().latencyReport();
+            } else if (ch == 'T' || ch == 't') {
+                if (Tracer::isEnabled()) {
+                    Tracer::instance().dumpChromeTrace(tracePath);
+                } else {
+                    cout << "Tracing is not enabled ([Trace] seconds)" << endl;
+                }
+            } else if (ch == 'Q' || ch == 'q') {
+                quit = true;
+            } else {
+                cout << "You pressed: " << ch << endl;
             }
         }
 
-        resetTerminalMode();
-        daq.stopReading();
+        usleep(10000);
     }
 
+    if (!headless) {
+        resetTerminalMode(); // Restore terminal settings before exiting
+    }
+    cout << "Saving final data before exit..." << endl;
+    watcher.stop();
+    control.stop();
+    retention.stop();
+    stages.stop(fanout);
+    session.stop();
+    fanout.stop();
     daq.stopReading();
+    cout << Metrics::instance().latencyReport();
     return 0;
 }